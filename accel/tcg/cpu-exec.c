@@ -620,6 +620,35 @@ void cpu_exec_step_atomic(CPUState *cpu)
     end_exclusive();
 }
 
+#ifdef CONFIG_USER_ONLY
+bool tb_pretranslate(CPUState *cpu, vaddr pc, uint64_t cs_base,
+                     uint32_t flags, uint32_t cflags)
+{
+    if (sigsetjmp(cpu->jmp_env, 0) != 0) {
+        /* The guest would have faulted; forget about this TB. */
+        cpu_exec_longjmp_cleanup(cpu);
+        cpu->exception_index = -1;
+        return true;
+    }
+
+    mmap_lock();
+    /*
+     * Leave the rest of the buffer to the running cpus: a flush from
+     * here could not be processed, and would discard their work too.
+     */
+    if (tcg_code_size() > tcg_code_capacity() / 2) {
+        mmap_unlock();
+        return false;
+    }
+    if ((page_get_flags(pc) & PAGE_EXEC) &&
+        !tb_htable_lookup(cpu, pc, cs_base, flags, cflags)) {
+        tb_gen_code(cpu, pc, cs_base, flags, cflags);
+    }
+    mmap_unlock();
+    return true;
+}
+#endif
+
 void tb_set_jmp_target(TranslationBlock *tb, int n, uintptr_t addr)
 {
     /*
@@ -177,6 +177,41 @@ static void gen_udata_cond_cb(struct qemu_plugin_conditional_cb *cb)
     tcg_temp_free_ptr(ptr);
 }
 
+/*
+ * Decrement the per-vCPU countdown and branch to @skip unless it
+ * underflowed, in which case it is reloaded with period - 1. A zeroed
+ * countdown therefore fires on the first event and every @period events
+ * after that.
+ */
+static void gen_sample_countdown(qemu_plugin_u64 entry, uint64_t period,
+                                 TCGLabel *skip)
+{
+    TCGv_ptr ptr = gen_plugin_u64_ptr(entry);
+    TCGv_i64 val = tcg_temp_ebb_new_i64();
+
+    tcg_gen_ld_i64(val, ptr, 0);
+    tcg_gen_subi_i64(val, val, 1);
+    tcg_gen_st_i64(val, ptr, 0);
+    tcg_gen_brcondi_i64(TCG_COND_GE, val, 0, skip);
+    tcg_gen_st_i64(tcg_constant_i64(period - 1), ptr, 0);
+
+    tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(ptr);
+}
+
+static void gen_udata_sampled_cb(struct qemu_plugin_sampled_cb *cb)
+{
+    TCGLabel *after_cb = gen_new_label();
+
+    gen_sample_countdown(cb->entry, cb->period, after_cb);
+    TCGv_i32 cpu_index = gen_cpu_index();
+    tcg_gen_call2(cb->f.vcpu_udata, cb->info, NULL,
+                  tcgv_i32_temp(cpu_index),
+                  tcgv_ptr_temp(tcg_constant_ptr(cb->userp)));
+    tcg_temp_free_i32(cpu_index);
+    gen_set_label(after_cb);
+}
+
 static void gen_inline_add_u64_cb(struct qemu_plugin_inline_cb *cb)
 {
     TCGv_ptr ptr = gen_plugin_u64_ptr(cb->entry);
@@ -212,6 +247,77 @@ static void gen_mem_cb(struct qemu_plugin_regular_cb *cb,
     tcg_temp_free_i32(cpu_index);
 }
 
+static void gen_mem_sampled_cb(struct qemu_plugin_sampled_cb *cb,
+                               qemu_plugin_meminfo_t meminfo, TCGv_i64 addr)
+{
+    TCGLabel *after_cb = gen_new_label();
+
+    gen_sample_countdown(cb->entry, cb->period, after_cb);
+    TCGv_i32 cpu_index = gen_cpu_index();
+    tcg_gen_call4(cb->f.vcpu_mem, cb->info, NULL,
+                  tcgv_i32_temp(cpu_index),
+                  tcgv_i32_temp(tcg_constant_i32(meminfo)),
+                  tcgv_i64_temp(addr),
+                  tcgv_ptr_temp(tcg_constant_ptr(cb->userp)));
+    tcg_temp_free_i32(cpu_index);
+    gen_set_label(after_cb);
+}
+
+/*
+ * Append a record for this access to the vCPU's entry of the buffer and only
+ * call out of generated code once the buffer is full:
+ *
+ *   e = &buffer[cpu_index];
+ *   e->records[e->n] = { addr, userdata, meminfo };
+ *   if (++e->n == capacity) {
+ *       plugin_mem_buffer_flush(cpu_index, buffer);
+ *   }
+ */
+static void gen_mem_buffer_cb(struct qemu_plugin_mem_buffer_cb *cb,
+                              qemu_plugin_meminfo_t meminfo, TCGv_i64 addr)
+{
+    struct qemu_plugin_mem_buffer *buf = cb->buf;
+    qemu_plugin_u64 count = { .score = buf->score,
+                              .offset = offsetof(struct
+                                                 qemu_plugin_mem_buffer_entry,
+                                                 n) };
+    TCGv_ptr entry = gen_plugin_u64_ptr(count);
+    TCGv_ptr rec = tcg_temp_ebb_new_ptr();
+    TCGv_i64 n = tcg_temp_ebb_new_i64();
+    TCGv_i64 off = tcg_temp_ebb_new_i64();
+    TCGLabel *not_full = gen_new_label();
+    intptr_t rec_base = offsetof(struct qemu_plugin_mem_buffer_entry, records);
+
+    tcg_gen_ld_i64(n, entry, 0);
+    tcg_gen_muli_i64(off, n, sizeof(struct qemu_plugin_mem_record));
+    tcg_gen_trunc_i64_ptr(rec, off);
+    tcg_gen_add_ptr(rec, rec, entry);
+
+    tcg_gen_st_i64(addr, rec,
+                   rec_base + offsetof(struct qemu_plugin_mem_record, vaddr));
+    tcg_gen_st_i64(tcg_constant_i64(cb->userdata), rec,
+                   rec_base + offsetof(struct qemu_plugin_mem_record,
+                                       userdata));
+    tcg_gen_st_i32(tcg_constant_i32(meminfo), rec,
+                   rec_base + offsetof(struct qemu_plugin_mem_record, info));
+
+    tcg_gen_addi_i64(n, n, 1);
+    tcg_gen_st_i64(n, entry, 0);
+    tcg_gen_brcondi_i64(TCG_COND_LTU, n, buf->capacity, not_full);
+
+    TCGv_i32 cpu_index = gen_cpu_index();
+    tcg_gen_call2(plugin_mem_buffer_flush, cb->info, NULL,
+                  tcgv_i32_temp(cpu_index),
+                  tcgv_ptr_temp(tcg_constant_ptr(buf)));
+    tcg_temp_free_i32(cpu_index);
+    gen_set_label(not_full);
+
+    tcg_temp_free_i64(off);
+    tcg_temp_free_i64(n);
+    tcg_temp_free_ptr(rec);
+    tcg_temp_free_ptr(entry);
+}
+
 static void inject_cb(struct qemu_plugin_dyn_cb *cb)
 
 {
@@ -222,6 +328,9 @@ static void inject_cb(struct qemu_plugin_dyn_cb *cb)
     case PLUGIN_CB_COND:
         gen_udata_cond_cb(&cb->cond);
         break;
+    case PLUGIN_CB_SAMPLED:
+        gen_udata_sampled_cb(&cb->sampled);
+        break;
     case PLUGIN_CB_INLINE_ADD_U64:
         gen_inline_add_u64_cb(&cb->inline_insn);
         break;
@@ -249,6 +358,16 @@ static void inject_mem_cb(struct qemu_plugin_dyn_cb *cb,
             inject_cb(cb);
         }
         break;
+    case PLUGIN_CB_MEM_SAMPLED:
+        if (rw & cb->sampled.rw) {
+            gen_mem_sampled_cb(&cb->sampled, meminfo, addr);
+        }
+        break;
+    case PLUGIN_CB_MEM_BUFFER:
+        if (rw & cb->mem_buffer.rw) {
+            gen_mem_buffer_cb(&cb->mem_buffer, meminfo, addr);
+        }
+        break;
     default:
         g_assert_not_reached();
         break;
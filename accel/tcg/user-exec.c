@@ -23,6 +23,7 @@
 #include "tcg/tcg.h"
 #include "qemu/bitops.h"
 #include "qemu/rcu.h"
+#include "qemu/seqlock.h"
 #include "exec/cpu_ldst.h"
 #include "qemu/main-loop.h"
 #include "exec/translate-all.h"
@@ -154,6 +155,15 @@ typedef struct PageFlagsNode {
 
 static IntervalTreeRoot pageflags_root;
 
+/*
+ * All modifications of pageflags_root happen with mmap_lock held, and are
+ * bracketed by pageflags_seq.  Nodes are freed with RCU, so that readers
+ * may walk the tree without mmap_lock: a lookup which raced with a writer
+ * is simply repeated, which avoids the false negatives of a bare lockless
+ * interval tree lookup.
+ */
+static QemuSeqLock pageflags_seq;
+
 static PageFlagsNode *pageflags_find(target_ulong start, target_ulong last)
 {
     IntervalTreeNode *n;
@@ -217,24 +227,28 @@ void page_dump(FILE *f)
 
 int page_get_flags(target_ulong address)
 {
-    PageFlagsNode *p = pageflags_find(address, address);
+    PageFlagsNode *p;
+    unsigned seq;
+    int flags;
+
+    if (have_mmap_lock()) {
+        p = pageflags_find(address, address);
+        return p ? p->flags : 0;
+    }
 
     /*
      * See util/interval-tree.c re lockless lookups: no false positives but
-     * there are false negatives.  If we find nothing, retry with the mmap
-     * lock acquired.
+     * there are false negatives while the tree is being modified.  The
+     * sequence count tells us when that may have happened.
      */
-    if (p) {
-        return p->flags;
-    }
-    if (have_mmap_lock()) {
-        return 0;
-    }
+    RCU_READ_LOCK_GUARD();
+    do {
+        seq = seqlock_read_begin(&pageflags_seq);
+        p = pageflags_find(address, address);
+        flags = p ? qatomic_read(&p->flags) : 0;
+    } while (seqlock_read_retry(&pageflags_seq, seq));
 
-    mmap_lock();
-    p = pageflags_find(address, address);
-    mmap_unlock();
-    return p ? p->flags : 0;
+    return flags;
 }
 
 /* A subroutine of page_set_flags: insert a new node for [start,last]. */
@@ -519,17 +533,76 @@ void page_set_flags(target_ulong start, target_ulong last, int flags)
 
     if (!flags || reset) {
         page_reset_target_data(start, last);
+    }
+
+    seqlock_write_begin(&pageflags_seq);
+    if (!flags || reset) {
         inval_tb |= pageflags_unset(start, last);
     }
     if (flags) {
         inval_tb |= pageflags_set_clear(start, last, flags,
                                         ~(reset ? 0 : PAGE_STICKY));
     }
+    seqlock_write_end(&pageflags_seq);
+
     if (inval_tb) {
         tb_invalidate_phys_range(start, last);
     }
 }
 
+/*
+ * A subroutine of page_check_range: check [start,last] without taking
+ * mmap_lock.  Return 1 if the range is accessible, 0 if it is not, and
+ * -1 if some page must first be unprotected, which needs the lock.
+ */
+static int pageflags_check_range_lockless(target_ulong start,
+                                          target_ulong last, int flags)
+{
+    target_ulong addr;
+    unsigned seq;
+    int ret;
+
+    RCU_READ_LOCK_GUARD();
+    do {
+        seq = seqlock_read_begin(&pageflags_seq);
+        addr = start;
+        while (true) {
+            PageFlagsNode *p = pageflags_find(addr, last);
+            target_ulong p_start, p_last;
+            int missing;
+
+            if (!p) {
+                ret = 0;
+                break;
+            }
+            p_start = qatomic_read(&p->itree.start);
+            p_last = qatomic_read(&p->itree.last);
+            if (addr < p_start || p_last < addr) {
+                /* Gap in the range, or a node caught mid-update. */
+                ret = 0;
+                break;
+            }
+
+            missing = flags & ~qatomic_read(&p->flags);
+            if (missing & ~PAGE_WRITE) {
+                ret = 0;
+                break;
+            }
+            if (missing & PAGE_WRITE) {
+                ret = -1;
+                break;
+            }
+            if (last <= p_last) {
+                ret = 1;
+                break;
+            }
+            addr = p_last + 1;
+        }
+    } while (seqlock_read_retry(&pageflags_seq, seq));
+
+    return ret;
+}
+
 bool page_check_range(target_ulong start, target_ulong len, int flags)
 {
     target_ulong last;
@@ -546,24 +619,27 @@ bool page_check_range(target_ulong start, target_ulong len, int flags)
     }
 
     locked = have_mmap_lock();
+    if (!locked) {
+        /*
+         * The common case, e.g. validating syscall buffers, needs no
+         * lock at all.  Only write-protected pages holding translated
+         * code go through the locked slow path below.
+         */
+        int r = pageflags_check_range_lockless(start, last, flags);
+        if (r >= 0) {
+            return r;
+        }
+        mmap_lock();
+        locked = -1;
+    }
+
     while (true) {
         PageFlagsNode *p = pageflags_find(start, last);
         int missing;
 
         if (!p) {
-            if (!locked) {
-                /*
-                 * Lockless lookups have false negatives.
-                 * Retry with the lock held.
-                 */
-                mmap_lock();
-                locked = -1;
-                p = pageflags_find(start, last);
-            }
-            if (!p) {
-                ret = false; /* entire region invalid */
-                break;
-            }
+            ret = false; /* entire region invalid */
+            break;
         }
         if (start < p->itree.start) {
             ret = false; /* initial bytes invalid */
@@ -688,7 +764,9 @@ void page_protect(tb_page_addr_t address)
     }
 
     if (prot & PAGE_WRITE) {
+        seqlock_write_begin(&pageflags_seq);
         pageflags_set_clear(start, last, 0, PAGE_WRITE);
+        seqlock_write_end(&pageflags_seq);
         mprotect(g2h_untagged(start), last - start + 1,
                  prot & (PAGE_READ | PAGE_EXEC) ? PROT_READ : PROT_NONE);
     }
@@ -743,7 +821,9 @@ int page_unprotect(target_ulong address, uintptr_t pc)
             start = address & TARGET_PAGE_MASK;
             len = TARGET_PAGE_SIZE;
             prot = p->flags | PAGE_WRITE;
+            seqlock_write_begin(&pageflags_seq);
             pageflags_set_clear(start, start + len - 1, PAGE_WRITE, 0);
+            seqlock_write_end(&pageflags_seq);
             current_tb_invalidated = tb_invalidate_phys_page_unwind(start, pc);
         } else {
             start = address & -host_page_size;
@@ -758,8 +838,10 @@ int page_unprotect(target_ulong address, uintptr_t pc)
                     prot |= p->flags;
                     if (p->flags & PAGE_WRITE_ORG) {
                         prot |= PAGE_WRITE;
+                        seqlock_write_begin(&pageflags_seq);
                         pageflags_set_clear(addr, addr + TARGET_PAGE_SIZE - 1,
                                             PAGE_WRITE, 0);
+                        seqlock_write_end(&pageflags_seq);
                     }
                 }
                 /*
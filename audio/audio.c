@@ -36,6 +36,7 @@
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
 #include "qemu/help_option.h"
 #include "sysemu/sysemu.h"
@@ -856,6 +857,22 @@ static void audio_timer (void *opaque)
     audio_reset_timer(s);
 }
 
+static void audio_poll_bh(void *opaque)
+{
+    AudioState *s = opaque;
+
+    audio_run(s, "poll");
+}
+
+/*
+ * Backends that call back from their own thread use this instead of
+ * audio_run() to implement poll mode.  It is safe to call from any thread.
+ */
+void audio_poll_kick(AudioState *s)
+{
+    qemu_bh_schedule(s->poll_bh);
+}
+
 /*
  * Public API
  */
@@ -1656,6 +1673,11 @@ static void free_audio_state(AudioState *s)
         s->ts = NULL;
     }
 
+    if (s->poll_bh) {
+        qemu_bh_delete(s->poll_bh);
+        s->poll_bh = NULL;
+    }
+
     g_free(s);
 }
 
@@ -1735,6 +1757,7 @@ static AudioState *audio_init(Audiodev *dev, Error **errp)
     }
 
     s->ts = timer_new_ns(QEMU_CLOCK_VIRTUAL, audio_timer, s);
+    s->poll_bh = qemu_bh_new(audio_poll_bh, s);
 
     if (dev) {
         /* -audiodev option */
@@ -222,6 +222,7 @@ typedef struct AudioState {
     void *drv_opaque;
 
     QEMUTimer *ts;
+    QEMUBH *poll_bh;
     QLIST_HEAD (card_listhead, QEMUSoundCard) card_head;
     QLIST_HEAD (hw_in_listhead, HWVoiceIn) hw_head_in;
     QLIST_HEAD (hw_out_listhead, HWVoiceOut) hw_head_out;
@@ -249,6 +250,7 @@ void audio_pcm_info_clear_buf (struct audio_pcm_info *info, void *buf, int len);
 int audio_bug (const char *funcname, int cond);
 
 void audio_run(AudioState *s, const char *msg);
+void audio_poll_kick(AudioState *s);
 
 const char *audio_application_name(void);
 
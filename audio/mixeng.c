@@ -30,6 +30,11 @@
 #define AUDIO_CAP "mixeng"
 #include "audio_int.h"
 
+#if defined(CONFIG_AVX2_OPT) && !defined(FLOAT_MIXENG)
+#include <immintrin.h>
+#include "host/cpuinfo.h"
+#endif
+
 /* 8 bit */
 #define ENDIAN_CONVERSION natural
 #define ENDIAN_CONVERT(v) (v)
@@ -267,6 +272,176 @@ f_sample *mixeng_clip[2][2][2][3] = {
     }
 };
 
+static void mixeng_mix_int(struct st_sample *dst, const struct st_sample *src,
+                           size_t samples)
+{
+    size_t i;
+
+    for (i = 0; i < samples; i++) {
+        dst[i].l += src[i].l;
+        dst[i].r += src[i].r;
+    }
+}
+
+/*
+ * Vectorized versions of the most common conversions, i.e. those of
+ * native endian signed 16-bit samples, and of mixing.  They produce
+ * exactly the same results as the generic code.
+ */
+#if defined(CONFIG_AVX2_OPT) && !defined(FLOAT_MIXENG)
+static void __attribute__((target("avx2")))
+conv_natural_int16_t_to_stereo_avx2(struct st_sample *dst, const void *src,
+                                    int samples)
+{
+    const int16_t *in = src;
+    int i;
+
+    /* Four frames, i.e. eight samples, per iteration */
+    for (i = 0; i + 4 <= samples; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + i * 2));
+        __m256i lo = _mm256_cvtepi16_epi64(v);
+        __m256i hi = _mm256_cvtepi16_epi64(_mm_srli_si128(v, 8));
+
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_slli_epi64(lo, 16));
+        _mm256_storeu_si256((__m256i *)(dst + i + 2),
+                            _mm256_slli_epi64(hi, 16));
+    }
+    conv_natural_int16_t_to_stereo(dst + i, in + i * 2, samples - i);
+}
+
+static void __attribute__((target("avx2")))
+conv_natural_int16_t_to_mono_avx2(struct st_sample *dst, const void *src,
+                                  int samples)
+{
+    const int16_t *in = src;
+    int i;
+
+    for (i = 0; i + 4 <= samples; i += 4) {
+        __m128i v = _mm_loadl_epi64((const __m128i *)(in + i));
+        __m256i w = _mm256_slli_epi64(_mm256_cvtepi16_epi64(v), 16);
+
+        /* Duplicate each sample into both channels */
+        _mm256_storeu_si256((__m256i *)(dst + i),
+                            _mm256_permute4x64_epi64(w, 0x50));
+        _mm256_storeu_si256((__m256i *)(dst + i + 2),
+                            _mm256_permute4x64_epi64(w, 0xfa));
+    }
+    conv_natural_int16_t_to_mono(dst + i, in + i, samples - i);
+}
+
+/* Saturate four samples to 32 bits and scale them to 16 bits */
+static inline __m128i __attribute__((target("avx2")))
+clip_int16_avx2(__m256i v)
+{
+    const __m256i max = _mm256_set1_epi64x(INT32_MAX);
+    const __m256i min = _mm256_set1_epi64x(INT32_MIN);
+    const __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+    v = _mm256_blendv_epi8(v, max, _mm256_cmpgt_epi64(v, max));
+    v = _mm256_blendv_epi8(v, min, _mm256_cmpgt_epi64(min, v));
+    v = _mm256_permutevar8x32_epi32(v, low_halves);
+    return _mm_srai_epi32(_mm256_castsi256_si128(v), 16);
+}
+
+static void __attribute__((target("avx2")))
+clip_natural_int16_t_from_stereo_avx2(void *dst, const struct st_sample *src,
+                                      int samples)
+{
+    int16_t *out = dst;
+    int i;
+
+    for (i = 0; i + 4 <= samples; i += 4) {
+        __m128i a = clip_int16_avx2(
+            _mm256_loadu_si256((const __m256i *)(src + i)));
+        __m128i b = clip_int16_avx2(
+            _mm256_loadu_si256((const __m256i *)(src + i + 2)));
+
+        _mm_storeu_si128((__m128i *)(out + i * 2), _mm_packs_epi32(a, b));
+    }
+    clip_natural_int16_t_from_stereo(out + i * 2, src + i, samples - i);
+}
+
+static void __attribute__((target("avx2")))
+mixeng_mix_avx2(struct st_sample *dst, const struct st_sample *src,
+                size_t samples)
+{
+    size_t i;
+
+    for (i = 0; i + 2 <= samples; i += 2) {
+        __m256i *d = (__m256i *)(dst + i);
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+
+        _mm256_storeu_si256(d, _mm256_add_epi64(_mm256_loadu_si256(d), v));
+    }
+    mixeng_mix_int(dst + i, src + i, samples - i);
+}
+#endif
+
+typedef struct MixengAccel {
+    t_sample *conv_s16_mono;
+    t_sample *conv_s16_stereo;
+    f_sample *clip_s16_stereo;
+    void (*mix)(struct st_sample *dst, const struct st_sample *src,
+                size_t samples);
+} MixengAccel;
+
+static const MixengAccel mixeng_accel_table[] = {
+    {
+        conv_natural_int16_t_to_mono,
+        conv_natural_int16_t_to_stereo,
+        clip_natural_int16_t_from_stereo,
+        mixeng_mix_int,
+    },
+#if defined(CONFIG_AVX2_OPT) && !defined(FLOAT_MIXENG)
+    {
+        conv_natural_int16_t_to_mono_avx2,
+        conv_natural_int16_t_to_stereo_avx2,
+        clip_natural_int16_t_from_stereo_avx2,
+        mixeng_mix_avx2,
+    },
+#endif
+};
+
+static unsigned mixeng_accel_index;
+static void (*mixeng_mix)(struct st_sample *dst, const struct st_sample *src,
+                          size_t samples) = mixeng_mix_int;
+
+static void mixeng_set_accel(unsigned index)
+{
+    const MixengAccel *accel = &mixeng_accel_table[index];
+
+    /* indices: [stereo][signed][swap endianness][8, 16 or 32-bits] */
+    mixeng_conv[0][1][0][1] = accel->conv_s16_mono;
+    mixeng_conv[1][1][0][1] = accel->conv_s16_stereo;
+    mixeng_clip[1][1][0][1] = accel->clip_s16_stereo;
+    mixeng_mix = accel->mix;
+    mixeng_accel_index = index;
+}
+
+static unsigned mixeng_best_accel(void)
+{
+#if defined(CONFIG_AVX2_OPT) && !defined(FLOAT_MIXENG)
+    if (cpuinfo_init() & CPUINFO_AVX2) {
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+static void __attribute__((constructor)) mixeng_init_accel(void)
+{
+    mixeng_set_accel(mixeng_best_accel());
+}
+
+bool test_mixeng_next_accel(void)
+{
+    if (mixeng_accel_index == 0) {
+        return false;
+    }
+    mixeng_set_accel(mixeng_accel_index - 1);
+    return true;
+}
+
 #ifdef FLOAT_MIXENG
 #define CONV_NATURAL_FLOAT(x) (x)
 #define CLIP_NATURAL_FLOAT(x) (x)
@@ -429,10 +604,12 @@ void *st_rate_start (int inrate, int outrate)
 
 #define NAME st_rate_flow_mix
 #define OP(a, b) a += b
+#define OP_BLOCK(dst, src, n) mixeng_mix(dst, src, n)
 #include "rate_template.h"
 
 #define NAME st_rate_flow
 #define OP(a, b) a = b
+#define OP_BLOCK(dst, src, n) memcpy(dst, src, (n) * sizeof(struct st_sample))
 #include "rate_template.h"
 
 void st_rate_stop (void *opaque)
@@ -532,6 +709,15 @@ void mixeng_volume (struct st_sample *buf, int len, struct mixeng_volume *vol)
         return;
     }
 
+    /* Unity gain is the common case, e.g. if the guest never set a volume */
+#ifdef FLOAT_MIXENG
+    if (vol->l == 1.0 && vol->r == 1.0) {
+#else
+    if (vol->l == 1LL << 32 && vol->r == 1LL << 32) {
+#endif
+        return;
+    }
+
     while (len--) {
 #ifdef FLOAT_MIXENG
         buf->l = buf->l * vol->l;
@@ -57,4 +57,7 @@ uint32_t st_rate_frames_in(void *opaque, uint32_t frames_out);
 void mixeng_clear (struct st_sample *buf, int len);
 void mixeng_volume (struct st_sample *buf, int len, struct mixeng_volume *vol);
 
+/* For the benchmark: fall back to the next slower conversion routines */
+bool test_mixeng_next_accel(void);
+
 #endif /* QEMU_MIXENG_H */
@@ -410,6 +410,18 @@ static void stream_state_cb (pa_stream *s, void * userdata)
     }
 }
 
+/*
+ * With try-poll, mix as soon as PulseAudio wants or has data.  The request
+ * callback is edge-triggered: after an underrun, or when the guest stops
+ * and restarts the stream, it may not come again until QEMU writes.  So
+ * this only runs the audio core early, and the voice does not set
+ * poll_mode, which would stop the timer that keeps the stream going.
+ */
+static void stream_request_cb(pa_stream *s, size_t length, void *userdata)
+{
+    audio_poll_kick(userdata);
+}
+
 static pa_stream *qpa_simple_new (
         PAConnection *c,
         const char *name,
@@ -417,6 +429,7 @@ static pa_stream *qpa_simple_new (
         const char *dev,
         const pa_sample_spec *ss,
         const pa_buffer_attr *attr,
+        AudioState *poll,
         int *rerror)
 {
     int r;
@@ -475,6 +488,13 @@ static pa_stream *qpa_simple_new (
     }
 
     pa_stream_set_state_callback(stream, stream_state_cb, c);
+    if (poll) {
+        if (dir == PA_STREAM_PLAYBACK) {
+            pa_stream_set_write_callback(stream, stream_request_cb, poll);
+        } else {
+            pa_stream_set_read_callback(stream, stream_request_cb, poll);
+        }
+    }
 
     flags = PA_STREAM_EARLY_REQUESTS;
 
@@ -541,6 +561,7 @@ static int qpa_init_out(HWVoiceOut *hw, struct audsettings *as,
         ppdo->name,
         &ss,
         &ba,                    /* buffering attributes */
+        ppdo->try_poll ? hw->s : NULL,
         &error
         );
     if (!pa->stream) {
@@ -590,6 +611,7 @@ static int qpa_init_in(HWVoiceIn *hw, struct audsettings *as, void *drv_opaque)
         ppdo->name,
         &ss,
         &ba,                    /* buffering attributes */
+        ppdo->try_poll ? hw->s : NULL,
         &error
         );
     if (!pa->stream) {
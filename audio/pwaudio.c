@@ -54,6 +54,9 @@ typedef struct PWVoice {
 
     pwvolume volume;
     bool muted;
+
+    /* In poll mode, the process callback wakes up the audio core */
+    AudioState *poll;
 } PWVoice;
 
 typedef struct PWVoiceOut {
@@ -139,6 +142,11 @@ playback_on_process(void *data)
 
     /* queue the buffer for playback */
     pw_stream_queue_buffer(v->stream, b);
+
+    /* refill the ring buffer right away */
+    if (v->poll) {
+        audio_poll_kick(v->poll);
+    }
 }
 
 /* output data processing function to generate stuffs in the buffer */
@@ -190,6 +198,10 @@ capture_on_process(void *data)
 
     /* queue the buffer for playback */
     pw_stream_queue_buffer(v->stream, b);
+
+    if (v->poll) {
+        audio_poll_kick(v->poll);
+    }
 }
 
 static void
@@ -558,6 +570,9 @@ qpw_init_out(HWVoiceOut *hw, struct audsettings *as, void *drv_opaque)
                             (ppdo->has_latency ? ppdo->latency : 46440)
                             * (uint64_t)v->info.rate / 1000000 * v->frame_size);
 
+    hw->poll_mode = ppdo->try_poll;
+    v->poll = hw->poll_mode ? hw->s : NULL;
+
     pw_thread_loop_unlock(c->thread_loop);
     return 0;
 }
@@ -599,6 +614,9 @@ qpw_init_in(HWVoiceIn *hw, struct audsettings *as, void *drv_opaque)
     hw->samples = audio_buffer_frames(
         qapi_AudiodevPipewirePerDirectionOptions_base(ppdo), &obt_as, 46440);
 
+    hw->poll_mode = ppdo->try_poll;
+    v->poll = hw->poll_mode ? hw->s : NULL;
+
     pw_thread_loop_unlock(c->thread_loop);
     return 0;
 }
@@ -68,9 +68,16 @@ void block_acct_setup(BlockAcctStats *stats, enum OnOffAuto account_invalid,
 void block_acct_cleanup(BlockAcctStats *stats)
 {
     BlockAcctTimedStats *s, *next;
+    unsigned q, i;
+
     QSLIST_FOREACH_SAFE(s, &stats->intervals, entries, next) {
         g_free(s);
     }
+    for (q = 0; q < BLOCK_ACCT_MAX_QUEUES; q++) {
+        for (i = 0; i < BLOCK_MAX_IOTYPE; i++) {
+            hdr_histogram_destroy(&stats->latency_hdr[q][i]);
+        }
+    }
     qemu_mutex_destroy(&stats->lock);
 }
 
@@ -102,14 +109,25 @@ BlockAcctTimedStats *block_acct_interval_next(BlockAcctStats *stats,
     }
 }
 
-void block_acct_start(BlockAcctStats *stats, BlockAcctCookie *cookie,
-                      int64_t bytes, enum BlockAcctType type)
+/* Like block_acct_start(), for devices with multiple queues. The latency
+ * of the request is also recorded in the histograms of @queue.
+ */
+void block_acct_start_queue(BlockAcctStats *stats, BlockAcctCookie *cookie,
+                            int64_t bytes, enum BlockAcctType type,
+                            unsigned queue)
 {
     assert(type < BLOCK_MAX_IOTYPE);
 
     cookie->bytes = bytes;
     cookie->start_time_ns = qemu_clock_get_ns(clock_type);
     cookie->type = type;
+    cookie->queue = queue % BLOCK_ACCT_MAX_QUEUES;
+}
+
+void block_acct_start(BlockAcctStats *stats, BlockAcctCookie *cookie,
+                      int64_t bytes, enum BlockAcctType type)
+{
+    block_acct_start_queue(stats, cookie, bytes, type, 0);
 }
 
 /* block_latency_histogram_compare_func:
@@ -188,6 +206,42 @@ int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
     return 0;
 }
 
+/* Add the latencies of the completed requests of type @type to @snap.
+ * If @queue is not negative, only the requests that were submitted on
+ * that queue are included; if @ctx is not NULL, only those that completed
+ * in that AioContext.
+ */
+void block_acct_latency_snapshot(BlockAcctStats *stats,
+                                 enum BlockAcctType type, int queue,
+                                 AioContext *ctx, HdrHistogramSnapshot *snap)
+{
+    int q;
+
+    assert(type < BLOCK_MAX_IOTYPE);
+    assert(queue < BLOCK_ACCT_MAX_QUEUES);
+
+    for (q = 0; q < BLOCK_ACCT_MAX_QUEUES; q++) {
+        if (queue < 0 || q == queue) {
+            hdr_histogram_add_to_snapshot(&stats->latency_hdr[q][type], ctx,
+                                          snap);
+        }
+    }
+}
+
+/* The latencies recorded in @ctx stay in the totals, but no longer match
+ * @ctx in block_acct_latency_snapshot().  Call this before @ctx is freed.
+ */
+void block_acct_forget_aio_context(BlockAcctStats *stats, AioContext *ctx)
+{
+    int q, i;
+
+    for (q = 0; q < BLOCK_ACCT_MAX_QUEUES; q++) {
+        for (i = 0; i < BLOCK_MAX_IOTYPE; i++) {
+            hdr_histogram_forget_tag(&stats->latency_hdr[q][i], ctx);
+        }
+    }
+}
+
 void block_latency_histograms_clear(BlockAcctStats *stats)
 {
     int i;
@@ -238,6 +292,13 @@ static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
         }
     }
 
+    /* Per thread, so this does not need the lock */
+    if (!failed || stats->account_failed) {
+        hdr_histogram_record(&stats->latency_hdr[cookie->queue][cookie->type],
+                             MAX(latency_ns, 0),
+                             qemu_get_current_aio_context());
+    }
+
     cookie->type = BLOCK_ACCT_NONE;
 }
 
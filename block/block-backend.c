@@ -560,6 +560,21 @@ BlockBackend *blk_all_next(BlockBackend *blk)
                : QTAILQ_FIRST(&block_backends);
 }
 
+/*
+ * Called when @ctx is going away, so that an AioContext allocated later
+ * at the same address does not inherit its latency statistics.
+ */
+void blk_forget_aio_context_stats(AioContext *ctx)
+{
+    BlockBackend *blk = NULL;
+
+    GLOBAL_STATE_CODE();
+
+    while ((blk = blk_all_next(blk)) != NULL) {
+        block_acct_forget_aio_context(&blk->stats, ctx);
+    }
+}
+
 void blk_remove_all_bs(void)
 {
     BlockBackend *blk = NULL;
@@ -20,8 +20,10 @@
 
 #include "qemu/osdep.h"
 
+#include "block/aio_task.h"
 #include "block/block_int.h"
 #include "block/qdict.h"
+#include "block/thread-pool.h"
 #include "sysemu/block-backend.h"
 #include "crypto/block.h"
 #include "qapi/opts-visitor.h"
@@ -32,14 +34,28 @@
 #include "qemu/option.h"
 #include "qemu/cutils.h"
 #include "qemu/memalign.h"
+#include "qemu/units.h"
 #include "crypto.h"
 
+/*
+ * 1 MB bounce buffer gives good performance / memory tradeoff
+ * when using cache=none|directsync.
+ */
+#define BLOCK_CRYPTO_MAX_IO_SIZE (1024 * 1024)
+
+/* Number of bounce buffers kept around for the next requests */
+#define BLOCK_CRYPTO_MAX_FREE_BOUNCE 8
+
 typedef struct BlockCrypto BlockCrypto;
 
 struct BlockCrypto {
     QCryptoBlock *block;
     bool updating_keys;
     BdrvChild *header;  /* Reference to the detached LUKS header */
+
+    QemuMutex bounce_lock;
+    void *free_bounce[BLOCK_CRYPTO_MAX_FREE_BOUNCE];
+    unsigned int n_free_bounce;
 };
 
 
@@ -371,6 +387,7 @@ static int block_crypto_open_generic(QCryptoBlockFormat format,
     }
 
     bs->encrypted = true;
+    qemu_mutex_init(&crypto->bounce_lock);
 
     ret = 0;
  cleanup:
@@ -450,6 +467,11 @@ block_crypto_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
 static void block_crypto_close(BlockDriverState *bs)
 {
     BlockCrypto *crypto = bs->opaque;
+
+    while (crypto->n_free_bounce) {
+        qemu_vfree(crypto->free_bounce[--crypto->n_free_bounce]);
+    }
+    qemu_mutex_destroy(&crypto->bounce_lock);
     qcrypto_block_free(crypto->block);
 }
 
@@ -461,10 +483,158 @@ static int block_crypto_reopen_prepare(BDRVReopenState *state,
 }
 
 /*
- * 1 MB bounce buffer gives good performance / memory tradeoff
- * when using cache=none|directsync.
+ * Bounce buffers are BLOCK_CRYPTO_MAX_IO_SIZE bytes for requests at least
+ * that large, and only those are kept for reuse; smaller requests get a
+ * buffer of their own size, so that they do not pin a full-size one.
  */
-#define BLOCK_CRYPTO_MAX_IO_SIZE (1024 * 1024)
+static void *block_crypto_get_bounce(BlockDriverState *bs, size_t size)
+{
+    BlockCrypto *crypto = bs->opaque;
+    void *buf = NULL;
+
+    size = MIN(size, BLOCK_CRYPTO_MAX_IO_SIZE);
+    if (size == BLOCK_CRYPTO_MAX_IO_SIZE) {
+        WITH_QEMU_LOCK_GUARD(&crypto->bounce_lock) {
+            if (crypto->n_free_bounce) {
+                buf = crypto->free_bounce[--crypto->n_free_bounce];
+            }
+        }
+    }
+    if (!buf) {
+        buf = qemu_try_blockalign(bs->file->bs, size);
+    }
+    return buf;
+}
+
+static void block_crypto_put_bounce(BlockCrypto *crypto, void *buf,
+                                    size_t size)
+{
+    if (!buf) {
+        return;
+    }
+    if (size >= BLOCK_CRYPTO_MAX_IO_SIZE) {
+        WITH_QEMU_LOCK_GUARD(&crypto->bounce_lock) {
+            if (crypto->n_free_bounce < BLOCK_CRYPTO_MAX_FREE_BOUNCE) {
+                crypto->free_bounce[crypto->n_free_bounce++] = buf;
+                return;
+            }
+        }
+    }
+    qemu_vfree(buf);
+}
+
+/*
+ * Encryption and decryption run in the thread pool, so that they do not
+ * stall the AioContext.  Large requests are split in up to
+ * BLOCK_CRYPTO_MAX_WORKERS pieces that are processed in parallel; each
+ * thread gets its own QCryptoCipher from the QCryptoBlock.  Pieces are
+ * not made smaller than BLOCK_CRYPTO_MIN_TASK_SIZE, below which handing
+ * them to another thread costs more than it saves.
+ */
+#define BLOCK_CRYPTO_MAX_WORKERS 8
+#define BLOCK_CRYPTO_MIN_TASK_SIZE (64 * KiB)
+
+typedef struct BlockCryptoTask {
+    AioTask task;
+
+    QCryptoBlock *block;
+    uint64_t offset;
+    uint8_t *buf;
+    size_t len;
+    BlockCryptoEncDecFunc *func;
+    BlockCryptoSubmitFunc *submit;
+    void *submit_opaque;
+} BlockCryptoTask;
+
+static int block_crypto_encdec_pool_func(void *opaque)
+{
+    BlockCryptoTask *t = opaque;
+
+    return t->func(t->block, t->offset, t->buf, t->len, NULL);
+}
+
+static int coroutine_fn block_crypto_encdec_submit(BlockCryptoTask *t)
+{
+    if (t->submit) {
+        return t->submit(t->submit_opaque, block_crypto_encdec_pool_func, t);
+    }
+    return thread_pool_submit_co(block_crypto_encdec_pool_func, t);
+}
+
+static int coroutine_fn block_crypto_encdec_task_entry(AioTask *task)
+{
+    return block_crypto_encdec_submit(container_of(task, BlockCryptoTask,
+                                                   task));
+}
+
+/*
+ * block_crypto_co_encdec:
+ *
+ * Encrypt or decrypt, depending on @func, @len bytes of @buf in place.
+ * @offset is the offset of @buf in the payload and, like @len, must be
+ * a multiple of the encryption sector size.  Each piece is handed to the
+ * thread pool by @submit with @submit_opaque, or directly if @submit is
+ * NULL; this lets the caller bound the number of threads it uses.
+ *
+ * Returns 0 on success, negative on failure.
+ */
+int coroutine_fn
+block_crypto_co_encdec(QCryptoBlock *block, uint64_t offset, uint8_t *buf,
+                       size_t len, BlockCryptoEncDecFunc *func,
+                       BlockCryptoSubmitFunc *submit, void *submit_opaque)
+{
+    uint64_t sector_size = qcrypto_block_get_sector_size(block);
+    AioTaskPool *pool;
+    size_t task_size;
+    size_t done;
+    int ret;
+
+    assert(QEMU_IS_ALIGNED(offset, sector_size));
+    assert(QEMU_IS_ALIGNED(len, sector_size));
+
+    if (len == 0) {
+        return 0;
+    }
+    if (len <= BLOCK_CRYPTO_MIN_TASK_SIZE) {
+        BlockCryptoTask t = {
+            .block = block,
+            .offset = offset,
+            .buf = buf,
+            .len = len,
+            .func = func,
+            .submit = submit,
+            .submit_opaque = submit_opaque,
+        };
+        return block_crypto_encdec_submit(&t);
+    }
+
+    task_size = DIV_ROUND_UP(len, BLOCK_CRYPTO_MAX_WORKERS);
+    task_size = MAX(ROUND_UP(task_size, sector_size),
+                    BLOCK_CRYPTO_MIN_TASK_SIZE);
+
+    pool = aio_task_pool_new(BLOCK_CRYPTO_MAX_WORKERS);
+    for (done = 0; done < len && aio_task_pool_status(pool) == 0;
+         done += task_size) {
+        BlockCryptoTask *t = g_new(BlockCryptoTask, 1);
+
+        *t = (BlockCryptoTask) {
+            .task.func = block_crypto_encdec_task_entry,
+            .block = block,
+            .offset = offset + done,
+            .buf = buf + done,
+            .len = MIN(len - done, task_size),
+            .func = func,
+            .submit = submit,
+            .submit_opaque = submit_opaque,
+        };
+        aio_task_pool_start_task(pool, &t->task);
+    }
+    aio_task_pool_wait_all(pool);
+    ret = aio_task_pool_status(pool);
+    aio_task_pool_free(pool);
+
+    return ret;
+}
 
 static int coroutine_fn GRAPH_RDLOCK
 block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
@@ -488,9 +658,7 @@ block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
     /* Bounce buffer because we don't wish to expose cipher text
      * in qiov which points to guest memory.
      */
-    cipher_data =
-        qemu_try_blockalign(bs->file->bs, MIN(BLOCK_CRYPTO_MAX_IO_SIZE,
-                                              qiov->size));
+    cipher_data = block_crypto_get_bounce(bs, qiov->size);
     if (cipher_data == NULL) {
         ret = -ENOMEM;
         goto cleanup;
@@ -508,8 +676,9 @@ block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
             goto cleanup;
         }
 
-        if (qcrypto_block_decrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
+        if (block_crypto_co_encdec(crypto->block, offset + bytes_done,
+                                   cipher_data, cur_bytes,
+                                   qcrypto_block_decrypt, NULL, NULL) < 0) {
             ret = -EIO;
             goto cleanup;
         }
@@ -522,7 +691,7 @@ block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
 
  cleanup:
     qemu_iovec_destroy(&hd_qiov);
-    qemu_vfree(cipher_data);
+    block_crypto_put_bounce(crypto, cipher_data, qiov->size);
 
     return ret;
 }
@@ -552,9 +721,7 @@ block_crypto_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
     /* Bounce buffer because we're not permitted to touch
      * contents of qiov - it points to guest memory.
      */
-    cipher_data =
-        qemu_try_blockalign(bs->file->bs, MIN(BLOCK_CRYPTO_MAX_IO_SIZE,
-                                              qiov->size));
+    cipher_data = block_crypto_get_bounce(bs, qiov->size);
     if (cipher_data == NULL) {
         ret = -ENOMEM;
         goto cleanup;
@@ -565,8 +732,9 @@ block_crypto_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
 
         qemu_iovec_to_buf(qiov, bytes_done, cipher_data, cur_bytes);
 
-        if (qcrypto_block_encrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
+        if (block_crypto_co_encdec(crypto->block, offset + bytes_done,
+                                   cipher_data, cur_bytes,
+                                   qcrypto_block_encrypt, NULL, NULL) < 0) {
             ret = -EIO;
             goto cleanup;
         }
@@ -586,7 +754,7 @@ block_crypto_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
 
  cleanup:
     qemu_iovec_destroy(&hd_qiov);
-    qemu_vfree(cipher_data);
+    block_crypto_put_bounce(crypto, cipher_data, qiov->size);
 
     return ret;
 }
@@ -21,6 +21,8 @@
 #ifndef BLOCK_CRYPTO_H
 #define BLOCK_CRYPTO_H
 
+#include "block/thread-pool.h"
+
 #define BLOCK_CRYPTO_OPT_DEF_KEY_SECRET(prefix, helpstr)                \
     {                                                                   \
         .name = prefix BLOCK_CRYPTO_OPT_QCOW_KEY_SECRET,                \
@@ -139,4 +141,18 @@ block_crypto_amend_opts_init(QDict *opts, Error **errp);
 QCryptoBlockOpenOptions *
 block_crypto_open_opts_init(QDict *opts, Error **errp);
 
+/* Common prototype of qcrypto_block_encrypt() and qcrypto_block_decrypt() */
+typedef int BlockCryptoEncDecFunc(QCryptoBlock *block, uint64_t offset,
+                                  uint8_t *buf, size_t len, Error **errp);
+
+/* Run @func(@arg) in the thread pool, on behalf of @opaque */
+typedef int coroutine_fn BlockCryptoSubmitFunc(void *opaque,
+                                               ThreadPoolFunc *func,
+                                               void *arg);
+
+int coroutine_fn
+block_crypto_co_encdec(QCryptoBlock *block, uint64_t offset, uint8_t *buf,
+                       size_t len, BlockCryptoEncDecFunc *func,
+                       BlockCryptoSubmitFunc *submit, void *submit_opaque);
+
 #endif /* BLOCK_CRYPTO_H */
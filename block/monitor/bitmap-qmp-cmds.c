@@ -91,6 +91,7 @@ void qmp_block_dirty_bitmap_add(const char *node, const char *name,
                                 bool has_granularity, uint32_t granularity,
                                 bool has_persistent, bool persistent,
                                 bool has_disabled, bool disabled,
+                                bool has_sparse, bool sparse,
                                 Error **errp)
 {
     BlockDriverState *bs;
@@ -140,6 +141,10 @@ void qmp_block_dirty_bitmap_add(const char *node, const char *name,
         bdrv_disable_dirty_bitmap(bitmap);
     }
 
+    if (has_sparse && sparse) {
+        bdrv_dirty_bitmap_set_sparse(bitmap, true);
+    }
+
     bdrv_dirty_bitmap_set_persistence(bitmap, persistent);
 }
 
@@ -338,6 +338,21 @@ finish:
     return ret;
 }
 
+/* Bitmaps with at most a quarter of their clusters dirty are kept sparse. */
+static bool bitmap_table_mostly_zero(const uint64_t *bitmap_table,
+                                     uint32_t bitmap_table_size)
+{
+    uint32_t i, nonzero = 0;
+
+    for (i = 0; i < bitmap_table_size; ++i) {
+        if (bitmap_table[i] & (BME_TABLE_ENTRY_OFFSET_MASK |
+                               BME_TABLE_ENTRY_FLAG_ALL_ONES)) {
+            nonzero++;
+        }
+    }
+    return nonzero <= bitmap_table_size / 4;
+}
+
 static coroutine_fn GRAPH_RDLOCK
 BdrvDirtyBitmap *load_bitmap(BlockDriverState *bs,
                              Qcow2Bitmap *bm, Error **errp)
@@ -366,6 +381,10 @@ BdrvDirtyBitmap *load_bitmap(BlockDriverState *bs,
         goto fail;
     }
 
+    if (bitmap_table_mostly_zero(bitmap_table, bm->table.size)) {
+        bdrv_dirty_bitmap_set_sparse(bitmap, true);
+    }
+
     ret = load_bitmap_data(bs, bitmap_table, bm->table.size, bitmap);
     if (ret < 0) {
         error_setg_errno(errp, -ret, "Could not read bitmap '%s' from image",
@@ -431,41 +431,22 @@ qcow2_co_decompress(BlockDriverState *bs, void *dest, size_t dest_size,
  */
 
 /*
- * Qcow2EncDecFunc: common prototype of qcrypto_block_encrypt() and
- * qcrypto_block_decrypt() functions.
+ * block_crypto_co_encdec() splits large requests so that they use several
+ * threads; each piece still goes through qcow2_co_process(), so that the
+ * image as a whole does not use more than QCOW2_MAX_THREADS of them.
  */
-typedef int (*Qcow2EncDecFunc)(QCryptoBlock *block, uint64_t offset,
-                               uint8_t *buf, size_t len, Error **errp);
-
-typedef struct Qcow2EncDecData {
-    QCryptoBlock *block;
-    uint64_t offset;
-    uint8_t *buf;
-    size_t len;
-
-    Qcow2EncDecFunc func;
-} Qcow2EncDecData;
-
-static int qcow2_encdec_pool_func(void *opaque)
+static int coroutine_fn
+qcow2_co_encdec_submit(void *opaque, ThreadPoolFunc *func, void *arg)
 {
-    Qcow2EncDecData *data = opaque;
-
-    return data->func(data->block, data->offset, data->buf, data->len, NULL);
+    return qcow2_co_process(opaque, func, arg);
 }
 
 static int coroutine_fn
 qcow2_co_encdec(BlockDriverState *bs, uint64_t host_offset,
                 uint64_t guest_offset, void *buf, size_t len,
-                Qcow2EncDecFunc func)
+                BlockCryptoEncDecFunc *func)
 {
     BDRVQcow2State *s = bs->opaque;
-    Qcow2EncDecData arg = {
-        .block = s->crypto,
-        .offset = s->crypt_physical_offset ? host_offset : guest_offset,
-        .buf = buf,
-        .len = len,
-        .func = func,
-    };
     uint64_t sector_size;
 
     assert(s->crypto);
@@ -475,7 +456,11 @@ qcow2_co_encdec(BlockDriverState *bs, uint64_t host_offset,
     assert(QEMU_IS_ALIGNED(host_offset, sector_size));
     assert(QEMU_IS_ALIGNED(len, sector_size));
 
-    return len == 0 ? 0 : qcow2_co_process(bs, qcow2_encdec_pool_func, &arg);
+    return block_crypto_co_encdec(s->crypto,
+                                  s->crypt_physical_offset ? host_offset
+                                                           : guest_offset,
+                                  buf, len, func,
+                                  qcow2_co_encdec_submit, bs);
 }
 
 /*
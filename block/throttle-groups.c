@@ -29,6 +29,7 @@
 #include "qemu/main-loop.h"
 #include "qemu/queue.h"
 #include "qemu/thread.h"
+#include "qemu/units.h"
 #include "sysemu/qtest.h"
 #include "qapi/error.h"
 #include "qapi/qapi-visit-block-core.h"
@@ -62,6 +63,19 @@ static void timer_cb(ThrottleGroupMember *tgm, ThrottleDirection direction);
  * blk_set_aio_context()). Therefore in this file a thread will
  * access some other ThrottleGroupMember's timers only after verifying that
  * that ThrottleGroupMember has throttled requests in the queue.
+ *
+ * A group can have a parent group, whose limits apply to the combined
+ * I/O of all its children. Each request is accounted in the group of its
+ * ThrottleGroupMember and in all of its ancestors, and it has to wait if
+ * any of them is over its limits. When the locks of several groups are
+ * needed, they are taken from the member's group up to the root.
+ *
+ * To keep the lock out of the common case, a group that is not throttling
+ * receives a small credit of bytes and operations, which is accounted in
+ * its buckets and in those of its ancestors beforehand. Requests consume
+ * the credit with atomic operations and only take the locks when it runs
+ * out; at that point whatever is left is returned to the buckets and the
+ * exact algorithm above takes over until nothing is throttled anymore.
  */
 struct ThrottleGroup {
     Object parent_obj;
@@ -70,6 +84,10 @@ struct ThrottleGroup {
     bool is_initialized;
     char *name; /* This is constant during the lifetime of the group */
 
+    /* These are constant once the group is initialized */
+    char *parent_name;
+    ThrottleGroup *parent;
+
     QemuMutex lock; /* This lock protects the following four fields */
     ThrottleState ts;
     QLIST_HEAD(, ThrottleGroupMember) head;
@@ -77,6 +95,15 @@ struct ThrottleGroup {
     bool any_timer_armed[THROTTLE_MAX];
     QEMUClockType clock_type;
 
+    /* Lock-free fast path, see above. These fields are accessed atomically,
+     * and credit is only granted with the locks of the group and of its
+     * ancestors held.
+     */
+    uint32_t credit_bytes[THROTTLE_MAX];
+    uint32_t credit_ops[THROTTLE_MAX];
+    uint32_t credit_max_io;                /* larger requests count as >1 op */
+    unsigned waiting[THROTTLE_MAX];        /* number of queued requests */
+
     /* This field is protected by the global QEMU mutex */
     QTAILQ_ENTRY(ThrottleGroup) list;
 };
@@ -85,6 +112,13 @@ struct ThrottleGroup {
 static QTAILQ_HEAD(, ThrottleGroup) throttle_groups =
     QTAILQ_HEAD_INITIALIZER(throttle_groups);
 
+/* Upper bounds of the credit of a group, in bytes and operations. A group
+ * gets half of the headroom left in its buckets and those of its ancestors,
+ * so that sibling groups can still make progress.
+ */
+#define THROTTLE_GROUP_CREDIT_BYTES (4 * MiB)
+#define THROTTLE_GROUP_CREDIT_OPS   64
+
 
 /* This function reads throttle_groups and must be called under the global
  * mutex.
@@ -170,6 +204,188 @@ const char *throttle_group_get_name(ThrottleGroupMember *tgm)
     return tg->name;
 }
 
+/* Lock a ThrottleGroup and all its ancestors, from the group up to the
+ * root.
+ *
+ * @tg: the ThrottleGroup
+ */
+static void throttle_group_lock(ThrottleGroup *tg)
+{
+    for (; tg; tg = tg->parent) {
+        qemu_mutex_lock(&tg->lock);
+    }
+}
+
+/* Unlock a ThrottleGroup and all its ancestors.
+ *
+ * @tg: the ThrottleGroup
+ */
+static void throttle_group_unlock(ThrottleGroup *tg)
+{
+    for (; tg; tg = tg->parent) {
+        qemu_mutex_unlock(&tg->lock);
+    }
+}
+
+/* Atomically take some units from a credit counter.
+ *
+ * @credit: the counter
+ * @n:      the number of units to take
+ * @ret:    whether there was enough credit
+ */
+static bool throttle_group_take_credit(uint32_t *credit, uint32_t n)
+{
+    uint32_t old = qatomic_read(credit);
+
+    while (old >= n) {
+        uint32_t prev = qatomic_cmpxchg(credit, old, old - n);
+        if (prev == old) {
+            return true;
+        }
+        old = prev;
+    }
+
+    return false;
+}
+
+/* Try to execute an I/O request with the credit of its group, without
+ * taking any lock. Requests that would overtake queued ones, or that count
+ * as more than one operation, always go through the slow path.
+ *
+ * If the bytes were taken but the operations ran out, the bytes cannot be
+ * put back into the credit: throttle_group_revoke_credit() may already
+ * have emptied it and refunded the buckets. They are returned in @taken
+ * instead, and must be refunded under the locks.
+ *
+ * @tg:        the ThrottleGroup of the request
+ * @bytes:     the number of bytes for this I/O
+ * @direction: the ThrottleDirection
+ * @taken:     the bytes that were taken from the credit but not used
+ * @ret:       whether the request was accounted and can be executed
+ */
+static bool throttle_group_try_credit(ThrottleGroup *tg, int64_t bytes,
+                                      ThrottleDirection direction,
+                                      uint32_t *taken)
+{
+    *taken = 0;
+    if (qatomic_read(&tg->waiting[direction]) ||
+        bytes > qatomic_read(&tg->credit_max_io)) {
+        return false;
+    }
+
+    if (!throttle_group_take_credit(&tg->credit_bytes[direction], bytes)) {
+        return false;
+    }
+    if (!throttle_group_take_credit(&tg->credit_ops[direction], 1)) {
+        *taken = bytes;
+        return false;
+    }
+
+    return true;
+}
+
+/* Take back the credit of a group and remove it from the buckets of the
+ * group and of its ancestors.
+ *
+ * This assumes that the locks of tg and its ancestors are held.
+ *
+ * @tg:        the ThrottleGroup
+ * @direction: the ThrottleDirection
+ * @taken:     bytes already taken out of the credit, to refund as well
+ */
+static void throttle_group_revoke_credit(ThrottleGroup *tg,
+                                         ThrottleDirection direction,
+                                         uint32_t taken)
+{
+    uint32_t bytes = qatomic_xchg(&tg->credit_bytes[direction], 0) + taken;
+    uint32_t ops = qatomic_xchg(&tg->credit_ops[direction], 0);
+    ThrottleGroup *iter;
+
+    if (!bytes && !ops) {
+        return;
+    }
+
+    for (iter = tg; iter; iter = iter->parent) {
+        throttle_charge(&iter->ts, direction, -(double)bytes, -(double)ops);
+    }
+}
+
+/* Give some credit to a group if none of its requests are throttled, and
+ * account it in the buckets of the group and of its ancestors.
+ *
+ * This assumes that the locks of tg and its ancestors are held.
+ *
+ * @tg:        the ThrottleGroup
+ * @direction: the ThrottleDirection
+ */
+static void throttle_group_grant_credit(ThrottleGroup *tg,
+                                        ThrottleDirection direction)
+{
+    double bytes = 2 * THROTTLE_GROUP_CREDIT_BYTES;
+    double units = 2 * THROTTLE_GROUP_CREDIT_OPS;
+    uint64_t max_io = UINT32_MAX;
+    uint32_t grant_bytes, grant_ops;
+    ThrottleGroup *iter;
+    int64_t now;
+
+    if (qatomic_read(&tg->waiting[direction]) ||
+        tg->any_timer_armed[direction]) {
+        return;
+    }
+
+    now = qemu_clock_get_ns(tg->clock_type);
+    for (iter = tg; iter; iter = iter->parent) {
+        throttle_compute_headroom(&iter->ts, direction, now, &bytes, &units);
+        if (iter->ts.cfg.op_size) {
+            max_io = MIN(max_io, iter->ts.cfg.op_size);
+        }
+    }
+
+    grant_bytes = bytes / 2;
+    grant_ops = units / 2;
+    if (!grant_bytes || !grant_ops) {
+        return;
+    }
+
+    for (iter = tg; iter; iter = iter->parent) {
+        throttle_charge(&iter->ts, direction, grant_bytes, grant_ops);
+    }
+
+    qatomic_set(&tg->credit_max_io, max_io);
+    qatomic_add(&tg->credit_bytes[direction], grant_bytes);
+    qatomic_add(&tg->credit_ops[direction], grant_ops);
+}
+
+/* Drop the credit of a group and of all groups below it. The credit is
+ * not removed from the buckets, whose levels have just been reset for the
+ * group itself; for its descendants the difference leaks away.
+ *
+ * This function reads throttle_groups and must be called under the global
+ * mutex.
+ *
+ * @tg: the ThrottleGroup whose configuration changed
+ */
+static void throttle_group_drop_credit(ThrottleGroup *tg)
+{
+    ThrottleGroup *iter, *ancestor;
+    ThrottleDirection dir;
+
+    QTAILQ_FOREACH(iter, &throttle_groups, list) {
+        for (ancestor = iter; ancestor; ancestor = ancestor->parent) {
+            if (ancestor == tg) {
+                break;
+            }
+        }
+        if (!ancestor) {
+            continue;
+        }
+        for (dir = THROTTLE_READ; dir < THROTTLE_MAX; dir++) {
+            qatomic_set(&iter->credit_bytes[dir], 0);
+            qatomic_set(&iter->credit_ops[dir], 0);
+        }
+    }
+}
+
 /* Return the next ThrottleGroupMember in the round-robin sequence, simulating
  * a circular list.
  *
@@ -255,10 +471,11 @@ static ThrottleGroupMember *next_throttle_token(ThrottleGroupMember *tgm,
 }
 
 /* Check if the next I/O request for a ThrottleGroupMember needs to be
- * throttled or not. If there's no timer set in this group, set one and update
- * the token accordingly.
+ * throttled or not, either by its group or by any of its ancestors. If
+ * there's no timer set in this group, set one and update the token
+ * accordingly.
  *
- * This assumes that tg->lock is held.
+ * This assumes that the locks of tg and its ancestors are held.
  *
  * @tgm:        the current ThrottleGroupMember
  * @direction:  the ThrottleDirection
@@ -270,7 +487,8 @@ static bool throttle_group_schedule_timer(ThrottleGroupMember *tgm,
     ThrottleState *ts = tgm->throttle_state;
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
     ThrottleTimers *tt = &tgm->throttle_timers;
-    bool must_wait;
+    ThrottleGroup *iter;
+    int64_t now, wait = 0;
 
     if (qatomic_read(&tgm->io_limits_disabled)) {
         return false;
@@ -281,15 +499,24 @@ static bool throttle_group_schedule_timer(ThrottleGroupMember *tgm,
         return true;
     }
 
-    must_wait = throttle_schedule_timer(ts, tt, direction);
+    /* Wait for whichever group in the hierarchy has the longest delay */
+    now = qemu_clock_get_ns(tg->clock_type);
+    for (iter = tg; iter; iter = iter->parent) {
+        wait = MAX(wait, throttle_compute_delay(&iter->ts, direction, now));
+    }
+
+    if (!wait) {
+        return false;
+    }
 
-    /* If a timer just got armed, set tgm as the current token */
-    if (must_wait) {
-        tg->tokens[direction] = tgm;
-        tg->any_timer_armed[direction] = true;
+    /* Arm the timer if needed and set tgm as the current token */
+    if (!timer_pending(tt->timers[direction])) {
+        timer_mod(tt->timers[direction], now + wait);
     }
+    tg->tokens[direction] = tgm;
+    tg->any_timer_armed[direction] = true;
 
-    return must_wait;
+    return true;
 }
 
 /* Start the next pending I/O request for a ThrottleGroupMember. Return whether
@@ -312,7 +539,7 @@ static bool coroutine_fn throttle_group_co_restart_queue(ThrottleGroupMember *tg
 
 /* Look for the next pending I/O request and schedule it.
  *
- * This assumes that tg->lock is held.
+ * This assumes that the locks of tg and its ancestors are held.
  *
  * @tgm:       the current ThrottleGroupMember
  * @direction: the ThrottleDirection
@@ -352,7 +579,7 @@ static void coroutine_mixed_fn schedule_next_request(ThrottleGroupMember *tgm,
 
 /* Check if an I/O request needs to be throttled, wait and set a timer
  * if necessary, and schedule the next request using a round robin
- * algorithm.
+ * algorithm. Requests that fit in the credit of the group skip all of this.
  *
  * @tgm:       the current ThrottleGroupMember
  * @bytes:     the number of bytes for this I/O
@@ -365,11 +592,20 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     bool must_wait;
     ThrottleGroupMember *token;
     ThrottleGroup *tg = container_of(tgm->throttle_state, ThrottleGroup, ts);
+    ThrottleGroup *iter;
+    uint32_t taken;
 
     assert(bytes >= 0);
     assert(direction < THROTTLE_MAX);
 
-    qemu_mutex_lock(&tg->lock);
+    if (throttle_group_try_credit(tg, bytes, direction, &taken)) {
+        return;
+    }
+
+    throttle_group_lock(tg);
+
+    /* Return what is left of the credit so that the buckets are exact */
+    throttle_group_revoke_credit(tg, direction, taken);
 
     /* First we check if this I/O has to be throttled. */
     token = next_throttle_token(tgm, direction);
@@ -378,22 +614,29 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     /* Wait if there's a timer set or queued requests of this type */
     if (must_wait || tgm->pending_reqs[direction]) {
         tgm->pending_reqs[direction]++;
-        qemu_mutex_unlock(&tg->lock);
+        qatomic_inc(&tg->waiting[direction]);
+        throttle_group_unlock(tg);
         qemu_co_mutex_lock(&tgm->throttled_reqs_lock);
         qemu_co_queue_wait(&tgm->throttled_reqs[direction],
                            &tgm->throttled_reqs_lock);
         qemu_co_mutex_unlock(&tgm->throttled_reqs_lock);
-        qemu_mutex_lock(&tg->lock);
+        throttle_group_lock(tg);
+        qatomic_dec(&tg->waiting[direction]);
         tgm->pending_reqs[direction]--;
     }
 
     /* The I/O will be executed, so do the accounting */
-    throttle_account(tgm->throttle_state, direction, bytes);
+    for (iter = tg; iter; iter = iter->parent) {
+        throttle_account(&iter->ts, direction, bytes);
+    }
 
     /* Schedule the next request */
     schedule_next_request(tgm, direction);
 
-    qemu_mutex_unlock(&tg->lock);
+    /* If nothing is throttled, let the next requests skip the locks */
+    throttle_group_grant_credit(tg, direction);
+
+    throttle_group_unlock(tg);
 }
 
 typedef struct {
@@ -415,9 +658,9 @@ static void coroutine_fn throttle_group_restart_queue_entry(void *opaque)
     /* If the request queue was empty then we have to take care of
      * scheduling the next one */
     if (empty_queue) {
-        qemu_mutex_lock(&tg->lock);
+        throttle_group_lock(tg);
         schedule_next_request(tgm, direction);
-        qemu_mutex_unlock(&tg->lock);
+        throttle_group_unlock(tg);
     }
 
     g_free(data);
@@ -469,6 +712,9 @@ void throttle_group_restart_tgm(ThrottleGroupMember *tgm)
  * to throttle_config(), but guarantees atomicity within the
  * throttling group.
  *
+ * This function reads throttle_groups and must be called under the global
+ * mutex.
+ *
  * @tgm:    a ThrottleGroupMember that is a member of the group
  * @cfg: the configuration to set
  */
@@ -480,6 +726,8 @@ void throttle_group_config(ThrottleGroupMember *tgm, ThrottleConfig *cfg)
     throttle_config(ts, tg->clock_type, cfg);
     qemu_mutex_unlock(&tg->lock);
 
+    throttle_group_drop_credit(tg);
+
     throttle_group_restart_tgm(tgm);
 }
 
@@ -642,14 +890,14 @@ void throttle_group_detach_aio_context(ThrottleGroupMember *tgm)
     }
 
     /* Kick off next ThrottleGroupMember, if necessary */
-    WITH_QEMU_LOCK_GUARD(&tg->lock) {
-        for (dir = THROTTLE_READ; dir < THROTTLE_MAX; dir++) {
-            if (timer_pending(tt->timers[dir])) {
-                tg->any_timer_armed[dir] = false;
-                schedule_next_request(tgm, dir);
-            }
+    throttle_group_lock(tg);
+    for (dir = THROTTLE_READ; dir < THROTTLE_MAX; dir++) {
+        if (timer_pending(tt->timers[dir])) {
+            tg->any_timer_armed[dir] = false;
+            schedule_next_request(tgm, dir);
         }
     }
+    throttle_group_unlock(tg);
 
     throttle_timers_detach_aio_context(tt);
     tgm->aio_context = NULL;
@@ -791,6 +1039,18 @@ static void throttle_group_obj_complete(UserCreatable *obj, Error **errp)
     if (!throttle_is_valid(&cfg, errp)) {
         return;
     }
+
+    /* The parent must already exist, which also rules out cycles */
+    if (tg->parent_name) {
+        tg->parent = throttle_group_by_name(tg->parent_name);
+        if (!tg->parent) {
+            error_setg(errp, "Throttle group '%s' not found",
+                       tg->parent_name);
+            return;
+        }
+        object_ref(OBJECT(tg->parent));
+    }
+
     throttle_config(&tg->ts, tg->clock_type, &cfg);
     QTAILQ_INSERT_TAIL(&throttle_groups, tg, list);
     tg->is_initialized = true;
@@ -804,7 +1064,11 @@ static void throttle_group_obj_finalize(Object *obj)
     if (tg->is_initialized) {
         QTAILQ_REMOVE(&throttle_groups, tg, list);
     }
+    if (tg->parent) {
+        object_unref(OBJECT(tg->parent));
+    }
     qemu_mutex_destroy(&tg->lock);
+    g_free(tg->parent_name);
     g_free(tg->name);
 }
 
@@ -906,6 +1170,9 @@ static void throttle_group_set_limits(Object *obj, Visitor *v,
 
 unlock:
     qemu_mutex_unlock(&tg->lock);
+    if (!local_err && tg->is_initialized) {
+        throttle_group_drop_credit(tg);
+    }
     qapi_free_ThrottleLimits(argp);
     error_propagate(errp, local_err);
     return;
@@ -929,6 +1196,27 @@ static void throttle_group_get_limits(Object *obj, Visitor *v,
     visit_type_ThrottleLimits(v, name, &argp, errp);
 }
 
+static char *throttle_group_get_parent(Object *obj, Error **errp)
+{
+    ThrottleGroup *tg = THROTTLE_GROUP(obj);
+
+    return g_strdup(tg->parent_name ?: "");
+}
+
+static void throttle_group_set_parent(Object *obj, const char *value,
+                                      Error **errp)
+{
+    ThrottleGroup *tg = THROTTLE_GROUP(obj);
+
+    if (tg->is_initialized) {
+        error_setg(errp, "Property cannot be set after initialization");
+        return;
+    }
+
+    g_free(tg->parent_name);
+    tg->parent_name = g_strdup(value);
+}
+
 static bool throttle_group_can_be_deleted(UserCreatable *uc)
 {
     return OBJECT(uc)->ref == 1;
@@ -958,6 +1246,11 @@ static void throttle_group_obj_class_init(ObjectClass *klass, void *class_data)
                               throttle_group_get_limits,
                               throttle_group_set_limits,
                               NULL, NULL);
+
+    /* Group whose limits also apply to the I/O of this one */
+    object_class_property_add_str(klass, "parent",
+                                  throttle_group_get_parent,
+                                  throttle_group_set_parent);
 }
 
 static const TypeInfo throttle_group_info = {
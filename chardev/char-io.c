@@ -23,6 +23,7 @@
  */
 #include "qemu/osdep.h"
 #include "chardev/char-io.h"
+#include "qemu/iov.h"
 
 typedef struct IOWatchPoll {
     GSource parent;
@@ -146,19 +147,21 @@ void remove_fd_in_watch(Chardev *chr)
     }
 }
 
-int io_channel_send_full(QIOChannel *ioc,
-                         const void *buf, size_t len,
-                         int *fds, size_t nfds)
+int io_channel_sendv_full(QIOChannel *ioc,
+                          const struct iovec *iov, size_t niov,
+                          int *fds, size_t nfds)
 {
+    g_autofree struct iovec *local_iov = NULL;
+    struct iovec *cur = (struct iovec *)iov;
+    unsigned int cnt = niov;
+    size_t len = iov_size(iov, niov);
     size_t offset = 0;
 
     while (offset < len) {
         ssize_t ret = 0;
-        struct iovec iov = { .iov_base = (char *)buf + offset,
-                             .iov_len = len - offset };
 
         ret = qio_channel_writev_full(
-            ioc, &iov, 1,
+            ioc, cur, cnt,
             fds, nfds, 0, NULL);
         if (ret == QIO_CHANNEL_ERR_BLOCK) {
             if (offset) {
@@ -173,11 +176,28 @@ int io_channel_send_full(QIOChannel *ioc,
         }
 
         offset += ret;
+        if (offset < len) {
+            /* Skip what was sent, on a copy of the caller's array */
+            if (!local_iov) {
+                local_iov = g_memdup2(iov, niov * sizeof(*iov));
+                cur = local_iov;
+            }
+            iov_discard_front(&cur, &cnt, ret);
+        }
     }
 
     return offset;
 }
 
+int io_channel_send_full(QIOChannel *ioc,
+                         const void *buf, size_t len,
+                         int *fds, size_t nfds)
+{
+    struct iovec iov = { .iov_base = (char *)buf, .iov_len = len };
+
+    return io_channel_sendv_full(ioc, &iov, 1, fds, nfds);
+}
+
 int io_channel_send(QIOChannel *ioc, const void *buf, size_t len)
 {
     return io_channel_send_full(ioc, buf, len, NULL, 0);
@@ -25,6 +25,14 @@ static GRand *rng;
 static int limit;
 static bool sys;
 
+/*
+ * In buffered mode data accesses are recorded by generated code and
+ * simulated in batches, using virtual addresses.
+ */
+#define MEM_BUFFER_RECORDS 4096
+static bool buffered;
+static struct qemu_plugin_mem_buffer *mem_buffer;
+
 enum EvictionPolicy {
     LRU,
     FIFO,
@@ -385,21 +393,13 @@ static bool access_cache(Cache *cache, uint64_t addr)
     return false;
 }
 
-static void vcpu_mem_access(unsigned int vcpu_index, qemu_plugin_meminfo_t info,
-                            uint64_t vaddr, void *userdata)
+static void dcache_access(unsigned int vcpu_index, uint64_t effective_addr,
+                          InsnData *userdata)
 {
-    uint64_t effective_addr;
-    struct qemu_plugin_hwaddr *hwaddr;
     int cache_idx;
     InsnData *insn;
     bool hit_in_l1;
 
-    hwaddr = qemu_plugin_get_hwaddr(info, vaddr);
-    if (hwaddr && qemu_plugin_hwaddr_is_io(hwaddr)) {
-        return;
-    }
-
-    effective_addr = hwaddr ? qemu_plugin_hwaddr_phys_addr(hwaddr) : vaddr;
     cache_idx = vcpu_index % cores;
 
     g_mutex_lock(&l1_dcache_locks[cache_idx]);
@@ -427,6 +427,33 @@ static void vcpu_mem_access(unsigned int vcpu_index, qemu_plugin_meminfo_t info,
     g_mutex_unlock(&l2_ucache_locks[cache_idx]);
 }
 
+static void vcpu_mem_access(unsigned int vcpu_index, qemu_plugin_meminfo_t info,
+                            uint64_t vaddr, void *userdata)
+{
+    uint64_t effective_addr;
+    struct qemu_plugin_hwaddr *hwaddr;
+
+    hwaddr = qemu_plugin_get_hwaddr(info, vaddr);
+    if (hwaddr && qemu_plugin_hwaddr_is_io(hwaddr)) {
+        return;
+    }
+
+    effective_addr = hwaddr ? qemu_plugin_hwaddr_phys_addr(hwaddr) : vaddr;
+    dcache_access(vcpu_index, effective_addr, userdata);
+}
+
+static void vcpu_mem_buffer(unsigned int vcpu_index,
+                            const qemu_plugin_mem_record *records,
+                            size_t n_records, void *userdata)
+{
+    size_t i;
+
+    for (i = 0; i < n_records; i++) {
+        dcache_access(vcpu_index, records[i].vaddr,
+                      (InsnData *)(uintptr_t)records[i].userdata);
+    }
+}
+
 static void vcpu_insn_exec(unsigned int vcpu_index, void *userdata)
 {
     uint64_t insn_addr;
@@ -496,9 +523,14 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
         }
         g_mutex_unlock(&hashtable_lock);
 
-        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem_access,
-                                         QEMU_PLUGIN_CB_NO_REGS,
-                                         rw, data);
+        if (buffered) {
+            qemu_plugin_register_vcpu_mem_buffer(insn, mem_buffer, rw,
+                                                 (uintptr_t)data);
+        } else {
+            qemu_plugin_register_vcpu_mem_cb(insn, vcpu_mem_access,
+                                             QEMU_PLUGIN_CB_NO_REGS,
+                                             rw, data);
+        }
 
         qemu_plugin_register_vcpu_insn_exec_cb(insn, vcpu_insn_exec,
                                                QEMU_PLUGIN_CB_NO_REGS, data);
@@ -705,6 +737,10 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
     log_stats();
     log_top_insns();
 
+    if (buffered) {
+        qemu_plugin_mem_buffer_free(mem_buffer);
+    }
+
     caches_free(l1_dcaches);
     caches_free(l1_icaches);
 
@@ -803,6 +839,11 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
                 fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
                 return -1;
             }
+        } else if (g_strcmp0(tokens[0], "buffered") == 0) {
+            if (!qemu_plugin_bool_parse(tokens[0], tokens[1], &buffered)) {
+                fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
+                return -1;
+            }
         } else if (g_strcmp0(tokens[0], "evict") == 0) {
             if (g_strcmp0(tokens[1], "rand") == 0) {
                 policy = RAND;
@@ -850,6 +891,11 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
     l1_icache_locks = g_new0(GMutex, cores);
     l2_ucache_locks = use_l2 ? g_new0(GMutex, cores) : NULL;
 
+    if (buffered) {
+        mem_buffer = qemu_plugin_mem_buffer_new(MEM_BUFFER_RECORDS,
+                                                vcpu_mem_buffer, NULL);
+    }
+
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
 
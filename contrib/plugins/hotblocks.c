@@ -19,6 +19,10 @@ QEMU_PLUGIN_EXPORT int qemu_plugin_version = QEMU_PLUGIN_VERSION;
 
 static bool do_inline;
 
+/* When sampling, only every sample_period-th block execution is counted */
+static uint64_t sample_period;
+static struct qemu_plugin_scoreboard *sample_countdown;
+
 /* Plugins need to take care of their own locking */
 static GMutex lock;
 static GHashTable *hotblocks;
@@ -87,6 +91,9 @@ static void plugin_exit(qemu_plugin_id_t id, void *p)
 
     g_hash_table_foreach(hotblocks, exec_count_free, NULL);
     g_hash_table_destroy(hotblocks);
+    if (sample_countdown) {
+        qemu_plugin_scoreboard_free(sample_countdown);
+    }
 }
 
 static void plugin_init(void)
@@ -101,7 +108,16 @@ static void vcpu_tb_exec(unsigned int cpu_index, void *udata)
                         cpu_index, 1);
 }
 
+static void vcpu_tb_sampled(unsigned int cpu_index, void *udata)
+{
+    ExecCount *cnt = (ExecCount *)udata;
+    qemu_plugin_u64_add(qemu_plugin_scoreboard_u64(cnt->exec_count),
+                        cpu_index, sample_period);
+}
+
 /*
+ * When sampling, a countdown shared by all blocks is decremented inline
+ * and the vcpu_tb_sampled callback only runs when it expires.
  * When do_inline we ask the plugin to increment the counter for us.
  * Otherwise a helper is inserted which calls the vcpu_tb_exec
  * callback.
@@ -128,7 +144,12 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 
     g_mutex_unlock(&lock);
 
-    if (do_inline) {
+    if (sample_period) {
+        qemu_plugin_register_vcpu_tb_exec_sampled_cb(
+            tb, vcpu_tb_sampled, QEMU_PLUGIN_CB_NO_REGS,
+            qemu_plugin_scoreboard_u64(sample_countdown), sample_period,
+            (void *)cnt);
+    } else if (do_inline) {
         qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
             tb, QEMU_PLUGIN_INLINE_ADD_U64,
             qemu_plugin_scoreboard_u64(cnt->exec_count), 1);
@@ -151,6 +172,8 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
                 fprintf(stderr, "boolean argument parsing failed: %s\n", opt);
                 return -1;
             }
+        } else if (g_strcmp0(tokens[0], "sample") == 0) {
+            sample_period = g_ascii_strtoull(tokens[1], NULL, 10);
         } else {
             fprintf(stderr, "option parsing failed: %s\n", opt);
             return -1;
@@ -158,6 +181,9 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
     }
 
     plugin_init();
+    if (sample_period) {
+        sample_countdown = qemu_plugin_scoreboard_new(sizeof(uint64_t));
+    }
 
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
@@ -28,6 +28,10 @@ static int limit = 50;
 static enum qemu_plugin_mem_rw rw = QEMU_PLUGIN_MEM_RW;
 static bool track_io;
 
+/* When sampling, each sampled access stands for sample_period accesses */
+static uint64_t sample_period;
+static struct qemu_plugin_scoreboard *sample_countdown;
+
 enum sort_type {
     SORT_RW = 0,
     SORT_R,
@@ -138,10 +142,10 @@ static void vcpu_haddr(unsigned int cpu_index, qemu_plugin_meminfo_t meminfo,
         g_hash_table_insert(pages, GUINT_TO_POINTER(page), (gpointer) count);
     }
     if (qemu_plugin_mem_is_store(meminfo)) {
-        count->writes++;
+        count->writes += sample_period ? sample_period : 1;
         count->cpu_write |= (1 << cpu_index);
     } else {
-        count->reads++;
+        count->reads += sample_period ? sample_period : 1;
         count->cpu_read |= (1 << cpu_index);
     }
 
@@ -155,9 +159,16 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 
     for (i = 0; i < n; i++) {
         struct qemu_plugin_insn *insn = qemu_plugin_tb_get_insn(tb, i);
-        qemu_plugin_register_vcpu_mem_cb(insn, vcpu_haddr,
-                                         QEMU_PLUGIN_CB_NO_REGS,
-                                         rw, NULL);
+        if (sample_period) {
+            qemu_plugin_register_vcpu_mem_sampled_cb(
+                insn, vcpu_haddr, QEMU_PLUGIN_CB_NO_REGS, rw,
+                qemu_plugin_scoreboard_u64(sample_countdown), sample_period,
+                NULL);
+        } else {
+            qemu_plugin_register_vcpu_mem_cb(insn, vcpu_haddr,
+                                             QEMU_PLUGIN_CB_NO_REGS,
+                                             rw, NULL);
+        }
     }
 }
 
@@ -189,6 +200,8 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
             }
         } else if (g_strcmp0(tokens[0], "pagesize") == 0) {
             page_size = g_ascii_strtoull(tokens[1], NULL, 10);
+        } else if (g_strcmp0(tokens[0], "sample") == 0) {
+            sample_period = g_ascii_strtoull(tokens[1], NULL, 10);
         } else {
             fprintf(stderr, "option parsing failed: %s\n", opt);
             return -1;
@@ -196,6 +209,9 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
     }
 
     plugin_init();
+    if (sample_period) {
+        sample_countdown = qemu_plugin_scoreboard_new(sizeof(uint64_t));
+    }
 
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
@@ -0,0 +1,135 @@
+/*
+ * AES in XTS mode, using the host's AES instructions when available
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "crypto/aes-xts.h"
+
+typedef void aes_xts_fn(const AESXTSKey *key, const uint8_t *iv,
+                        size_t len, uint8_t *dst, const uint8_t *src);
+
+typedef struct AESXTSAccel {
+    aes_xts_fn *encrypt;
+    aes_xts_fn *decrypt;
+} AESXTSAccel;
+
+static void aes_xts_rk_to_bytes(uint8_t (*rk)[AES_BLOCK_SIZE],
+                                const AES_KEY *key)
+{
+    int i, j;
+
+    for (i = 0; i <= key->rounds; i++) {
+        for (j = 0; j < 4; j++) {
+            stl_be_p(&rk[i][j * 4], key->rd_key[i * 4 + j]);
+        }
+    }
+}
+
+int aes_xts_set_key(AESXTSKey *key, const uint8_t *userkey, size_t nkey)
+{
+    size_t half = nkey / 2;
+
+    if (nkey != 32 && nkey != 48 && nkey != 64) {
+        return -1;
+    }
+
+    if (AES_set_encrypt_key(userkey, half * 8, &key->enc) ||
+        AES_set_decrypt_key(userkey, half * 8, &key->dec) ||
+        AES_set_encrypt_key(userkey + half, half * 8, &key->tweak)) {
+        return -1;
+    }
+
+    aes_xts_rk_to_bytes(key->enc_rk, &key->enc);
+    aes_xts_rk_to_bytes(key->dec_rk, &key->dec);
+    aes_xts_rk_to_bytes(key->tweak_rk, &key->tweak);
+    key->rounds = key->enc.rounds;
+    return 0;
+}
+
+/* Multiply the tweak by x in GF(2^128), as a little-endian number */
+static inline void aes_xts_mul_x(uint64_t *t)
+{
+    uint64_t carry = t[1] >> 63;
+
+    t[1] = (t[1] << 1) | (t[0] >> 63);
+    t[0] = (t[0] << 1) ^ (carry * 0x87);
+}
+
+static inline void aes_xts_gen(const AESXTSKey *key, const uint8_t *iv,
+                               size_t len, uint8_t *dst, const uint8_t *src,
+                               bool enc)
+{
+    uint8_t buf[AES_BLOCK_SIZE];
+    uint64_t t[2];
+
+    AES_encrypt(iv, buf, &key->tweak);
+    t[0] = ldq_le_p(buf);
+    t[1] = ldq_le_p(buf + 8);
+
+    for (; len; len -= AES_BLOCK_SIZE) {
+        stq_le_p(buf, ldq_le_p(src) ^ t[0]);
+        stq_le_p(buf + 8, ldq_le_p(src + 8) ^ t[1]);
+        if (enc) {
+            AES_encrypt(buf, buf, &key->enc);
+        } else {
+            AES_decrypt(buf, buf, &key->dec);
+        }
+        stq_le_p(dst, ldq_le_p(buf) ^ t[0]);
+        stq_le_p(dst + 8, ldq_le_p(buf + 8) ^ t[1]);
+
+        aes_xts_mul_x(t);
+        src += AES_BLOCK_SIZE;
+        dst += AES_BLOCK_SIZE;
+    }
+}
+
+static void aes_xts_encrypt_gen(const AESXTSKey *key, const uint8_t *iv,
+                                size_t len, uint8_t *dst, const uint8_t *src)
+{
+    aes_xts_gen(key, iv, len, dst, src, true);
+}
+
+static void aes_xts_decrypt_gen(const AESXTSKey *key, const uint8_t *iv,
+                                size_t len, uint8_t *dst, const uint8_t *src)
+{
+    aes_xts_gen(key, iv, len, dst, src, false);
+}
+
+#include "host/crypto/aes-xts.c.inc"
+
+static const AESXTSAccel *aes_xts_accel;
+static unsigned accel_index;
+
+void aes_xts_encrypt(const AESXTSKey *key, const uint8_t *iv,
+                     size_t len, uint8_t *dst, const uint8_t *src)
+{
+    assert(len && QEMU_IS_ALIGNED(len, AES_BLOCK_SIZE));
+    aes_xts_accel->encrypt(key, iv, len, dst, src);
+}
+
+void aes_xts_decrypt(const AESXTSKey *key, const uint8_t *iv,
+                     size_t len, uint8_t *dst, const uint8_t *src)
+{
+    assert(len && QEMU_IS_ALIGNED(len, AES_BLOCK_SIZE));
+    aes_xts_accel->decrypt(key, iv, len, dst, src);
+}
+
+bool test_aes_xts_next_accel(void)
+{
+    if (accel_index != 0) {
+        aes_xts_accel = &accel_table[--accel_index];
+        return true;
+    }
+    accel_index = best_accel();
+    aes_xts_accel = &accel_table[accel_index];
+    return false;
+}
+
+static void __attribute__((constructor)) init_accel(void)
+{
+    accel_index = best_accel();
+    aes_xts_accel = &accel_table[accel_index];
+}
@@ -39,6 +39,9 @@
 #ifdef CONFIG_SNAPPY
 #include <snappy-c.h>
 #endif
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
 #ifndef ELF_MACHINE_UNAME
 #define ELF_MACHINE_UNAME "Unknown"
 #endif
@@ -1003,6 +1006,11 @@ static void create_header32(DumpState *s, Error **errp)
     if (s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) {
         status |= DUMP_DH_COMPRESSED_SNAPPY;
     }
+#endif
+#ifdef CONFIG_ZSTD
+    if (s->flag_compress & DUMP_DH_COMPRESSED_ZSTD) {
+        status |= DUMP_DH_COMPRESSED_ZSTD;
+    }
 #endif
     dh->status = cpu_to_dump32(s, status);
 
@@ -1114,6 +1122,11 @@ static void create_header64(DumpState *s, Error **errp)
     if (s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) {
         status |= DUMP_DH_COMPRESSED_SNAPPY;
     }
+#endif
+#ifdef CONFIG_ZSTD
+    if (s->flag_compress & DUMP_DH_COMPRESSED_ZSTD) {
+        status |= DUMP_DH_COMPRESSED_ZSTD;
+    }
 #endif
     dh->status = cpu_to_dump32(s, status);
 
@@ -1466,6 +1479,297 @@ static size_t get_len_buf_out(size_t page_size, uint32_t flag_compress)
     case DUMP_DH_COMPRESSED_SNAPPY:
         return snappy_max_compressed_length(page_size);
 #endif
+
+#ifdef CONFIG_ZSTD
+    case DUMP_DH_COMPRESSED_ZSTD:
+        return ZSTD_compressBound(page_size);
+#endif
+    }
+    return 0;
+}
+
+/*
+ * Pages are compressed by a pool of threads, DUMP_JOB_PAGES at a time,
+ * while the dump thread reads guest memory and writes the compressed
+ * pages out in their original order.
+ */
+#define DUMP_JOB_PAGES              64
+#define DUMP_MAX_COMPRESS_THREADS   16
+
+typedef struct DumpCompressJob {
+    /* Input: pages in guest RAM, or in bounce if they span two blocks */
+    const uint8_t *page[DUMP_JOB_PAGES];
+    uint8_t *bounce;
+    unsigned npages;
+
+    /*
+     * Output: size 0 is a zero page, and flags 0 means that the page
+     * is stored uncompressed from page[] rather than from out.
+     */
+    uint8_t *out;
+    uint32_t size[DUMP_JOB_PAGES];
+    uint32_t flags[DUMP_JOB_PAGES];
+    bool done;
+
+    QSIMPLEQ_ENTRY(DumpCompressJob) next;
+} DumpCompressJob;
+
+typedef struct DumpCompressPool {
+    DumpState *state;
+    size_t len_buf_out;
+
+    QemuMutex lock;
+    QemuCond job_cond;          /* a job was queued, or exiting was set */
+    QemuCond done_cond;         /* a job was completed */
+    QSIMPLEQ_HEAD(, DumpCompressJob) queue;
+    bool exiting;
+
+    unsigned nthreads;
+    QemuThread *threads;
+    unsigned njobs;
+    DumpCompressJob *jobs;
+} DumpCompressPool;
+
+typedef struct DumpCompressContext {
+#ifdef CONFIG_LZO
+    lzo_bytep wrkmem;
+#endif
+#ifdef CONFIG_ZSTD
+    ZSTD_CCtx *zstd;
+#endif
+} DumpCompressContext;
+
+#ifdef CONFIG_ZSTD
+static bool dump_zstd_compress(ZSTD_CCtx *zstd, uint8_t *buf_out,
+                               size_t *size_out, const uint8_t *buf,
+                               size_t size)
+{
+    size_t ret;
+
+    if (!zstd) {
+        return false;
+    }
+    /* level 1 is the fastest, like Z_BEST_SPEED for zlib */
+    ret = ZSTD_compressCCtx(zstd, buf_out, *size_out, buf, size, 1);
+    if (ZSTD_isError(ret)) {
+        return false;
+    }
+    *size_out = ret;
+    return true;
+}
+#endif
+
+/*
+ * Compress page @i of @job.  Only one compression format will be used
+ * here, for s->flag_compress is set.  But when compression fails to
+ * work, we fall back to save in plaintext.
+ */
+static void dump_compress_page(DumpCompressPool *pool, DumpCompressContext *ctx,
+                               DumpCompressJob *job, unsigned i)
+{
+    DumpState *s = pool->state;
+    const uint8_t *buf = job->page[i];
+    uint8_t *buf_out = job->out + i * pool->len_buf_out;
+    size_t page_size = s->dump_info.page_size;
+    size_t size_out = pool->len_buf_out;
+
+    if (buffer_is_zero(buf, page_size)) {
+        job->size[i] = 0;
+        job->flags[i] = 0;
+        return;
+    }
+
+    if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
+            (compress2(buf_out, (uLongf *)&size_out, buf,
+                       page_size, Z_BEST_SPEED) == Z_OK) &&
+            (size_out < page_size)) {
+        job->flags[i] = DUMP_DH_COMPRESSED_ZLIB;
+#ifdef CONFIG_LZO
+    } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
+            (lzo1x_1_compress(buf, page_size, buf_out,
+            (lzo_uint *)&size_out, ctx->wrkmem) == LZO_E_OK) &&
+            (size_out < page_size)) {
+        job->flags[i] = DUMP_DH_COMPRESSED_LZO;
+#endif
+#ifdef CONFIG_SNAPPY
+    } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
+            (snappy_compress((char *)buf, page_size,
+            (char *)buf_out, &size_out) == SNAPPY_OK) &&
+            (size_out < page_size)) {
+        job->flags[i] = DUMP_DH_COMPRESSED_SNAPPY;
+#endif
+#ifdef CONFIG_ZSTD
+    } else if ((s->flag_compress & DUMP_DH_COMPRESSED_ZSTD) &&
+            dump_zstd_compress(ctx->zstd, buf_out, &size_out,
+                               buf, page_size) &&
+            (size_out < page_size)) {
+        job->flags[i] = DUMP_DH_COMPRESSED_ZSTD;
+#endif
+    } else {
+        job->flags[i] = 0;
+        size_out = page_size;
+    }
+    job->size[i] = size_out;
+}
+
+static void *dump_compress_thread(void *opaque)
+{
+    DumpCompressPool *pool = opaque;
+    DumpCompressContext ctx = { };
+    DumpCompressJob *job;
+    unsigned i;
+
+#ifdef CONFIG_LZO
+    ctx.wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
+#endif
+#ifdef CONFIG_ZSTD
+    if (pool->state->flag_compress & DUMP_DH_COMPRESSED_ZSTD) {
+        ctx.zstd = ZSTD_createCCtx();
+    }
+#endif
+
+    qemu_mutex_lock(&pool->lock);
+    while (!pool->exiting) {
+        job = QSIMPLEQ_FIRST(&pool->queue);
+        if (!job) {
+            qemu_cond_wait(&pool->job_cond, &pool->lock);
+            continue;
+        }
+        QSIMPLEQ_REMOVE_HEAD(&pool->queue, next);
+        qemu_mutex_unlock(&pool->lock);
+
+        for (i = 0; i < job->npages; i++) {
+            dump_compress_page(pool, &ctx, job, i);
+        }
+
+        qemu_mutex_lock(&pool->lock);
+        job->done = true;
+        qemu_cond_signal(&pool->done_cond);
+    }
+    qemu_mutex_unlock(&pool->lock);
+
+#ifdef CONFIG_LZO
+    g_free(ctx.wrkmem);
+#endif
+#ifdef CONFIG_ZSTD
+    ZSTD_freeCCtx(ctx.zstd);
+#endif
+    return NULL;
+}
+
+static void dump_compress_pool_init(DumpCompressPool *pool, DumpState *s,
+                                    size_t len_buf_out)
+{
+    size_t page_size = s->dump_info.page_size;
+    unsigned i;
+
+    pool->state = s;
+    pool->len_buf_out = len_buf_out;
+    qemu_mutex_init(&pool->lock);
+    qemu_cond_init(&pool->job_cond);
+    qemu_cond_init(&pool->done_cond);
+    QSIMPLEQ_INIT(&pool->queue);
+    pool->exiting = false;
+
+    /* Two jobs per thread, so that threads are busy while one is written */
+    pool->nthreads = MIN(g_get_num_processors(), DUMP_MAX_COMPRESS_THREADS);
+    pool->njobs = 2 * pool->nthreads;
+    pool->jobs = g_new0(DumpCompressJob, pool->njobs);
+    for (i = 0; i < pool->njobs; i++) {
+        pool->jobs[i].bounce = g_malloc(DUMP_JOB_PAGES * page_size);
+        pool->jobs[i].out = g_malloc(DUMP_JOB_PAGES * len_buf_out);
+    }
+
+    pool->threads = g_new(QemuThread, pool->nthreads);
+    for (i = 0; i < pool->nthreads; i++) {
+        qemu_thread_create(&pool->threads[i], "dump-compress",
+                           dump_compress_thread, pool, QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void dump_compress_pool_destroy(DumpCompressPool *pool)
+{
+    unsigned i;
+
+    qemu_mutex_lock(&pool->lock);
+    pool->exiting = true;
+    qemu_cond_broadcast(&pool->job_cond);
+    qemu_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->nthreads; i++) {
+        qemu_thread_join(&pool->threads[i]);
+    }
+    g_free(pool->threads);
+
+    for (i = 0; i < pool->njobs; i++) {
+        g_free(pool->jobs[i].bounce);
+        g_free(pool->jobs[i].out);
+    }
+    g_free(pool->jobs);
+
+    qemu_cond_destroy(&pool->done_cond);
+    qemu_cond_destroy(&pool->job_cond);
+    qemu_mutex_destroy(&pool->lock);
+}
+
+static void dump_compress_submit(DumpCompressPool *pool, DumpCompressJob *job)
+{
+    qemu_mutex_lock(&pool->lock);
+    job->done = false;
+    QSIMPLEQ_INSERT_TAIL(&pool->queue, job, next);
+    qemu_cond_signal(&pool->job_cond);
+    qemu_mutex_unlock(&pool->lock);
+}
+
+static void dump_compress_wait(DumpCompressPool *pool, DumpCompressJob *job)
+{
+    qemu_mutex_lock(&pool->lock);
+    while (!job->done) {
+        qemu_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    qemu_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Write the pages of a completed job into the caches of page_data and
+ * page_desc.  Zero pages all share the page data at the start of the
+ * page section.
+ */
+static int write_dump_job(DumpState *s, DumpCompressPool *pool,
+                          DumpCompressJob *job, DataCache *page_desc,
+                          DataCache *page_data, const PageDescriptor *pd_zero,
+                          off_t *offset_data, Error **errp)
+{
+    PageDescriptor pd;
+    const uint8_t *data;
+    unsigned i;
+
+    for (i = 0; i < job->npages; i++) {
+        if (job->size[i] == 0) {
+            pd = *pd_zero;
+        } else {
+            if (job->flags[i]) {
+                data = job->out + i * pool->len_buf_out;
+            } else {
+                data = job->page[i];
+            }
+            if (write_cache(page_data, data, job->size[i], false) < 0) {
+                error_setg(errp, "dump: failed to write page data");
+                return -1;
+            }
+
+            pd.flags = cpu_to_dump32(s, job->flags[i]);
+            pd.size = cpu_to_dump32(s, job->size[i]);
+            pd.page_flags = cpu_to_dump64(s, 0);
+            pd.offset = cpu_to_dump64(s, *offset_data);
+            *offset_data += job->size[i];
+        }
+
+        if (write_cache(page_desc, &pd, sizeof(PageDescriptor), false) < 0) {
+            error_setg(errp, "dump: failed to write page desc");
+            return -1;
+        }
+        s->written_size += s->dump_info.page_size;
     }
     return 0;
 }
@@ -1474,17 +1778,16 @@ static void write_dump_pages(DumpState *s, Error **errp)
 {
     int ret = 0;
     DataCache page_desc, page_data;
-    size_t len_buf_out, size_out;
-#ifdef CONFIG_LZO
-    lzo_bytep wrkmem = NULL;
-#endif
-    uint8_t *buf_out = NULL;
+    DumpCompressPool pool;
+    DumpCompressJob *job;
+    size_t len_buf_out;
     off_t offset_desc, offset_data;
-    PageDescriptor pd, pd_zero;
+    PageDescriptor pd_zero;
     uint8_t *buf;
     GuestPhysBlock *block_iter = NULL;
     uint64_t pfn_iter;
-    g_autofree uint8_t *page = NULL;
+    unsigned head = 0, in_flight = 0;
+    bool more = true;
 
     /* get offset of page_desc and page_data in dump file */
     offset_desc = s->offset_page;
@@ -1497,11 +1800,7 @@ static void write_dump_pages(DumpState *s, Error **errp)
     len_buf_out = get_len_buf_out(s->dump_info.page_size, s->flag_compress);
     assert(len_buf_out != 0);
 
-#ifdef CONFIG_LZO
-    wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
-#endif
-
-    buf_out = g_malloc(len_buf_out);
+    dump_compress_pool_init(&pool, s, len_buf_out);
 
     /*
      * init zero page's page_desc and page_data, because every zero page
@@ -1520,103 +1819,44 @@ static void write_dump_pages(DumpState *s, Error **errp)
     }
 
     offset_data += s->dump_info.page_size;
-    page = g_malloc(s->dump_info.page_size);
 
     /*
      * dump memory to vmcore page by page. zero page will all be resided in the
-     * first page of page section
+     * first page of page section.  Up to njobs batches of pages are being
+     * compressed at any time; they are written back in the order they were
+     * read.
      */
-    for (buf = page; get_next_page(&block_iter, &pfn_iter, &buf, s); buf = page) {
-        /* check zero page */
-        if (buffer_is_zero(buf, s->dump_info.page_size)) {
-            ret = write_cache(&page_desc, &pd_zero, sizeof(PageDescriptor),
-                              false);
+    while (more || in_flight) {
+        job = &pool.jobs[head % pool.njobs];
+
+        if (in_flight == pool.njobs || !more) {
+            /* the oldest job is next to be written */
+            job = &pool.jobs[(head - in_flight) % pool.njobs];
+            dump_compress_wait(&pool, job);
+            ret = write_dump_job(s, &pool, job, &page_desc, &page_data,
+                                 &pd_zero, &offset_data, errp);
             if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
                 goto out;
             }
-        } else {
-            /*
-             * not zero page, then:
-             * 1. compress the page
-             * 2. write the compressed page into the cache of page_data
-             * 3. get page desc of the compressed page and write it into the
-             *    cache of page_desc
-             *
-             * only one compression format will be used here, for
-             * s->flag_compress is set. But when compression fails to work,
-             * we fall back to save in plaintext.
-             */
-             size_out = len_buf_out;
-             if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
-                    (compress2(buf_out, (uLongf *)&size_out, buf,
-                               s->dump_info.page_size, Z_BEST_SPEED) == Z_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_ZLIB);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#ifdef CONFIG_LZO
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
-                    (lzo1x_1_compress(buf, s->dump_info.page_size, buf_out,
-                    (lzo_uint *)&size_out, wrkmem) == LZO_E_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_LZO);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-#ifdef CONFIG_SNAPPY
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
-                    (snappy_compress((char *)buf, s->dump_info.page_size,
-                    (char *)buf_out, &size_out) == SNAPPY_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_SNAPPY);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-            } else {
-                /*
-                 * fall back to save in plaintext, size_out should be
-                 * assigned the target's page size
-                 */
-                pd.flags = cpu_to_dump32(s, 0);
-                size_out = s->dump_info.page_size;
-                pd.size = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf,
-                                  s->dump_info.page_size, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-            }
-
-            /* get and write page desc here */
-            pd.page_flags = cpu_to_dump64(s, 0);
-            pd.offset = cpu_to_dump64(s, offset_data);
-            offset_data += size_out;
+            in_flight--;
+            continue;
+        }
 
-            ret = write_cache(&page_desc, &pd, sizeof(PageDescriptor), false);
-            if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
-                goto out;
+        job->npages = 0;
+        while (job->npages < DUMP_JOB_PAGES) {
+            buf = job->bounce + job->npages * s->dump_info.page_size;
+            if (!get_next_page(&block_iter, &pfn_iter, &buf, s)) {
+                more = false;
+                break;
             }
+            job->page[job->npages++] = buf;
+        }
+
+        if (job->npages) {
+            dump_compress_submit(&pool, job);
+            head++;
+            in_flight++;
         }
-        s->written_size += s->dump_info.page_size;
     }
 
     ret = write_cache(&page_desc, NULL, 0, true);
@@ -1631,14 +1871,9 @@ static void write_dump_pages(DumpState *s, Error **errp)
     }
 
 out:
+    dump_compress_pool_destroy(&pool);
     free_data_cache(&page_desc);
     free_data_cache(&page_data);
-
-#ifdef CONFIG_LZO
-    g_free(wrkmem);
-#endif
-
-    g_free(buf_out);
 }
 
 static void create_kdump_vmcore(DumpState *s, Error **errp)
@@ -1946,6 +2181,12 @@ static void dump_init(DumpState *s, int fd, bool has_format,
             s->flag_compress = DUMP_DH_COMPRESSED_SNAPPY;
             break;
 
+#ifdef CONFIG_ZSTD
+        case DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZSTD:
+            s->flag_compress = DUMP_DH_COMPRESSED_ZSTD;
+            break;
+#endif
+
         default:
             s->flag_compress = 0;
         }
@@ -2105,6 +2346,12 @@ void qmp_dump_guest_memory(bool paging, const char *protocol,
             format = DUMP_GUEST_MEMORY_FORMAT_KDUMP_SNAPPY;
             kdump_raw = true;
             break;
+#ifdef CONFIG_ZSTD
+        case DUMP_GUEST_MEMORY_FORMAT_KDUMP_RAW_ZSTD:
+            format = DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZSTD;
+            kdump_raw = true;
+            break;
+#endif
         default:
             break;
         }
@@ -2234,6 +2481,12 @@ DumpGuestMemoryCapability *qmp_query_dump_guest_memory_capability(Error **errp)
     QAPI_LIST_APPEND(tail, DUMP_GUEST_MEMORY_FORMAT_KDUMP_RAW_SNAPPY);
 #endif
 
+    /* add new item if kdump-zstd is available */
+#ifdef CONFIG_ZSTD
+    QAPI_LIST_APPEND(tail, DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZSTD);
+    QAPI_LIST_APPEND(tail, DUMP_GUEST_MEMORY_FORMAT_KDUMP_RAW_ZSTD);
+#endif
+
     if (win_dump_available(NULL)) {
         QAPI_LIST_APPEND(tail, DUMP_GUEST_MEMORY_FORMAT_WIN_DMP);
     }
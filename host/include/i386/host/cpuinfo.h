@@ -26,6 +26,8 @@
 #define CPUINFO_ATOMIC_VMOVDQU  (1u << 17)
 #define CPUINFO_AES             (1u << 18)
 #define CPUINFO_PCLMUL          (1u << 19)
+#define CPUINFO_VAES            (1u << 20)
+#define CPUINFO_VPCLMULQDQ      (1u << 21)
 
 /* Initialized with a constructor. */
 extern unsigned cpuinfo;
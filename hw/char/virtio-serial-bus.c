@@ -23,6 +23,7 @@
 #include "qemu/iov.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "qemu/units.h"
 #include "migration/qemu-file-types.h"
 #include "monitor/monitor.h"
 #include "qemu/error-report.h"
@@ -157,6 +158,138 @@ static void discard_throttle_data(VirtIOSerialPort *port)
     }
 }
 
+/*
+ * Limits for the data handed to have_data_iov in one go.  The data stays
+ * in guest memory until the port consumes it, so these only bound how
+ * many elements are held back from the guest while a write is pending.
+ */
+#define VIRTIO_SERIAL_BATCH_ELEMS   64
+#define VIRTIO_SERIAL_BATCH_BYTES   (1 * MiB)
+
+/* Skip @bytes of port->elem, which must have at least as many left */
+static void port_elem_advance(VirtIOSerialPort *port, size_t bytes)
+{
+    while (bytes) {
+        size_t left = port->elem->out_sg[port->iov_idx].iov_len -
+                      port->iov_offset;
+
+        if (bytes < left) {
+            port->iov_offset += bytes;
+            return;
+        }
+        bytes -= left;
+        port->iov_idx++;
+        port->iov_offset = 0;
+    }
+}
+
+/*
+ * Gather the pending elements of the queue, up to the limits above, and
+ * pass them to the port with a single call.  Elements that were written
+ * completely are returned to the guest together; the first one that was
+ * not becomes port->elem and the ones after it go back to the queue.
+ */
+static void do_flush_queued_data_iov(VirtIOSerialPort *port, VirtQueue *vq)
+{
+    VirtIOSerialPortClass *vsc = VIRTIO_SERIAL_PORT_GET_CLASS(port);
+    VirtQueueElement *elems[VIRTIO_SERIAL_BATCH_ELEMS];
+    size_t elem_len[VIRTIO_SERIAL_BATCH_ELEMS];
+    struct iovec iov[VIRTQUEUE_MAX_SIZE];
+
+    while (!port->throttled) {
+        unsigned int nelems = 0, niov = 0, i;
+        size_t len = 0, done;
+        ssize_t ret;
+
+        if (!port->elem) {
+            port->elem = virtqueue_pop(vq, sizeof(VirtQueueElement));
+            if (!port->elem) {
+                break;
+            }
+            port->iov_idx = 0;
+            port->iov_offset = 0;
+        }
+
+        /* Resume the element that was left off mid-way, if any */
+        elems[0] = port->elem;
+        elem_len[0] = 0;
+        for (i = port->iov_idx; i < port->elem->out_num; i++) {
+            size_t offset = i == port->iov_idx ? port->iov_offset : 0;
+
+            iov[niov].iov_base = port->elem->out_sg[i].iov_base + offset;
+            iov[niov].iov_len = port->elem->out_sg[i].iov_len - offset;
+            elem_len[0] += iov[niov++].iov_len;
+        }
+        len = elem_len[0];
+        nelems = 1;
+
+        while (nelems < VIRTIO_SERIAL_BATCH_ELEMS &&
+               len < VIRTIO_SERIAL_BATCH_BYTES) {
+            VirtQueueElement *elem = virtqueue_pop(vq,
+                                                   sizeof(VirtQueueElement));
+
+            if (!elem) {
+                break;
+            }
+            if (niov + elem->out_num > ARRAY_SIZE(iov)) {
+                virtqueue_unpop(vq, elem, 0);
+                g_free(elem);
+                break;
+            }
+            memcpy(&iov[niov], elem->out_sg,
+                   elem->out_num * sizeof(struct iovec));
+            niov += elem->out_num;
+            elem_len[nelems] = iov_size(elem->out_sg, elem->out_num);
+            len += elem_len[nelems];
+            elems[nelems++] = elem;
+        }
+
+        ret = vsc->have_data_iov(port, iov, niov);
+        trace_virtio_serial_flush_batch(port->id, nelems, len, ret);
+        if (!port->elem) { /* bail if we got disconnected */
+            /*
+             * virtio_serial_close() only dropped the first element and
+             * the ones still in the queue, which are past the batch;
+             * return the rest of the batch to the guest unused.
+             */
+            for (i = 1; i < nelems; i++) {
+                virtqueue_fill(vq, elems[i], 0, i - 1);
+                g_free(elems[i]);
+            }
+            virtqueue_flush(vq, nelems - 1);
+            return;
+        }
+
+        /*
+         * Without throttling, whatever the port did not take was dropped,
+         * which is the same as what do_flush_queued_data() does.
+         */
+        done = port->throttled ? MAX(ret, 0) : len;
+        for (i = 0; i < nelems && done >= elem_len[i]; i++) {
+            done -= elem_len[i];
+            virtqueue_fill(vq, elems[i], 0, i);
+            g_free(elems[i]);
+        }
+        virtqueue_flush(vq, i);
+
+        port->elem = NULL;
+        if (i < nelems) {
+            unsigned int j;
+
+            for (j = nelems - 1; j > i; j--) {
+                virtqueue_unpop(vq, elems[j], 0);
+                g_free(elems[j]);
+            }
+            if (i > 0) {
+                port->iov_idx = 0;
+                port->iov_offset = 0;
+            }
+            port->elem = elems[i];
+            port_elem_advance(port, done);
+        }
+    }
+}
+
 static void do_flush_queued_data(VirtIOSerialPort *port, VirtQueue *vq,
                                  VirtIODevice *vdev)
 {
@@ -167,6 +300,12 @@ static void do_flush_queued_data(VirtIOSerialPort *port, VirtQueue *vq,
 
     vsc = VIRTIO_SERIAL_PORT_GET_CLASS(port);
 
+    if (vsc->have_data_iov) {
+        do_flush_queued_data_iov(port, vq);
+        virtio_notify(vdev, vq);
+        return;
+    }
+
     while (!port->throttled) {
         unsigned int i;
 
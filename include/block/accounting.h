@@ -27,6 +27,7 @@
 
 #include "qemu/timed-average.h"
 #include "qemu/thread.h"
+#include "qemu/hdr-histogram.h"
 #include "qapi/qapi-types-common.h"
 
 typedef struct BlockAcctTimedStats BlockAcctTimedStats;
@@ -42,6 +43,9 @@ enum BlockAcctType {
     BLOCK_MAX_IOTYPE,
 };
 
+/* Requests on higher queues share the histograms of lower ones */
+#define BLOCK_ACCT_MAX_QUEUES 64
+
 struct BlockAcctTimedStats {
     BlockAcctStats *stats;
     TimedAverage latency[BLOCK_MAX_IOTYPE];
@@ -92,12 +96,16 @@ struct BlockAcctStats {
     bool account_invalid;
     bool account_failed;
     BlockLatencyHistogram latency_histogram[BLOCK_MAX_IOTYPE];
+
+    /* Always enabled, updated without taking @lock */
+    HdrHistogram latency_hdr[BLOCK_ACCT_MAX_QUEUES][BLOCK_MAX_IOTYPE];
 };
 
 typedef struct BlockAcctCookie {
     int64_t bytes;
     int64_t start_time_ns;
     enum BlockAcctType type;
+    unsigned queue;
 } BlockAcctCookie;
 
 void block_acct_init(BlockAcctStats *stats);
@@ -109,6 +117,9 @@ BlockAcctTimedStats *block_acct_interval_next(BlockAcctStats *stats,
                                               BlockAcctTimedStats *s);
 void block_acct_start(BlockAcctStats *stats, BlockAcctCookie *cookie,
                       int64_t bytes, enum BlockAcctType type);
+void block_acct_start_queue(BlockAcctStats *stats, BlockAcctCookie *cookie,
+                            int64_t bytes, enum BlockAcctType type,
+                            unsigned queue);
 void block_acct_done(BlockAcctStats *stats, BlockAcctCookie *cookie);
 void block_acct_failed(BlockAcctStats *stats, BlockAcctCookie *cookie);
 void block_acct_invalid(BlockAcctStats *stats, enum BlockAcctType type);
@@ -120,5 +131,9 @@ double block_acct_queue_depth(BlockAcctTimedStats *stats,
 int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
                                 uint64List *boundaries);
 void block_latency_histograms_clear(BlockAcctStats *stats);
+void block_acct_latency_snapshot(BlockAcctStats *stats,
+                                 enum BlockAcctType type, int queue,
+                                 AioContext *ctx, HdrHistogramSnapshot *snap);
+void block_acct_forget_aio_context(BlockAcctStats *stats, AioContext *ctx);
 
 #endif
@@ -232,6 +232,20 @@ guint qemu_chr_fe_add_watch(CharBackend *be, GIOCondition cond,
  */
 int qemu_chr_fe_write(CharBackend *be, const uint8_t *buf, int len);
 
+/**
+ * qemu_chr_fe_writev:
+ * @iov: the data
+ * @iovcnt: the number of elements in @iov
+ *
+ * Like qemu_chr_fe_write(), but gather the data from @iov.  Backends
+ * that support it send the whole array with a single system call, for
+ * example with sendmsg() on sockets.  This function is thread-safe.
+ *
+ * Returns: the number of bytes consumed (0 if no associated Chardev)
+ *          or -1 on error.
+ */
+int qemu_chr_fe_writev(CharBackend *be, const struct iovec *iov, int iovcnt);
+
 /**
  * qemu_chr_fe_write_all:
  * @buf: the data
@@ -0,0 +1,60 @@
+/*
+ * AES in XTS mode, using the host's AES instructions when available
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef QEMU_AES_XTS_H
+#define QEMU_AES_XTS_H
+
+#include "crypto/aes.h"
+
+typedef struct AESXTSKey {
+    /* Key schedules for the portable implementation */
+    AES_KEY enc;
+    AES_KEY dec;
+    AES_KEY tweak;
+
+    /*
+     * The same round keys in memory byte order, as expected by the AES
+     * instructions; dec_rk is the schedule of the equivalent inverse
+     * cipher, i.e. InvMixColumns has been applied to the inner keys.
+     */
+    uint8_t enc_rk[AES_MAXNR + 1][AES_BLOCK_SIZE] QEMU_ALIGNED(16);
+    uint8_t dec_rk[AES_MAXNR + 1][AES_BLOCK_SIZE] QEMU_ALIGNED(16);
+    uint8_t tweak_rk[AES_MAXNR + 1][AES_BLOCK_SIZE] QEMU_ALIGNED(16);
+    int rounds;
+} AESXTSKey;
+
+/**
+ * aes_xts_set_key:
+ * @key: the key schedule to fill in
+ * @userkey: the data key followed by the tweak key
+ * @nkey: length of @userkey, 32, 48 or 64 bytes
+ *
+ * Returns 0 on success, -1 if @nkey is invalid.
+ */
+int aes_xts_set_key(AESXTSKey *key, const uint8_t *userkey, size_t nkey);
+
+/**
+ * aes_xts_encrypt:
+ * @key: the key schedule
+ * @iv: the tweak of the first block, AES_BLOCK_SIZE bytes
+ * @len: the length of @dst and @src, a non-zero multiple of AES_BLOCK_SIZE
+ * @dst: buffer for the ciphertext
+ * @src: the plaintext, which may be the same as @dst
+ */
+void aes_xts_encrypt(const AESXTSKey *key, const uint8_t *iv,
+                     size_t len, uint8_t *dst, const uint8_t *src);
+
+/* Like aes_xts_encrypt(), from ciphertext in @src to plaintext in @dst */
+void aes_xts_decrypt(const AESXTSKey *key, const uint8_t *iv,
+                     size_t len, uint8_t *dst, const uint8_t *src);
+
+/*
+ * Switch to the next slower implementation, for testing and benchmarks.
+ * Returns false, after going back to the fastest one, when there is none.
+ */
+bool test_aes_xts_next_accel(void);
+
+#endif
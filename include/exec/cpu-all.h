@@ -178,6 +178,9 @@ void page_reset_target_data(target_ulong start, target_ulong last);
  * Return true if every page in [@start, @start+@len) has @flags set.
  * Return false if any page is unmapped.  Thus testing flags == 0 is
  * equivalent to testing for flags == PAGE_VALID.
+ *
+ * The mmap_lock need not be held; it is only taken when write-protected
+ * pages must be unprotected.
  */
 bool page_check_range(target_ulong start, target_ulong last, int flags);
 
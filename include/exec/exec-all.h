@@ -585,6 +585,26 @@ G_NORETURN void cpu_loop_exit_sigbus(CPUState *cpu, target_ulong addr,
                                      MMUAccessType access_type,
                                      uintptr_t ra);
 
+/**
+ * tb_pretranslate:
+ * @cpu: a cpu that is not executing guest code
+ * @pc: the guest pc of the TB
+ * @cs_base: the cs_base of the TB
+ * @flags: the flags of the TB
+ * @cflags: the compile flags of the TB
+ *
+ * Translate the TB ahead of its first execution, so that the cpus that
+ * do run the guest find it in the TB hash table.  Nothing is done if the
+ * TB already exists, or if @pc is not executable.  A TB whose translation
+ * would raise a guest exception is dropped silently.  The caller must set
+ * current_cpu to @cpu beforehand.
+ *
+ * Return false if the code buffer is getting full, in which case the
+ * caller should stop translating ahead.
+ */
+bool tb_pretranslate(CPUState *cpu, vaddr pc, uint64_t cs_base,
+                     uint32_t flags, uint32_t cflags);
+
 #else
 static inline void mmap_lock(void) {}
 static inline void mmap_unlock(void) {}
@@ -80,6 +80,14 @@ struct VirtIOSerialPortClass {
      */
     ssize_t (*have_data)(VirtIOSerialPort *port, const uint8_t *buf,
                          ssize_t len);
+
+    /*
+     * Optional; like have_data, but for all the data that the guest
+     * queued since the last call.  The buffers point into guest memory
+     * and are only valid until the function returns.
+     */
+    ssize_t (*have_data_iov)(VirtIOSerialPort *port, const struct iovec *iov,
+                             int iovcnt);
 };
 
 /*
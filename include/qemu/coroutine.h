@@ -283,6 +283,29 @@ void qemu_coroutine_inc_pool_size(unsigned int additional_pool_size);
  */
 void qemu_coroutine_dec_pool_size(unsigned int additional_pool_size);
 
+/**
+ * Start trimming coroutine pools that went idle, from a main loop timer.
+ * Without it, pools are only trimmed when they are used.
+ */
+void qemu_coroutine_pool_trim_init(void);
+
+typedef struct CoroutinePoolStats {
+    uint64_t hits;              /* coroutines recycled from the pool */
+    uint64_t misses;            /* coroutines allocated from scratch */
+    uint64_t remote_batches;    /* batches taken from another NUMA node */
+    uint64_t trimmed;           /* unused coroutines freed by the pool */
+    uint64_t size;              /* coroutines in the global pool */
+    uint64_t max_size;          /* limit on the size of the global pool */
+} CoroutinePoolStats;
+
+/**
+ * Get coroutine pool statistics
+ *
+ * Coroutines recycled by other threads are only counted as hits once
+ * those threads exchange a batch with the global pool.
+ */
+void qemu_coroutine_get_pool_stats(CoroutinePoolStats *stats);
+
 /**
  * Sends a (part of) iovec down a socket, yielding when the socket is full, or
  * Receives data into a (part of) iovec from a socket,
@@ -68,6 +68,12 @@
 #ifndef bit_AVX512VBMI2
 #define bit_AVX512VBMI2 (1 << 6)
 #endif
+#ifndef bit_VAES
+#define bit_VAES        (1 << 9)
+#endif
+#ifndef bit_VPCLMULQDQ
+#define bit_VPCLMULQDQ  (1 << 10)
+#endif
 
 /* Leaf 0x80000001, %ecx */
 #ifndef bit_LZCNT
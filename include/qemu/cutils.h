@@ -220,6 +220,27 @@ static inline bool buffer_is_zero(const void *buf, size_t len)
 #define buffer_is_zero  buffer_is_zero_ool
 #endif
 
+/**
+ * buffer_diff_tiles:
+ * @a: first buffer
+ * @b: second buffer
+ * @len: length of the buffers in bytes
+ * @tile: size of a tile in bytes
+ * @check: bitmap of the tiles to compare, or NULL to compare all of them
+ * @diff: bitmap with one bit per tile
+ *
+ * Split @a and @b into tiles of @tile bytes, the last of which may be
+ * shorter, and compare the tiles selected by @check.  On return, the bits
+ * of @diff are set for the tiles that differ and clear for the others.
+ * @diff has DIV_ROUND_UP(@len, @tile) bits, so when @len is zero there
+ * are no tiles and @diff is left untouched.
+ *
+ * Returns the number of tiles that differ.
+ */
+size_t buffer_diff_tiles(const void *a, const void *b, size_t len, size_t tile,
+                         const unsigned long *check, unsigned long *diff);
+bool test_buffer_diff_next_accel(void);
+
 /*
  * Implementation of ULEB128 (http://en.wikipedia.org/wiki/LEB128)
  * Input is limited to 14-bit numbers
@@ -61,6 +61,17 @@ struct HBitmapIter {
  */
 HBitmap *hbitmap_alloc(uint64_t size, int granularity);
 
+/**
+ * hbitmap_alloc_sparse:
+ * @size: Number of bits in the bitmap.
+ * @granularity: Granularity of the bitmap, as for hbitmap_alloc().
+ * @sparse: Whether the bitmap uses the sparse representation.
+ *
+ * Allocate a new HBitmap, like hbitmap_alloc() followed by
+ * hbitmap_set_sparse() but without allocating the flat bottom level.
+ */
+HBitmap *hbitmap_alloc_sparse(uint64_t size, int granularity, bool sparse);
+
 /**
  * hbitmap_truncate:
  * @hb: The bitmap to change the size of.
@@ -71,6 +82,27 @@ HBitmap *hbitmap_alloc(uint64_t size, int granularity);
  */
 void hbitmap_truncate(HBitmap *hb, uint64_t size);
 
+/**
+ * hbitmap_set_sparse:
+ * @hb: The bitmap to convert.
+ * @sparse: Whether the bitmap should use the sparse representation.
+ *
+ * Convert @hb in place between the flat representation and one where the
+ * bottom level is split in chunks that are only allocated while they have
+ * any bit set.  The sparse representation saves memory for bitmaps that
+ * are mostly clear, at the cost of a small overhead on each access.
+ * This may invalidate existing HBitmapIterators.
+ */
+void hbitmap_set_sparse(HBitmap *hb, bool sparse);
+
+/**
+ * hbitmap_is_sparse:
+ * @hb: HBitmap to operate on.
+ *
+ * Returns whether @hb uses the sparse representation.
+ */
+bool hbitmap_is_sparse(const HBitmap *hb);
+
 /**
  * hbitmap_merge:
  *
@@ -350,4 +382,12 @@ bool hbitmap_status(const HBitmap *hb, int64_t start, int64_t count,
  */
 int64_t hbitmap_iter_next(HBitmapIter *hbi);
 
+/*
+ * test_hbitmap_next_accel:
+ *
+ * Switch to the next slower implementation of the word kernels, for
+ * benchmarks and tests.  Returns false if there is none.
+ */
+bool test_hbitmap_next_accel(void);
+
 #endif
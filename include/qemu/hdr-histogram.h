@@ -0,0 +1,100 @@
+/*
+ * Lock-free log-linear histograms
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef QEMU_HDR_HISTOGRAM_H
+#define QEMU_HDR_HISTOGRAM_H
+
+/*
+ * Values are counted in buckets whose width doubles every
+ * HDR_HISTOGRAM_SUB_BUCKETS buckets, like in HdrHistogram: values below
+ * HDR_HISTOGRAM_SUB_BUCKETS are exact, and larger ones are rounded up to
+ * the upper bound of their bucket, which is 1/HDR_HISTOGRAM_SUB_BUCKETS
+ * of their power of two wide; i.e. the relative error is below 6.25%.
+ * Values of 2^40 or more, which is over 18 minutes for nanoseconds, all
+ * end up in the last bucket.
+ *
+ * Each thread records into its own shard of the histogram, so recording
+ * a value does not need any locked instruction.  Readers sum the shards,
+ * and may see a few values more or less than were recorded at the exact
+ * time of the read.
+ */
+#define HDR_HISTOGRAM_SUB_BITS      4
+#define HDR_HISTOGRAM_SUB_BUCKETS   (1 << HDR_HISTOGRAM_SUB_BITS)
+#define HDR_HISTOGRAM_MAX_BITS      40
+#define HDR_HISTOGRAM_BUCKETS \
+    ((HDR_HISTOGRAM_MAX_BITS - HDR_HISTOGRAM_SUB_BITS + 1) * \
+     HDR_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct HdrHistogramShard HdrHistogramShard;
+
+typedef struct HdrHistogram {
+    HdrHistogramShard *shards;
+} HdrHistogram;
+
+/* The sum of all shards of one or more histograms */
+typedef struct HdrHistogramSnapshot {
+    uint64_t count;
+    uint64_t max;
+    uint64_t buckets[HDR_HISTOGRAM_BUCKETS];
+} HdrHistogramSnapshot;
+
+/*
+ * hdr_histogram_destroy:
+ *
+ * Free the shards of @hist.  Nothing may be recorded concurrently.  A
+ * zeroed HdrHistogram is empty and needs no further initialization.
+ */
+void hdr_histogram_destroy(HdrHistogram *hist);
+
+/*
+ * hdr_histogram_record:
+ * @hist: the histogram
+ * @value: the value to record
+ * @tag: an opaque pointer, which can be used to select shards when
+ *       summing them, e.g. to split the values by event loop
+ *
+ * Record @value in the shard of @hist that belongs to the current thread
+ * and @tag, creating it if necessary.
+ */
+void hdr_histogram_record(HdrHistogram *hist, uint64_t value, const void *tag);
+
+/*
+ * hdr_histogram_add_to_snapshot:
+ * @hist: the histogram
+ * @tag: if not NULL, only sum the shards that were recorded with @tag
+ * @snap: the snapshot to add to
+ *
+ * Add the values recorded in @hist to @snap, which should be zeroed
+ * before the first call.
+ */
+void hdr_histogram_add_to_snapshot(HdrHistogram *hist, const void *tag,
+                                   HdrHistogramSnapshot *snap);
+
+/*
+ * hdr_histogram_forget_tag:
+ * @hist: the histogram
+ * @tag: the tag
+ *
+ * Detach the values that were recorded with @tag from it, for example
+ * before the object that @tag points to is freed and its address can be
+ * reused.  The values are still included when summing all shards.
+ * Nothing may be recorded with @tag concurrently.
+ */
+void hdr_histogram_forget_tag(HdrHistogram *hist, const void *tag);
+
+/*
+ * hdr_histogram_percentile:
+ * @snap: the values
+ * @percentile: between 0 and 100
+ *
+ * Return the highest value that can be in the same bucket as the value
+ * at @percentile, but not more than the largest value that was recorded.
+ * This is 0 if @snap is empty, and the largest value for 100.
+ */
+uint64_t hdr_histogram_percentile(const HdrHistogramSnapshot *snap,
+                                  double percentile);
+
+#endif /* QEMU_HDR_HISTOGRAM_H */
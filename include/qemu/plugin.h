@@ -72,6 +72,9 @@ enum plugin_dyn_cb_type {
     PLUGIN_CB_MEM_REGULAR,
     PLUGIN_CB_INLINE_ADD_U64,
     PLUGIN_CB_INLINE_STORE_U64,
+    PLUGIN_CB_MEM_BUFFER,
+    PLUGIN_CB_SAMPLED,
+    PLUGIN_CB_MEM_SAMPLED,
 };
 
 struct qemu_plugin_regular_cb {
@@ -96,6 +99,22 @@ struct qemu_plugin_conditional_cb {
     uint64_t imm;
 };
 
+struct qemu_plugin_sampled_cb {
+    union qemu_plugin_cb_sig f;
+    TCGHelperInfo *info;
+    void *userp;
+    qemu_plugin_u64 entry;
+    uint64_t period;
+    enum qemu_plugin_mem_rw rw;
+};
+
+struct qemu_plugin_mem_buffer_cb {
+    struct qemu_plugin_mem_buffer *buf;
+    TCGHelperInfo *info;
+    uint64_t userdata;
+    enum qemu_plugin_mem_rw rw;
+};
+
 /*
  * A dynamic callback has an insertion point that is determined at run-time.
  * Usually the insertion point is somewhere in the code cache; think for
@@ -107,6 +126,8 @@ struct qemu_plugin_dyn_cb {
         struct qemu_plugin_regular_cb regular;
         struct qemu_plugin_conditional_cb cond;
         struct qemu_plugin_inline_cb inline_insn;
+        struct qemu_plugin_mem_buffer_cb mem_buffer;
+        struct qemu_plugin_sampled_cb sampled;
     };
 };
 
@@ -128,6 +149,27 @@ struct qemu_plugin_scoreboard {
     QLIST_ENTRY(qemu_plugin_scoreboard) entry;
 };
 
+/*
+ * A memory access buffer is a scoreboard whose per-vCPU entry is a
+ * struct qemu_plugin_mem_buffer_entry holding @capacity records. Generated
+ * code appends to the entry of the executing vCPU and only calls out to
+ * plugin_mem_buffer_flush() once it is full.
+ */
+struct qemu_plugin_mem_buffer {
+    struct qemu_plugin_scoreboard *score;
+    size_t capacity;
+    qemu_plugin_vcpu_mem_buffer_cb_t cb;
+    void *userdata;
+    QLIST_ENTRY(qemu_plugin_mem_buffer) entry;
+};
+
+struct qemu_plugin_mem_buffer_entry {
+    uint64_t n;
+    struct qemu_plugin_mem_record records[];
+};
+
+void plugin_mem_buffer_flush(uint32_t cpu_index, void *buf);
+
 /* Internal context for this TranslationBlock */
 struct qemu_plugin_tb {
     GPtrArray *insns;
@@ -57,11 +57,17 @@ typedef uint64_t qemu_plugin_id_t;
  * - Remove qemu_plugin_register_vcpu_{tb, insn, mem}_exec_inline.
  *   Those functions are replaced by *_per_vcpu variants, which guarantee
  *   thread-safety for operations.
+ *
+ * version 4:
+ * - added qemu_plugin_mem_buffer_{new,free,flush} and
+ *   qemu_plugin_register_vcpu_mem_buffer for buffered memory tracing.
+ * - added qemu_plugin_register_vcpu_{tb_exec,insn_exec,mem}_sampled_cb
+ *   for sampling every Nth event.
  */
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 3
+#define QEMU_PLUGIN_VERSION 4
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -350,6 +356,32 @@ void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
                                                uint64_t imm,
                                                void *userdata);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_sampled_cb() - register sampled callback
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @entry: per-vCPU countdown, shared by all events sampled together
+ * @period: sampling period, at most INT64_MAX
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @entry countdown is decremented inline every time the translated
+ * unit executes, and @cb is only called when it underflows, after which it
+ * is reloaded with @period - 1. Registering the same @entry on every block
+ * thus samples every @period-th block execution of a vCPU. A countdown
+ * initialised to zero fires on its first event.
+ * A @period of 1 is equivalent to qemu_plugin_register_vcpu_tb_exec_cb,
+ * a @period of 0 installs no callback.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_tb_exec_sampled_cb(
+    struct qemu_plugin_tb *tb,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    qemu_plugin_u64 entry,
+    uint64_t period,
+    void *userdata);
+
 /**
  * enum qemu_plugin_op - describes an inline op
  *
@@ -420,6 +452,27 @@ void qemu_plugin_register_vcpu_insn_exec_cond_cb(
     uint64_t imm,
     void *userdata);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_sampled_cb() - sampled insn execution cb
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @entry: per-vCPU countdown, shared by all events sampled together
+ * @period: sampling period, at most INT64_MAX
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * Like qemu_plugin_register_vcpu_tb_exec_sampled_cb(), but the countdown
+ * is decremented every time the instruction executes.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_insn_exec_sampled_cb(
+    struct qemu_plugin_insn *insn,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    qemu_plugin_u64 entry,
+    uint64_t period,
+    void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - insn exec inline op
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -642,6 +695,30 @@ void qemu_plugin_register_vcpu_mem_cb(struct qemu_plugin_insn *insn,
                                       enum qemu_plugin_mem_rw rw,
                                       void *userdata);
 
+/**
+ * qemu_plugin_register_vcpu_mem_sampled_cb() - sampled memory access callback
+ * @insn: handle for instruction to instrument
+ * @cb: callback of type qemu_plugin_vcpu_mem_cb_t
+ * @flags: (currently unused) callback flags
+ * @rw: monitor reads, writes or both
+ * @entry: per-vCPU countdown, shared by all events sampled together
+ * @period: sampling period, at most INT64_MAX
+ * @userdata: opaque pointer for userdata
+ *
+ * Like qemu_plugin_register_vcpu_mem_cb(), but @cb is only called when
+ * the @entry countdown, decremented inline on every matching access,
+ * underflows. See qemu_plugin_register_vcpu_tb_exec_sampled_cb() for the
+ * countdown semantics.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_sampled_cb(struct qemu_plugin_insn *insn,
+                                              qemu_plugin_vcpu_mem_cb_t cb,
+                                              enum qemu_plugin_cb_flags flags,
+                                              enum qemu_plugin_mem_rw rw,
+                                              qemu_plugin_u64 entry,
+                                              uint64_t period,
+                                              void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_mem_inline_per_vcpu() - inline op for mem access
  * @insn: handle for instruction to instrument
@@ -661,6 +738,101 @@ void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     qemu_plugin_u64 entry,
     uint64_t imm);
 
+/**
+ * struct qemu_plugin_mem_record - memory access recorded in a buffer
+ * @vaddr: the virtual address of the access
+ * @userdata: the value passed to qemu_plugin_register_vcpu_mem_buffer()
+ * @info: opaque memory transaction handle for the qemu_plugin_mem_* queries
+ * @reserved: padding, always zero
+ *
+ * Records are delivered after the fact, so qemu_plugin_get_hwaddr() cannot
+ * be used on @info.
+ */
+typedef struct qemu_plugin_mem_record {
+    uint64_t vaddr;
+    uint64_t userdata;
+    qemu_plugin_meminfo_t info;
+    uint32_t reserved;
+} qemu_plugin_mem_record;
+
+/** struct qemu_plugin_mem_buffer - Opaque handle for a memory access buffer */
+struct qemu_plugin_mem_buffer;
+
+/**
+ * typedef qemu_plugin_vcpu_mem_buffer_cb_t - memory buffer callback type
+ * @vcpu_index: the vCPU that performed the accesses
+ * @records: the buffered accesses, oldest first
+ * @n_records: number of entries in @records
+ * @userdata: any user data attached to the buffer
+ *
+ * @records is only valid for the duration of the callback.
+ */
+typedef void (*qemu_plugin_vcpu_mem_buffer_cb_t)(
+    unsigned int vcpu_index,
+    const qemu_plugin_mem_record *records,
+    size_t n_records,
+    void *userdata);
+
+/**
+ * qemu_plugin_mem_buffer_new() - alloc a per-vCPU memory access buffer
+ * @n_records: number of records buffered per vCPU before @cb is called
+ * @cb: callback consuming the buffered records
+ * @userdata: opaque pointer passed to @cb
+ *
+ * Memory accesses instrumented with qemu_plugin_register_vcpu_mem_buffer()
+ * are appended to the buffer of the executing vCPU by generated code. @cb
+ * is called with a batch of records when a vCPU's buffer is full, when the
+ * vCPU idles or exits, before the atexit callbacks run, and when
+ * qemu_plugin_mem_buffer_flush() is called.
+ *
+ * Returns a pointer to a new buffer. It must be freed using
+ * qemu_plugin_mem_buffer_free().
+ */
+QEMU_PLUGIN_API
+struct qemu_plugin_mem_buffer *
+qemu_plugin_mem_buffer_new(size_t n_records,
+                           qemu_plugin_vcpu_mem_buffer_cb_t cb,
+                           void *userdata);
+
+/**
+ * qemu_plugin_mem_buffer_free() - free a memory access buffer
+ * @buf: buffer to free
+ *
+ * Records still pending in @buf are discarded.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf);
+
+/**
+ * qemu_plugin_mem_buffer_flush() - deliver pending records of a vCPU
+ * @buf: buffer to flush
+ * @vcpu_index: vCPU whose records are delivered
+ *
+ * This must be called from the vCPU @vcpu_index itself, or when that vCPU
+ * is not running (e.g. from an atexit callback).
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_buffer_flush(struct qemu_plugin_mem_buffer *buf,
+                                  unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_register_vcpu_mem_buffer() - buffer memory accesses of an insn
+ * @insn: handle for instruction to instrument
+ * @buf: buffer receiving the records
+ * @rw: record reads, writes or both
+ * @userdata: value stored in each record, e.g. to identify @insn
+ *
+ * This records every memory access generated by the instruction into
+ * @buf. Unlike qemu_plugin_register_vcpu_mem_cb() no call out of
+ * generated code happens for each access, the plugin is instead called
+ * with batches of records.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_buffer(struct qemu_plugin_insn *insn,
+                                          struct qemu_plugin_mem_buffer *buf,
+                                          enum qemu_plugin_mem_rw rw,
+                                          uint64_t userdata);
+
 /**
  * qemu_plugin_request_time_control() - request the ability to control time
  *
@@ -64,6 +64,16 @@ struct rcu_reader_data {
 
     /* Data used for registry, protected by rcu_registry_lock */
     QLIST_ENTRY(rcu_reader_data) node;
+    bool registered;
+
+    /*
+     * Callbacks queued by this thread with call_rcu1(), newest first.
+     * The call_rcu thread takes the whole list at once.  cbs_queued is
+     * only written by this thread, cbs_taken only under rcu_registry_lock.
+     */
+    struct rcu_head *cbs;
+    unsigned cbs_queued;
+    unsigned cbs_taken;
 
     /*
      * NotifierList used to force an RCU grace period.  Accessed under
@@ -120,6 +130,36 @@ static inline void rcu_read_unlock(void)
 
 void synchronize_rcu(void);
 
+/*
+ * Like synchronize_rcu(), but also ask readers that are inside a
+ * read-side critical section to leave it as soon as possible, through
+ * their force-RCU notifiers.  Use it when the caller is waiting on the
+ * grace period, rather than just freeing memory.  The barriers go
+ * through sys_membarrier's private expedited command where the kernel
+ * has it, and fall back to smp_mb_global()'s usual implementation.
+ */
+void synchronize_rcu_expedited(void);
+
+/*
+ * Grace period statistics.  Durations are in nanoseconds; bucket i of
+ * the histogram counts grace periods that lasted less than 2^i
+ * microseconds but not less than 2^(i-1).  A grace period is expedited
+ * if it was run by synchronize_rcu_expedited(), or started while
+ * drain_call_rcu() was waiting.
+ */
+#define RCU_STATS_HIST_BUCKETS 32
+
+typedef struct RCUStats {
+    uint64_t grace_periods;
+    uint64_t expedited_grace_periods;
+    uint64_t grace_period_ns;
+    uint64_t max_grace_period_ns;
+    uint64_t grace_period_hist[RCU_STATS_HIST_BUCKETS];
+    uint64_t callbacks;
+} RCUStats;
+
+void rcu_get_stats(RCUStats *stats);
+
 /*
  * Reader thread registration.
  */
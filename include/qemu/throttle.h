@@ -156,8 +156,17 @@ bool throttle_schedule_timer(ThrottleState *ts,
                              ThrottleTimers *tt,
                              ThrottleDirection direction);
 
+int64_t throttle_compute_delay(ThrottleState *ts, ThrottleDirection direction,
+                               int64_t now);
+
+void throttle_compute_headroom(ThrottleState *ts, ThrottleDirection direction,
+                               int64_t now, double *bytes, double *units);
+
 void throttle_account(ThrottleState *ts, ThrottleDirection direction,
                       uint64_t size);
+
+void throttle_charge(ThrottleState *ts, ThrottleDirection direction,
+                     double bytes, double units);
 void throttle_limits_to_config(ThrottleLimits *arg, ThrottleConfig *cfg,
                                Error **errp);
 void throttle_config_to_limits(ThrottleConfig *cfg, ThrottleLimits *var);
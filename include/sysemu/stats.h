@@ -42,4 +42,45 @@ void add_stats_schema(StatsSchemaList **, StatsProvider, StatsTarget,
  */
 bool apply_str_list_filter(const char *string, strList *list);
 
+/*
+ * Description of a statistic whose value is a uint64_t at @offset in a
+ * structure of the provider, or an array of @length uint64_t buckets if
+ * @type is a histogram.  If @exponent is not zero, the unit is seconds
+ * with that decimal exponent; otherwise the value has no unit.
+ */
+typedef struct StatsDesc {
+    const char *name;
+    StatsType type;
+    int exponent;
+    size_t offset;
+    unsigned int length;
+} StatsDesc;
+
+/*
+ * Append to *@list the statistics in the @n entries of @desc whose names
+ * pass the @names filter, taking their values from @values.
+ */
+void add_stats_from_desc(StatsList **list, strList *names,
+                         const StatsDesc *desc, size_t n, const void *values);
+
+/*
+ * Return the schema for the @n statistics in @desc, in the same order.
+ */
+StatsSchemaValueList *stats_schema_from_desc(const StatsDesc *desc, size_t n);
+
+/*
+ * Register the statistics of the RCU subsystem.
+ */
+void rcu_stats_init(void);
+
+/*
+ * Register the statistics of the coroutine pool.
+ */
+void coroutine_pool_stats_init(void);
+
+/*
+ * Register the latency percentiles of the block devices.
+ */
+void block_stats_init(void);
+
 #endif /* STATS_H */
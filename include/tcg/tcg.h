@@ -526,6 +526,11 @@ struct TCGContext {
 #ifdef TCG_TARGET_NEED_POOL_LABELS
     struct TCGLabelPoolData *pool_labels;
 #endif
+#ifdef TCG_TARGET_NEED_PEEPHOLE
+    const tcg_insn_unit *peep_ptr;
+    TCGReg peep_reg;
+    unsigned peep_state;
+#endif
 
     TCGLabel *exitreq_label;
 
@@ -0,0 +1,133 @@
+/*
+ * Pluggable video encoders for remote displays
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#ifndef UI_VIDEO_ENCODER_H
+#define UI_VIDEO_ENCODER_H
+
+#include "ui/qemu-pixman.h"
+
+typedef struct VideoEncoder VideoEncoder;
+typedef struct VideoEncoderDriver VideoEncoderDriver;
+
+/*
+ * A video encoder turns successive frames of a display surface into a
+ * compressed bitstream.  The frames must all have the size that was given
+ * to video_encoder_new() and use the PIXMAN_x8r8g8b8 format.
+ *
+ * Besides the codec, the encoder paces frames to a maximum rate and adapts
+ * the bitrate to the link: the caller reports how much encoded data is
+ * still waiting to be sent with video_encoder_feedback(), and the bitrate
+ * is lowered when a backlog builds up and raised again when it drains.
+ */
+struct VideoEncoderDriver {
+    const char *name;
+    /* Drivers with higher priority are preferred when none is requested */
+    int priority;
+    /* Size of the driver's state, which starts with a VideoEncoder */
+    size_t instance_size;
+
+    /* Prepare @enc->width x @enc->height frames at @enc->bitrate kbit/s */
+    bool (*init)(VideoEncoder *enc, Error **errp);
+    void (*finalize)(VideoEncoder *enc);
+    /* Append the compressed frame to @out */
+    bool (*encode)(VideoEncoder *enc, pixman_image_t *image, bool keyframe,
+                   GByteArray *out, Error **errp);
+    /* Apply a new value of @enc->bitrate; may be NULL */
+    void (*set_bitrate)(VideoEncoder *enc);
+};
+
+struct VideoEncoder {
+    const VideoEncoderDriver *drv;
+    int width;
+    int height;
+
+    /* Frame pacing */
+    unsigned fps;
+    int64_t next_frame_ns;
+
+    /* Adaptive bitrate, in kbit/s */
+    uint32_t bitrate;
+    uint32_t min_bitrate;
+    uint32_t max_bitrate;
+    unsigned idle_frames;
+
+    bool keyframe;
+    uint64_t frames;
+};
+
+#define VIDEO_ENCODER_DEFAULT_FPS        30
+#define VIDEO_ENCODER_DEFAULT_BITRATE    4000
+#define VIDEO_ENCODER_MIN_BITRATE        250
+#define VIDEO_ENCODER_MAX_BITRATE        40000
+
+void video_encoder_register(const VideoEncoderDriver *drv);
+
+/**
+ * video_encoder_available:
+ * @name: name of the driver, or NULL for any driver suitable for clients
+ *
+ * Returns whether video_encoder_new() can succeed for @name.  The "null"
+ * driver, which produces no output and only exists for testing, is only
+ * used when requested by name.
+ */
+bool video_encoder_available(const char *name);
+
+/**
+ * video_encoder_new:
+ * @name: name of the driver, or NULL for the best available one
+ * @width: width of the frames
+ * @height: height of the frames
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Returns a new encoder, or NULL on failure.  The first frame it produces
+ * is a keyframe.
+ */
+VideoEncoder *video_encoder_new(const char *name, int width, int height,
+                                Error **errp);
+void video_encoder_free(VideoEncoder *enc);
+
+/**
+ * video_encoder_frame_due:
+ * @enc: the encoder
+ * @now: the current time in nanoseconds, on QEMU_CLOCK_REALTIME
+ *
+ * Returns whether enough time passed since the last frame to encode
+ * another one at the configured frame rate.  Unlike the other functions,
+ * this can be called while another thread is encoding a frame.
+ */
+bool video_encoder_frame_due(VideoEncoder *enc, int64_t now);
+
+/* Like video_encoder_frame_due(), but returns how long to wait, or 0 */
+int64_t video_encoder_frame_delay(VideoEncoder *enc, int64_t now);
+
+/**
+ * video_encoder_encode:
+ * @enc: the encoder
+ * @image: the frame to encode
+ * @now: the current time in nanoseconds, on QEMU_CLOCK_REALTIME
+ * @out: buffer to which the compressed frame is appended
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Returns false on failure.
+ */
+bool video_encoder_encode(VideoEncoder *enc, pixman_image_t *image,
+                          int64_t now, GByteArray *out, Error **errp);
+
+/* Make the next frame a keyframe, e.g. after packet loss or a new viewer */
+void video_encoder_request_keyframe(VideoEncoder *enc);
+
+/**
+ * video_encoder_feedback:
+ * @enc: the encoder
+ * @backlog: number of encoded bytes not yet sent to the client
+ *
+ * Adapt the bitrate to the throughput of the link.  Call it once per frame.
+ */
+void video_encoder_feedback(VideoEncoder *enc, size_t backlog);
+
+#endif
@@ -19,6 +19,7 @@
 #include "block/block.h"
 #include "sysemu/event-loop-base.h"
 #include "sysemu/iothread.h"
+#include "sysemu/block-backend.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-misc.h"
 #include "qemu/error-report.h"
@@ -126,6 +127,7 @@ static void iothread_instance_finalize(Object *obj)
      * GSources first before destroying any GMainContext.
      */
     if (iothread->ctx) {
+        blk_forget_aio_context_stats(iothread->ctx);
         aio_context_unref(iothread->ctx);
         iothread->ctx = NULL;
     }
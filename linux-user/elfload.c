@@ -14,6 +14,7 @@
 #include "signal-common.h"
 #include "loader.h"
 #include "user-mmap.h"
+#include "vdso-data.h"
 #include "disas/disas.h"
 #include "qemu/bitops.h"
 #include "qemu/path.h"
@@ -52,6 +53,7 @@ typedef struct {
     unsigned reloc_count;
     unsigned sigreturn_ofs;
     unsigned rt_sigreturn_ofs;
+    unsigned data_ofs;
 } VdsoImageInfo;
 
 #define ELF_OSABI   ELFOSABI_SYSV
@@ -330,6 +332,22 @@ static void elf_core_copy_regs(target_elf_gregset_t *regs, const CPUX86State *en
 
 #define VDSO_HEADER "vdso.c.inc"
 
+/*
+ * The vdso reads the clock with rdtsc, which is cpu_get_host_ticks(),
+ * and the cpu number with rdtscp, if the cpu model has it.
+ */
+static uint32_t vdso_data_flags(void)
+{
+    X86CPU *cpu = X86_CPU(thread_cpu);
+    uint32_t flags = VDSO_DATA_F_CLOCK;
+
+    if (cpu->env.features[FEAT_8000_0001_EDX] & CPUID_EXT2_RDTSCP) {
+        flags |= VDSO_DATA_F_GETCPU;
+    }
+    return flags;
+}
+#define VDSO_DATA_FLAGS vdso_data_flags()
+
 #define USE_ELF_CORE_DUMP
 #define ELF_EXEC_PAGESIZE       4096
 
@@ -3526,6 +3544,10 @@ static void load_elf_interp(const char *filename, struct image_info *info,
 #define  vdso_image_info()  NULL
 #endif
 
+#ifndef VDSO_DATA_FLAGS
+#define VDSO_DATA_FLAGS 0
+#endif
+
 static void load_elf_vdso(struct image_info *info, const VdsoImageInfo *vdso)
 {
     ImageSource src;
@@ -3563,6 +3585,11 @@ static void load_elf_vdso(struct image_info *info, const VdsoImageInfo *vdso)
     /* Remove write from VDSO segment. */
     target_mprotect(info->start_data, info->end_data - info->start_data,
                     PROT_READ | PROT_EXEC);
+
+    /* Publish the data page, if present; this also makes it non-executable. */
+    if (vdso->data_ofs) {
+        vdso_data_init(load_addr + vdso->data_ofs, VDSO_DATA_FLAGS);
+    }
 }
 
 static int symfind(const void *s0, const void *s1)
@@ -33,9 +33,11 @@ static void output_reloc(FILE *outf, void *buf, void *loc)
 
 static const char *sigreturn_sym;
 static const char *rt_sigreturn_sym;
+static const char *data_sym;
 
 static unsigned sigreturn_addr;
 static unsigned rt_sigreturn_addr;
+static unsigned data_addr;
 
 #define N 32
 #define elfN(x)  elf32_##x
@@ -65,11 +67,14 @@ int main(int argc, char **argv)
     bool need_bswap;
 
     while (1) {
-        int opt = getopt(argc, argv, "o:p:r:s:");
+        int opt = getopt(argc, argv, "d:o:p:r:s:");
         if (opt < 0) {
             break;
         }
         switch (opt) {
+        case 'd':
+            data_sym = optarg;
+            break;
         case 'o':
             outf_name = optarg;
             break;
@@ -85,7 +90,8 @@ int main(int argc, char **argv)
         default:
         usage:
             fprintf(stderr, "usage: [-p prefix] [-r rt-sigreturn-name] "
-                    "[-s sigreturn-name] -o output-file input-file\n");
+                    "[-s sigreturn-name] [-d data-name] "
+                    "-o output-file input-file\n");
             return EXIT_FAILURE;
         }
     }
@@ -203,6 +209,7 @@ int main(int argc, char **argv)
     fprintf(outf, "    .reloc_count = ARRAY_SIZE(%s_relocs),\n", prefix);
     fprintf(outf, "    .sigreturn_ofs = 0x%x,\n", sigreturn_addr);
     fprintf(outf, "    .rt_sigreturn_ofs = 0x%x,\n", rt_sigreturn_addr);
+    fprintf(outf, "    .data_ofs = 0x%x,\n", data_addr);
     fprintf(outf, "};\n");
 
     /*
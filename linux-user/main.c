@@ -55,6 +55,8 @@
 #include "signal-common.h"
 #include "loader.h"
 #include "user-mmap.h"
+#include "vdso-data.h"
+#include "tb-profile.h"
 #include "tcg/perf.h"
 #include "exec/page-vary.h"
 
@@ -144,8 +146,10 @@ void fork_start(void)
 {
     start_exclusive();
     mmap_fork_start();
+    tb_profile_fork_start();
     cpu_list_lock();
     qemu_plugin_user_prefork_lock();
+    vdso_data_fork_start();
     gdbserver_fork_start();
 }
 
@@ -154,6 +158,8 @@ void fork_end(pid_t pid)
     bool child = pid == 0;
 
     qemu_plugin_user_postfork(child);
+    vdso_data_fork_end(child);
+    tb_profile_fork_end(child);
     mmap_fork_end(child);
     if (child) {
         CPUState *cpu, *next_cpu;
@@ -451,6 +457,13 @@ static void handle_arg_jitdump(const char *arg)
     perf_enable_jitdump();
 }
 
+static const char *tb_profile_path;
+
+static void handle_arg_tb_profile(const char *arg)
+{
+    tb_profile_path = arg;
+}
+
 static QemuPluginList plugins = QTAILQ_HEAD_INITIALIZER(plugins);
 
 #ifdef CONFIG_PLUGIN
@@ -526,6 +539,8 @@ static const struct qemu_argument arg_table[] = {
      "",           "Generate a /tmp/perf-${pid}.map file for perf"},
     {"jitdump",    "QEMU_JITDUMP",     false, handle_arg_jitdump,
      "",           "Generate a jit-${pid}.dump file for perf"},
+    {"tb-profile", "QEMU_TB_PROFILE",  true,  handle_arg_tb_profile,
+     "file",       "pre-translate code recorded in 'file', then update it"},
     {NULL, NULL, false, NULL, NULL, NULL}
 };
 
@@ -738,6 +753,17 @@ int main(int argc, char **argv, char **envp)
     }
     trace_init_file();
     qemu_plugin_load_list(&plugins, &error_fatal);
+    if (tb_profile_path) {
+        /*
+         * Plugins instrument TBs per vCPU, and the pre-translation worker
+         * is not one: its TBs would miss the instrumentation.
+         */
+        if (!QTAILQ_EMPTY(&plugins)) {
+            error_report("-tb-profile cannot be used with plugins");
+            exit(EXIT_FAILURE);
+        }
+        tb_profile_init(tb_profile_path);
+    }
 
     /* Zero out regs */
     memset(regs, 0, sizeof(struct target_pt_regs));
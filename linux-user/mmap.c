@@ -24,6 +24,7 @@
 #include "qemu.h"
 #include "user-internals.h"
 #include "user-mmap.h"
+#include "tb-profile.h"
 #include "target_mman.h"
 #include "qemu/interval-tree.h"
 
@@ -1010,6 +1011,10 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
         }
     }
 
+    if (ret != -1 && (target_prot & PROT_EXEC) && !(flags & MAP_ANONYMOUS)) {
+        tb_profile_mmap(ret, len, fd, offset);
+    }
+
     return ret;
 }
 
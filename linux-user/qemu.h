@@ -153,6 +153,11 @@ struct TaskState {
      * from multiple threads.)
      */
     int signal_pending;
+    /*
+     * True if block_signals() has blocked all host signals and
+     * process_pending_signals() has not unblocked them yet.
+     */
+    bool host_signals_blocked;
 
     /* This thread's sigaltstack, if it has one */
     struct target_sigaltstack sigaltstack_used;
@@ -183,8 +183,11 @@ int block_signals(void)
      * run any further guest code before unblocking signals in
      * process_pending_signals().
      */
-    sigfillset(&set);
-    sigprocmask(SIG_SETMASK, &set, 0);
+    if (!ts->host_signals_blocked) {
+        sigfillset(&set);
+        sigprocmask(SIG_SETMASK, &set, 0);
+        ts->host_signals_blocked = true;
+    }
 
     return qatomic_xchg(&ts->signal_pending, 1);
 }
@@ -205,33 +208,45 @@ int do_sigprocmask(int how, const sigset_t *set, sigset_t *oldset)
     }
 
     if (set) {
+        sigset_t mask = ts->signal_mask;
         int i;
 
-        if (block_signals()) {
-            return -QEMU_ERESTARTSYS;
-        }
-
         switch (how) {
         case SIG_BLOCK:
-            sigorset(&ts->signal_mask, &ts->signal_mask, set);
+            sigorset(&mask, &mask, set);
             break;
         case SIG_UNBLOCK:
             for (i = 1; i <= NSIG; ++i) {
                 if (sigismember(set, i)) {
-                    sigdelset(&ts->signal_mask, i);
+                    sigdelset(&mask, i);
                 }
             }
             break;
         case SIG_SETMASK:
-            ts->signal_mask = *set;
+            mask = *set;
             break;
         default:
             g_assert_not_reached();
         }
 
         /* Silently ignore attempts to change blocking status of KILL or STOP */
-        sigdelset(&ts->signal_mask, SIGKILL);
-        sigdelset(&ts->signal_mask, SIGSTOP);
+        sigdelset(&mask, SIGKILL);
+        sigdelset(&mask, SIGSTOP);
+
+        /*
+         * Guest libraries and runtimes often reinstate the mask that is
+         * already in place.  Only this thread writes signal_mask, so that
+         * needs neither blocking host signals nor a trip through
+         * process_pending_signals().
+         */
+        if (!memcmp(&mask, &ts->signal_mask, sizeof(mask))) {
+            return 0;
+        }
+
+        if (block_signals()) {
+            return -QEMU_ERESTARTSYS;
+        }
+        ts->signal_mask = mask;
     }
     return 0;
 }
@@ -1030,7 +1045,11 @@ static void host_signal_handler(int host_sig, siginfo_t *info, void *puc)
     sigdelset(sigmask, SIGSEGV);
     sigdelset(sigmask, SIGBUS);
 
-    /* interrupt the virtual CPU as soon as possible */
+    /*
+     * Interrupt the virtual CPU as soon as possible.  This only stops the
+     * current TB at its next exit check: execution resumes from the TB
+     * cache, and nothing is retranslated.
+     */
     cpu_exit(thread_cpu);
 }
 
@@ -1275,8 +1294,11 @@ void process_pending_signals(CPUArchState *cpu_env)
     sigset_t *blocked_set;
 
     while (qatomic_read(&ts->signal_pending)) {
-        sigfillset(&set);
-        sigprocmask(SIG_SETMASK, &set, 0);
+        /* Signals blocked by block_signals() need no blocking again. */
+        if (!ts->host_signals_blocked) {
+            sigfillset(&set);
+            sigprocmask(SIG_SETMASK, &set, 0);
+        }
 
     restart_scan:
         sig = ts->sync_signal.pending;
@@ -1306,10 +1328,16 @@ void process_pending_signals(CPUArchState *cpu_env)
                 (!sigismember(blocked_set,
                               target_to_host_signal_table[sig]))) {
                 handle_pending_signal(cpu_env, sig, &ts->sigtab[sig - 1]);
-                /* Restart scan from the beginning, as handle_pending_signal
-                 * might have resulted in a new synchronous signal (eg SIGSEGV).
+                /*
+                 * Restart scan from the beginning if handle_pending_signal
+                 * resulted in a new synchronous signal (eg SIGSEGV).
+                 * Otherwise keep delivering the remaining signals in this
+                 * pass: host signals are blocked, so no new lower-numbered
+                 * signal can have arrived meanwhile.
                  */
-                goto restart_scan;
+                if (ts->sync_signal.pending) {
+                    goto restart_scan;
+                }
             }
         }
 
@@ -1322,6 +1350,7 @@ void process_pending_signals(CPUArchState *cpu_env)
         set = ts->signal_mask;
         sigdelset(&set, SIGSEGV);
         sigdelset(&set, SIGBUS);
+        ts->host_signals_blocked = false;
         sigprocmask(SIG_SETMASK, &set, 0);
     }
     ts->in_sigsuspend = 0;
@@ -144,6 +144,7 @@
 #include "qapi/error.h"
 #include "fd-trans.h"
 #include "cpu_loop-common.h"
+#include "vdso-data.h"
 
 #ifndef CLONE_IO
 #define CLONE_IO                0x80000000      /* Clone io context */
@@ -9366,6 +9367,7 @@ static abi_long do_syscall1(CPUArchState *cpu_env, int num, abi_long arg1,
     case TARGET_NR_time:
         {
             time_t host_time;
+            vdso_data_update();
             ret = get_errno(time(&host_time));
             if (!is_error(ret)
                 && arg1
@@ -10333,6 +10335,7 @@ static abi_long do_syscall1(CPUArchState *cpu_env, int num, abi_long arg1,
             struct timeval tv;
             struct timezone tz;
 
+            vdso_data_update();
             ret = get_errno(gettimeofday(&tv, &tz));
             if (!is_error(ret)) {
                 if (arg1 && copy_to_user_timeval(arg1, &tv)) {
@@ -12704,6 +12707,7 @@ static abi_long do_syscall1(CPUArchState *cpu_env, int num, abi_long arg1,
     case TARGET_NR_clock_gettime:
     {
         struct timespec ts;
+        vdso_data_update();
         ret = get_errno(clock_gettime(arg1, &ts));
         if (!is_error(ret)) {
             ret = host_to_target_timespec(arg2, &ts);
@@ -12715,6 +12719,7 @@ static abi_long do_syscall1(CPUArchState *cpu_env, int num, abi_long arg1,
     case TARGET_NR_clock_gettime64:
     {
         struct timespec ts;
+        vdso_data_update();
         ret = get_errno(clock_gettime(arg1, &ts));
         if (!is_error(ret)) {
             ret = host_to_target_timespec64(arg2, &ts);
@@ -13755,6 +13760,116 @@ static abi_long do_syscall1(CPUArchState *cpu_env, int num, abi_long arg1,
     return ret;
 }
 
+/*
+ * When guest and host are the same architecture with the same ABI, the
+ * syscall numbers and structure layouts are identical, and some syscalls
+ * need nothing but guest-to-host pointer translation.  Dispatch those
+ * directly, bypassing do_syscall1().
+ */
+#if (defined(TARGET_X86_64) && defined(__x86_64__)) || \
+    (defined(TARGET_AARCH64) && defined(__aarch64__))
+#if TARGET_BIG_ENDIAN == HOST_BIG_ENDIAN && TARGET_ABI_BITS == HOST_LONG_BITS
+#define SYSCALL_PASSTHROUGH
+#endif
+#endif
+
+#ifdef SYSCALL_PASSTHROUGH
+typedef enum {
+    PT_KIND_VAL,        /* passed unchanged */
+    PT_KIND_FD,         /* file descriptor without an fd translator */
+    PT_KIND_IN,         /* buffer read by the host kernel */
+    PT_KIND_OUT,        /* buffer written by the host kernel */
+} PassthroughArgKind;
+
+typedef struct PassthroughArg {
+    uint8_t kind;
+    uint8_t len_arg;    /* 1-based argument holding the buffer size, or 0 */
+    uint16_t size;      /* buffer size if len_arg is 0 */
+} PassthroughArg;
+
+typedef struct PassthroughSyscall {
+    bool valid;
+    PassthroughArg args[6];
+} PassthroughSyscall;
+
+#define PT_VAL          { PT_KIND_VAL }
+#define PT_FD           { PT_KIND_FD }
+#define PT_IN(N)        { PT_KIND_IN, N }
+#define PT_OUT(N)       { PT_KIND_OUT, N }
+#define PT_IN_SIZE(T)   { PT_KIND_IN, 0, sizeof(T) }
+#define PT_OUT_SIZE(T)  { PT_KIND_OUT, 0, sizeof(T) }
+
+static const PassthroughSyscall passthrough_syscalls[] = {
+#define P(NAME, ...)  [TARGET_NR_##NAME] = { true, { __VA_ARGS__ } },
+#include "passthrough.c.inc"
+#undef P
+};
+
+/*
+ * Forward syscall @num directly to the host if it is listed in
+ * passthrough.c.inc.  Return false if it must be emulated instead.
+ */
+static bool do_syscall_passthrough(CPUState *cpu, int num, abi_long *ret,
+                                   abi_long arg1, abi_long arg2,
+                                   abi_long arg3, abi_long arg4,
+                                   abi_long arg5, abi_long arg6)
+{
+    const abi_long args[6] = { arg1, arg2, arg3, arg4, arg5, arg6 };
+    const PassthroughSyscall *pt;
+    long host_args[6];
+    int i;
+
+    if (num < 0 || num >= ARRAY_SIZE(passthrough_syscalls)) {
+        return false;
+    }
+    pt = &passthrough_syscalls[num];
+    if (!pt->valid) {
+        return false;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(args); i++) {
+        const PassthroughArg *a = &pt->args[i];
+        abi_ulong len;
+
+        switch (a->kind) {
+        case PT_KIND_VAL:
+            host_args[i] = args[i];
+            break;
+        case PT_KIND_FD:
+            if (fd_trans_target_to_host_data(args[i]) ||
+                fd_trans_host_to_target_data(args[i])) {
+                return false;
+            }
+            host_args[i] = args[i];
+            break;
+        case PT_KIND_IN:
+        case PT_KIND_OUT:
+            if (args[i] == 0) {
+                /* Let the host kernel decide whether NULL is valid. */
+                host_args[i] = 0;
+                break;
+            }
+            len = a->len_arg ? args[a->len_arg - 1] : a->size;
+            if (!access_ok(cpu, a->kind == PT_KIND_IN ? VERIFY_READ
+                                                      : VERIFY_WRITE,
+                           args[i], len)) {
+                *ret = -TARGET_EFAULT;
+                return true;
+            }
+            host_args[i] = (long)g2h(cpu, args[i]);
+            break;
+        default:
+            g_assert_not_reached();
+        }
+    }
+
+    *ret = get_errno(safe_syscall(num, host_args[0], host_args[1],
+                                  host_args[2], host_args[3],
+                                  host_args[4], host_args[5]));
+    return true;
+}
+#endif
+
 abi_long do_syscall(CPUArchState *cpu_env, int num, abi_long arg1,
                     abi_long arg2, abi_long arg3, abi_long arg4,
                     abi_long arg5, abi_long arg6, abi_long arg7,
@@ -13784,8 +13899,14 @@ abi_long do_syscall(CPUArchState *cpu_env, int num, abi_long arg1,
         print_syscall(cpu_env, num, arg1, arg2, arg3, arg4, arg5, arg6);
     }
 
-    ret = do_syscall1(cpu_env, num, arg1, arg2, arg3, arg4,
-                      arg5, arg6, arg7, arg8);
+#ifdef SYSCALL_PASSTHROUGH
+    if (!do_syscall_passthrough(cpu, num, &ret, arg1, arg2, arg3,
+                                arg4, arg5, arg6))
+#endif
+    {
+        ret = do_syscall1(cpu_env, num, arg1, arg2, arg3, arg4,
+                          arg5, arg6, arg7, arg8);
+    }
 
     if (unlikely(qemu_loglevel_mask(LOG_STRACE))) {
         print_syscall_ret(cpu_env, num, ret, arg1, arg2,
@@ -0,0 +1,482 @@
+/*
+ * Profile-guided pre-translation.
+ *
+ * The profile is a text file.  It starts with a line naming the target,
+ * followed by one group of lines per mapped file:
+ *
+ *   file <inode> <path>
+ *   <offset> <cs_base> <flags>
+ *   ...
+ *
+ * with all numbers in hex.  Groups for files that this process did not
+ * map are carried over to the new profile without being parsed.
+ *
+ * Concurrent runs share the profile: each one merges what the others
+ * wrote since it started, under "<profile>.lock", before replacing it.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include <sys/file.h>
+#include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/rcu.h"
+#include "qemu/selfmap.h"
+#include "exec/exec-all.h"
+#include "tcg/startup.h"
+#include "tcg/tcg.h"
+#include "qemu.h"
+#include "user-internals.h"
+#include "tb-profile.h"
+#include "trace.h"
+
+#define TB_PROFILE_HEADER   "qemu-" TARGET_NAME " tb profile 1\n"
+
+/* Bound the growth of the profile, which every process reads. */
+#define TB_PROFILE_MAX_ENTRIES  (64 * 1024)
+
+typedef struct TbProfileEntry {
+    uint64_t offset;
+    uint64_t cs_base;
+    uint32_t flags;
+} TbProfileEntry;
+
+typedef struct TbProfileFile {
+    uint64_t inode;
+    /* The entry lines as read from the profile, until parsed. */
+    const char *text;
+    const char *text_end;
+    /* A set of TbProfileEntry, once parsed. */
+    GHashTable *entries;
+} TbProfileFile;
+
+typedef struct TbProfileWork {
+    vaddr pc;
+    uint64_t cs_base;
+    uint32_t flags;
+    uint32_t cflags;
+} TbProfileWork;
+
+static char *profile_path;
+/* The profiles read so far, which unparsed groups point into. */
+static GPtrArray *profile_contents;
+static bool profile_dirty;
+
+/* Protects everything below, and the files' entries. */
+static QemuMutex profile_lock;
+static QemuCond work_cond;
+static GHashTable *profile_files;
+static GArray *work;
+static CPUState *worker_cpu;
+static bool worker_running;
+
+static guint tb_profile_entry_hash(gconstpointer p)
+{
+    const TbProfileEntry *e = p;
+
+    return e->offset ^ (e->offset >> 32) ^ e->cs_base ^ e->flags;
+}
+
+static gboolean tb_profile_entry_equal(gconstpointer a, gconstpointer b)
+{
+    const TbProfileEntry *ea = a, *eb = b;
+
+    return ea->offset == eb->offset &&
+           ea->cs_base == eb->cs_base &&
+           ea->flags == eb->flags;
+}
+
+static void tb_profile_file_free(gpointer p)
+{
+    TbProfileFile *f = p;
+
+    if (f->entries) {
+        g_hash_table_destroy(f->entries);
+    }
+    g_free(f);
+}
+
+static TbProfileFile *tb_profile_file_new(const char *path, uint64_t inode)
+{
+    TbProfileFile *f = g_new0(TbProfileFile, 1);
+
+    f->inode = inode;
+    g_hash_table_replace(profile_files, g_strdup(path), f);
+    return f;
+}
+
+static bool tb_profile_parse_hex(const char **p, char sep, uint64_t *val)
+{
+    char *end;
+
+    *val = g_ascii_strtoull(*p, &end, 16);
+    if (end == *p || *end != sep) {
+        return false;
+    }
+    *p = end + 1;
+    return true;
+}
+
+static void tb_profile_file_parse(TbProfileFile *f)
+{
+    const char *p = f->text;
+
+    if (f->entries) {
+        return;
+    }
+    f->entries = g_hash_table_new_full(tb_profile_entry_hash,
+                                       tb_profile_entry_equal, g_free, NULL);
+
+    while (p && p < f->text_end) {
+        const char *eol = strchrnul(p, '\n');
+        const char *next = *eol ? eol + 1 : eol;
+        uint64_t offset, cs_base, flags;
+
+        if (tb_profile_parse_hex(&p, ' ', &offset) &&
+            tb_profile_parse_hex(&p, ' ', &cs_base) &&
+            tb_profile_parse_hex(&p, '\n', &flags) &&
+            g_hash_table_size(f->entries) < TB_PROFILE_MAX_ENTRIES) {
+            TbProfileEntry e = {
+                .offset = offset, .cs_base = cs_base, .flags = flags
+            };
+            g_hash_table_add(f->entries, g_memdup2(&e, sizeof(e)));
+        }
+        p = next;
+    }
+    f->text = NULL;
+}
+
+/*
+ * Add a group read from the profile.  One for a file that this process
+ * recorded or mapped, and whose entries are therefore parsed, is merged
+ * into them if it names the same inode and dropped otherwise.
+ */
+static void tb_profile_add_group(const char *path, uint64_t inode,
+                                 const char *text, const char *text_end)
+{
+    TbProfileFile *f = g_hash_table_lookup(profile_files, path);
+    TbProfileFile other = { .text = text, .text_end = text_end };
+    GHashTableIter iter;
+    TbProfileEntry *e;
+
+    if (!f || !f->entries) {
+        f = tb_profile_file_new(path, inode);
+        f->text = text;
+        f->text_end = text_end;
+        return;
+    }
+    if (f->inode != inode) {
+        return;
+    }
+
+    tb_profile_file_parse(&other);
+    g_hash_table_iter_init(&iter, other.entries);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&e, NULL)) {
+        g_hash_table_iter_steal(&iter);
+        if (g_hash_table_size(f->entries) < TB_PROFILE_MAX_ENTRIES &&
+            !g_hash_table_contains(f->entries, e)) {
+            g_hash_table_add(f->entries, e);
+        } else {
+            g_free(e);
+        }
+    }
+    g_hash_table_destroy(other.entries);
+}
+
+/* Only index the groups here; see tb_profile_file_parse(). */
+static void tb_profile_read(void)
+{
+    g_autofree char *file = NULL;
+    const char *p, *text = NULL;
+    uint64_t inode = 0;
+    char *contents;
+
+    if (!g_file_get_contents(profile_path, &contents, NULL, NULL)) {
+        return;
+    }
+    g_ptr_array_add(profile_contents, contents);
+    if (!g_str_has_prefix(contents, TB_PROFILE_HEADER)) {
+        /* A profile for another target: start afresh. */
+        return;
+    }
+
+    p = contents + strlen(TB_PROFILE_HEADER);
+    while (*p) {
+        const char *eol = strchrnul(p, '\n');
+
+        if (g_str_has_prefix(p, "file ")) {
+            if (file) {
+                tb_profile_add_group(file, inode, text, p);
+                g_clear_pointer(&file, g_free);
+            }
+            p += strlen("file ");
+            if (*eol && tb_profile_parse_hex(&p, ' ', &inode) && p < eol) {
+                file = g_strndup(p, eol - p);
+                text = eol + 1;
+            }
+        }
+        p = *eol ? eol + 1 : eol;
+    }
+    if (file) {
+        tb_profile_add_group(file, inode, text, p);
+    }
+}
+
+void tb_profile_init(const char *path)
+{
+    qemu_mutex_init(&profile_lock);
+    qemu_cond_init(&work_cond);
+    profile_path = g_strdup(path);
+    profile_contents = g_ptr_array_new_with_free_func(g_free);
+    profile_files = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                          g_free, tb_profile_file_free);
+    work = g_array_new(false, false, sizeof(TbProfileWork));
+
+    tb_profile_read();
+}
+
+static void *tb_profile_worker(void *opaque)
+{
+    CPUState *cpu = opaque;
+
+    rcu_register_thread();
+    tcg_register_thread();
+    thread_cpu = cpu;
+    current_cpu = cpu;
+
+    qemu_mutex_lock(&profile_lock);
+    while (true) {
+        TbProfileWork w;
+
+        while (work->len == 0) {
+            qemu_cond_wait(&work_cond, &profile_lock);
+        }
+        w = g_array_index(work, TbProfileWork, work->len - 1);
+        g_array_set_size(work, work->len - 1);
+
+        qemu_mutex_unlock(&profile_lock);
+        if (!tb_pretranslate(cpu, w.pc, w.cs_base, w.flags, w.cflags)) {
+            /* Try again when the next file is mapped. */
+            qemu_mutex_lock(&profile_lock);
+            g_array_set_size(work, 0);
+            continue;
+        }
+        qemu_mutex_lock(&profile_lock);
+    }
+    return NULL;
+}
+
+static void tb_profile_start_worker(void)
+{
+    QemuThread thread;
+
+    if (!worker_cpu) {
+        CPUState *cpu = cpu_create(object_get_typename(OBJECT(thread_cpu)));
+
+        cpu_reset(cpu);
+        /*
+         * The worker only lends its cpu to the translator.  It is not a
+         * guest thread, so keep it out of CPU_FOREACH.  This also gives
+         * its cpu_index back, for the next guest thread to reuse; only
+         * plugins would have seen it, and main() rejects them together
+         * with -tb-profile.
+         */
+        cpu_list_remove(cpu);
+        cpu->opaque = g_new0(TaskState, 1);
+        worker_cpu = cpu;
+    }
+    qemu_thread_create(&thread, "tb-profile", tb_profile_worker,
+                       worker_cpu, QEMU_THREAD_DETACHED);
+    worker_running = true;
+}
+
+void tb_profile_mmap(abi_ulong start, abi_ulong len, int fd, off_t offset)
+{
+    g_autofree char *link = NULL;
+    g_autofree char *path = NULL;
+    TbProfileFile *f;
+    GHashTableIter iter;
+    TbProfileEntry *e;
+    uint32_t cflags;
+    struct stat st;
+    guint queued;
+
+    if (!profile_files) {
+        return;
+    }
+    link = g_strdup_printf("/proc/self/fd/%d", fd);
+    path = g_file_read_link(link, NULL);
+    if (!path || fstat(fd, &st) != 0) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&profile_lock);
+
+    f = g_hash_table_lookup(profile_files, path);
+    if (!f || f->inode != st.st_ino) {
+        return;
+    }
+    tb_profile_file_parse(f);
+
+    cflags = curr_cflags(thread_cpu);
+    queued = work->len;
+    g_hash_table_iter_init(&iter, f->entries);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&e, NULL)) {
+        if (e->offset >= offset && e->offset - offset < len) {
+            TbProfileWork w = {
+                .pc = start + (e->offset - offset),
+                .cs_base = e->cs_base,
+                .flags = e->flags,
+                .cflags = cflags,
+            };
+            g_array_append_val(work, w);
+        }
+    }
+    if (work->len == queued) {
+        return;
+    }
+    trace_tb_profile_queue(path, start, work->len - queued);
+    if (!worker_running) {
+        tb_profile_start_worker();
+    }
+    qemu_cond_signal(&work_cond);
+}
+
+static gboolean tb_profile_add_tb(gpointer key, gpointer value, gpointer data)
+{
+    const TranslationBlock *tb = value;
+    IntervalTreeRoot *maps = data;
+    IntervalTreeNode *n;
+    TbProfileFile *f;
+    TbProfileEntry e;
+    MapInfo *mi;
+    uintptr_t host;
+
+    /* Only record the TBs that a normal run would look up. */
+    if (tb_cflags(tb) & (CF_COUNT_MASK | CF_INVALID | CF_NOIRQ | CF_PCREL)) {
+        return false;
+    }
+    if (!guest_addr_valid_untagged(tb->pc)) {
+        return false;
+    }
+
+    host = (uintptr_t)g2h_untagged(tb->pc);
+    n = interval_tree_iter_first(maps, host, host);
+    if (!n) {
+        return false;
+    }
+    mi = container_of(n, MapInfo, itree);
+    if (!mi->is_exec || !mi->path || mi->path[0] != '/' ||
+        g_str_has_suffix(mi->path, " (deleted)")) {
+        return false;
+    }
+
+    f = g_hash_table_lookup(profile_files, mi->path);
+    if (!f || f->inode != mi->inode) {
+        /* A new file, or one that has been replaced since. */
+        f = tb_profile_file_new(mi->path, mi->inode);
+    }
+    tb_profile_file_parse(f);
+
+    e.offset = mi->offset + (host - mi->itree.start);
+    e.cs_base = tb->cs_base;
+    e.flags = tb->flags;
+    if (g_hash_table_size(f->entries) < TB_PROFILE_MAX_ENTRIES &&
+        !g_hash_table_contains(f->entries, &e)) {
+        g_hash_table_add(f->entries, g_memdup2(&e, sizeof(e)));
+        profile_dirty = true;
+    }
+    return false;
+}
+
+void tb_profile_save(void)
+{
+    g_autoptr(GString) out = NULL;
+    g_autoptr(GError) err = NULL;
+    g_autofree char *lock_path = NULL;
+    IntervalTreeRoot *maps;
+    int lock_fd;
+    GHashTableIter iter;
+    const char *path;
+    TbProfileFile *f;
+
+    if (!profile_files) {
+        return;
+    }
+
+    maps = read_self_maps();
+    if (!maps) {
+        return;
+    }
+    WITH_MMAP_LOCK_GUARD() {
+        QEMU_LOCK_GUARD(&profile_lock);
+        tcg_tb_foreach(tb_profile_add_tb, maps);
+    }
+    free_self_maps(maps);
+
+    QEMU_LOCK_GUARD(&profile_lock);
+    if (!profile_dirty) {
+        return;
+    }
+
+    /* Merge what other runs wrote meanwhile; closing lock_fd unlocks. */
+    lock_path = g_strconcat(profile_path, ".lock", NULL);
+    lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd < 0 || flock(lock_fd, LOCK_EX) < 0) {
+        warn_report("could not lock TB profile: %s", strerror(errno));
+        if (lock_fd >= 0) {
+            close(lock_fd);
+        }
+        return;
+    }
+    tb_profile_read();
+
+    out = g_string_new(TB_PROFILE_HEADER);
+    g_hash_table_iter_init(&iter, profile_files);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&path, (gpointer *)&f)) {
+        g_string_append_printf(out, "file %" PRIx64 " %s\n", f->inode, path);
+        if (!f->entries) {
+            g_string_append_len(out, f->text, f->text_end - f->text);
+        } else {
+            GHashTableIter eiter;
+            TbProfileEntry *e;
+
+            g_hash_table_iter_init(&eiter, f->entries);
+            while (g_hash_table_iter_next(&eiter, (gpointer *)&e, NULL)) {
+                g_string_append_printf(out, "%" PRIx64 " %" PRIx64 " %x\n",
+                                       e->offset, e->cs_base, e->flags);
+            }
+        }
+    }
+
+    /* Replace the file atomically, as readers do not take the lock. */
+    if (!g_file_set_contents(profile_path, out->str, out->len, &err)) {
+        warn_report("could not write TB profile: %s", err->message);
+    }
+    close(lock_fd);
+    profile_dirty = false;
+}
+
+void tb_profile_fork_start(void)
+{
+    if (profile_files) {
+        qemu_mutex_lock(&profile_lock);
+    }
+}
+
+void tb_profile_fork_end(bool child)
+{
+    if (!profile_files) {
+        return;
+    }
+    if (child) {
+        /* The worker thread did not survive the fork. */
+        qemu_mutex_init(&profile_lock);
+        qemu_cond_init(&work_cond);
+        g_array_set_size(work, 0);
+        worker_running = false;
+    } else {
+        qemu_mutex_unlock(&profile_lock);
+    }
+}
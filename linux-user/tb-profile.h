@@ -0,0 +1,50 @@
+/*
+ * Profile-guided pre-translation.
+ *
+ * At exit, QEMU records where every TB in the code cache starts, as an
+ * offset into the file mapped at that address.  When a later process
+ * maps the same file for execution, those TBs are translated on a
+ * background thread, so that the guest finds them ready instead of
+ * translating them itself.  This mostly helps short-lived processes,
+ * such as the compiler invocations of a cross build, which otherwise
+ * spend much of their life translating the same library code.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef LINUX_USER_TB_PROFILE_H
+#define LINUX_USER_TB_PROFILE_H
+
+/**
+ * tb_profile_init:
+ * @path: the profile file
+ *
+ * Read the profile left by previous runs, if any, and enable
+ * pre-translation and the profile update at exit.
+ */
+void tb_profile_init(const char *path);
+
+/**
+ * tb_profile_mmap:
+ * @start: guest address of the new mapping
+ * @len: length of the new mapping
+ * @fd: the file descriptor that was mapped
+ * @offset: file offset of @start
+ *
+ * Queue the profiled TBs that fall within a new executable mapping of
+ * @fd for translation.
+ */
+void tb_profile_mmap(abi_ulong start, abi_ulong len, int fd, off_t offset);
+
+/**
+ * tb_profile_save:
+ *
+ * Merge the TBs currently in the code cache into the profile, and
+ * write it back if anything changed.
+ */
+void tb_profile_save(void);
+
+void tb_profile_fork_start(void);
+void tb_profile_fork_end(bool child);
+
+#endif /* LINUX_USER_TB_PROFILE_H */
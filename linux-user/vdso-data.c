@@ -0,0 +1,213 @@
+/*
+ * Host side of the vdso data page.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/memfd.h"
+#include "qemu/timer.h"
+#include "exec/page-protection.h"
+#include "qemu.h"
+#include "user-internals.h"
+#include "user-mmap.h"
+#include "vdso-data.h"
+
+/*
+ * Take at least this long to estimate the host tick rate, and let the
+ * guest extrapolate a snapshot for at most this long.
+ */
+#define VDSO_CALIBRATE_NS   (100 * SCALE_MS)
+#define VDSO_VALID_NS       (10 * SCALE_MS)
+
+/* The guest data page, and our writable alias of it, if any. */
+static VdsoData *vdso_guest;
+static VdsoData *vdso_data;
+static QemuMutex vdso_data_lock;
+
+/* The values last published, in host byte order. */
+static uint32_t vdso_seq;
+static uint32_t vdso_flags;
+static uint64_t vdso_tick_last;
+static uint64_t vdso_tick_max;
+static uint64_t vdso_mult;
+static int64_t vdso_monotonic;
+
+/* Start of the calibration window. */
+static int64_t calib_tick;
+static int64_t calib_ns;
+
+static int64_t clock_ns(clockid_t id)
+{
+    struct timespec ts;
+
+    clock_gettime(id, &ts);
+    return ts.tv_sec * NANOSECONDS_PER_SECOND + ts.tv_nsec;
+}
+
+static uint64_t ticks_to_ns(uint64_t ticks, uint64_t mult)
+{
+    uint64_t lo, hi;
+
+    mulu64(&lo, &hi, ticks, mult);
+    return (hi << 32) | (lo >> 32);
+}
+
+/*
+ * Map a memfd over the guest page at @host, keeping a second, writable
+ * mapping for ourselves.  Return the latter, or NULL on failure.
+ */
+static VdsoData *vdso_data_map(void *host)
+{
+    void *rw;
+    int fd;
+
+    fd = qemu_memfd_create("qemu-vdso-data", VDSO_DATA_PAGE_SIZE,
+                           false, 0, 0, NULL);
+    if (fd < 0) {
+        return NULL;
+    }
+    rw = mmap(NULL, VDSO_DATA_PAGE_SIZE, PROT_READ | PROT_WRITE,
+              MAP_SHARED, fd, 0);
+    if (rw == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    memcpy(rw, host, VDSO_DATA_PAGE_SIZE);
+    if (mmap(host, VDSO_DATA_PAGE_SIZE, PROT_READ,
+             MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(rw, VDSO_DATA_PAGE_SIZE);
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+    return rw;
+}
+
+void vdso_data_init(abi_ulong addr, uint32_t flags)
+{
+    VdsoData *host = g2h_untagged(addr);
+
+    qemu_mutex_init(&vdso_data_lock);
+    vdso_guest = host;
+
+    /*
+     * The guest page must stay read-only, so we need to write it via
+     * an alias.  That only works if the page is a whole host page.
+     * Failing that, publish the static flags and never the clock.
+     */
+    if (qemu_real_host_page_size() <= VDSO_DATA_PAGE_SIZE &&
+        QEMU_IS_ALIGNED((uintptr_t)host, qemu_real_host_page_size())) {
+        vdso_data = vdso_data_map(host);
+    }
+    if (vdso_data) {
+        WITH_MMAP_LOCK_GUARD() {
+            page_set_flags(addr, addr + VDSO_DATA_PAGE_SIZE - 1,
+                           PAGE_VALID | PAGE_READ);
+        }
+    }
+
+    vdso_flags = flags & ~VDSO_DATA_F_CLOCK;
+    if (vdso_data) {
+        qatomic_set(&vdso_data->flags, tswap32(vdso_flags));
+        if (flags & VDSO_DATA_F_CLOCK) {
+            vdso_flags |= VDSO_DATA_F_CLOCK;
+        }
+    } else {
+        /* Without the alias, open the page just long enough to write */
+        target_mprotect(addr, VDSO_DATA_PAGE_SIZE, PROT_READ | PROT_WRITE);
+        host->flags = tswap32(vdso_flags);
+        target_mprotect(addr, VDSO_DATA_PAGE_SIZE, PROT_READ);
+    }
+}
+
+void vdso_data_update(void)
+{
+    int64_t tick, mono, real;
+    uint64_t mult;
+
+    if (!vdso_data || !(vdso_flags & VDSO_DATA_F_CLOCK)) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&vdso_data_lock);
+
+    /* Read the ticks last, so that the snapshot never leads the clocks. */
+    mono = clock_ns(CLOCK_MONOTONIC);
+    real = clock_ns(CLOCK_REALTIME);
+    tick = cpu_get_host_ticks();
+
+    if (calib_ns == 0) {
+        calib_tick = tick;
+        calib_ns = mono;
+        return;
+    }
+    if (mono - calib_ns < VDSO_CALIBRATE_NS || tick <= calib_tick) {
+        return;
+    }
+
+    /*
+     * Round the rate down a little, so that the extrapolated clock lags
+     * the host clock rather than leads it.  Otherwise the guest could
+     * see time going backwards at the next snapshot.
+     */
+    mult = (double)(mono - calib_ns) / (tick - calib_tick) * 0x1p32;
+    mult -= mult >> 16;
+
+    if (vdso_mult && tick - vdso_tick_last <= vdso_tick_max) {
+        mono = MAX(mono, vdso_monotonic +
+                   ticks_to_ns(tick - vdso_tick_last, vdso_mult));
+    }
+
+    vdso_tick_last = tick;
+    vdso_tick_max = ((uint64_t)VDSO_VALID_NS << 32) / mult;
+    vdso_mult = mult;
+    vdso_monotonic = mono;
+
+    qatomic_set(&vdso_data->seq, tswap32(++vdso_seq));
+    smp_wmb();
+    vdso_data->flags = tswap32(vdso_flags);
+    vdso_data->tick_last = tswap64(tick);
+    vdso_data->tick_max = tswap64(vdso_tick_max);
+    vdso_data->mult = tswap64(mult);
+    vdso_data->realtime = tswap64(real);
+    vdso_data->monotonic = tswap64(mono);
+    smp_wmb();
+    qatomic_set(&vdso_data->seq, tswap32(++vdso_seq));
+}
+
+void vdso_data_fork_start(void)
+{
+    if (vdso_data) {
+        qemu_mutex_lock(&vdso_data_lock);
+    }
+}
+
+void vdso_data_fork_end(bool child)
+{
+    if (!vdso_data) {
+        return;
+    }
+    if (child) {
+        /*
+         * The memfd is still shared with the parent, which keeps
+         * updating it.  Give the child its own copy, which may have
+         * been caught mid-update; the next update republishes it.
+         * If that fails, keep reading the parent's snapshots, which
+         * are just as good, but stop writing them.
+         */
+        VdsoData *old = vdso_data;
+
+        vdso_data = vdso_data_map(vdso_guest);
+        munmap(old, VDSO_DATA_PAGE_SIZE);
+        qemu_mutex_init(&vdso_data_lock);
+        if (vdso_data) {
+            vdso_data->flags = tswap32(vdso_flags & ~VDSO_DATA_F_CLOCK);
+            smp_wmb();
+            qatomic_set(&vdso_data->seq, tswap32(vdso_seq));
+        }
+    } else {
+        qemu_mutex_unlock(&vdso_data_lock);
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ * Data page shared between QEMU and the replacement guest vdso.
+ *
+ * QEMU publishes a snapshot of the host clocks, together with the
+ * host tick counter value at which it was taken.  The vdso converts
+ * the elapsed ticks to nanoseconds, and so answers clock_gettime and
+ * friends without a syscall.  When the snapshot is too old, the vdso
+ * falls back to the syscall, which refreshes the snapshot.
+ *
+ * This file is included by the vdso assembly sources as well, so
+ * only the offsets below may be used from there.
+ *
+ * The x86_64 and i386 vdsos use the page: rdtsc in user mode returns
+ * cpu_get_host_ticks(), the tick source of the snapshot.  The riscv,
+ * loongarch and hppa time counters do too, so their vdsos only need to
+ * be rebuilt to follow.  aarch64, arm, ppc and s390x derive theirs from
+ * QEMU's clocks, and need a matching tick source here first.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef LINUX_USER_VDSO_DATA_H
+#define LINUX_USER_VDSO_DATA_H
+
+/* The data page is reserved at the end of the vdso image. */
+#define VDSO_DATA_PAGE_SIZE     4096
+
+#define VDSO_DATA_SEQ           0   /* u32: odd while being updated */
+#define VDSO_DATA_FLAGS         4   /* u32: VDSO_DATA_F_* */
+#define VDSO_DATA_TICK_LAST     8   /* u64: host ticks at the snapshot */
+#define VDSO_DATA_TICK_MAX      16  /* u64: ticks for which it remains valid */
+#define VDSO_DATA_MULT          24  /* u64: nanoseconds per tick, 32.32 */
+#define VDSO_DATA_REALTIME      32  /* s64: CLOCK_REALTIME, in ns */
+#define VDSO_DATA_MONOTONIC     40  /* s64: CLOCK_MONOTONIC, in ns */
+
+/* The clock snapshot is valid. */
+#define VDSO_DATA_F_CLOCK       1
+/* rdtscp, or the target equivalent, reports the host cpu. */
+#define VDSO_DATA_F_GETCPU      2
+
+#ifndef __ASSEMBLER__
+
+typedef struct VdsoData {
+    uint32_t seq;
+    uint32_t flags;
+    uint64_t tick_last;
+    uint64_t tick_max;
+    uint64_t mult;
+    int64_t realtime;
+    int64_t monotonic;
+} VdsoData;
+
+QEMU_BUILD_BUG_ON(offsetof(VdsoData, flags) != VDSO_DATA_FLAGS);
+QEMU_BUILD_BUG_ON(offsetof(VdsoData, tick_last) != VDSO_DATA_TICK_LAST);
+QEMU_BUILD_BUG_ON(offsetof(VdsoData, tick_max) != VDSO_DATA_TICK_MAX);
+QEMU_BUILD_BUG_ON(offsetof(VdsoData, mult) != VDSO_DATA_MULT);
+QEMU_BUILD_BUG_ON(offsetof(VdsoData, realtime) != VDSO_DATA_REALTIME);
+QEMU_BUILD_BUG_ON(offsetof(VdsoData, monotonic) != VDSO_DATA_MONOTONIC);
+
+/**
+ * vdso_data_init:
+ * @addr: guest address of the data page within the loaded vdso
+ * @flags: VDSO_DATA_F_* features supported by the target
+ *
+ * Set up the data page after the vdso has been loaded and made
+ * read-only.  The clock snapshot only becomes valid once the host
+ * tick rate has been calibrated by vdso_data_update().
+ */
+void vdso_data_init(abi_ulong addr, uint32_t flags);
+
+/**
+ * vdso_data_update:
+ *
+ * Refresh the clock snapshot.  Called when the guest falls back to
+ * a time syscall, which happens whenever the snapshot is stale.
+ */
+void vdso_data_update(void);
+
+void vdso_data_fork_start(void);
+void vdso_data_fork_end(bool child);
+
+#endif /* __ASSEMBLER__ */
+#endif /* LINUX_USER_VDSO_DATA_H */
@@ -124,6 +124,25 @@ void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
                                        cond, entry, imm, udata);
 }
 
+void qemu_plugin_register_vcpu_tb_exec_sampled_cb(
+    struct qemu_plugin_tb *tb,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    qemu_plugin_u64 entry,
+    uint64_t period,
+    void *udata)
+{
+    if (period == 0 || tb_is_mem_only()) {
+        return;
+    }
+    if (period == 1) {
+        qemu_plugin_register_vcpu_tb_exec_cb(tb, cb, flags, udata);
+        return;
+    }
+    plugin_register_dyn_sampled_cb__udata(&tb->cbs, cb, flags,
+                                          entry, period, udata);
+}
+
 void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
     struct qemu_plugin_tb *tb,
     enum qemu_plugin_op op,
@@ -165,6 +184,25 @@ void qemu_plugin_register_vcpu_insn_exec_cond_cb(
                                        cond, entry, imm, udata);
 }
 
+void qemu_plugin_register_vcpu_insn_exec_sampled_cb(
+    struct qemu_plugin_insn *insn,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    qemu_plugin_u64 entry,
+    uint64_t period,
+    void *udata)
+{
+    if (period == 0 || tb_is_mem_only()) {
+        return;
+    }
+    if (period == 1) {
+        qemu_plugin_register_vcpu_insn_exec_cb(insn, cb, flags, udata);
+        return;
+    }
+    plugin_register_dyn_sampled_cb__udata(&insn->insn_cbs, cb, flags,
+                                          entry, period, udata);
+}
+
 void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
     struct qemu_plugin_insn *insn,
     enum qemu_plugin_op op,
@@ -190,6 +228,25 @@ void qemu_plugin_register_vcpu_mem_cb(struct qemu_plugin_insn *insn,
     plugin_register_vcpu_mem_cb(&insn->mem_cbs, cb, flags, rw, udata);
 }
 
+void qemu_plugin_register_vcpu_mem_sampled_cb(struct qemu_plugin_insn *insn,
+                                              qemu_plugin_vcpu_mem_cb_t cb,
+                                              enum qemu_plugin_cb_flags flags,
+                                              enum qemu_plugin_mem_rw rw,
+                                              qemu_plugin_u64 entry,
+                                              uint64_t period,
+                                              void *udata)
+{
+    if (period == 0) {
+        return;
+    }
+    if (period == 1) {
+        qemu_plugin_register_vcpu_mem_cb(insn, cb, flags, rw, udata);
+        return;
+    }
+    plugin_register_vcpu_mem_sampled_cb(&insn->mem_cbs, cb, flags, rw,
+                                        entry, period, udata);
+}
+
 void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     struct qemu_plugin_insn *insn,
     enum qemu_plugin_mem_rw rw,
@@ -200,6 +257,14 @@ void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     plugin_register_inline_op_on_entry(&insn->mem_cbs, rw, op, entry, imm);
 }
 
+void qemu_plugin_register_vcpu_mem_buffer(struct qemu_plugin_insn *insn,
+                                          struct qemu_plugin_mem_buffer *buf,
+                                          enum qemu_plugin_mem_rw rw,
+                                          uint64_t userdata)
+{
+    plugin_register_vcpu_mem_buffer(&insn->mem_cbs, buf, rw, userdata);
+}
+
 void qemu_plugin_register_vcpu_tb_trans_cb(qemu_plugin_id_t id,
                                            qemu_plugin_vcpu_tb_trans_cb_t cb)
 {
@@ -587,6 +652,26 @@ uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry)
     return total;
 }
 
+struct qemu_plugin_mem_buffer *
+qemu_plugin_mem_buffer_new(size_t n_records,
+                           qemu_plugin_vcpu_mem_buffer_cb_t cb,
+                           void *userdata)
+{
+    return plugin_mem_buffer_new(n_records, cb, userdata);
+}
+
+void qemu_plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf)
+{
+    plugin_mem_buffer_free(buf);
+}
+
+void qemu_plugin_mem_buffer_flush(struct qemu_plugin_mem_buffer *buf,
+                                  unsigned int vcpu_index)
+{
+    g_assert(vcpu_index < qemu_plugin_num_vcpus());
+    plugin_mem_buffer_flush(vcpu_index, buf);
+}
+
 /*
  * Time control
  */
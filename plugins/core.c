@@ -283,10 +283,34 @@ void qemu_plugin_vcpu_init_hook(CPUState *cpu)
     async_run_on_cpu(cpu, qemu_plugin_vcpu_init__async, RUN_ON_CPU_NULL);
 }
 
+/*
+ * The buffers are collected under the lock, but the callbacks are run
+ * without it, because plugins are free to call back into the API.
+ */
+static void plugin_mem_buffers_flush_vcpu(int cpu_index)
+{
+    g_autoptr(GPtrArray) bufs = g_ptr_array_new();
+    struct qemu_plugin_mem_buffer *buf;
+    guint i;
+
+    WITH_QEMU_LOCK_GUARD(&plugin.lock) {
+        QLIST_FOREACH(buf, &plugin.mem_buffers, entry) {
+            g_ptr_array_add(bufs, buf);
+        }
+    }
+
+    for (i = 0; i < bufs->len; i++) {
+        plugin_mem_buffer_flush(cpu_index, g_ptr_array_index(bufs, i));
+    }
+}
+
 void qemu_plugin_vcpu_exit_hook(CPUState *cpu)
 {
     bool success;
 
+    if (cpu->cpu_index < plugin.num_vcpus) {
+        plugin_mem_buffers_flush_vcpu(cpu->cpu_index);
+    }
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_EXIT);
 
     assert(cpu->cpu_index != UNASSIGNED_CPU_INDEX);
@@ -425,6 +449,37 @@ void plugin_register_dyn_cond_cb__udata(GArray **arr,
     dyn_cb->cond = cond_cb;
 }
 
+void plugin_register_dyn_sampled_cb__udata(GArray **arr,
+                                           qemu_plugin_vcpu_udata_cb_t cb,
+                                           enum qemu_plugin_cb_flags flags,
+                                           qemu_plugin_u64 entry,
+                                           uint64_t period,
+                                           void *udata)
+{
+    static TCGHelperInfo info[3] = {
+        [QEMU_PLUGIN_CB_NO_REGS].flags = TCG_CALL_NO_RWG,
+        [QEMU_PLUGIN_CB_R_REGS].flags = TCG_CALL_NO_WG,
+        /*
+         * Match qemu_plugin_vcpu_udata_cb_t:
+         *   void (*)(uint32_t, void *)
+         */
+        [0 ... 2].typemask = (dh_typemask(void, 0) |
+                              dh_typemask(i32, 1) |
+                              dh_typemask(ptr, 2))
+    };
+    assert((unsigned)flags < ARRAY_SIZE(info));
+    assert(period > 0 && period <= INT64_MAX);
+
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+    struct qemu_plugin_sampled_cb sampled_cb = { .userp = udata,
+                                                 .f.vcpu_udata = cb,
+                                                 .entry = entry,
+                                                 .period = period,
+                                                 .info = &info[flags] };
+    dyn_cb->type = PLUGIN_CB_SAMPLED;
+    dyn_cb->sampled = sampled_cb;
+}
+
 void plugin_register_vcpu_mem_cb(GArray **arr,
                                  void *cb,
                                  enum qemu_plugin_cb_flags flags,
@@ -465,6 +520,113 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
     dyn_cb->regular = regular_cb;
 }
 
+void plugin_register_vcpu_mem_sampled_cb(GArray **arr,
+                                         void *cb,
+                                         enum qemu_plugin_cb_flags flags,
+                                         enum qemu_plugin_mem_rw rw,
+                                         qemu_plugin_u64 entry,
+                                         uint64_t period,
+                                         void *udata)
+{
+    static TCGHelperInfo info[3] = {
+        [QEMU_PLUGIN_CB_NO_REGS].flags = TCG_CALL_NO_RWG,
+        [QEMU_PLUGIN_CB_R_REGS].flags = TCG_CALL_NO_WG,
+        /*
+         * Match qemu_plugin_vcpu_mem_cb_t:
+         *   void (*)(uint32_t, qemu_plugin_meminfo_t, uint64_t, void *)
+         */
+        [0 ... 2].typemask =
+            (dh_typemask(void, 0) |
+             dh_typemask(i32, 1) |
+             (__builtin_types_compatible_p(qemu_plugin_meminfo_t, uint32_t)
+              ? dh_typemask(i32, 2) : dh_typemask(s32, 2)) |
+             dh_typemask(i64, 3) |
+             dh_typemask(ptr, 4))
+    };
+    assert((unsigned)flags < ARRAY_SIZE(info));
+    assert(period > 0 && period <= INT64_MAX);
+
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+    struct qemu_plugin_sampled_cb sampled_cb = { .userp = udata,
+                                                 .rw = rw,
+                                                 .f.vcpu_mem = cb,
+                                                 .entry = entry,
+                                                 .period = period,
+                                                 .info = &info[flags] };
+    dyn_cb->type = PLUGIN_CB_MEM_SAMPLED;
+    dyn_cb->sampled = sampled_cb;
+}
+
+void plugin_register_vcpu_mem_buffer(GArray **arr,
+                                     struct qemu_plugin_mem_buffer *buf,
+                                     enum qemu_plugin_mem_rw rw,
+                                     uint64_t userdata)
+{
+    static TCGHelperInfo info = {
+        .flags = TCG_CALL_NO_RWG,
+        /*
+         * Match plugin_mem_buffer_flush:
+         *   void (*)(uint32_t, void *)
+         */
+        .typemask = (dh_typemask(void, 0) |
+                     dh_typemask(i32, 1) |
+                     dh_typemask(ptr, 2))
+    };
+
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+    struct qemu_plugin_mem_buffer_cb mem_buffer_cb = { .buf = buf,
+                                                       .info = &info,
+                                                       .userdata = userdata,
+                                                       .rw = rw };
+    dyn_cb->type = PLUGIN_CB_MEM_BUFFER;
+    dyn_cb->mem_buffer = mem_buffer_cb;
+}
+
+static struct qemu_plugin_mem_buffer_entry *
+plugin_mem_buffer_entry(struct qemu_plugin_mem_buffer *buf, int cpu_index)
+{
+    GArray *arr = buf->score->data;
+
+    return (struct qemu_plugin_mem_buffer_entry *)
+        (arr->data + cpu_index * g_array_get_element_size(arr));
+}
+
+/*
+ * Disable CFI checks.
+ * The callback function has been loaded from an external library so we do not
+ * have type information
+ */
+QEMU_DISABLE_CFI
+void plugin_mem_buffer_flush(uint32_t cpu_index, void *opaque)
+{
+    struct qemu_plugin_mem_buffer *buf = opaque;
+    struct qemu_plugin_mem_buffer_entry *e =
+        plugin_mem_buffer_entry(buf, cpu_index);
+
+    if (e->n) {
+        buf->cb(cpu_index, e->records, e->n, buf->userdata);
+        e->n = 0;
+    }
+}
+
+/* Slow path equivalent of the code generated for PLUGIN_CB_MEM_BUFFER */
+static void plugin_mem_buffer_append(struct qemu_plugin_mem_buffer_cb *cb,
+                                     int cpu_index,
+                                     qemu_plugin_meminfo_t info,
+                                     uint64_t vaddr)
+{
+    struct qemu_plugin_mem_buffer_entry *e =
+        plugin_mem_buffer_entry(cb->buf, cpu_index);
+    struct qemu_plugin_mem_record *rec = &e->records[e->n];
+
+    rec->vaddr = vaddr;
+    rec->userdata = cb->userdata;
+    rec->info = info;
+    if (++e->n == cb->buf->capacity) {
+        plugin_mem_buffer_flush(cpu_index, cb->buf);
+    }
+}
+
 /*
  * Disable CFI checks.
  * The callback function has been loaded from an external library so we do not
@@ -536,6 +698,7 @@ void qemu_plugin_vcpu_idle_cb(CPUState *cpu)
 {
     /* idle and resume cb may be called before init, ignore in this case */
     if (cpu->cpu_index < plugin.num_vcpus) {
+        plugin_mem_buffers_flush_vcpu(cpu->cpu_index);
         plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_IDLE);
     }
 }
@@ -579,15 +742,19 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
+static uint64_t *plugin_u64_ptr(qemu_plugin_u64 entry, int cpu_index)
+{
+    char *ptr = entry.score->data->data;
+    size_t elem_size = g_array_get_element_size(entry.score->data);
+
+    return (uint64_t *)(ptr + entry.offset + cpu_index * elem_size);
+}
+
 void exec_inline_op(enum plugin_dyn_cb_type type,
                     struct qemu_plugin_inline_cb *cb,
                     int cpu_index)
 {
-    char *ptr = cb->entry.score->data->data;
-    size_t elem_size = g_array_get_element_size(
-        cb->entry.score->data);
-    size_t offset = cb->entry.offset;
-    uint64_t *val = (uint64_t *)(ptr + offset + cpu_index * elem_size);
+    uint64_t *val = plugin_u64_ptr(cb->entry, cpu_index);
 
     switch (type) {
     case PLUGIN_CB_INLINE_ADD_U64:
@@ -628,6 +795,25 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                 exec_inline_op(cb->type, &cb->inline_insn, cpu->cpu_index);
             }
             break;
+        case PLUGIN_CB_MEM_SAMPLED:
+            if (rw & cb->sampled.rw) {
+                uint64_t *countdown = plugin_u64_ptr(cb->sampled.entry,
+                                                     cpu->cpu_index);
+
+                if ((int64_t)--*countdown < 0) {
+                    *countdown = cb->sampled.period - 1;
+                    cb->sampled.f.vcpu_mem(cpu->cpu_index,
+                                           make_plugin_meminfo(oi, rw),
+                                           vaddr, cb->sampled.userp);
+                }
+            }
+            break;
+        case PLUGIN_CB_MEM_BUFFER:
+            if (rw & cb->mem_buffer.rw) {
+                plugin_mem_buffer_append(&cb->mem_buffer, cpu->cpu_index,
+                                         make_plugin_meminfo(oi, rw), vaddr);
+            }
+            break;
         default:
             g_assert_not_reached();
         }
@@ -636,6 +822,12 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
 
 void qemu_plugin_atexit_cb(void)
 {
+    int i;
+
+    /* deliver what is left in the buffers before plugins report results */
+    for (i = 0; i < plugin.num_vcpus; i++) {
+        plugin_mem_buffers_flush_vcpu(i);
+    }
     plugin_cb__udata(QEMU_PLUGIN_EV_ATEXIT);
 }
 
@@ -727,6 +919,7 @@ static void __attribute__((__constructor__)) plugin_init(void)
     plugin.id_ht = g_hash_table_new(g_int64_hash, g_int64_equal);
     plugin.cpu_ht = g_hash_table_new(g_int_hash, g_int_equal);
     QLIST_INIT(&plugin.scoreboards);
+    QLIST_INIT(&plugin.mem_buffers);
     plugin.scoreboard_alloc_size = 16; /* avoid frequent reallocation */
     QTAILQ_INIT(&plugin.ctxs);
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
@@ -762,3 +955,37 @@ void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
     g_array_free(score->data, TRUE);
     g_free(score);
 }
+
+struct qemu_plugin_mem_buffer *
+plugin_mem_buffer_new(size_t n_records, qemu_plugin_vcpu_mem_buffer_cb_t cb,
+                      void *userdata)
+{
+    struct qemu_plugin_mem_buffer *buf;
+    size_t entry_size;
+
+    g_assert(n_records > 0 && cb);
+    entry_size = sizeof(struct qemu_plugin_mem_buffer_entry) +
+                 n_records * sizeof(struct qemu_plugin_mem_record);
+
+    buf = g_new0(struct qemu_plugin_mem_buffer, 1);
+    buf->score = plugin_scoreboard_new(entry_size);
+    buf->capacity = n_records;
+    buf->cb = cb;
+    buf->userdata = userdata;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_INSERT_HEAD(&plugin.mem_buffers, buf, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    return buf;
+}
+
+void plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(buf, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    plugin_scoreboard_free(buf->score);
+    g_free(buf);
+}
@@ -32,6 +32,7 @@ struct qemu_plugin_state {
      */
     GHashTable *cpu_ht;
     QLIST_HEAD(, qemu_plugin_scoreboard) scoreboards;
+    QLIST_HEAD(, qemu_plugin_mem_buffer) mem_buffers;
     size_t scoreboard_alloc_size;
     DECLARE_BITMAP(mask, QEMU_PLUGIN_EV_MAX);
     /*
@@ -102,12 +103,33 @@ plugin_register_dyn_cond_cb__udata(GArray **arr,
                                    uint64_t imm,
                                    void *udata);
 
+void
+plugin_register_dyn_sampled_cb__udata(GArray **arr,
+                                      qemu_plugin_vcpu_udata_cb_t cb,
+                                      enum qemu_plugin_cb_flags flags,
+                                      qemu_plugin_u64 entry,
+                                      uint64_t period,
+                                      void *udata);
+
 void plugin_register_vcpu_mem_cb(GArray **arr,
                                  void *cb,
                                  enum qemu_plugin_cb_flags flags,
                                  enum qemu_plugin_mem_rw rw,
                                  void *udata);
 
+void plugin_register_vcpu_mem_sampled_cb(GArray **arr,
+                                         void *cb,
+                                         enum qemu_plugin_cb_flags flags,
+                                         enum qemu_plugin_mem_rw rw,
+                                         qemu_plugin_u64 entry,
+                                         uint64_t period,
+                                         void *udata);
+
+void plugin_register_vcpu_mem_buffer(GArray **arr,
+                                     struct qemu_plugin_mem_buffer *buf,
+                                     enum qemu_plugin_mem_rw rw,
+                                     uint64_t userdata);
+
 void exec_inline_op(enum plugin_dyn_cb_type type,
                     struct qemu_plugin_inline_cb *cb,
                     int cpu_index);
@@ -118,4 +140,10 @@ struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size);
 
 void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
 
+struct qemu_plugin_mem_buffer *
+plugin_mem_buffer_new(size_t n_records, qemu_plugin_vcpu_mem_buffer_cb_t cb,
+                      void *userdata);
+
+void plugin_mem_buffer_free(struct qemu_plugin_mem_buffer *buf);
+
 #endif /* PLUGIN_H */
@@ -823,12 +823,14 @@ DEF("audiodev", HAS_ARG, QEMU_OPTION_audiodev,
     "                server= PulseAudio server address\n"
     "                in|out.name= source/sink device name\n"
     "                in|out.latency= desired latency in microseconds\n"
+    "                in|out.try-poll= also mix when PulseAudio asks for data\n"
 #endif
 #ifdef CONFIG_AUDIO_PIPEWIRE
     "-audiodev pipewire,id=id[,prop[=value][,...]]\n"
     "                in|out.name= source/sink device name\n"
     "                in|out.stream-name= name of pipewire stream\n"
     "                in|out.latency= desired latency in microseconds\n"
+    "                in|out.try-poll= mix when PipeWire asks for data\n"
 #endif
 #ifdef CONFIG_AUDIO_SDL
     "-audiodev sdl,id=id[,prop[=value][,...]]\n"
@@ -993,6 +995,10 @@ SRST
         Desired latency in microseconds. The PulseAudio server will try
         to honor this value but actual latencies may be lower or higher.
 
+    ``in|out.try-poll=on|off``
+        Also mix audio whenever PulseAudio requests or delivers data,
+        besides every ``timer-period``. Default is off.
+
 ``-audiodev pipewire,id=id[,prop[=value][,...]]``
     Creates a backend using PipeWire. This backend is available on
     most systems.
@@ -1008,6 +1014,10 @@ SRST
     ``in|out.stream-name``
         Specify the name of pipewire stream.
 
+    ``in|out.try-poll=on|off``
+        Mix audio whenever PipeWire requests or delivers data, instead
+        of every ``timer-period``. Default is off.
+
 ``-audiodev sdl,id=id[,prop[=value][,...]]``
     Creates a backend using SDL. This backend is available on most
     systems, but you should use your platform's native backend if
@@ -2602,10 +2612,11 @@ SRST
         ``sasl-authz`` and ``tls-authz`` options are a replacement.
 
     ``lossy=on|off``
-        Enable lossy compression methods (gradient, JPEG, ...). If this
-        option is set, VNC client may receive lossy framebuffer updates
+        Enable lossy compression methods (gradient, JPEG, H.264, ...). If
+        this option is set, VNC client may receive lossy framebuffer updates
         depending on its encoding settings. Enabling this option can
-        save a lot of bandwidth at the expense of quality.
+        save a lot of bandwidth at the expense of quality. H.264 is only
+        available if QEMU was built with libx264.
 
     ``non-adaptive=on|off``
         Disable adaptive encodings. Adaptive encodings are enabled by
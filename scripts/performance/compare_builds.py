@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+
+#  Compare the wall clock time of running the same target executable
+#  under two QEMU builds, for instance a TCI build before and after a
+#  change to the interpreter.
+#
+#  Syntax:
+#  compare_builds.py [-h] [-n <runs>] <old qemu> <new qemu> -- \
+#                    [<qemu executable options>] \
+#                    <target executable> [<target executable options>]
+#
+#  [-h] - Print the script arguments help message.
+#  [-n] - Number of runs for each build (default 5).  The best run of
+#         each build is reported.
+#
+#  Example of usage:
+#  compare_builds.py old/qemu-arm new/qemu-arm -- coulomb_double-arm
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import subprocess
+import sys
+import time
+
+
+def best_time(command, runs):
+    """
+    Run a command several times and return its fastest run.
+
+    Parameters:
+    command (list): command line to execute
+    runs (int): number of runs
+
+    Returns:
+    (float): wall clock time of the fastest run, in seconds
+    """
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        run = subprocess.run(command, stdout=subprocess.DEVNULL,
+                             stderr=subprocess.PIPE)
+        elapsed = time.perf_counter() - start
+        if run.returncode:
+            sys.exit(run.stderr.decode("utf-8"))
+        if best is None or elapsed < best:
+            best = elapsed
+    return best
+
+
+def main():
+    # Parse the command line arguments
+    parser = argparse.ArgumentParser(
+        usage='compare_builds.py [-h] [-n <runs>] <old qemu> <new qemu> -- '
+        '[<qemu executable options>] '
+        '<target executable> [<target executable options>]')
+
+    parser.add_argument('-n', dest='runs', type=int, default=5,
+                        help='number of runs for each build')
+    parser.add_argument('old', type=str, help=argparse.SUPPRESS)
+    parser.add_argument('new', type=str, help=argparse.SUPPRESS)
+    parser.add_argument('command', type=str, nargs='+', help=argparse.SUPPRESS)
+
+    args = parser.parse_args()
+    if args.runs < 1:
+        sys.exit("The number of runs must be positive.")
+
+    old = best_time([args.old] + args.command, args.runs)
+    new = best_time([args.new] + args.command, args.runs)
+
+    print("{:<10}{:>12.3f} s".format("old", old))
+    print("{:<10}{:>12.3f} s".format("new", new))
+    print("{:<10}{:>12.2f} x".format("speedup", old / new))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,184 @@
+/*
+ * query-stats provider for block device latencies
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/main-loop.h"
+#include "qom/object.h"
+#include "hw/qdev-core.h"
+#include "block/accounting.h"
+#include "sysemu/block-backend.h"
+#include "sysemu/iothread.h"
+#include "sysemu/stats.h"
+
+static const struct {
+    enum BlockAcctType type;
+    const char *name;
+} block_stats_ops[] = {
+    { BLOCK_ACCT_READ, "read" },
+    { BLOCK_ACCT_WRITE, "write" },
+    { BLOCK_ACCT_FLUSH, "flush" },
+    { BLOCK_ACCT_ZONE_APPEND, "zone-append" },
+    { BLOCK_ACCT_UNMAP, "unmap" },
+};
+
+/*
+ * Percentiles are rounded up to the end of their histogram bucket, i.e.
+ * they are at most 6.25% above the actual value.  The maximum is exact.
+ */
+static const struct {
+    const char *suffix;
+    double percentile;
+    StatsType type;
+} block_stats_percentiles[] = {
+    { "p50", 50, STATS_TYPE_INSTANT },
+    { "p90", 90, STATS_TYPE_INSTANT },
+    { "p99", 99, STATS_TYPE_INSTANT },
+    { "p999", 99.9, STATS_TYPE_INSTANT },
+    { "max", 100, STATS_TYPE_PEAK },
+};
+
+#define BLOCK_STATS_PER_OP ARRAY_SIZE(block_stats_percentiles)
+
+/*
+ * "<op>-latency-<suffix>" for each pair, filled in by block_stats_init().
+ * The values of each operation are an array of BLOCK_STATS_PER_OP.
+ */
+static StatsDesc block_stats_desc[ARRAY_SIZE(block_stats_ops) *
+                                  BLOCK_STATS_PER_OP];
+
+typedef struct BlockStatsArgs {
+    StatsResultList **result;
+    strList *names;
+    BlockAcctStats *stats;
+    const char *qom_path;
+} BlockStatsArgs;
+
+/*
+ * Add the latencies of the requests that were submitted on @queue (all
+ * if negative) and completed in @ctx (all if NULL), if there are any.
+ */
+static void block_stats_add(BlockStatsArgs *args, int queue,
+                            AioContext *ctx, const char *iothread)
+{
+    g_autofree HdrHistogramSnapshot *snap = g_new(HdrHistogramSnapshot, 1);
+    StatsList *list = NULL;
+    StatsResult *entry;
+    size_t i, j;
+
+    for (i = 0; i < ARRAY_SIZE(block_stats_ops); i++) {
+        uint64_t values[BLOCK_STATS_PER_OP];
+
+        memset(snap, 0, sizeof(*snap));
+        block_acct_latency_snapshot(args->stats, block_stats_ops[i].type,
+                                    queue, ctx, snap);
+        if (!snap->count) {
+            continue;
+        }
+
+        for (j = 0; j < BLOCK_STATS_PER_OP; j++) {
+            values[j] = hdr_histogram_percentile(
+                snap, block_stats_percentiles[j].percentile);
+        }
+        add_stats_from_desc(&list, args->names,
+                            &block_stats_desc[i * BLOCK_STATS_PER_OP],
+                            BLOCK_STATS_PER_OP, values);
+    }
+
+    if (!list) {
+        return;
+    }
+
+    add_stats_entry(args->result, STATS_PROVIDER_BLOCK, args->qom_path, list);
+    entry = (*args->result)->value;
+    if (queue >= 0) {
+        entry->has_queue = true;
+        entry->queue = queue;
+    }
+    entry->iothread = g_strdup(iothread);
+}
+
+static int block_stats_add_iothread(Object *obj, void *opaque)
+{
+    IOThread *iothread = (IOThread *)object_dynamic_cast(obj, TYPE_IOTHREAD);
+    g_autofree char *id = NULL;
+
+    if (iothread) {
+        id = iothread_get_id(iothread);
+        block_stats_add(opaque, -1, iothread_get_aio_context(iothread), id);
+    }
+    return 0;
+}
+
+static void block_stats_cb(StatsResultList **result, StatsTarget target,
+                           strList *names, strList *targets, Error **errp)
+{
+    BlockStatsArgs args = { .result = result, .names = names };
+    BlockBackend *blk;
+    int q;
+
+    if (target != STATS_TARGET_BLOCK) {
+        return;
+    }
+
+    for (blk = blk_all_next(NULL); blk; blk = blk_all_next(blk)) {
+        DeviceState *dev = blk_get_attached_dev(blk);
+        g_autofree char *qom_path = NULL;
+
+        if (!dev) {
+            continue;
+        }
+        qom_path = object_get_canonical_path(OBJECT(dev));
+        if (!apply_str_list_filter(qom_path, targets)) {
+            continue;
+        }
+
+        args.stats = blk_get_stats(blk);
+        args.qom_path = qom_path;
+
+        /*
+         * Entries are prepended, so add them in reverse: the totals come
+         * first, then each queue, then the main loop and each IOThread.
+         * The main loop's name is not a valid QOM id, so that it cannot
+         * be mistaken for an IOThread.
+         */
+        object_child_foreach(object_get_objects_root(),
+                             block_stats_add_iothread, &args);
+        block_stats_add(&args, -1, qemu_get_aio_context(), "#main-loop");
+        for (q = BLOCK_ACCT_MAX_QUEUES; q-- > 0; ) {
+            block_stats_add(&args, q, NULL, NULL);
+        }
+        block_stats_add(&args, -1, NULL, NULL);
+    }
+}
+
+static void block_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    add_stats_schema(result, STATS_PROVIDER_BLOCK, STATS_TARGET_BLOCK,
+                     stats_schema_from_desc(block_stats_desc,
+                                            ARRAY_SIZE(block_stats_desc)));
+}
+
+void block_stats_init(void)
+{
+    size_t i, j;
+
+    for (i = 0; i < ARRAY_SIZE(block_stats_ops); i++) {
+        for (j = 0; j < BLOCK_STATS_PER_OP; j++) {
+            StatsDesc *desc = &block_stats_desc[i * BLOCK_STATS_PER_OP + j];
+
+            desc->name = g_strdup_printf("%s-latency-%s",
+                                         block_stats_ops[i].name,
+                                         block_stats_percentiles[j].suffix);
+            desc->type = block_stats_percentiles[j].type;
+            desc->exponent = -9;
+            desc->offset = j * sizeof(uint64_t);
+        }
+    }
+
+    add_stats_callbacks(STATS_PROVIDER_BLOCK, block_stats_cb,
+                        block_schemas_cb);
+}
@@ -0,0 +1,60 @@
+/*
+ * query-stats provider for the coroutine pool
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/coroutine.h"
+#include "sysemu/stats.h"
+
+static const StatsDesc coroutine_pool_stats_desc[] = {
+    { "hits", STATS_TYPE_CUMULATIVE, 0,
+      offsetof(CoroutinePoolStats, hits) },
+    { "misses", STATS_TYPE_CUMULATIVE, 0,
+      offsetof(CoroutinePoolStats, misses) },
+    { "remote-batches", STATS_TYPE_CUMULATIVE, 0,
+      offsetof(CoroutinePoolStats, remote_batches) },
+    { "trimmed", STATS_TYPE_CUMULATIVE, 0,
+      offsetof(CoroutinePoolStats, trimmed) },
+    { "size", STATS_TYPE_INSTANT, 0,
+      offsetof(CoroutinePoolStats, size) },
+    { "max-size", STATS_TYPE_INSTANT, 0,
+      offsetof(CoroutinePoolStats, max_size) },
+};
+
+static void coroutine_pool_stats_cb(StatsResultList **result,
+                                    StatsTarget target, strList *names,
+                                    strList *targets, Error **errp)
+{
+    StatsList *list = NULL;
+    CoroutinePoolStats stats;
+
+    if (target != STATS_TARGET_VM) {
+        return;
+    }
+
+    qemu_coroutine_get_pool_stats(&stats);
+    add_stats_from_desc(&list, names, coroutine_pool_stats_desc,
+                        ARRAY_SIZE(coroutine_pool_stats_desc), &stats);
+    if (list) {
+        add_stats_entry(result, STATS_PROVIDER_COROUTINE_POOL, NULL, list);
+    }
+}
+
+static void coroutine_pool_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *list =
+        stats_schema_from_desc(coroutine_pool_stats_desc,
+                               ARRAY_SIZE(coroutine_pool_stats_desc));
+
+    add_stats_schema(result, STATS_PROVIDER_COROUTINE_POOL, STATS_TARGET_VM,
+                     list);
+}
+
+void coroutine_pool_stats_init(void)
+{
+    add_stats_callbacks(STATS_PROVIDER_COROUTINE_POOL, coroutine_pool_stats_cb,
+                        coroutine_pool_schemas_cb);
+}
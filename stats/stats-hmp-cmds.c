@@ -92,6 +92,17 @@ static void print_stats_results(Monitor *mon, StatsTarget target,
                        StatsProvider_str(result->provider));
     }
 
+    if (target == STATS_TARGET_BLOCK) {
+        monitor_printf(mon, "%s", result->qom_path);
+        if (result->has_queue) {
+            monitor_printf(mon, " queue %" PRIu32, result->queue);
+        }
+        if (result->iothread) {
+            monitor_printf(mon, " iothread %s", result->iothread);
+        }
+        monitor_printf(mon, ":\n");
+    }
+
     for (stats_list = result->stats; stats_list;
              stats_list = stats_list->next,
              schema_value_list = schema_value_list->next) {
@@ -156,6 +167,7 @@ static StatsFilter *stats_filter(StatsTarget target, const char *names,
         break;
     }
     case STATS_TARGET_CRYPTODEV:
+    case STATS_TARGET_BLOCK:
         break;
     default:
         break;
@@ -229,6 +241,7 @@ void hmp_info_stats(Monitor *mon, const QDict *qdict)
         filter = stats_filter(target, names, cpu_index, provider);
         break;
     case STATS_TARGET_CRYPTODEV:
+    case STATS_TARGET_BLOCK:
         filter = stats_filter(target, names, -1, provider);
         break;
     default:
@@ -66,6 +66,14 @@ static bool invoke_stats_cb(StatsCallbacks *entry,
         break;
     case STATS_TARGET_CRYPTODEV:
         break;
+    case STATS_TARGET_BLOCK:
+        if (filter->u.block.has_devices) {
+            if (!filter->u.block.devices) {
+                return true;
+            }
+            targets = filter->u.block.devices;
+        }
+        break;
     default:
         abort();
     }
@@ -136,6 +144,64 @@ void add_stats_entry(StatsResultList **stats_results, StatsProvider provider,
     QAPI_LIST_PREPEND(*stats_results, entry);
 }
 
+void add_stats_from_desc(StatsList **list, strList *names,
+                         const StatsDesc *desc, size_t n, const void *values)
+{
+    size_t i;
+    unsigned int j;
+
+    while (*list) {
+        list = &(*list)->next;
+    }
+
+    for (i = 0; i < n; i++) {
+        const uint64_t *val = values + desc[i].offset;
+        Stats *stats;
+
+        if (!apply_str_list_filter(desc[i].name, names)) {
+            continue;
+        }
+
+        stats = g_new0(Stats, 1);
+        stats->name = g_strdup(desc[i].name);
+        stats->value = g_new0(StatsValue, 1);
+        if (desc[i].length) {
+            uint64List **tail = &stats->value->u.list;
+
+            stats->value->type = QTYPE_QLIST;
+            for (j = 0; j < desc[i].length; j++) {
+                QAPI_LIST_APPEND(tail, val[j]);
+            }
+        } else {
+            stats->value->type = QTYPE_QNUM;
+            stats->value->u.scalar = *val;
+        }
+        QAPI_LIST_APPEND(list, stats);
+    }
+}
+
+StatsSchemaValueList *stats_schema_from_desc(const StatsDesc *desc, size_t n)
+{
+    StatsSchemaValueList *list = NULL, **tail = &list;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        StatsSchemaValue *value = g_new0(StatsSchemaValue, 1);
+
+        value->name = g_strdup(desc[i].name);
+        value->type = desc[i].type;
+        if (desc[i].exponent) {
+            value->has_unit = true;
+            value->unit = STATS_UNIT_SECONDS;
+            value->has_base = true;
+            value->base = 10;
+            value->exponent = desc[i].exponent;
+        }
+        QAPI_LIST_APPEND(tail, value);
+    }
+    return list;
+}
+
 void add_stats_schema(StatsSchemaList **schema_results,
                       StatsProvider provider, StatsTarget target,
                       StatsSchemaValueList *stats_list)
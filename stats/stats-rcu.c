@@ -0,0 +1,56 @@
+/*
+ * query-stats provider for the RCU subsystem
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/rcu.h"
+#include "sysemu/stats.h"
+
+static const StatsDesc rcu_stats_desc[] = {
+    { "grace-periods", STATS_TYPE_CUMULATIVE, 0,
+      offsetof(RCUStats, grace_periods) },
+    { "expedited-grace-periods", STATS_TYPE_CUMULATIVE, 0,
+      offsetof(RCUStats, expedited_grace_periods) },
+    { "grace-period-time", STATS_TYPE_CUMULATIVE, -9,
+      offsetof(RCUStats, grace_period_ns) },
+    { "max-grace-period-time", STATS_TYPE_PEAK, -9,
+      offsetof(RCUStats, max_grace_period_ns) },
+    /* Bucket i counts grace periods of [2^(i-1), 2^i) microseconds.  */
+    { "grace-period-histogram", STATS_TYPE_LOG2_HISTOGRAM, -6,
+      offsetof(RCUStats, grace_period_hist), RCU_STATS_HIST_BUCKETS },
+    { "callbacks", STATS_TYPE_CUMULATIVE, 0,
+      offsetof(RCUStats, callbacks) },
+};
+
+static void rcu_stats_cb(StatsResultList **result, StatsTarget target,
+                         strList *names, strList *targets, Error **errp)
+{
+    StatsList *list = NULL;
+    RCUStats stats;
+
+    if (target != STATS_TARGET_VM) {
+        return;
+    }
+
+    rcu_get_stats(&stats);
+    add_stats_from_desc(&list, names, rcu_stats_desc,
+                        ARRAY_SIZE(rcu_stats_desc), &stats);
+    if (list) {
+        add_stats_entry(result, STATS_PROVIDER_RCU, NULL, list);
+    }
+}
+
+static void rcu_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    add_stats_schema(result, STATS_PROVIDER_RCU, STATS_TARGET_VM,
+                     stats_schema_from_desc(rcu_stats_desc,
+                                            ARRAY_SIZE(rcu_stats_desc)));
+}
+
+void rcu_stats_init(void)
+{
+    add_stats_callbacks(STATS_PROVIDER_RCU, rcu_stats_cb, rcu_schemas_cb);
+}
@@ -172,5 +172,6 @@ typedef enum {
 #define TCG_TARGET_DEFAULT_MO (0)
 #define TCG_TARGET_NEED_LDST_LABELS
 #define TCG_TARGET_NEED_POOL_LABELS
+#define TCG_TARGET_NEED_PEEPHOLE
 
 #endif /* AARCH64_TCG_TARGET_H */
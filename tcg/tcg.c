@@ -352,7 +352,38 @@ static void tcg_out_label(TCGContext *s, TCGLabel *l)
     tcg_debug_assert(!l->has_value);
     l->has_value = 1;
     l->u.value_ptr = tcg_splitwx_to_rx(s->code_ptr);
+#ifdef TCG_TARGET_NEED_PEEPHOLE
+    /* Code may now arrive here from elsewhere. */
+    s->peep_ptr = NULL;
+#endif
+}
+
+#ifdef TCG_TARGET_NEED_PEEPHOLE
+/*
+ * Let the backend note what the insn it has just emitted leaves behind
+ * in @reg, e.g. flags that already compare it against zero, as a set of
+ * backend-defined @state bits.
+ */
+static void tcg_peep_record(TCGContext *s, TCGReg reg, unsigned state)
+{
+    s->peep_ptr = s->code_ptr;
+    s->peep_reg = reg;
+    s->peep_state = state;
+}
+
+/*
+ * Return the state recorded for @reg, if the insn that recorded it is
+ * still the last one emitted and no label has been placed after it;
+ * otherwise nothing is known and 0 is returned.
+ */
+static unsigned tcg_peep_state(TCGContext *s, TCGReg reg)
+{
+    if (s->peep_ptr == s->code_ptr && s->peep_reg == reg) {
+        return s->peep_state;
+    }
+    return 0;
 }
+#endif
 
 TCGLabel *gen_new_label(void)
 {
@@ -6179,6 +6210,9 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
 #ifdef TCG_TARGET_NEED_POOL_LABELS
     s->pool_labels = NULL;
 #endif
+#ifdef TCG_TARGET_NEED_PEEPHOLE
+    s->peep_ptr = NULL;
+#endif
 
     start_words = s->insn_start_words;
     s->gen_insn_data =
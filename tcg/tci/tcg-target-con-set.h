@@ -11,10 +11,12 @@
  */
 C_O0_I1(r)
 C_O0_I2(r, r)
+C_O0_I2(r, rI)
 C_O0_I3(r, r, r)
 C_O0_I4(r, r, r, r)
 C_O1_I1(r, r)
 C_O1_I2(r, r, r)
+C_O1_I2(r, r, rI)
 C_O1_I4(r, r, r, r, r)
 C_O2_I1(r, r, r)
 C_O2_I2(r, r, r, r)
@@ -0,0 +1,111 @@
+/*
+ * Coroutine switch and memory benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/coroutine.h"
+#include "qemu/units.h"
+
+static void coroutine_fn yield_loop(void *opaque)
+{
+    unsigned int *counter = opaque;
+
+    while (*counter > 0) {
+        (*counter)--;
+        qemu_coroutine_yield();
+    }
+}
+
+static void test_enter_yield(void)
+{
+    unsigned int max = 10000000, i = max;
+    Coroutine *co = qemu_coroutine_create(yield_loop, &i);
+    double duration;
+
+    g_test_timer_start();
+    while (i > 0) {
+        qemu_coroutine_enter(co);
+    }
+    duration = g_test_timer_elapsed();
+
+    g_test_message("enter+yield: %.1f ns", duration * 1e9 / max);
+}
+
+static void coroutine_fn empty_coroutine(void *opaque)
+{
+}
+
+static void test_lifecycle(void)
+{
+    unsigned int max = 1000000, i;
+    double duration;
+
+    g_test_timer_start();
+    for (i = 0; i < max; i++) {
+        qemu_coroutine_enter(qemu_coroutine_create(empty_coroutine, NULL));
+    }
+    duration = g_test_timer_elapsed();
+
+    g_test_message("create+enter+terminate: %.1f ns", duration * 1e9 / max);
+}
+
+/* Resident set size in bytes, or 0 if unknown.  */
+static uint64_t get_rss(void)
+{
+    g_autofree char *buf = NULL;
+    unsigned long size, resident;
+
+    if (!g_file_get_contents("/proc/self/statm", &buf, NULL, NULL) ||
+        sscanf(buf, "%lu %lu", &size, &resident) != 2) {
+        return 0;
+    }
+    return (uint64_t)resident * qemu_real_host_page_size();
+}
+
+/* Touch about as much stack as a typical block layer request.  */
+static void coroutine_fn stack_user(void *opaque)
+{
+    volatile char buf[2 * KiB];
+
+    memset((char *)buf, 0, sizeof(buf));
+    qemu_coroutine_yield();
+}
+
+static void test_memory(void)
+{
+    unsigned int max = 10000, i;
+    Coroutine **cos = g_new(Coroutine *, max);
+    uint64_t before, after;
+
+    before = get_rss();
+    if (!before) {
+        g_test_skip("resident set size not available");
+        g_free(cos);
+        return;
+    }
+
+    for (i = 0; i < max; i++) {
+        cos[i] = qemu_coroutine_create(stack_user, NULL);
+        qemu_coroutine_enter(cos[i]);
+    }
+    after = get_rss();
+    for (i = 0; i < max; i++) {
+        qemu_coroutine_enter(cos[i]);
+    }
+
+    g_test_message("%u suspended coroutines: %.1f KiB each",
+                   max, (double)(after - before) / max / KiB);
+    g_free(cos);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/coroutine/enter-yield", test_enter_yield);
+    g_test_add_func("/coroutine/lifecycle", test_lifecycle);
+    g_test_add_func("/coroutine/memory", test_memory);
+    return g_test_run();
+}
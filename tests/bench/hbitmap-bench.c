@@ -0,0 +1,121 @@
+/*
+ * HBitmap speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/hbitmap.h"
+#include "qemu/units.h"
+
+/* A 4 TiB disk with 64 KiB granularity, i.e. 64 Mbit */
+#define BENCH_BITS      (64 * MiB)
+
+/* Dirty one item in @stride, in runs of @run items */
+static HBitmap *bench_bitmap(uint64_t stride, uint64_t run)
+{
+    HBitmap *hb = hbitmap_alloc(BENCH_BITS, 0);
+    uint64_t i;
+
+    for (i = 0; i < BENCH_BITS; i += stride) {
+        hbitmap_set(hb, i, MIN(run, BENCH_BITS - i));
+    }
+    return hb;
+}
+
+static void bench_count(void)
+{
+    HBitmap *hb = bench_bitmap(3, 2);
+    unsigned n = 0;
+
+    /* Resetting a large range recounts the bits that were set in it.  */
+    g_test_timer_start();
+    do {
+        hbitmap_reset(hb, 0, BENCH_BITS / 2);
+        hbitmap_set(hb, 0, BENCH_BITS / 2);
+        n++;
+    } while (g_test_timer_elapsed() < 0.5);
+    g_test_message("set+reset 32 Mbit: %8.1f us",
+                   g_test_timer_last() * 1e6 / n);
+    hbitmap_free(hb);
+}
+
+static void bench_next_dirty_area(void)
+{
+    HBitmap *hb = bench_bitmap(BENCH_BITS / 16, BENCH_BITS / 32);
+    int64_t start, count;
+    unsigned n = 0;
+
+    g_test_timer_start();
+    do {
+        for (start = 0;
+             hbitmap_next_dirty_area(hb, start, BENCH_BITS, INT64_MAX,
+                                     &start, &count);
+             start += count) {
+            /* nothing */
+        }
+        n++;
+    } while (g_test_timer_elapsed() < 0.5);
+    g_test_message("next_dirty_area, 16 areas: %8.1f us",
+                   g_test_timer_last() * 1e6 / n);
+    hbitmap_free(hb);
+}
+
+static void bench_merge(void)
+{
+    HBitmap *a = bench_bitmap(5, 1);
+    HBitmap *b = bench_bitmap(7, 3);
+    HBitmap *r = hbitmap_alloc(BENCH_BITS, 0);
+    unsigned n = 0;
+
+    g_test_timer_start();
+    do {
+        hbitmap_merge(a, b, r);
+        n++;
+    } while (g_test_timer_elapsed() < 0.5);
+    g_test_message("merge 64 Mbit: %8.1f us", g_test_timer_last() * 1e6 / n);
+    hbitmap_free(a);
+    hbitmap_free(b);
+    hbitmap_free(r);
+}
+
+static void bench_serialize(void)
+{
+    HBitmap *hb = bench_bitmap(5, 1);
+    uint64_t size = hbitmap_serialization_size(hb, 0, BENCH_BITS);
+    uint8_t *buf = g_malloc(size);
+    unsigned n = 0;
+
+    g_test_timer_start();
+    do {
+        hbitmap_serialize_part(hb, buf, 0, BENCH_BITS);
+        hbitmap_deserialize_part(hb, buf, 0, BENCH_BITS, true);
+        n++;
+    } while (g_test_timer_elapsed() < 0.5);
+    g_test_message("serialize+deserialize 64 Mbit: %8.1f us",
+                   g_test_timer_last() * 1e6 / n);
+    g_free(buf);
+    hbitmap_free(hb);
+}
+
+static void test(const void *opaque)
+{
+    int accel_index = 0;
+
+    do {
+        g_test_message("accel #%d", accel_index);
+        bench_count();
+        bench_next_dirty_area();
+        bench_merge();
+        bench_serialize();
+        accel_index++;
+    } while (test_hbitmap_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_data_func("/hbitmap/speed", NULL, test);
+    return g_test_run();
+}
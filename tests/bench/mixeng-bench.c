@@ -0,0 +1,83 @@
+/*
+ * Audio mixing engine speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "audio/mixeng.h"
+
+/* 10 ms of stereo audio at 48 kHz, the default timer-period */
+#define FRAMES 480
+
+static int16_t pcm[FRAMES * 2];
+static struct st_sample buf[FRAMES], mix[FRAMES];
+
+static void bench_conv(void *rate)
+{
+    mixeng_conv[1][1][0][1](buf, pcm, FRAMES);
+}
+
+static void bench_clip(void *rate)
+{
+    mixeng_clip[1][1][0][1](pcm, buf, FRAMES);
+}
+
+static void bench_mix(void *rate)
+{
+    size_t isamp = FRAMES, osamp = FRAMES;
+
+    memset(mix, 0, sizeof(mix));
+    st_rate_flow_mix(rate, buf, mix, &isamp, &osamp);
+}
+
+static const struct {
+    const char *name;
+    void (*func)(void *rate);
+    int inrate;
+} benches[] = {
+    { "conv", bench_conv, 48000 },
+    { "clip", bench_clip, 48000 },
+    { "mix", bench_mix, 48000 },
+    { "resample+mix", bench_mix, 44100 },
+};
+
+static void test(const void *opaque)
+{
+    int accel_index = 0;
+    int i;
+
+    for (i = 0; i < FRAMES * 2; i++) {
+        pcm[i] = g_test_rand_int();
+    }
+    mixeng_conv[1][1][0][1](buf, pcm, FRAMES);
+
+    do {
+        if (accel_index != 0) {
+            g_test_message("%s", "");  /* gnu_printf Werror for simple "" */
+        }
+        for (i = 0; i < ARRAY_SIZE(benches); i++) {
+            void *rate = st_rate_start(benches[i].inrate, 48000);
+            double total = 0;
+
+            g_test_timer_start();
+            do {
+                benches[i].func(rate);
+                total += FRAMES;
+            } while (g_test_timer_elapsed() < 0.5);
+
+            g_test_message("%-12s #%d: %8.1f Mframes/sec", benches[i].name,
+                           accel_index, total / 1e6 / g_test_timer_last());
+            st_rate_stop(rate);
+        }
+        accel_index++;
+    } while (test_mixeng_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_data_func("/audio/mixeng/speed", NULL, test);
+    return g_test_run();
+}
@@ -0,0 +1,181 @@
+/*
+ * TCG code generation microbenchmarks
+ *
+ * Each kernel is a small loop that stresses one pattern the TCG host
+ * backends have to translate: compare-and-branch on the result of
+ * arithmetic, 32-bit arithmetic whose results are used as 64-bit
+ * values, and loads and stores with a variety of offsets.  Run it under
+ * a linux-user QEMU; comparing two QEMU builds shows the effect of a
+ * backend change on the generated code, for instance with
+ * scripts/performance/compare_builds.py.
+ *
+ * It only uses the C library, so that it can be built with a cross
+ * compiler for any guest.
+ *
+ * License: GNU GPL, version 2 or later.
+ *   See the COPYING file in the top-level directory.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define ARRAY_WORDS 4096
+
+static volatile uint64_t sink;
+static uint64_t array[ARRAY_WORDS];
+
+/* Logical ops feeding a test against zero.  */
+static uint64_t bench_logic_branch(uint64_t n)
+{
+    uint64_t x = 0x9e3779b97f4a7c15ull, hits = 0;
+
+    for (uint64_t i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        if ((x & 0x30) == 0) {
+            hits++;
+        }
+        if ((x | i) < 0x1000) {
+            hits += 2;
+        }
+    }
+    return hits;
+}
+
+/* Add and subtract feeding a test against zero.  */
+static uint64_t bench_arith_branch(uint64_t n)
+{
+    uint64_t acc = 0;
+    int64_t left = n;
+
+    while (left != 0) {
+        int64_t step = (left & 7) + 1;
+
+        if (step > left) {
+            step = left;
+        }
+        left -= step;
+        acc += step;
+        if (acc - n == 0) {
+            acc++;
+        }
+    }
+    return acc;
+}
+
+/* 32-bit arithmetic whose results index memory or widen to 64 bits.  */
+static uint64_t bench_zext(uint64_t n)
+{
+    uint32_t h = 2166136261u;
+    uint64_t sum = 0;
+
+    for (uint64_t i = 0; i < n; i++) {
+        h = (h ^ (uint32_t)i) * 16777619u;
+        sum += h;
+        sum += array[h % ARRAY_WORDS];
+    }
+    return sum;
+}
+
+/* Loads and stores through a base pointer with many offsets.  */
+static uint64_t bench_ldst(uint64_t n)
+{
+    uint64_t sum = 0;
+
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t *p = &array[i & 63];
+
+        p[0] += i;
+        p[1] ^= p[0];
+        sum += p[64] + p[512] + p[1024] + p[2048];
+        p[3000] = sum;
+    }
+    return sum;
+}
+
+static const struct {
+    const char *name;
+    uint64_t (*func)(uint64_t n);
+} benches[] = {
+    { "logic-branch", bench_logic_branch },
+    { "arith-branch", bench_arith_branch },
+    { "zext", bench_zext },
+    { "ldst", bench_ldst },
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *progname)
+{
+    fprintf(stderr, "Usage: %s [-n iterations] [bench...]\n", progname);
+    fprintf(stderr, "Benchmarks:");
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        fprintf(stderr, " %s", benches[i].name);
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t n = 50000000;
+    int first = 1;
+
+    if (argc > 2 && !strcmp(argv[1], "-n")) {
+        n = strtoull(argv[2], NULL, 0);
+        if (n == 0) {
+            usage(argv[0]);
+        }
+        first = 3;
+    }
+
+    for (int j = first; j < argc; j++) {
+        size_t i;
+
+        for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+            if (!strcmp(argv[j], benches[i].name)) {
+                break;
+            }
+        }
+        if (i == sizeof(benches) / sizeof(benches[0])) {
+            usage(argv[0]);
+        }
+    }
+
+    for (size_t i = 0; i < ARRAY_WORDS; i++) {
+        array[i] = i * 0x100000001b3ull;
+    }
+
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        double start, elapsed;
+
+        if (first < argc) {
+            int j;
+
+            for (j = first; j < argc; j++) {
+                if (!strcmp(argv[j], benches[i].name)) {
+                    break;
+                }
+            }
+            if (j == argc) {
+                continue;
+            }
+        }
+
+        start = now();
+        sink = benches[i].func(n);
+        elapsed = now() - start;
+        printf("%-14s %8.3f s %10.2f ns/iter\n",
+               benches[i].name, elapsed, elapsed * 1e9 / n);
+    }
+    return 0;
+}
@@ -0,0 +1,230 @@
+/*
+ * dump-guest-memory tests for the kdump-compressed formats
+ *
+ * Pages are compressed by a pool of threads and written back in order;
+ * check that every page descriptor of the dump matches the guest page
+ * with the same page frame number.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include <zlib.h>
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
+
+#define PAGE_SIZE           4096
+#define RAM_SIZE            (32 * MiB)
+
+/* Enough pages for several batches per compression thread */
+#define TEST_ADDR           (8 * MiB)
+#define TEST_PAGES          1024
+
+/* See include/sysemu/dump.h; x86_64 dumps are little endian */
+#define MDF_HEADER_SIZE     4096
+#define DUMP_DH_COMPRESSED_ZLIB     0x1
+#define DUMP_DH_COMPRESSED_ZSTD     0x20
+
+typedef struct QEMU_PACKED MakedumpfileDataHeader {
+    int64_t offset;
+    int64_t buf_size;
+} MakedumpfileDataHeader;
+
+typedef struct QEMU_PACKED DiskDumpHeader64 {
+    char signature[8];
+    uint32_t header_version;
+    char utsname[6 * 65];
+    char timestamp[22];
+    uint32_t status;
+    uint32_t block_size;
+    uint32_t sub_hdr_size;
+    uint32_t bitmap_blocks;
+} DiskDumpHeader64;
+
+typedef struct QEMU_PACKED PageDescriptor {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t flags;
+    uint64_t page_flags;
+} PageDescriptor;
+
+/*
+ * Even pages are random, so they do not compress and are stored as is;
+ * odd pages compress well.
+ */
+static void fill_page(uint8_t *page, uint64_t pfn)
+{
+    if (pfn & 1) {
+        memset(page, pfn | 1, PAGE_SIZE);
+    } else {
+        GRand *rand = g_rand_new_with_seed(pfn);
+        int i;
+
+        for (i = 0; i < PAGE_SIZE; i++) {
+            page[i] = g_rand_int(rand);
+        }
+        g_rand_free(rand);
+    }
+}
+
+/* Turn the makedumpfile flattened format back into the dump itself. */
+static GByteArray *unflatten(const uint8_t *buf, size_t len)
+{
+    GByteArray *dump = g_byte_array_new();
+    size_t pos = MDF_HEADER_SIZE;
+
+    g_assert_cmpmem(buf, strlen("makedumpfile"), "makedumpfile",
+                    strlen("makedumpfile"));
+    while (true) {
+        MakedumpfileDataHeader dh;
+        int64_t offset, size;
+
+        g_assert_cmpuint(pos + sizeof(dh), <=, len);
+        memcpy(&dh, buf + pos, sizeof(dh));
+        pos += sizeof(dh);
+        offset = be64_to_cpu(dh.offset);
+        size = be64_to_cpu(dh.buf_size);
+        if (offset == -1) {
+            break;
+        }
+
+        g_assert_cmpuint(pos + size, <=, len);
+        if (dump->len < offset + size) {
+            g_byte_array_set_size(dump, offset + size);
+        }
+        memcpy(dump->data + offset, buf + pos, size);
+        pos += size;
+    }
+    return dump;
+}
+
+static void uncompress_page(uint32_t flags, const uint8_t *data, size_t size,
+                            uint8_t *page)
+{
+    switch (flags) {
+    case 0:
+        g_assert_cmpuint(size, ==, PAGE_SIZE);
+        memcpy(page, data, PAGE_SIZE);
+        break;
+    case DUMP_DH_COMPRESSED_ZLIB: {
+        uLongf len = PAGE_SIZE;
+
+        g_assert_cmpint(uncompress(page, &len, data, size), ==, Z_OK);
+        g_assert_cmpuint(len, ==, PAGE_SIZE);
+        break;
+    }
+#ifdef CONFIG_ZSTD
+    case DUMP_DH_COMPRESSED_ZSTD:
+        g_assert_cmpuint(ZSTD_decompress(page, PAGE_SIZE, data, size), ==,
+                         PAGE_SIZE);
+        break;
+#endif
+    default:
+        g_assert_not_reached();
+    }
+}
+
+static void check_dump(const uint8_t *dump, size_t len, uint32_t compressed)
+{
+    const DiskDumpHeader64 *dh = (const DiskDumpHeader64 *)dump;
+    uint32_t block_size = le32_to_cpu(dh->block_size);
+    const uint8_t *bitmap;
+    const PageDescriptor *pd;
+    size_t bitmap_len, ndesc = 0;
+    uint8_t expected[PAGE_SIZE], page[PAGE_SIZE];
+    unsigned checked = 0, ncompressed = 0;
+    uint64_t pfn;
+
+    g_assert_cmpmem(dh->signature, 8, "KDUMP   ", 8);
+    g_assert_cmpuint(block_size, ==, PAGE_SIZE);
+    g_assert(le32_to_cpu(dh->status) & compressed);
+
+    /* Both copies of the bitmap are the same; only read the first */
+    bitmap = dump + (1 + le32_to_cpu(dh->sub_hdr_size)) * block_size;
+    bitmap_len = le32_to_cpu(dh->bitmap_blocks) / 2 * block_size;
+    pd = (const PageDescriptor *)(bitmap + 2 * bitmap_len);
+
+    for (pfn = 0; pfn < bitmap_len * 8; pfn++) {
+        if (!(bitmap[pfn / 8] & (1u << (pfn % 8)))) {
+            continue;
+        }
+        if (pfn >= TEST_ADDR / PAGE_SIZE &&
+            pfn < TEST_ADDR / PAGE_SIZE + TEST_PAGES) {
+            uint64_t offset = le64_to_cpu(pd[ndesc].offset);
+            uint32_t size = le32_to_cpu(pd[ndesc].size);
+            uint32_t flags = le32_to_cpu(pd[ndesc].flags);
+
+            g_assert_cmpuint(offset + size, <=, len);
+            uncompress_page(flags, dump + offset, size, page);
+            fill_page(expected, pfn);
+            g_assert_cmpmem(page, PAGE_SIZE, expected, PAGE_SIZE);
+            if (flags) {
+                g_assert_cmpuint(flags, ==, compressed);
+                ncompressed++;
+            }
+            checked++;
+        }
+        ndesc++;
+    }
+
+    g_assert_cmpuint(checked, ==, TEST_PAGES);
+    g_assert_cmpuint(ncompressed, ==, TEST_PAGES / 2);
+}
+
+static void test_kdump(const void *opaque)
+{
+    const char *format = opaque;
+    uint32_t compressed = g_str_equal(format, "kdump-zlib")
+                          ? DUMP_DH_COMPRESSED_ZLIB : DUMP_DH_COMPRESSED_ZSTD;
+    g_autofree char *path = NULL;
+    g_autofree char *protocol = NULL;
+    g_autofree uint8_t *contents = NULL;
+    g_autofree uint8_t *buf = g_malloc(TEST_PAGES * PAGE_SIZE);
+    g_autoptr(GByteArray) dump = NULL;
+    QTestState *qts;
+    QDict *resp;
+    size_t len;
+    int fd, i;
+
+    fd = g_file_open_tmp("qtest-dump-XXXXXX", &path, NULL);
+    g_assert(fd >= 0);
+    close(fd);
+    protocol = g_strconcat("file:", path, NULL);
+
+    qts = qtest_initf("-machine pc -m %d", (int)(RAM_SIZE / MiB));
+    for (i = 0; i < TEST_PAGES; i++) {
+        fill_page(buf + i * PAGE_SIZE, TEST_ADDR / PAGE_SIZE + i);
+    }
+    qtest_bufwrite(qts, TEST_ADDR, buf, TEST_PAGES * PAGE_SIZE);
+
+    resp = qtest_qmp(qts, "{ 'execute': 'dump-guest-memory', 'arguments': {"
+                     "  'paging': false, 'protocol': %s, 'format': %s } }",
+                     protocol, format);
+    g_assert(qdict_haskey(resp, "return"));
+    qobject_unref(resp);
+    qtest_quit(qts);
+
+    g_assert(g_file_get_contents(path, (char **)&contents, &len, NULL));
+    unlink(path);
+
+    dump = unflatten(contents, len);
+    check_dump(dump->data, dump->len, compressed);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    if (qtest_has_machine("pc")) {
+        qtest_add_data_func("dump/kdump-zlib", "kdump-zlib", test_kdump);
+#ifdef CONFIG_ZSTD
+        qtest_add_data_func("dump/kdump-zstd", "kdump-zstd", test_kdump);
+#endif
+    }
+
+    return g_test_run();
+}
@@ -0,0 +1,72 @@
+/*
+ * query-stats tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+
+/* Return the value of the scalar statistic @name in @result, or -1. */
+static int64_t stats_get_scalar(QDict *result, const char *name)
+{
+    QListEntry *e;
+
+    QLIST_FOREACH_ENTRY(qdict_get_qlist(result, "stats"), e) {
+        QDict *stat = qobject_to(QDict, qlist_entry_obj(e));
+
+        if (!strcmp(qdict_get_str(stat, "name"), name)) {
+            return qdict_get_int(stat, "value");
+        }
+    }
+    return -1;
+}
+
+/* Return the only result of query-stats for @target and @provider. */
+static QDict *stats_query_one(QTestState *qts, const char *target,
+                              const char *provider)
+{
+    QDict *resp, *result;
+    QList *results;
+
+    resp = qtest_qmp(qts, "{ 'execute': 'query-stats', 'arguments': {"
+                     "  'target': %s, 'providers': [ { 'provider': %s } ] } }",
+                     target, provider);
+    results = qdict_get_qlist(resp, "return");
+    g_assert_cmpint(qlist_size(results), ==, 1);
+    result = qobject_to(QDict, qlist_peek(results));
+    g_assert_cmpstr(qdict_get_str(result, "provider"), ==, provider);
+    qobject_ref(result);
+    qobject_unref(resp);
+    return result;
+}
+
+static void test_coroutine_pool(void)
+{
+    QTestState *qts = qtest_init("-machine none");
+    QDict *result = stats_query_one(qts, "vm", "coroutine-pool");
+
+    g_assert_cmpint(stats_get_scalar(result, "hits"), >=, 0);
+    g_assert_cmpint(stats_get_scalar(result, "misses"), >=, 0);
+    g_assert_cmpint(stats_get_scalar(result, "remote-batches"), >=, 0);
+    g_assert_cmpint(stats_get_scalar(result, "trimmed"), >=, 0);
+    g_assert_cmpint(stats_get_scalar(result, "size"), >=, 0);
+    g_assert_cmpint(stats_get_scalar(result, "size"), <=,
+                    stats_get_scalar(result, "max-size") +
+                    /* Overshooting by one batch is allowed */ 128);
+
+    qobject_unref(result);
+    qtest_quit(qts);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("stats/coroutine-pool", test_coroutine_pool);
+
+    return g_test_run();
+}
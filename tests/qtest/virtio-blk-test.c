@@ -12,6 +12,8 @@
 #include "libqtest-single.h"
 #include "qemu/bswap.h"
 #include "qemu/module.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
 #include "standard-headers/linux/virtio_blk.h"
 #include "standard-headers/linux/virtio_pci.h"
 #include "libqos/qgraph.h"
@@ -771,6 +773,157 @@ static void resize(void *obj, void *data, QGuestAllocator *t_alloc)
 
 }
 
+/* Submit a one-sector request of @type on @vq and wait for it. */
+static void stats_request(QTestState *qts, QVirtioDevice *dev,
+                          QGuestAllocator *alloc, QVirtQueue *vq,
+                          uint32_t type)
+{
+    QVirtioBlkReq req;
+    uint64_t req_addr;
+    uint32_t free_head;
+
+    req.type = type;
+    req.ioprio = 1;
+    req.sector = 0;
+    req.data = g_malloc0(512);
+
+    req_addr = virtio_blk_request(alloc, dev, &req, 512);
+
+    g_free(req.data);
+
+    free_head = qvirtqueue_add(qts, vq, req_addr, 16, false, true);
+    qvirtqueue_add(qts, vq, req_addr + 16, 512,
+                   type == VIRTIO_BLK_T_IN, true);
+    qvirtqueue_add(qts, vq, req_addr + 528, 1, true, false);
+    qvirtqueue_kick(qts, dev, vq, free_head);
+
+    qvirtio_wait_used_elem(qts, dev, vq, free_head, NULL,
+                           QVIRTIO_BLK_TIMEOUT_US);
+    g_assert_cmpint(readb(req_addr + 528), ==, VIRTIO_BLK_S_OK);
+
+    guest_free(alloc, req_addr);
+}
+
+/*
+ * Return the query-stats entry for @queue (none if negative) and
+ * @iothread (none if NULL), or NULL if there is none.
+ */
+static QDict *stats_find(QList *results, int queue, const char *iothread)
+{
+    QListEntry *e;
+
+    QLIST_FOREACH_ENTRY(results, e) {
+        QDict *result = qobject_to(QDict, qlist_entry_obj(e));
+
+        if (queue < 0 ? qdict_haskey(result, "queue")
+                      : (!qdict_haskey(result, "queue") ||
+                         qdict_get_int(result, "queue") != queue)) {
+            continue;
+        }
+        if (g_strcmp0(qdict_get_try_str(result, "iothread"), iothread)) {
+            continue;
+        }
+        return result;
+    }
+    return NULL;
+}
+
+static bool stats_has(QDict *result, const char *name)
+{
+    QListEntry *e;
+
+    QLIST_FOREACH_ENTRY(qdict_get_qlist(result, "stats"), e) {
+        QDict *stat = qobject_to(QDict, qlist_entry_obj(e));
+
+        if (!strcmp(qdict_get_str(stat, "name"), name)) {
+            g_assert_cmpint(qdict_get_int(stat, "value"), >, 0);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Check the per-queue block statistics of a device with two queues:
+ * reads go to queue 0 and writes to queue 1, and all of them complete
+ * in the AioContext of @data, an IOThread id or NULL for the main loop.
+ */
+static void query_stats(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioBlkPCI *blk = obj;
+    QVirtioDevice *dev = &blk->pci_vdev.vdev;
+    const char *iothread = data ? data : "#main-loop";
+    QTestState *qts = global_qtest;
+    QVirtQueue *vq[2];
+    uint64_t features;
+    QList *results;
+    QListEntry *e;
+    QDict *resp, *result;
+    int i;
+
+    features = qvirtio_get_features(dev);
+    g_assert(features & (1u << VIRTIO_BLK_F_MQ));
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                            (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                            (1u << VIRTIO_RING_F_EVENT_IDX) |
+                            (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    g_assert_cmpint(qvirtio_config_readw(dev,
+                        offsetof(struct virtio_blk_config, num_queues)),
+                    ==, 2);
+
+    for (i = 0; i < ARRAY_SIZE(vq); i++) {
+        vq[i] = qvirtqueue_setup(dev, t_alloc, i);
+    }
+    qvirtio_set_driver_ok(dev);
+
+    stats_request(qts, dev, t_alloc, vq[0], VIRTIO_BLK_T_IN);
+    stats_request(qts, dev, t_alloc, vq[1], VIRTIO_BLK_T_OUT);
+
+    resp = qtest_qmp(qts, "{ 'execute': 'query-stats', 'arguments': {"
+                     "  'target': 'block',"
+                     "  'providers': [ { 'provider': 'block' } ] } }");
+    results = qdict_get_qlist(resp, "return");
+
+    /* drive1 is not attached to a device, so it has no entries */
+    QLIST_FOREACH_ENTRY(results, e) {
+        result = qobject_to(QDict, qlist_entry_obj(e));
+        g_assert_cmpstr(qdict_get_str(result, "provider"), ==, "block");
+        g_assert(strstr(qdict_get_str(result, "qom-path"), "/drv0"));
+    }
+
+    result = stats_find(results, -1, NULL);
+    g_assert(result);
+    g_assert(stats_has(result, "read-latency-max"));
+    g_assert(stats_has(result, "write-latency-max"));
+
+    result = stats_find(results, 0, NULL);
+    g_assert(result);
+    g_assert(stats_has(result, "read-latency-p50"));
+    g_assert(!stats_has(result, "write-latency-p50"));
+
+    result = stats_find(results, 1, NULL);
+    g_assert(result);
+    g_assert(!stats_has(result, "read-latency-p50"));
+    g_assert(stats_has(result, "write-latency-p50"));
+
+    result = stats_find(results, -1, iothread);
+    g_assert(result);
+    g_assert(stats_has(result, "read-latency-max"));
+    g_assert(stats_has(result, "write-latency-max"));
+
+    /* Nothing completed anywhere else */
+    g_assert(!stats_find(results, -1, data ? "#main-loop" : "iothread0"));
+    g_assert_cmpint(qlist_size(results), ==, 4);
+
+    qobject_unref(resp);
+
+    for (i = 0; i < ARRAY_SIZE(vq); i++) {
+        qvirtqueue_cleanup(dev->bus, vq[i], t_alloc);
+    }
+}
+
 static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
 {
     char *tmp_path = drive_create();
@@ -802,6 +955,15 @@ static void register_virtio_blk_test(void)
     qos_add_test("nxvirtq", "virtio-blk-pci",
                       test_nonexistent_virtqueue, &opts);
     qos_add_test("hotplug", "virtio-blk-pci", pci_hotplug, &opts);
+
+    opts.edge.extra_device_opts = "num-queues=2";
+    qos_add_test("query-stats", "virtio-blk-pci", query_stats, &opts);
+
+    opts.edge.before_cmd_line = "-object iothread,id=iothread0";
+    opts.edge.extra_device_opts = "num-queues=2,iothread=iothread0";
+    opts.arg = (void *)"iothread0";
+    qos_add_test("query-stats-iothread", "virtio-blk-pci", query_stats,
+                 &opts);
 }
 
 libqos_init(register_virtio_blk_test);
@@ -10,8 +10,18 @@
 #include "qemu/osdep.h"
 #include "libqtest-single.h"
 #include "qemu/module.h"
+#include "standard-headers/linux/virtio_console.h"
 #include "libqos/virtio-serial.h"
 
+#define QVIRTIO_SERIAL_TIMEOUT_US (30 * 1000 * 1000)
+
+/*
+ * Enough data to fill the socket buffer many times over, so that the port
+ * is throttled with elements queued behind the one it stopped in.
+ */
+#define SERIAL_TX_BUFS      100
+#define SERIAL_TX_BUF_SIZE  30000
+
 /* Tests only initialization so far. TODO: Replace with functional tests */
 static void virtio_serial_nop(void *obj, void *data, QGuestAllocator *alloc)
 {
@@ -24,6 +34,198 @@ static void serial_hotplug(void *obj, void *data, QGuestAllocator *alloc)
     qtest_qmp_device_del(global_qtest, "hp-port");
 }
 
+#ifndef _WIN32
+
+typedef struct SerialTx {
+    QVirtQueue *rx;
+    QVirtQueue *tx;
+    uint64_t addr;
+    uint32_t head[SERIAL_TX_BUFS];
+} SerialTx;
+
+static uint8_t serial_tx_pattern(size_t offset)
+{
+    return offset % 251;
+}
+
+/*
+ * Set up port 0 without multiport, so that the port is open as soon as
+ * the driver is, and queue SERIAL_TX_BUFS buffers on its transmit queue.
+ */
+static void serial_tx_start(QVirtioDevice *dev, QGuestAllocator *alloc,
+                            SerialTx *t)
+{
+    QTestState *qts = global_qtest;
+    uint8_t *data = g_malloc(SERIAL_TX_BUF_SIZE);
+    uint64_t features;
+    int i, j;
+
+    features = qvirtio_get_features(dev);
+    features &= ~(QVIRTIO_F_BAD_FEATURE |
+                  (1ull << VIRTIO_RING_F_INDIRECT_DESC) |
+                  (1ull << VIRTIO_RING_F_EVENT_IDX) |
+                  (1ull << VIRTIO_CONSOLE_F_MULTIPORT));
+    qvirtio_set_features(dev, features);
+
+    t->rx = qvirtqueue_setup(dev, alloc, 0);
+    t->tx = qvirtqueue_setup(dev, alloc, 1);
+    qvirtio_set_driver_ok(dev);
+
+    t->addr = guest_alloc(alloc, SERIAL_TX_BUFS * SERIAL_TX_BUF_SIZE);
+    for (i = 0; i < SERIAL_TX_BUFS; i++) {
+        uint64_t addr = t->addr + i * SERIAL_TX_BUF_SIZE;
+
+        for (j = 0; j < SERIAL_TX_BUF_SIZE; j++) {
+            data[j] = serial_tx_pattern(i * SERIAL_TX_BUF_SIZE + j);
+        }
+        memwrite(addr, data, SERIAL_TX_BUF_SIZE);
+
+        t->head[i] = qvirtqueue_add(qts, t->tx, addr, SERIAL_TX_BUF_SIZE,
+                                    false, false);
+        qvirtqueue_kick(qts, dev, t->tx, t->head[i]);
+    }
+    g_free(data);
+}
+
+/*
+ * Wait until @count buffers have been returned on the transmit queue and
+ * store their heads in @used.  The device may return several buffers
+ * with a single interrupt, so poll the used ring instead of the ISR.
+ */
+static void serial_tx_wait_used(SerialTx *t, uint32_t *used, int count)
+{
+    gint64 start_time = g_get_monotonic_time();
+    int n = 0;
+
+    while (n < count) {
+        qtest_clock_step(global_qtest, 100);
+        while (n < count &&
+               qvirtqueue_get_buf(global_qtest, t->tx, &used[n], NULL)) {
+            n++;
+        }
+        g_assert(g_get_monotonic_time() - start_time <=
+                 QVIRTIO_SERIAL_TIMEOUT_US);
+    }
+}
+
+static void serial_tx_finish(QVirtioDevice *dev, QGuestAllocator *alloc,
+                             SerialTx *t)
+{
+    guest_free(alloc, t->addr);
+    qvirtqueue_cleanup(dev->bus, t->tx, alloc);
+    qvirtqueue_cleanup(dev->bus, t->rx, alloc);
+}
+
+/*
+ * The backend takes only part of the data at a time, so the elements are
+ * flushed in batches that end in the middle of an element.  All of the
+ * data must still arrive in order, and every buffer be returned once.
+ */
+static void serial_short_write(void *obj, void *data, QGuestAllocator *alloc)
+{
+    QVirtioSerial *serial = obj;
+    QVirtioDevice *dev = serial->vdev;
+    int *sv = data;
+    SerialTx t;
+    uint32_t used[SERIAL_TX_BUFS];
+    size_t total = SERIAL_TX_BUFS * SERIAL_TX_BUF_SIZE;
+    size_t offset = 0;
+    uint8_t buf[4096];
+    int i;
+
+    serial_tx_start(dev, alloc, &t);
+
+    while (offset < total) {
+        ssize_t ret = recv(sv[0], buf, MIN(sizeof(buf), total - offset), 0);
+
+        g_assert_cmpint(ret, >, 0);
+        for (i = 0; i < ret; i++) {
+            g_assert_cmpint(buf[i], ==, serial_tx_pattern(offset + i));
+        }
+        offset += ret;
+    }
+
+    serial_tx_wait_used(&t, used, SERIAL_TX_BUFS);
+    for (i = 0; i < SERIAL_TX_BUFS; i++) {
+        g_assert_cmpint(used[i], ==, t.head[i]);
+    }
+
+    serial_tx_finish(dev, alloc, &t);
+}
+
+/*
+ * Stop reading while the port is throttled, so that the next batch fails
+ * to be written and the port is closed in the middle of it.  The element
+ * that was partially written is dropped together with port->elem; every
+ * other one must be returned to the guest exactly once.
+ */
+static void serial_disconnect(void *obj, void *data, QGuestAllocator *alloc)
+{
+    QVirtioSerial *serial = obj;
+    QVirtioDevice *dev = serial->vdev;
+    int *sv = data;
+    SerialTx t;
+    uint32_t used[SERIAL_TX_BUFS];
+    bool seen[SERIAL_TX_BUFS] = { };
+    uint8_t buf[4096];
+    ssize_t ret;
+    int i, j;
+
+    serial_tx_start(dev, alloc, &t);
+
+    /*
+     * Drain what is already in the socket, which makes QEMU write again,
+     * but without a hangup that would close the port before the write.
+     */
+    g_assert_cmpint(shutdown(sv[0], SHUT_RD), ==, 0);
+    do {
+        ret = recv(sv[0], buf, sizeof(buf), 0);
+        g_assert_cmpint(ret, >=, 0);
+    } while (ret > 0);
+
+    serial_tx_wait_used(&t, used, SERIAL_TX_BUFS - 1);
+    for (i = 0; i < SERIAL_TX_BUFS - 1; i++) {
+        for (j = 0; j < SERIAL_TX_BUFS && t.head[j] != used[i]; j++) {
+            /* nothing */
+        }
+        g_assert_cmpint(j, <, SERIAL_TX_BUFS);
+        g_assert_false(seen[j]);
+        seen[j] = true;
+    }
+
+    /* Nothing else may come back, in particular no element twice */
+    qtest_clock_step(global_qtest, 100);
+    g_assert_false(qvirtqueue_get_buf(global_qtest, t.tx, NULL, NULL));
+
+    serial_tx_finish(dev, alloc, &t);
+}
+
+static void virtio_serial_test_cleanup(void *sockets)
+{
+    int *sv = sockets;
+
+    close(sv[0]);
+    qos_invalidate_command_line();
+    close(sv[1]);
+    g_free(sv);
+}
+
+static void *virtio_serial_test_setup(GString *cmd_line, void *arg)
+{
+    int ret;
+    int *sv = g_new(int, 2);
+
+    ret = socketpair(PF_UNIX, SOCK_STREAM, 0, sv);
+    g_assert_cmpint(ret, !=, -1);
+
+    g_string_append_printf(cmd_line, " -chardev socket,id=vs0,fd=%d ", sv[1]);
+
+    g_test_queue_destroy(virtio_serial_test_cleanup, sv);
+    return sv;
+}
+
+#endif /* _WIN32 */
+
 static void register_virtio_serial_test(void)
 {
     QOSGraphTestOptions opts = { };
@@ -35,5 +237,13 @@ static void register_virtio_serial_test(void)
     qos_add_test("serialport-nop", "virtio-serial", virtio_serial_nop, &opts);
 
     qos_add_test("hotplug", "virtio-serial", serial_hotplug, NULL);
+
+#ifndef _WIN32
+    opts.before = virtio_serial_test_setup;
+    opts.edge.before_cmd_line = "-device virtserialport,bus=vser0.0,nr=0,"
+                                "chardev=vs0";
+    qos_add_test("short-write", "virtio-serial", serial_short_write, &opts);
+    qos_add_test("disconnect", "virtio-serial", serial_disconnect, &opts);
+#endif
 }
 libqos_init(register_virtio_serial_test);
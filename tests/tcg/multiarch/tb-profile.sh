@@ -0,0 +1,37 @@
+#!/bin/sh
+#
+# Record a TB profile, then check that a second run pre-translates from
+# it and that a concurrent pair of runs keeps the profile intact.
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+set -e
+
+QEMU=$1
+BIN=$2
+PROFILE=$BIN.tbprofile
+
+rm -f "$PROFILE" "$PROFILE.lock" "$BIN.tblog"
+
+$QEMU -tb-profile "$PROFILE" "$BIN" > /dev/null
+if ! grep -q "^file [0-9a-f]* .*/$(basename "$BIN")\$" "$PROFILE"; then
+    echo "no profile recorded for $BIN"
+    exit 1
+fi
+
+$QEMU -tb-profile "$PROFILE" -d trace:tb_profile_queue -D "$BIN.tblog" \
+    "$BIN" > /dev/null
+if ! grep -q "tb_profile_queue .*$(basename "$BIN") at" "$BIN.tblog"; then
+    echo "$BIN was not pre-translated from the profile"
+    exit 1
+fi
+
+$QEMU -tb-profile "$PROFILE" "$BIN" > /dev/null &
+$QEMU -tb-profile "$PROFILE" "$BIN" > /dev/null
+wait $!
+if ! head -n 1 "$PROFILE" | grep -q "tb profile 1\$"; then
+    echo "profile corrupted by concurrent runs"
+    exit 1
+fi
+
+rm -f "$PROFILE" "$PROFILE.lock" "$BIN.tblog"
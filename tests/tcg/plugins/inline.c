@@ -20,13 +20,18 @@ typedef struct {
     uint64_t count_insn_inline;
     uint64_t count_mem;
     uint64_t count_mem_inline;
+    uint64_t count_mem_buffered;
     uint64_t tb_cond_num_trigger;
     uint64_t tb_cond_track_count;
     uint64_t insn_cond_num_trigger;
     uint64_t insn_cond_track_count;
+    uint64_t insn_sample_num_trigger;
+    uint64_t insn_sample_countdown;
 } CPUCount;
 
 static const uint64_t cond_trigger_limit = 100;
+static const size_t mem_buffer_records = 64;
+static const uint64_t insn_sample_period = 7;
 
 typedef struct {
     uint64_t data_insn;
@@ -41,14 +46,18 @@ static qemu_plugin_u64 count_insn;
 static qemu_plugin_u64 count_insn_inline;
 static qemu_plugin_u64 count_mem;
 static qemu_plugin_u64 count_mem_inline;
+static qemu_plugin_u64 count_mem_buffered;
 static qemu_plugin_u64 tb_cond_num_trigger;
 static qemu_plugin_u64 tb_cond_track_count;
 static qemu_plugin_u64 insn_cond_num_trigger;
 static qemu_plugin_u64 insn_cond_track_count;
+static qemu_plugin_u64 insn_sample_num_trigger;
+static qemu_plugin_u64 insn_sample_countdown;
 static struct qemu_plugin_scoreboard *data;
 static qemu_plugin_u64 data_insn;
 static qemu_plugin_u64 data_tb;
 static qemu_plugin_u64 data_mem;
+static struct qemu_plugin_mem_buffer *mem_buffer;
 
 static uint64_t global_count_tb;
 static uint64_t global_count_insn;
@@ -111,14 +120,17 @@ static void stats_mem(void)
     const uint64_t per_vcpu = qemu_plugin_u64_sum(count_mem);
     const uint64_t inl_per_vcpu =
         qemu_plugin_u64_sum(count_mem_inline);
+    const uint64_t buffered = qemu_plugin_u64_sum(count_mem_buffered);
     g_autoptr(GString) stats = g_string_new("");
     g_string_append_printf(stats, "mem: %" PRIu64 "\n", expected);
     g_string_append_printf(stats, "mem: %" PRIu64 " (per vcpu)\n", per_vcpu);
     g_string_append_printf(stats, "mem: %" PRIu64 " (per vcpu inline)\n", inl_per_vcpu);
+    g_string_append_printf(stats, "mem: %" PRIu64 " (buffered)\n", buffered);
     qemu_plugin_outs(stats->str);
     g_assert(expected > 0);
     g_assert(per_vcpu == expected);
     g_assert(inl_per_vcpu == expected);
+    g_assert(buffered == expected);
 }
 
 static void plugin_exit(qemu_plugin_id_t id, void *udata)
@@ -134,6 +146,8 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
         const uint64_t insn_inline = qemu_plugin_u64_get(count_insn_inline, i);
         const uint64_t mem = qemu_plugin_u64_get(count_mem, i);
         const uint64_t mem_inline = qemu_plugin_u64_get(count_mem_inline, i);
+        const uint64_t mem_buffered =
+            qemu_plugin_u64_get(count_mem_buffered, i);
         const uint64_t tb_cond_trigger =
             qemu_plugin_u64_get(tb_cond_num_trigger, i);
         const uint64_t tb_cond_left =
@@ -142,34 +156,41 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
             qemu_plugin_u64_get(insn_cond_num_trigger, i);
         const uint64_t insn_cond_left =
             qemu_plugin_u64_get(insn_cond_track_count, i);
+        const uint64_t insn_sample_trigger =
+            qemu_plugin_u64_get(insn_sample_num_trigger, i);
         g_string_printf(stats, "cpu %d: tb (%" PRIu64 ", %" PRIu64
                         ", %" PRIu64 " * %" PRIu64 " + %" PRIu64
                         ") | "
                         "insn (%" PRIu64 ", %" PRIu64
                         ", %" PRIu64 " * %" PRIu64 " + %" PRIu64
                         ") | "
-                        "mem (%" PRIu64 ", %" PRIu64 ")"
+                        "mem (%" PRIu64 ", %" PRIu64 ", %" PRIu64 ")"
                         "\n",
                         i,
                         tb, tb_inline,
                         tb_cond_trigger, cond_trigger_limit, tb_cond_left,
                         insn, insn_inline,
                         insn_cond_trigger, cond_trigger_limit, insn_cond_left,
-                        mem, mem_inline);
+                        mem, mem_inline, mem_buffered);
         qemu_plugin_outs(stats->str);
         g_assert(tb == tb_inline);
         g_assert(insn == insn_inline);
         g_assert(mem == mem_inline);
+        g_assert(mem == mem_buffered);
         g_assert(tb_cond_trigger == tb / cond_trigger_limit);
         g_assert(tb_cond_left == tb % cond_trigger_limit);
         g_assert(insn_cond_trigger == insn / cond_trigger_limit);
         g_assert(insn_cond_left == insn % cond_trigger_limit);
+        /* a zeroed countdown fires on the first insn */
+        g_assert(insn_sample_trigger ==
+                 (insn + insn_sample_period - 1) / insn_sample_period);
     }
 
     stats_tb();
     stats_insn();
     stats_mem();
 
+    qemu_plugin_mem_buffer_free(mem_buffer);
     qemu_plugin_scoreboard_free(counts);
     qemu_plugin_scoreboard_free(data);
 }
@@ -202,6 +223,13 @@ static void vcpu_insn_cond_exec(unsigned int cpu_index, void *udata)
     qemu_plugin_u64_add(insn_cond_num_trigger, cpu_index, 1);
 }
 
+static void vcpu_insn_sampled_exec(unsigned int cpu_index, void *udata)
+{
+    g_assert(qemu_plugin_u64_get(insn_sample_countdown, cpu_index) ==
+             insn_sample_period - 1);
+    qemu_plugin_u64_add(insn_sample_num_trigger, cpu_index, 1);
+}
+
 static void vcpu_insn_exec(unsigned int cpu_index, void *udata)
 {
     qemu_plugin_u64_add(count_insn, cpu_index, 1);
@@ -223,6 +251,18 @@ static void vcpu_mem_access(unsigned int cpu_index,
     g_mutex_unlock(&mem_lock);
 }
 
+static void vcpu_mem_buffer(unsigned int cpu_index,
+                            const qemu_plugin_mem_record *records,
+                            size_t n_records, void *udata)
+{
+    g_assert(n_records > 0 && n_records <= mem_buffer_records);
+    for (size_t i = 0; i < n_records; ++i) {
+        /* every record carries the mem_store value of its insn */
+        g_assert(records[i].userdata != 0);
+    }
+    qemu_plugin_u64_add(count_mem_buffered, cpu_index, n_records);
+}
+
 static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 {
     void *tb_store = tb;
@@ -259,6 +299,10 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
             QEMU_PLUGIN_COND_EQ, insn_cond_track_count, cond_trigger_limit,
             insn_store);
 
+        qemu_plugin_register_vcpu_insn_exec_sampled_cb(
+            insn, vcpu_insn_sampled_exec, QEMU_PLUGIN_CB_NO_REGS,
+            insn_sample_countdown, insn_sample_period, insn_store);
+
         qemu_plugin_register_vcpu_mem_inline_per_vcpu(
             insn, QEMU_PLUGIN_MEM_RW,
             QEMU_PLUGIN_INLINE_STORE_U64,
@@ -270,6 +314,9 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
             insn, QEMU_PLUGIN_MEM_RW,
             QEMU_PLUGIN_INLINE_ADD_U64,
             count_mem_inline, 1);
+        qemu_plugin_register_vcpu_mem_buffer(insn, mem_buffer,
+                                             QEMU_PLUGIN_MEM_RW,
+                                             (uintptr_t) mem_store);
     }
 }
 
@@ -290,6 +337,8 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
         counts, CPUCount, count_insn_inline);
     count_mem_inline = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, count_mem_inline);
+    count_mem_buffered = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_mem_buffered);
     tb_cond_num_trigger = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, tb_cond_num_trigger);
     tb_cond_track_count = qemu_plugin_scoreboard_u64_in_struct(
@@ -298,10 +347,16 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
         counts, CPUCount, insn_cond_num_trigger);
     insn_cond_track_count = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, insn_cond_track_count);
+    insn_sample_num_trigger = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, insn_sample_num_trigger);
+    insn_sample_countdown = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, insn_sample_countdown);
     data = qemu_plugin_scoreboard_new(sizeof(CPUData));
     data_insn = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_insn);
     data_tb = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_tb);
     data_mem = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_mem);
+    mem_buffer = qemu_plugin_mem_buffer_new(mem_buffer_records,
+                                            vcpu_mem_buffer, NULL);
 
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
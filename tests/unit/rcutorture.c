@@ -63,6 +63,7 @@
 #include "qemu/atomic.h"
 #include "qemu/rcu.h"
 #include "qemu/thread.h"
+#include "qemu/notify.h"
 
 int nthreadsrunning;
 
@@ -236,6 +237,7 @@ struct rcu_stress {
 struct rcu_stress rcu_stress_array[RCU_STRESS_PIPE_LEN] = { { 0 } };
 struct rcu_stress *rcu_stress_current;
 int n_mberror;
+static bool rcu_stress_expedited;
 
 /* Updates protected by counts_mutex */
 long long rcu_stress_count[RCU_STRESS_PIPE_LEN + 1];
@@ -334,7 +336,11 @@ static void *rcu_update_stress_test(void *arg)
                            rcu_stress_array[i].age + 1);
             }
         }
-        synchronize_rcu();
+        if (rcu_stress_expedited) {
+            synchronize_rcu_expedited();
+        } else {
+            synchronize_rcu();
+        }
         n_updates++;
     }
 
@@ -433,6 +439,74 @@ static void gtest_stress_10_5(void)
     gtest_stress(10, 5);
 }
 
+static void gtest_stress_expedited(int nreaders, int duration)
+{
+    RCUStats before, after;
+
+    rcu_get_stats(&before);
+    rcu_stress_expedited = true;
+    gtest_stress(nreaders, duration);
+    rcu_stress_expedited = false;
+    rcu_get_stats(&after);
+    g_assert_cmpuint(after.expedited_grace_periods, >,
+                     before.expedited_grace_periods);
+}
+
+static void gtest_stress_expedited_10_1(void)
+{
+    gtest_stress_expedited(10, 1);
+}
+
+static void gtest_stress_expedited_10_5(void)
+{
+    gtest_stress_expedited(10, 5);
+}
+
+/*
+ * Expedited grace periods: a reader that only leaves its critical
+ * section when its force-RCU notifier runs must not hold up
+ * synchronize_rcu_expedited() forever.
+ */
+
+static QemuEvent force_rcu_reader_ready;
+static QemuEvent force_rcu_requested;
+
+static void force_rcu_notify(Notifier *n, void *data)
+{
+    qemu_event_set(&force_rcu_requested);
+}
+
+static void *rcu_force_rcu_reader(void *arg)
+{
+    Notifier force_rcu = { .notify = force_rcu_notify };
+
+    rcu_register_thread();
+    rcu_add_force_rcu_notifier(&force_rcu);
+
+    rcu_read_lock();
+    qemu_event_set(&force_rcu_reader_ready);
+    qemu_event_wait(&force_rcu_requested);
+    rcu_read_unlock();
+
+    rcu_remove_force_rcu_notifier(&force_rcu);
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void gtest_expedited_force_rcu(void)
+{
+    qemu_event_init(&force_rcu_reader_ready, false);
+    qemu_event_init(&force_rcu_requested, false);
+
+    create_thread(rcu_force_rcu_reader);
+    qemu_event_wait(&force_rcu_reader_ready);
+    synchronize_rcu_expedited();
+    wait_all_threads();
+
+    qemu_event_destroy(&force_rcu_reader_ready);
+    qemu_event_destroy(&force_rcu_requested);
+}
+
 /*
  * Mainprogram.
  */
@@ -455,10 +529,16 @@ int main(int argc, char *argv[])
         if (g_test_quick()) {
             g_test_add_func("/rcu/torture/1reader", gtest_stress_1_1);
             g_test_add_func("/rcu/torture/10readers", gtest_stress_10_1);
+            g_test_add_func("/rcu/torture/10readers-expedited",
+                            gtest_stress_expedited_10_1);
         } else {
             g_test_add_func("/rcu/torture/1reader", gtest_stress_1_5);
             g_test_add_func("/rcu/torture/10readers", gtest_stress_10_5);
+            g_test_add_func("/rcu/torture/10readers-expedited",
+                            gtest_stress_expedited_10_5);
         }
+        g_test_add_func("/rcu/torture/expedited-force-rcu",
+                        gtest_expedited_force_rcu);
         return g_test_run();
     }
 
@@ -0,0 +1,79 @@
+/*
+ * QEMU buffer_diff_tiles test
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/bitmap.h"
+
+#define BUF_SIZE 4096
+
+static uint8_t buf_a[BUF_SIZE], buf_b[BUF_SIZE];
+
+static void test_tiles(size_t len, size_t tile)
+{
+    size_t n = DIV_ROUND_UP(len, tile);
+    g_autofree unsigned long *check = bitmap_new(n);
+    g_autofree unsigned long *diff = bitmap_new(n);
+    size_t i, o;
+
+    memset(buf_b, 0x55, len);
+    memcpy(buf_a, buf_b, len);
+    g_assert_cmpint(buffer_diff_tiles(buf_a, buf_b, len, tile, NULL, diff),
+                    ==, 0);
+    g_assert(bitmap_empty(diff, n));
+
+    /* A difference at each offset of each tile is found.  */
+    for (o = 0; o < len; o++) {
+        buf_a[o] ^= 1;
+        g_assert_cmpint(buffer_diff_tiles(buf_a, buf_b, len, tile, NULL, diff),
+                        ==, 1);
+        g_assert(test_bit(o / tile, diff));
+        buf_a[o] ^= 1;
+    }
+
+    /* Only the tiles in @check are compared.  */
+    for (i = 0; i < n; i++) {
+        buf_a[i * tile] ^= 1;
+    }
+    for (i = 0; i < n; i += 3) {
+        set_bit(i, check);
+    }
+    g_assert_cmpint(buffer_diff_tiles(buf_a, buf_b, len, tile, check, diff),
+                    ==, DIV_ROUND_UP(n, 3));
+    for (i = 0; i < n; i++) {
+        g_assert_cmpint(test_bit(i, diff), ==, i % 3 == 0);
+    }
+}
+
+static void test_1(void)
+{
+    static const size_t tiles[] = { 1, 3, 16, 31, 32, 48, 64, 100, 128 };
+    static const size_t lens[] = { 1, 15, 64, 65, 257, 1000 };
+    size_t i, j;
+
+    for (i = 0; i < ARRAY_SIZE(tiles); i++) {
+        for (j = 0; j < ARRAY_SIZE(lens); j++) {
+            test_tiles(lens[j], tiles[i]);
+        }
+    }
+}
+
+static void test_2(void)
+{
+    do {
+        test_1();
+    } while (test_buffer_diff_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/cutils/bufferdiff", test_2);
+
+    return g_test_run();
+}
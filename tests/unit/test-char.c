@@ -129,6 +129,10 @@ static void char_stdio_test(void)
 
 static void char_ringbuf_test(void)
 {
+    struct iovec iov[] = {
+        { .iov_base = (void *)"a", .iov_len = 1 },
+        { .iov_base = (void *)"bc", .iov_len = 2 },
+    };
     QemuOpts *opts;
     Chardev *chr;
     CharBackend be;
@@ -164,6 +168,13 @@ static void char_ringbuf_test(void)
     g_assert_cmpstr(data, ==, "");
     g_free(data);
 
+    ret = qemu_chr_fe_writev(&be, iov, ARRAY_SIZE(iov));
+    g_assert_cmpint(ret, ==, 3);
+
+    data = qmp_ringbuf_read("ringbuf-label", 4, false, 0, &error_abort);
+    g_assert_cmpstr(data, ==, "bc");
+    g_free(data);
+
     qemu_chr_fe_deinit(&be, true);
 
     /* check alias */
@@ -1287,6 +1298,10 @@ static void char_file_fifo_test(void)
 
 static void char_file_test_internal(Chardev *ext_chr, const char *filepath)
 {
+    struct iovec iov[] = {
+        { .iov_base = (void *)"wor", .iov_len = 3 },
+        { .iov_base = (void *)"ld!", .iov_len = 3 },
+    };
     char *tmp_path = g_dir_make_tmp("qemu-test-char.XXXXXX", NULL);
     char *out;
     Chardev *chr;
@@ -1309,11 +1324,13 @@ static void char_file_test_internal(Chardev *ext_chr, const char *filepath)
     }
     ret = qemu_chr_write_all(chr, (uint8_t *)"hello!", 6);
     g_assert_cmpint(ret, ==, 6);
+    ret = qemu_chr_writev(chr, iov, ARRAY_SIZE(iov));
+    g_assert_cmpint(ret, ==, 6);
 
     ret = g_file_get_contents(out, &contents, &length, NULL);
     g_assert(ret == TRUE);
-    g_assert_cmpint(length, ==, 6);
-    g_assert(strncmp(contents, "hello!", 6) == 0);
+    g_assert_cmpint(length, ==, 12);
+    g_assert(strncmp(contents, "hello!world!", 12) == 0);
 
     if (!ext_chr) {
         object_unparent(OBJECT(chr));
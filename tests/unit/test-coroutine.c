@@ -13,6 +13,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/coroutine_int.h"
+#include "qemu/thread.h"
 
 /*
  * Check that qemu_in_coroutine() works
@@ -637,6 +638,140 @@ static void perf_cost(void)
                    (unsigned long)(1000000000.0 * duration / maxcycles));
 }
 
+/*
+ * Check the coroutine pool and its statistics
+ */
+
+/* Size of a pool batch, see util/qemu-coroutine.c */
+#define POOL_BATCH_SIZE 128
+
+static void coroutine_fn pool_yield_entry(void *opaque)
+{
+    qemu_coroutine_yield();
+}
+
+/* Run @n coroutines that are all alive at the same time */
+static void pool_run_concurrent(unsigned int n)
+{
+    g_autofree Coroutine **cos = g_new(Coroutine *, n);
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        cos[i] = qemu_coroutine_create(pool_yield_entry, NULL);
+        qemu_coroutine_enter(cos[i]);
+    }
+    for (i = 0; i < n; i++) {
+        qemu_coroutine_enter(cos[i]);
+    }
+}
+
+static void *pool_fill_thread(void *opaque)
+{
+    /*
+     * The local pool keeps two batches, so this returns at least one
+     * full batch to the global pool.
+     */
+    pool_run_concurrent(4 * POOL_BATCH_SIZE);
+    return NULL;
+}
+
+static void *pool_take_thread(void *opaque)
+{
+    pool_run_concurrent(POOL_BATCH_SIZE / 2);
+    return NULL;
+}
+
+static void pool_run_thread(void *(*fn)(void *))
+{
+    QemuThread thread;
+
+    qemu_thread_create(&thread, "pool", fn, NULL, QEMU_THREAD_JOINABLE);
+    qemu_thread_join(&thread);
+}
+
+static bool pool_has_global(void)
+{
+    CoroutinePoolStats stats;
+
+    qemu_coroutine_get_pool_stats(&stats);
+    if (stats.max_size < POOL_BATCH_SIZE) {
+        g_test_skip("global coroutine pool disabled by vm.max_map_count");
+        return false;
+    }
+    return true;
+}
+
+static void test_pool_hits(void)
+{
+    CoroutinePoolStats before, after;
+    int i;
+
+    qemu_coroutine_get_pool_stats(&before);
+    for (i = 0; i < 10; i++) {
+        Coroutine *co = qemu_coroutine_create(pool_yield_entry, NULL);
+
+        qemu_coroutine_enter(co);
+        qemu_coroutine_enter(co);
+    }
+    qemu_coroutine_get_pool_stats(&after);
+
+    /* Only the first one may need a new coroutine */
+    g_assert_cmpuint(after.hits + after.misses, ==,
+                     before.hits + before.misses + 10);
+    g_assert_cmpuint(after.hits, >=, before.hits + 9);
+}
+
+/*
+ * A batch returned by one thread is used by another, whichever NUMA node
+ * either of them runs on: a thread takes from the pool of its own node
+ * first and steals from the others before allocating new coroutines.
+ */
+static void test_pool_nodes(void)
+{
+    CoroutinePoolStats before, after;
+
+    if (!pool_has_global()) {
+        return;
+    }
+
+    pool_run_thread(pool_fill_thread);
+    qemu_coroutine_get_pool_stats(&before);
+    g_assert_cmpuint(before.size, >=, POOL_BATCH_SIZE);
+
+    pool_run_thread(pool_take_thread);
+    qemu_coroutine_get_pool_stats(&after);
+    g_assert_cmpuint(after.misses, ==, before.misses);
+    g_assert_cmpuint(after.hits, ==, before.hits + POOL_BATCH_SIZE / 2);
+    g_assert_cmpuint(after.size, ==, before.size - POOL_BATCH_SIZE);
+    g_assert_cmpuint(after.remote_batches, <=, before.remote_batches + 1);
+}
+
+/*
+ * Coroutines that sit unused in the global pool for a whole trim
+ * interval (2 seconds) are freed at the end of the next one.  Allow for
+ * a couple more intervals in case the threads run on different nodes.
+ */
+static void test_pool_trim(void)
+{
+    CoroutinePoolStats before, after;
+    int i;
+
+    if (!pool_has_global()) {
+        return;
+    }
+
+    qemu_coroutine_get_pool_stats(&before);
+    for (i = 0; i < 6; i++) {
+        pool_run_thread(pool_fill_thread);
+        qemu_coroutine_get_pool_stats(&after);
+        if (after.trimmed > before.trimmed) {
+            break;
+        }
+        g_usleep(2100 * 1000);
+    }
+    g_assert_cmpuint(after.trimmed, >=, before.trimmed + POOL_BATCH_SIZE / 2);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -656,6 +791,11 @@ int main(int argc, char **argv)
     g_test_add_func("/basic/entered", test_entered);
     g_test_add_func("/basic/in_coroutine", test_in_coroutine);
     g_test_add_func("/basic/order", test_order);
+    if (IS_ENABLED(CONFIG_COROUTINE_POOL)) {
+        g_test_add_func("/pool/hits", test_pool_hits);
+        g_test_add_func("/pool/nodes", test_pool_nodes);
+        g_test_add_func("/pool/trim", test_pool_trim);
+    }
     g_test_add_func("/locking/co-mutex", test_co_mutex);
     g_test_add_func("/locking/co-mutex/lockable", test_co_mutex_lockable);
     g_test_add_func("/locking/co-rwlock/upgrade", test_co_rwlock_upgrade);
@@ -0,0 +1,112 @@
+/*
+ * AES-XTS acceleration tests
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "crypto/aes-xts.h"
+
+/* Static, for the alignment of the round keys */
+static AESXTSKey key;
+
+/* IEEE 1619 vector #2 */
+static const uint8_t vec_key[32] = {
+    0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+    0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+    0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+    0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22, 0x22,
+};
+static const uint8_t vec_iv[AES_BLOCK_SIZE] = {
+    0x33, 0x33, 0x33, 0x33, 0x33,
+};
+static const uint8_t vec_ctx[32] = {
+    0xc4, 0x54, 0x18, 0x5e, 0x6a, 0x16, 0x93, 0x6e,
+    0x39, 0x33, 0x40, 0x38, 0xac, 0xef, 0x83, 0x8b,
+    0xfb, 0x18, 0x6f, 0xff, 0x74, 0x80, 0xad, 0xc4,
+    0x28, 0x93, 0x82, 0xec, 0xd6, 0xd3, 0x94, 0xf0,
+};
+
+static void test_vector(void)
+{
+    uint8_t buf[sizeof(vec_ctx)];
+
+    g_assert_cmpint(aes_xts_set_key(&key, vec_key, sizeof(vec_key)), ==, 0);
+    do {
+        memset(buf, 0x44, sizeof(buf));
+        aes_xts_encrypt(&key, vec_iv, sizeof(buf), buf, buf);
+        g_assert_cmpmem(buf, sizeof(buf), vec_ctx, sizeof(vec_ctx));
+        aes_xts_decrypt(&key, vec_iv, sizeof(buf), buf, buf);
+        g_assert_cmpuint(buf[0], ==, 0x44);
+        g_assert_cmpuint(buf[sizeof(buf) - 1], ==, 0x44);
+    } while (test_aes_xts_next_accel());
+}
+
+static void fill_random(uint8_t *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        buf[i] = g_test_rand_int();
+    }
+}
+
+/* Sum of all lengths from one block up to MAX_BLOCKS blocks */
+#define MAX_BLOCKS  64
+#define TOTAL_LEN   (MAX_BLOCKS * (MAX_BLOCKS + 1) / 2 * AES_BLOCK_SIZE)
+
+/*
+ * Run every implementation on all lengths up to and past the interleaved
+ * groups, with unaligned buffers, and compare the results with those of
+ * the portable one, which runs last.
+ */
+static void test_accel(const void *opaque)
+{
+    size_t nkey = (uintptr_t)opaque;
+    g_autofree uint8_t *userkey = g_malloc(nkey);
+    g_autofree uint8_t *src = g_malloc(TOTAL_LEN + 1);
+    g_autoptr(GPtrArray) results = g_ptr_array_new_with_free_func(g_free);
+    uint8_t iv[AES_BLOCK_SIZE];
+    uint8_t tmp[MAX_BLOCKS * AES_BLOCK_SIZE];
+    uint8_t *enc, *dec, *ref;
+    size_t len, pos;
+    unsigned i;
+
+    fill_random(userkey, nkey);
+    fill_random(iv, sizeof(iv));
+    fill_random(src, TOTAL_LEN + 1);
+    g_assert_cmpint(aes_xts_set_key(&key, userkey, nkey), ==, 0);
+
+    do {
+        enc = g_malloc0(TOTAL_LEN * 2 + 1);
+        dec = enc + TOTAL_LEN + 1;
+        for (len = AES_BLOCK_SIZE, pos = 0; pos < TOTAL_LEN;
+             pos += len, len += AES_BLOCK_SIZE) {
+            /* Out of place and misaligned */
+            aes_xts_encrypt(&key, iv, len, enc + pos + 1, src + pos + 1);
+            aes_xts_decrypt(&key, iv, len, tmp, enc + pos + 1);
+            g_assert_cmpmem(tmp, len, src + pos + 1, len);
+
+            /* In place */
+            memcpy(dec + pos, src + pos, len);
+            aes_xts_decrypt(&key, iv, len, dec + pos, dec + pos);
+        }
+        g_ptr_array_add(results, enc);
+    } while (test_aes_xts_next_accel());
+
+    ref = g_ptr_array_index(results, results->len - 1);
+    for (i = 0; i < results->len - 1; i++) {
+        enc = g_ptr_array_index(results, i);
+        g_assert_cmpmem(enc, TOTAL_LEN * 2 + 1, ref, TOTAL_LEN * 2 + 1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/crypto/aes-xts/vector", test_vector);
+    g_test_add_data_func("/crypto/aes-xts/accel/128", (void *)32, test_accel);
+    g_test_add_data_func("/crypto/aes-xts/accel/192", (void *)48, test_accel);
+    g_test_add_data_func("/crypto/aes-xts/accel/256", (void *)64, test_accel);
+    return g_test_run();
+}
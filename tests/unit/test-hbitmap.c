@@ -11,6 +11,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/hbitmap.h"
+#include "qapi/error.h"
 #include "qemu/bitmap.h"
 #include "block/block.h"
 
@@ -1042,6 +1043,131 @@ static void test_hbitmap_next_dirty_area_after_truncate(TestHBitmapData *data,
     test_hbitmap_next_dirty_area_check(data, 0, INT64_MAX);
 }
 
+static void test_hbitmap_sparse_compare(HBitmap *dense, HBitmap *sparse,
+                                        uint64_t size)
+{
+    g_autofree char *dense_hash = hbitmap_sha256(dense, &error_abort);
+    g_autofree char *sparse_hash = hbitmap_sha256(sparse, &error_abort);
+    uint64_t i;
+
+    g_assert_cmpint(hbitmap_count(sparse), ==, hbitmap_count(dense));
+    for (i = 0; i < size; i++) {
+        g_assert_cmpint(hbitmap_get(sparse, i), ==, hbitmap_get(dense, i));
+    }
+    for (i = 0; i < size; i += 4099) {
+        g_assert_cmpint(hbitmap_next_dirty(sparse, i, size - i), ==,
+                        hbitmap_next_dirty(dense, i, size - i));
+        g_assert_cmpint(hbitmap_next_zero(sparse, i, size - i), ==,
+                        hbitmap_next_zero(dense, i, size - i));
+    }
+    g_assert_cmpstr(sparse_hash, ==, dense_hash);
+}
+
+/* Apply the same operations to a dense and a sparse bitmap.  */
+static void test_hbitmap_sparse(void)
+{
+    const uint64_t size = 5 * 32768 + 77;
+    HBitmap *dense = hbitmap_alloc(size, 0);
+    HBitmap *sparse = hbitmap_alloc(size, 0);
+    HBitmap *other = hbitmap_alloc_sparse(size, 0, true);
+    uint64_t buf_size = hbitmap_serialization_size(dense, 0, size);
+    g_autofree uint8_t *dense_buf = g_malloc(buf_size);
+    g_autofree uint8_t *sparse_buf = g_malloc(buf_size);
+
+    hbitmap_set_sparse(sparse, true);
+    g_assert(hbitmap_is_sparse(sparse));
+    g_assert(hbitmap_is_sparse(other));
+    g_assert_cmpint(hbitmap_count(other), ==, 0);
+    test_hbitmap_sparse_compare(dense, sparse, size);
+
+    hbitmap_set(dense, 100, 70000);
+    hbitmap_set(sparse, 100, 70000);
+    hbitmap_set(dense, size - 5, 5);
+    hbitmap_set(sparse, size - 5, 5);
+    test_hbitmap_sparse_compare(dense, sparse, size);
+
+    /* Clearing whole chunks frees them */
+    hbitmap_reset(dense, 0, 70000);
+    hbitmap_reset(sparse, 0, 70000);
+    test_hbitmap_sparse_compare(dense, sparse, size);
+
+    hbitmap_set(other, 40000, 100000);
+    hbitmap_merge(sparse, other, sparse);
+    hbitmap_merge(dense, other, dense);
+    test_hbitmap_sparse_compare(dense, sparse, size);
+
+    hbitmap_serialize_part(dense, dense_buf, 0, size);
+    hbitmap_serialize_part(sparse, sparse_buf, 0, size);
+    g_assert(memcmp(dense_buf, sparse_buf, buf_size) == 0);
+    hbitmap_reset_all(sparse);
+    hbitmap_deserialize_part(sparse, dense_buf, 0, size, true);
+    test_hbitmap_sparse_compare(dense, sparse, size);
+
+    hbitmap_truncate(dense, size * 3);
+    hbitmap_truncate(sparse, size * 3);
+    hbitmap_set(dense, size * 2, 10);
+    hbitmap_set(sparse, size * 2, 10);
+    test_hbitmap_sparse_compare(dense, sparse, size * 3);
+    hbitmap_truncate(dense, 1000);
+    hbitmap_truncate(sparse, 1000);
+    test_hbitmap_sparse_compare(dense, sparse, 1000);
+
+    hbitmap_set_sparse(sparse, false);
+    g_assert(!hbitmap_is_sparse(sparse));
+    test_hbitmap_sparse_compare(dense, sparse, 1000);
+
+    hbitmap_free(dense);
+    hbitmap_free(sparse);
+    hbitmap_free(other);
+}
+
+/*
+ * Check the word kernels against hbitmap_get(), with every implementation
+ * that the host supports.  This must run last, because it leaves the
+ * slowest implementation selected.
+ */
+static void test_hbitmap_accel(void)
+{
+    const uint64_t size = 64 * 1024 + 77;
+    HBitmap *a = hbitmap_alloc(size, 0);
+    HBitmap *b = hbitmap_alloc(size, 0);
+    HBitmap *r = hbitmap_alloc(size, 0);
+    uint64_t i, count;
+
+    for (i = 0; i < size; i += 3) {
+        hbitmap_set(a, i, 2);
+    }
+    hbitmap_set(b, 1000, 40000);
+    hbitmap_reset(b, 30000, 1);
+
+    do {
+        hbitmap_merge(a, b, r);
+        count = 0;
+        for (i = 0; i < size; i++) {
+            bool bit = hbitmap_get(a, i) || hbitmap_get(b, i);
+
+            g_assert_cmpint(hbitmap_get(r, i), ==, bit);
+            count += bit;
+        }
+        g_assert_cmpint(hbitmap_count(r), ==, count);
+
+        /* hb_count_between on a dense bitmap */
+        hbitmap_reset(r, 5, size - 10);
+        count = 0;
+        for (i = 0; i < size; i++) {
+            count += hbitmap_get(r, i);
+        }
+        g_assert_cmpint(hbitmap_count(r), ==, count);
+
+        g_assert_cmpint(hbitmap_next_zero(b, 1000, size), ==, 30000);
+        g_assert_cmpint(hbitmap_next_zero(b, 30001, size), ==, 41000);
+    } while (test_hbitmap_next_accel());
+
+    hbitmap_free(a);
+    hbitmap_free(b);
+    hbitmap_free(r);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -1113,6 +1239,9 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/next_dirty_area/next_dirty_area_after_truncate",
                      test_hbitmap_next_dirty_area_after_truncate);
 
+    g_test_add_func("/hbitmap/sparse", test_hbitmap_sparse);
+    g_test_add_func("/hbitmap/accel", test_hbitmap_accel);
+
     g_test_run();
 
     return 0;
@@ -0,0 +1,139 @@
+/*
+ * Lock-free log-linear histogram tests
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include <math.h>
+#include "qemu/thread.h"
+#include "qemu/hdr-histogram.h"
+
+static void test_exact(void)
+{
+    HdrHistogram hist = { 0 };
+    g_autofree HdrHistogramSnapshot *snap = g_new0(HdrHistogramSnapshot, 1);
+    uint64_t i;
+
+    g_assert_cmpuint(hdr_histogram_percentile(snap, 50), ==, 0);
+
+    /* Small values have buckets of their own */
+    for (i = 1; i <= HDR_HISTOGRAM_SUB_BUCKETS - 1; i++) {
+        hdr_histogram_record(&hist, i, NULL);
+    }
+    hdr_histogram_add_to_snapshot(&hist, NULL, snap);
+    g_assert_cmpuint(snap->count, ==, 15);
+    g_assert_cmpuint(snap->max, ==, 15);
+    g_assert_cmpuint(hdr_histogram_percentile(snap, 0), ==, 1);
+    g_assert_cmpuint(hdr_histogram_percentile(snap, 20), ==, 3);
+    g_assert_cmpuint(hdr_histogram_percentile(snap, 50), ==, 8);
+    g_assert_cmpuint(hdr_histogram_percentile(snap, 99), ==, 15);
+    g_assert_cmpuint(hdr_histogram_percentile(snap, 100), ==, 15);
+
+    hdr_histogram_destroy(&hist);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static void test_precision(void)
+{
+    static const double percentiles[] = { 1, 25, 50, 90, 99, 99.9, 100 };
+    HdrHistogram hist = { 0 };
+    g_autofree HdrHistogramSnapshot *snap = g_new0(HdrHistogramSnapshot, 1);
+    g_autofree uint64_t *values = g_new(uint64_t, 10000);
+    unsigned i;
+
+    for (i = 0; i < 10000; i++) {
+        /* Spread over the whole range */
+        values[i] = (uint64_t)g_test_rand_int() << g_test_rand_int_range(0, 8);
+        hdr_histogram_record(&hist, values[i], NULL);
+    }
+    hdr_histogram_add_to_snapshot(&hist, NULL, snap);
+    qsort(values, 10000, sizeof(values[0]), cmp_u64);
+
+    for (i = 0; i < ARRAY_SIZE(percentiles); i++) {
+        unsigned rank = MAX((unsigned)ceil(percentiles[i] * 100), 1);
+        uint64_t exact = values[rank - 1];
+        uint64_t value = hdr_histogram_percentile(snap, percentiles[i]);
+
+        /* Never below the exact value, and at most one bucket above */
+        g_assert_cmpuint(value, >=, exact);
+        g_assert_cmpuint(value, <=, exact + exact / HDR_HISTOGRAM_SUB_BUCKETS);
+    }
+    g_assert_cmpuint(hdr_histogram_percentile(snap, 100), ==, values[9999]);
+
+    /* Huge values are clamped to the last bucket but keep the maximum */
+    hdr_histogram_record(&hist, UINT64_MAX, NULL);
+    memset(snap, 0, sizeof(*snap));
+    hdr_histogram_add_to_snapshot(&hist, NULL, snap);
+    g_assert_cmpuint(snap->buckets[HDR_HISTOGRAM_BUCKETS - 1], ==, 1);
+    g_assert_cmpuint(hdr_histogram_percentile(snap, 100), ==, UINT64_MAX);
+
+    hdr_histogram_destroy(&hist);
+}
+
+#define NR_THREADS      4
+#define NR_VALUES       100000
+
+static HdrHistogram threads_hist;
+static int tags[2];
+
+static void *record_thread(void *opaque)
+{
+    uintptr_t n = (uintptr_t)opaque;
+    unsigned i;
+
+    for (i = 0; i < NR_VALUES; i++) {
+        hdr_histogram_record(&threads_hist, i, &tags[n & 1]);
+    }
+    return NULL;
+}
+
+static void test_threads(void)
+{
+    g_autofree HdrHistogramSnapshot *snap = g_new0(HdrHistogramSnapshot, 1);
+    QemuThread threads[NR_THREADS];
+    uintptr_t i;
+
+    for (i = 0; i < NR_THREADS; i++) {
+        qemu_thread_create(&threads[i], "hdr-histogram", record_thread,
+                           (void *)i, QEMU_THREAD_JOINABLE);
+    }
+    for (i = 0; i < NR_THREADS; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+
+    hdr_histogram_add_to_snapshot(&threads_hist, NULL, snap);
+    g_assert_cmpuint(snap->count, ==, NR_THREADS * NR_VALUES);
+    g_assert_cmpuint(snap->max, ==, NR_VALUES - 1);
+
+    /* Half of the threads used each tag */
+    memset(snap, 0, sizeof(*snap));
+    hdr_histogram_add_to_snapshot(&threads_hist, &tags[1], snap);
+    g_assert_cmpuint(snap->count, ==, NR_THREADS / 2 * NR_VALUES);
+
+    /* A forgotten tag selects nothing, but the values still count */
+    hdr_histogram_forget_tag(&threads_hist, &tags[1]);
+    memset(snap, 0, sizeof(*snap));
+    hdr_histogram_add_to_snapshot(&threads_hist, &tags[1], snap);
+    g_assert_cmpuint(snap->count, ==, 0);
+    hdr_histogram_add_to_snapshot(&threads_hist, NULL, snap);
+    g_assert_cmpuint(snap->count, ==, NR_THREADS * NR_VALUES);
+
+    hdr_histogram_destroy(&threads_hist);
+    g_assert(threads_hist.shards == NULL);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/hdr-histogram/exact", test_exact);
+    g_test_add_func("/hdr-histogram/precision", test_precision);
+    g_test_add_func("/hdr-histogram/threads", test_threads);
+    return g_test_run();
+}
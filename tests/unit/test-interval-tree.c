@@ -8,6 +8,9 @@
 
 #include "qemu/osdep.h"
 #include "qemu/interval-tree.h"
+#include "qemu/atomic.h"
+#include "qemu/seqlock.h"
+#include "qemu/thread.h"
 
 static IntervalTreeNode nodes[20];
 static IntervalTreeRoot root;
@@ -193,6 +196,65 @@ static void test_find_many_range(void)
     }
 }
 
+/*
+ * Lockless lookups bracketed by a seqlock, as done for the user-mode page
+ * flags in accel/tcg/user-exec.c: a lookup that overlapped a writer is
+ * repeated, so a node that stays in the tree is never missed even while
+ * its neighbours are removed and inserted again.
+ */
+static QemuSeqLock lockless_seq;
+static IntervalTreeNode lockless_nodes[64];
+static IntervalTreeNode lockless_fixed = { .start = 1020, .last = 1020 };
+static bool lockless_stop;
+
+static void *lockless_writer(void *opaque)
+{
+    while (!qatomic_read(&lockless_stop)) {
+        int i = g_random_int_range(0, ARRAY_SIZE(lockless_nodes));
+
+        seqlock_write_begin(&lockless_seq);
+        interval_tree_remove(&lockless_nodes[i], &root);
+        interval_tree_insert(&lockless_nodes[i], &root);
+        seqlock_write_end(&lockless_seq);
+    }
+    return NULL;
+}
+
+static void test_lockless_seqlock(void)
+{
+    QemuThread thread;
+    int i;
+
+    seqlock_init(&lockless_seq);
+    for (i = 0; i < ARRAY_SIZE(lockless_nodes); ++i) {
+        /* Surround the fixed node, so that rotations move it around. */
+        lockless_nodes[i].start = i * 32;
+        lockless_nodes[i].last = i * 32 + 15;
+        interval_tree_insert(&lockless_nodes[i], &root);
+    }
+    interval_tree_insert(&lockless_fixed, &root);
+
+    qemu_thread_create(&thread, "writer", lockless_writer, NULL,
+                       QEMU_THREAD_JOINABLE);
+    for (i = 0; i < 1000000; ++i) {
+        IntervalTreeNode *n;
+        unsigned seq;
+
+        do {
+            seq = seqlock_read_begin(&lockless_seq);
+            n = interval_tree_iter_first(&root, 1020, 1020);
+        } while (seqlock_read_retry(&lockless_seq, seq));
+        g_assert(n == &lockless_fixed);
+    }
+    qatomic_set(&lockless_stop, true);
+    qemu_thread_join(&thread);
+
+    interval_tree_remove(&lockless_fixed, &root);
+    for (i = 0; i < ARRAY_SIZE(lockless_nodes); ++i) {
+        interval_tree_remove(&lockless_nodes[i], &root);
+    }
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -204,6 +266,7 @@ int main(int argc, char **argv)
     g_test_add_func("/interval-tree/find-one-range-many",
                     test_find_one_range_many);
     g_test_add_func("/interval-tree/find-many-range", test_find_many_range);
+    g_test_add_func("/interval-tree/lockless-seqlock", test_lockless_seqlock);
 
     return g_test_run();
 }
@@ -0,0 +1,173 @@
+/*
+ * Check the list of syscalls that linux-user forwards to the host
+ *
+ * linux-user/passthrough.c.inc is expanded here with the host syscall
+ * numbers, as it is for a guest with the same ABI as the host.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include <sys/syscall.h>
+
+/* Mirror of the descriptors in linux-user/syscall.c. */
+typedef enum {
+    PT_KIND_NONE,
+    PT_KIND_VAL,
+    PT_KIND_FD,
+    PT_KIND_IN,
+    PT_KIND_OUT,
+} PassthroughArgKind;
+
+typedef struct PassthroughArg {
+    uint8_t kind;
+    uint8_t len_arg;
+    uint16_t size;
+} PassthroughArg;
+
+typedef struct PassthroughSyscall {
+    const char *name;
+    int num;
+    PassthroughArg args[6];
+} PassthroughSyscall;
+
+#define PT_VAL          { PT_KIND_VAL }
+#define PT_FD           { PT_KIND_FD }
+#define PT_IN(N)        { PT_KIND_IN, N }
+#define PT_OUT(N)       { PT_KIND_OUT, N }
+#define PT_IN_SIZE(T)   { PT_KIND_IN, 0, sizeof(T) }
+#define PT_OUT_SIZE(T)  { PT_KIND_OUT, 0, sizeof(T) }
+
+/*
+ * Expand the entries for the syscalls that may be forwarded, and for
+ * some that linux-user must emulate, so that listing one of the latter
+ * is caught below.
+ */
+#define TARGET_NR_fdatasync
+#define TARGET_NR_fstat
+#define TARGET_NR_fsync
+#define TARGET_NR_ftruncate
+#define TARGET_NR_getegid
+#define TARGET_NR_geteuid
+#define TARGET_NR_getgid
+#define TARGET_NR_getpid
+#define TARGET_NR_getppid
+#define TARGET_NR_getrandom
+#define TARGET_NR_getrusage
+#define TARGET_NR_gettid
+#define TARGET_NR_getuid
+#define TARGET_NR_lseek
+#define TARGET_NR_pread64
+#define TARGET_NR_pwrite64
+#define TARGET_NR_read
+#define TARGET_NR_sched_yield
+#define TARGET_NR_umask
+#define TARGET_NR_write
+
+#define TARGET_NR_brk
+#define TARGET_NR_clock_gettime
+#define TARGET_NR_clone
+#define TARGET_NR_close
+#define TARGET_NR_execve
+#define TARGET_NR_exit
+#define TARGET_NR_exit_group
+#define TARGET_NR_fcntl
+#define TARGET_NR_gettimeofday
+#define TARGET_NR_ioctl
+#define TARGET_NR_kill
+#define TARGET_NR_mmap
+#define TARGET_NR_mprotect
+#define TARGET_NR_munmap
+#define TARGET_NR_openat
+#define TARGET_NR_readlink
+#define TARGET_NR_rt_sigaction
+#define TARGET_NR_rt_sigprocmask
+#define TARGET_NR_time
+
+static const PassthroughSyscall passthrough_syscalls[] = {
+#define P(NAME, ...)  { #NAME, __NR_##NAME, { __VA_ARGS__ } },
+#include "linux-user/passthrough.c.inc"
+#undef P
+};
+
+static const char *const denied_syscalls[] = {
+    "brk",
+    "clock_gettime",
+    "clone",
+    "close",
+    "execve",
+    "exit",
+    "exit_group",
+    "fcntl",
+    "gettimeofday",
+    "ioctl",
+    "kill",
+    "mmap",
+    "mprotect",
+    "munmap",
+    "openat",
+    "readlink",
+    "rt_sigaction",
+    "rt_sigprocmask",
+    "time",
+};
+
+static void test_sorted(void)
+{
+    int i;
+
+    g_assert_cmpint(ARRAY_SIZE(passthrough_syscalls), >, 0);
+    for (i = 1; i < ARRAY_SIZE(passthrough_syscalls); i++) {
+        g_assert_cmpstr(passthrough_syscalls[i - 1].name, <,
+                        passthrough_syscalls[i].name);
+    }
+}
+
+static void test_not_emulated(void)
+{
+    int i, j;
+
+    for (i = 0; i < ARRAY_SIZE(passthrough_syscalls); i++) {
+        for (j = 0; j < ARRAY_SIZE(denied_syscalls); j++) {
+            g_assert_cmpstr(passthrough_syscalls[i].name, !=,
+                            denied_syscalls[j]);
+        }
+    }
+}
+
+/* Every buffer must have a size, from a plain value argument or a type. */
+static void test_buffer_sizes(void)
+{
+    int i, j;
+
+    for (i = 0; i < ARRAY_SIZE(passthrough_syscalls); i++) {
+        const PassthroughSyscall *pt = &passthrough_syscalls[i];
+
+        for (j = 0; j < ARRAY_SIZE(pt->args); j++) {
+            const PassthroughArg *a = &pt->args[j];
+
+            if (a->kind != PT_KIND_IN && a->kind != PT_KIND_OUT) {
+                continue;
+            }
+            if (a->len_arg) {
+                g_assert_cmpint(a->len_arg, <=, ARRAY_SIZE(pt->args));
+                g_assert_cmpint(a->len_arg - 1, !=, j);
+                g_assert_cmpint(pt->args[a->len_arg - 1].kind, ==,
+                                PT_KIND_VAL);
+            } else {
+                g_assert_cmpint(a->size, >, 0);
+            }
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/syscall-passthrough/sorted", test_sorted);
+    g_test_add_func("/syscall-passthrough/not-emulated", test_not_emulated);
+    g_test_add_func("/syscall-passthrough/buffer-sizes", test_buffer_sizes);
+
+    return g_test_run();
+}
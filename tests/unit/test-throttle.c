@@ -734,6 +734,132 @@ static void test_accounting(void)
                                 (64.0 / 13)));
 }
 
+static void test_headroom(void)
+{
+    double bytes, units;
+    int64_t now;
+
+    throttle_config_init(&cfg);
+    /* buckets of 100 bytes and 5 write operations */
+    cfg.buckets[THROTTLE_BPS_TOTAL].avg = 1000;
+    cfg.buckets[THROTTLE_OPS_WRITE].avg = 50;
+    throttle_init(&ts);
+    throttle_config(&ts, QEMU_CLOCK_VIRTUAL, &cfg);
+    now = ts.previous_leak;
+
+    /* unlimited buckets leave the upper bound untouched */
+    bytes = units = 1000;
+    throttle_compute_headroom(&ts, THROTTLE_READ, now, &bytes, &units);
+    g_assert(double_cmp(bytes, 100));
+    g_assert(double_cmp(units, 1000));
+
+    throttle_account(&ts, THROTTLE_WRITE, 30);
+    bytes = units = 1000;
+    throttle_compute_headroom(&ts, THROTTLE_WRITE, now, &bytes, &units);
+    g_assert(double_cmp(bytes, 70));
+    g_assert(double_cmp(units, 4));
+
+    /* full buckets have no headroom */
+    throttle_account(&ts, THROTTLE_WRITE, 200);
+    bytes = units = 1000;
+    throttle_compute_headroom(&ts, THROTTLE_WRITE, now, &bytes, &units);
+    g_assert(double_cmp(bytes, 0));
+    g_assert(double_cmp(units, 3));
+    g_assert(throttle_compute_delay(&ts, THROTTLE_WRITE, now) > 0);
+
+    /* refunds don't make the levels negative */
+    throttle_charge(&ts, THROTTLE_WRITE, -1000, -1000);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_TOTAL].level, 0));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_WRITE].level, 0));
+    g_assert(throttle_compute_delay(&ts, THROTTLE_WRITE, now) == 0);
+
+    /* the buckets leak before computing the headroom */
+    throttle_account(&ts, THROTTLE_WRITE, 100);
+    bytes = units = 1000;
+    throttle_compute_headroom(&ts, THROTTLE_WRITE,
+                              now + NANOSECONDS_PER_SECOND / 20,
+                              &bytes, &units);
+    g_assert(double_cmp(bytes, 50));
+    g_assert(double_cmp(units, 5));
+}
+
+typedef struct {
+    ThrottleGroupMember *tgm;
+    int count;
+    int max;
+} GroupIOData;
+
+static void coroutine_fn group_io_entry(void *opaque)
+{
+    GroupIOData *data = opaque;
+
+    while (data->count < data->max) {
+        throttle_group_co_io_limits_intercept(data->tgm, 4096, THROTTLE_WRITE);
+        data->count++;
+    }
+}
+
+static void test_groups_parent(void)
+{
+    ThrottleConfig cfg1;
+    BlockBackend *blk1, *blk2;
+    ThrottleGroupMember *tgm1, *tgm2;
+    GroupIOData data = { 0 };
+    Object *child;
+    Error *err = NULL;
+
+    blk1 = blk_new(qemu_get_aio_context(), 0, BLK_PERM_ALL);
+    blk2 = blk_new(qemu_get_aio_context(), 0, BLK_PERM_ALL);
+    tgm1 = &blk_get_public(blk1)->throttle_group_member;
+    tgm2 = &blk_get_public(blk2)->throttle_group_member;
+
+    /* The parent must exist before its children */
+    child = object_new_with_props(TYPE_THROTTLE_GROUP,
+                                  object_get_objects_root(), "child0",
+                                  &err, "parent", "tenant0", NULL);
+    g_assert(child == NULL);
+    error_free_or_abort(&err);
+
+    throttle_group_register_tgm(tgm2, "tenant0", blk_get_aio_context(blk2));
+    child = object_new_with_props(TYPE_THROTTLE_GROUP,
+                                  object_get_objects_root(), "child0",
+                                  &error_abort, "parent", "tenant0", NULL);
+    throttle_group_register_tgm(tgm1, "child0", blk_get_aio_context(blk1));
+
+    /* ... and cannot be changed afterwards */
+    object_property_set_str(child, "parent", "child0", &err);
+    error_free_or_abort(&err);
+
+    /* 1 MB/s for the whole tenant, with bursts of 100 KB */
+    throttle_config_init(&cfg1);
+    cfg1.buckets[THROTTLE_BPS_WRITE].avg = 1000000;
+    throttle_group_config(tgm2, &cfg1);
+
+    /* The I/O of the child is accounted in the parent */
+    data.tgm = tgm1;
+    data.max = 1;
+    qemu_coroutine_enter(qemu_coroutine_create(group_io_entry, &data));
+    g_assert_cmpint(data.count, ==, 1);
+    g_assert(tgm2->throttle_state->cfg.buckets[THROTTLE_BPS_WRITE].level
+             >= 4096);
+
+    /* ... and throttled by it, even though the child has no limits */
+    data.max = 40;
+    qemu_coroutine_enter(qemu_coroutine_create(group_io_entry, &data));
+    g_assert_cmpint(data.count, <, data.max);
+    g_assert(timer_pending(tgm1->throttle_timers.timers[THROTTLE_WRITE]));
+
+    while (data.count < data.max) {
+        aio_poll(qemu_get_aio_context(), true);
+    }
+
+    throttle_group_unregister_tgm(tgm1);
+    throttle_group_unregister_tgm(tgm2);
+    object_unparent(child);
+    g_assert(!throttle_group_exists("child0"));
+    g_assert(!throttle_group_exists("tenant0"));
+}
+
 static void test_groups(void)
 {
     ThrottleConfig cfg1, cfg2;
@@ -829,7 +955,9 @@ int main(int argc, char **argv)
                     test_iops_size_is_missing_limit);
     g_test_add_func("/throttle/config_functions",   test_config_functions);
     g_test_add_func("/throttle/accounting",         test_accounting);
+    g_test_add_func("/throttle/headroom",           test_headroom);
     g_test_add_func("/throttle/groups",             test_groups);
+    g_test_add_func("/throttle/groups/parent",      test_groups_parent);
     return g_test_run();
 }
 
@@ -0,0 +1,173 @@
+/*
+ * Video encoder framework tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/module.h"
+#include "qemu/timer.h"
+#include "ui/video-encoder.h"
+
+#define WIDTH  64
+#define HEIGHT 48
+
+/* Emits one byte per frame, 'K' for keyframes and 'P' otherwise */
+typedef struct TestEncoder {
+    VideoEncoder parent;
+    unsigned bitrate_changes;
+} TestEncoder;
+
+static bool test_encoder_init(VideoEncoder *enc, Error **errp)
+{
+    return true;
+}
+
+static bool test_encoder_encode(VideoEncoder *enc, pixman_image_t *image,
+                                bool keyframe, GByteArray *out, Error **errp)
+{
+    uint8_t c = keyframe ? 'K' : 'P';
+
+    g_byte_array_append(out, &c, 1);
+    return true;
+}
+
+static void test_encoder_set_bitrate(VideoEncoder *enc)
+{
+    container_of(enc, TestEncoder, parent)->bitrate_changes++;
+}
+
+static const VideoEncoderDriver test_encoder = {
+    .name = "test",
+    .priority = 1,
+    .instance_size = sizeof(TestEncoder),
+    .init = test_encoder_init,
+    .encode = test_encoder_encode,
+    .set_bitrate = test_encoder_set_bitrate,
+};
+
+static pixman_image_t *test_image(void)
+{
+    return pixman_image_create_bits(PIXMAN_x8r8g8b8, WIDTH, HEIGHT, NULL, 0);
+}
+
+static void test_registry(void)
+{
+    VideoEncoder *enc;
+    Error *err = NULL;
+
+    /* The null encoder is only used on request */
+    g_assert_true(video_encoder_available("null"));
+    g_assert_false(video_encoder_available("nonexistent"));
+    g_assert_null(video_encoder_new("nonexistent", WIDTH, HEIGHT, &err));
+    error_free_or_abort(&err);
+
+    enc = video_encoder_new(NULL, WIDTH, HEIGHT, &error_abort);
+    g_assert_cmpstr(enc->drv->name, ==, "test");
+    video_encoder_free(enc);
+
+    enc = video_encoder_new("null", WIDTH, HEIGHT, &error_abort);
+    g_assert_cmpstr(enc->drv->name, ==, "null");
+    video_encoder_free(enc);
+}
+
+static void test_pacing(void)
+{
+    VideoEncoder *enc = video_encoder_new("test", WIDTH, HEIGHT, &error_abort);
+    pixman_image_t *image = test_image();
+    g_autoptr(GByteArray) out = g_byte_array_new();
+    int64_t interval = NANOSECONDS_PER_SECOND / enc->fps;
+    int64_t now = 1000;
+
+    g_assert_true(video_encoder_frame_due(enc, now));
+    g_assert_true(video_encoder_encode(enc, image, now, out, &error_abort));
+    g_assert_false(video_encoder_frame_due(enc, now));
+    g_assert_false(video_encoder_frame_due(enc, now + interval - 1));
+    g_assert_true(video_encoder_frame_due(enc, now + interval));
+    g_assert_cmpint(video_encoder_frame_delay(enc, now + 1), ==, interval - 1);
+    g_assert_cmpint(video_encoder_frame_delay(enc, now + interval + 1), ==, 0);
+
+    pixman_image_unref(image);
+    video_encoder_free(enc);
+}
+
+static void test_keyframe(void)
+{
+    VideoEncoder *enc = video_encoder_new("test", WIDTH, HEIGHT, &error_abort);
+    pixman_image_t *image = test_image();
+    g_autoptr(GByteArray) out = g_byte_array_new();
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        video_encoder_encode(enc, image, 0, out, &error_abort);
+    }
+    video_encoder_request_keyframe(enc);
+    video_encoder_encode(enc, image, 0, out, &error_abort);
+    video_encoder_encode(enc, image, 0, out, &error_abort);
+
+    g_assert_cmpint(out->len, ==, 5);
+    g_assert_cmpmem(out->data, out->len, "KPPKP", 5);
+    g_assert_cmpuint(enc->frames, ==, 5);
+
+    pixman_image_unref(image);
+    video_encoder_free(enc);
+}
+
+static void test_bitrate(void)
+{
+    VideoEncoder *enc = video_encoder_new("test", WIDTH, HEIGHT, &error_abort);
+    TestEncoder *s = container_of(enc, TestEncoder, parent);
+    size_t frame_bytes = enc->bitrate * 1000 / 8 / enc->fps;
+    uint32_t bitrate;
+    int i;
+
+    /* A backlog of one frame is steady state */
+    for (i = 0; i < 100; i++) {
+        video_encoder_feedback(enc, frame_bytes);
+    }
+    g_assert_cmpuint(enc->bitrate, ==, VIDEO_ENCODER_DEFAULT_BITRATE);
+    g_assert_cmpuint(s->bitrate_changes, ==, 0);
+
+    /* Congestion lowers the bitrate at once... */
+    video_encoder_feedback(enc, 3 * frame_bytes);
+    g_assert_cmpuint(enc->bitrate, <, VIDEO_ENCODER_DEFAULT_BITRATE);
+    g_assert_cmpuint(s->bitrate_changes, ==, 1);
+
+    /* ... down to the minimum */
+    for (i = 0; i < 100; i++) {
+        video_encoder_feedback(enc, SIZE_MAX);
+    }
+    g_assert_cmpuint(enc->bitrate, ==, enc->min_bitrate);
+
+    /* An idle link raises it again, once per second of frames */
+    bitrate = enc->bitrate;
+    for (i = 0; i < enc->fps - 1; i++) {
+        video_encoder_feedback(enc, 0);
+    }
+    g_assert_cmpuint(enc->bitrate, ==, bitrate);
+    video_encoder_feedback(enc, 0);
+    g_assert_cmpuint(enc->bitrate, >, bitrate);
+
+    for (i = 0; i < 1000 * enc->fps; i++) {
+        video_encoder_feedback(enc, 0);
+    }
+    g_assert_cmpuint(enc->bitrate, ==, enc->max_bitrate);
+
+    video_encoder_free(enc);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    module_call_init(MODULE_INIT_QOM);
+    video_encoder_register(&test_encoder);
+
+    g_test_add_func("/video-encoder/registry", test_registry);
+    g_test_add_func("/video-encoder/pacing", test_pacing);
+    g_test_add_func("/video-encoder/keyframe", test_keyframe);
+    g_test_add_func("/video-encoder/bitrate", test_bitrate);
+    return g_test_run();
+}
@@ -285,6 +285,13 @@ bool trace_init_backends(void)
     return true;
 }
 
+void trace_init_thread(void)
+{
+#ifdef CONFIG_TRACE_SIMPLE
+    st_init_thread();
+#endif
+}
+
 void trace_opt_parse(const char *optstr)
 {
     QemuOpts *opts = qemu_opts_parse_noisily(qemu_find_opts("trace"),
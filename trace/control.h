@@ -164,6 +164,15 @@ void trace_event_set_state_dynamic(TraceEvent *ev, bool state);
  */
 bool trace_init_backends(void);
 
+/**
+ * trace_init_thread:
+ *
+ * Prepare the calling thread for tracing.  Backends that keep per-thread
+ * state allocate it here rather than when the thread first emits an event,
+ * which could be from a signal handler.
+ */
+void trace_init_thread(void);
+
 /**
  * trace_init_file:
  *
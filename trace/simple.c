@@ -30,8 +30,8 @@
 /** Records were dropped event ID */
 #define DROPPED_EVENT_ID (~(uint64_t)0 - 1)
 
-/** Trace record is valid */
-#define TRACE_RECORD_VALID ((uint64_t)1 << 63)
+/** Thread buffer wrap-around marker, never written to the trace file */
+#define PADDING_EVENT_ID (~(uint64_t)0 - 2)
 
 /*
  * Trace records are written out by a dedicated thread.  The thread waits for
@@ -45,13 +45,44 @@ static bool trace_available;
 static bool trace_writeout_enabled;
 
 enum {
-    TRACE_BUF_LEN = 4096 * 64,
+    TRACE_BUF_LEN = 4096 * 16,
     TRACE_BUF_FLUSH_THRESHOLD = TRACE_BUF_LEN / 4,
+    TRACE_RECORD_ALIGN = sizeof(uint64_t),
 };
 
-uint8_t trace_buf[TRACE_BUF_LEN];
-static volatile gint trace_idx;
-static unsigned int writeout_idx;
+/* Idle writeout thread wakes up this often to pick up slow producers */
+#define TRACE_WRITEOUT_INTERVAL_US (100 * 1000)
+
+/*
+ * Every thread that emits trace events owns a ring buffer that only it
+ * writes to, so recording an event needs neither atomic read-modify-write
+ * operations nor cache line bouncing between threads.  The writeout thread
+ * is the single consumer of all buffers and merges their records by
+ * timestamp into the trace file.
+ *
+ * Records never wrap around the end of a buffer; when a record does not fit
+ * in the remaining space, a padding marker is written and the record starts
+ * at the beginning of the buffer.  @head and @tail are free-running byte
+ * counters, @head is only advanced by the owner thread and @tail only by the
+ * writeout thread.
+ */
+struct TraceThreadBuffer {
+    struct TraceThreadBuffer *next;     /* protected by trace_buffers_lock */
+    unsigned int head;
+    unsigned int tail;
+    unsigned int writeout_head;         /* writeout thread only */
+    unsigned int dropped;
+    bool busy;
+    bool exited;
+    uint8_t data[TRACE_BUF_LEN] QEMU_ALIGNED(TRACE_RECORD_ALIGN);
+};
+
+static GMutex trace_buffers_lock;
+static TraceThreadBuffer *trace_buffers;
+static __thread TraceThreadBuffer *trace_thread_buffer;
+static __thread bool trace_thread_buffer_unavailable;
+static void trace_thread_buffer_exit(gpointer data);
+static GPrivate trace_thread_key = G_PRIVATE_INIT(trace_thread_buffer_exit);
 static volatile gint dropped_events;
 static uint32_t trace_pid;
 static FILE *trace_fp;
@@ -76,55 +107,6 @@ typedef struct {
 } TraceLogHeader;
 
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size);
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size);
-
-static void clear_buffer_range(unsigned int idx, size_t len)
-{
-    uint32_t num = 0;
-    while (num < len) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = 0;
-        num++;
-    }
-}
-/**
- * Read a trace record from the trace buffer
- *
- * @idx         Trace buffer index
- * @record      Trace record to fill
- *
- * Returns false if the record is not valid.
- */
-static bool get_trace_record(unsigned int idx, TraceRecord **recordptr)
-{
-    uint64_t event_flag = 0;
-    TraceRecord record;
-    /* read the event flag to see if its a valid record */
-    read_from_buffer(idx, &record, sizeof(event_flag));
-
-    if (!(record.event & TRACE_RECORD_VALID)) {
-        return false;
-    }
-
-    smp_rmb(); /* read memory barrier before accessing record */
-    /* read the record header to know record length */
-    read_from_buffer(idx, &record, sizeof(TraceRecord));
-    *recordptr = malloc(record.length); /* don't use g_malloc, can deadlock when traced */
-    /* make a copy of record to avoid being overwritten */
-    read_from_buffer(idx, *recordptr, record.length);
-    smp_rmb(); /* memory barrier before clearing valid flag */
-    (*recordptr)->event &= ~TRACE_RECORD_VALID;
-    /* clear the trace buffer range for consumed record otherwise any byte
-     * with its MSB set may be considered as a valid event id when the writer
-     * thread crosses this range of buffer again.
-     */
-    clear_buffer_range(idx, record.length);
-    return true;
-}
-
 /**
  * Kick writeout thread
  *
@@ -148,49 +130,254 @@ static void wait_for_trace_records_available(void)
     g_mutex_lock(&trace_lock);
     while (!(trace_available && trace_writeout_enabled)) {
         g_cond_signal(&trace_empty_cond);
-        g_cond_wait(&trace_available_cond, &trace_lock);
+        if (!trace_writeout_enabled) {
+            g_cond_wait(&trace_available_cond, &trace_lock);
+        } else if (!g_cond_wait_until(&trace_available_cond, &trace_lock,
+                                      g_get_monotonic_time() +
+                                      TRACE_WRITEOUT_INTERVAL_US) &&
+                   trace_writeout_enabled) {
+            break; /* periodic writeout */
+        }
     }
     trace_available = false;
     g_mutex_unlock(&trace_lock);
 }
 
-static gpointer writeout_thread(gpointer opaque)
+/*
+ * Called on exit of any thread that has a buffer, including threads that
+ * were not created with qemu_thread_create() and thus never run the
+ * qemu_thread_atexit_add() notifiers.
+ */
+static void trace_thread_buffer_exit(gpointer data)
+{
+    TraceThreadBuffer *tbuf = data;
+
+    /* Trace events emitted by later thread exit handlers are dropped */
+    trace_thread_buffer = NULL;
+    trace_thread_buffer_unavailable = true;
+
+    /* The writeout thread frees the buffer once it is drained */
+    qatomic_store_release(&tbuf->exited, true);
+}
+
+static TraceThreadBuffer *trace_thread_buffer_alloc(void)
+{
+    TraceThreadBuffer *tbuf;
+
+    trace_thread_buffer_unavailable = true;
+    signal_barrier();
+
+    /* don't use g_malloc, can deadlock when traced */
+    tbuf = calloc(1, sizeof(*tbuf));
+    if (!tbuf) {
+        return NULL;
+    }
+    g_private_set(&trace_thread_key, tbuf);
+
+    g_mutex_lock(&trace_buffers_lock);
+    tbuf->next = trace_buffers;
+    trace_buffers = tbuf;
+    g_mutex_unlock(&trace_buffers_lock);
+
+    trace_thread_buffer = tbuf;
+    signal_barrier();
+    trace_thread_buffer_unavailable = false;
+    return tbuf;
+}
+
+/**
+ * Allocate the calling thread's trace buffer
+ *
+ * This is called when a thread starts, so that its first trace event does
+ * not have to allocate memory, which is not possible in a signal handler.
+ */
+void st_init_thread(void)
+{
+    if (!trace_thread_buffer && !trace_thread_buffer_unavailable) {
+        trace_thread_buffer_alloc();
+    }
+}
+
+/**
+ * Return the calling thread's trace buffer
+ *
+ * Threads that did not call st_init_thread() get their buffer on first use;
+ * QEMU does not deliver signals to such threads.
+ *
+ * Returns NULL if the buffer cannot be used right now, for example from a
+ * signal handler that interrupted the buffer's registration.
+ */
+static TraceThreadBuffer *trace_thread_buffer_get(void)
+{
+    TraceThreadBuffer *tbuf = trace_thread_buffer;
+
+    if (likely(tbuf)) {
+        return tbuf;
+    }
+    if (trace_thread_buffer_unavailable) {
+        return NULL;
+    }
+    return trace_thread_buffer_alloc();
+}
+
+/**
+ * Return the oldest record of a thread buffer that is ready for writeout
+ *
+ * @tbuf        Thread buffer, owned by the writeout thread's caller
+ *
+ * Returns NULL if all records up to the writeout snapshot have been consumed.
+ */
+static TraceRecord *thread_buffer_peek(TraceThreadBuffer *tbuf)
+{
+    unsigned int tail = tbuf->tail;
+
+    while (tail != tbuf->writeout_head) {
+        TraceRecord *record = (TraceRecord *)&tbuf->data[tail % TRACE_BUF_LEN];
+
+        if (record->event != PADDING_EVENT_ID) {
+            return record;
+        }
+        tail += TRACE_BUF_LEN - tail % TRACE_BUF_LEN;
+        qatomic_store_release(&tbuf->tail, tail);
+    }
+    return NULL;
+}
+
+/*
+ * Records are copied here with trace_buffers_lock held, and written to the
+ * trace file after dropping it, so that threads registering their buffer
+ * do not wait for file I/O.  Only used by the writeout thread.
+ */
+static uint8_t writeout_buf[TRACE_BUF_LEN];
+static size_t writeout_len;
+
+/**
+ * Append a record, preceded by its type, to writeout_buf
+ *
+ * Returns false if it does not fit.
+ */
+static bool writeout_buf_append(const TraceRecord *record)
+{
+    uint64_t type = TRACE_RECORD_TYPE_EVENT;
+
+    if (writeout_len + sizeof(type) + record->length > sizeof(writeout_buf)) {
+        return false;
+    }
+    memcpy(&writeout_buf[writeout_len], &type, sizeof(type));
+    memcpy(&writeout_buf[writeout_len + sizeof(type)], record, record->length);
+    writeout_len += sizeof(type) + record->length;
+    return true;
+}
+
+static void copy_dropped_record(void)
 {
-    TraceRecord *recordptr;
     union {
         TraceRecord rec;
         uint8_t bytes[sizeof(TraceRecord) + sizeof(uint64_t)];
     } dropped;
-    unsigned int idx = 0;
-    int dropped_count;
-    size_t unused __attribute__ ((unused));
-    uint64_t type = TRACE_RECORD_TYPE_EVENT;
+    uint64_t dropped_count = qatomic_xchg(&dropped_events, 0);
+    TraceThreadBuffer *tbuf;
+
+    for (tbuf = trace_buffers; tbuf; tbuf = tbuf->next) {
+        dropped_count += qatomic_xchg(&tbuf->dropped, 0);
+    }
+    if (!dropped_count) {
+        return;
+    }
+
+    dropped.rec.event = DROPPED_EVENT_ID;
+    dropped.rec.timestamp_ns = get_clock();
+    dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
+    dropped.rec.pid = trace_pid;
+    dropped.rec.arguments[0] = dropped_count;
+    writeout_buf_append(&dropped.rec);
+}
+
+/**
+ * Copy published records of all thread buffers to writeout_buf
+ *
+ * Records are merged by timestamp so that the trace file stays ordered even
+ * though each thread records into its own buffer.
+ *
+ * Returns true if writeout_buf filled up before all records were copied.
+ */
+static bool copy_thread_records(void)
+{
+    TraceThreadBuffer *tbuf;
 
     for (;;) {
-        wait_for_trace_records_available();
+        TraceThreadBuffer *oldest_buf = NULL;
+        TraceRecord *oldest = NULL;
+
+        for (tbuf = trace_buffers; tbuf; tbuf = tbuf->next) {
+            TraceRecord *record = thread_buffer_peek(tbuf);
 
-        if (g_atomic_int_get(&dropped_events)) {
-            dropped.rec.event = DROPPED_EVENT_ID;
-            dropped.rec.timestamp_ns = get_clock();
-            dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
-            dropped.rec.pid = trace_pid;
-            do {
-                dropped_count = g_atomic_int_get(&dropped_events);
-            } while (!g_atomic_int_compare_and_exchange(&dropped_events,
-                                                        dropped_count, 0));
-            dropped.rec.arguments[0] = dropped_count;
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+            if (record &&
+                (!oldest || record->timestamp_ns < oldest->timestamp_ns)) {
+                oldest = record;
+                oldest_buf = tbuf;
+            }
+        }
+        if (!oldest) {
+            return false;
+        }
+        if (!writeout_buf_append(oldest)) {
+            return true;
         }
+        qatomic_store_release(&oldest_buf->tail,
+                              oldest_buf->tail +
+                              ROUND_UP(oldest->length, TRACE_RECORD_ALIGN));
+    }
+}
 
-        while (get_trace_record(idx, &recordptr)) {
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(recordptr, recordptr->length, 1, trace_fp);
-            writeout_idx += recordptr->length;
-            free(recordptr); /* don't use g_free, can deadlock when traced */
-            idx = writeout_idx % TRACE_BUF_LEN;
+/**
+ * Write out all published records of all thread buffers
+ */
+static void write_thread_buffers(void)
+{
+    TraceThreadBuffer *tbuf, **prev;
+    bool more;
+    size_t unused __attribute__ ((unused));
+
+    g_mutex_lock(&trace_buffers_lock);
+
+    for (tbuf = trace_buffers; tbuf; tbuf = tbuf->next) {
+        tbuf->writeout_head = qatomic_load_acquire(&tbuf->head);
+    }
+
+    writeout_len = 0;
+    copy_dropped_record();
+    do {
+        more = copy_thread_records();
+
+        g_mutex_unlock(&trace_buffers_lock);
+        if (writeout_len) {
+            unused = fwrite(writeout_buf, writeout_len, 1, trace_fp);
+            writeout_len = 0;
+        }
+        g_mutex_lock(&trace_buffers_lock);
+    } while (more);
+
+    /* Reclaim buffers of exited threads once they have been drained */
+    prev = &trace_buffers;
+    while ((tbuf = *prev)) {
+        if (qatomic_load_acquire(&tbuf->exited) &&
+            tbuf->tail == qatomic_read(&tbuf->head)) {
+            *prev = tbuf->next;
+            free(tbuf); /* don't use g_free, can deadlock when traced */
+        } else {
+            prev = &tbuf->next;
         }
+    }
+
+    g_mutex_unlock(&trace_buffers_lock);
+}
 
+static gpointer writeout_thread(gpointer opaque)
+{
+    for (;;) {
+        wait_for_trace_records_available();
+        write_thread_buffers();
         fflush(trace_fp);
     }
     return NULL;
@@ -198,84 +385,85 @@ static gpointer writeout_thread(gpointer opaque)
 
 void trace_record_write_u64(TraceBufferRecord *rec, uint64_t val)
 {
-    rec->rec_off = write_to_buffer(rec->rec_off, &val, sizeof(uint64_t));
+    memcpy(&rec->tbuf->data[rec->rec_off], &val, sizeof(uint64_t));
+    rec->rec_off += sizeof(uint64_t);
 }
 
 void trace_record_write_str(TraceBufferRecord *rec, const char *s, uint32_t slen)
 {
     /* Write string length first */
-    rec->rec_off = write_to_buffer(rec->rec_off, &slen, sizeof(slen));
+    memcpy(&rec->tbuf->data[rec->rec_off], &slen, sizeof(slen));
+    rec->rec_off += sizeof(slen);
     /* Write actual string now */
-    rec->rec_off = write_to_buffer(rec->rec_off, (void*)s, slen);
+    memcpy(&rec->tbuf->data[rec->rec_off], s, slen);
+    rec->rec_off += slen;
 }
 
 int trace_record_start(TraceBufferRecord *rec, uint32_t event, size_t datasize)
 {
-    unsigned int idx, rec_off, old_idx, new_idx;
+    TraceThreadBuffer *tbuf = trace_thread_buffer_get();
     uint32_t rec_len = sizeof(TraceRecord) + datasize;
-    uint64_t event_u64 = event;
-    uint64_t timestamp_ns = get_clock();
-
-    do {
-        old_idx = g_atomic_int_get(&trace_idx);
-        smp_rmb();
-        new_idx = old_idx + rec_len;
-
-        if (new_idx - writeout_idx > TRACE_BUF_LEN) {
-            /* Trace Buffer Full, Event dropped ! */
-            g_atomic_int_inc(&dropped_events);
-            return -ENOSPC;
-        }
-    } while (!g_atomic_int_compare_and_exchange(&trace_idx, old_idx, new_idx));
+    unsigned int alloc_len = ROUND_UP(rec_len, TRACE_RECORD_ALIGN);
+    unsigned int head, idx, pad = 0;
+    TraceRecord *record;
 
-    idx = old_idx % TRACE_BUF_LEN;
+    if (!tbuf) {
+        g_atomic_int_inc(&dropped_events);
+        return -ENOSPC;
+    }
 
-    rec_off = idx;
-    rec_off = write_to_buffer(rec_off, &event_u64, sizeof(event_u64));
-    rec_off = write_to_buffer(rec_off, &timestamp_ns, sizeof(timestamp_ns));
-    rec_off = write_to_buffer(rec_off, &rec_len, sizeof(rec_len));
-    rec_off = write_to_buffer(rec_off, &trace_pid, sizeof(trace_pid));
+    /* A signal handler may trace while this thread is already recording */
+    if (qatomic_read(&tbuf->busy)) {
+        qatomic_inc(&tbuf->dropped);
+        return -EBUSY;
+    }
+    qatomic_set(&tbuf->busy, true);
+    signal_barrier();
 
-    rec->tbuf_idx = idx;
-    rec->rec_off  = (idx + sizeof(TraceRecord)) % TRACE_BUF_LEN;
-    return 0;
-}
+    head = tbuf->head;
+    idx = head % TRACE_BUF_LEN;
+    if (idx + alloc_len > TRACE_BUF_LEN) {
+        pad = TRACE_BUF_LEN - idx;
+    }
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
-{
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        data_ptr[x++] = trace_buf[idx++];
+    if (alloc_len > TRACE_BUF_FLUSH_THRESHOLD ||
+        head + pad + alloc_len - qatomic_load_acquire(&tbuf->tail) >
+        TRACE_BUF_LEN) {
+        /* Trace Buffer Full, Event dropped ! */
+        qatomic_inc(&tbuf->dropped);
+        signal_barrier();
+        qatomic_set(&tbuf->busy, false);
+        return -ENOSPC;
     }
-}
 
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size)
-{
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = data_ptr[x++];
+    if (pad) {
+        record = (TraceRecord *)&tbuf->data[idx];
+        record->event = PADDING_EVENT_ID;
+        idx = 0;
     }
-    return idx; /* most callers wants to know where to write next */
+
+    record = (TraceRecord *)&tbuf->data[idx];
+    record->event = event;
+    record->timestamp_ns = get_clock();
+    record->length = rec_len;
+    record->pid = trace_pid;
+
+    rec->tbuf = tbuf;
+    rec->rec_off = idx + sizeof(TraceRecord);
+    rec->new_head = head + pad + alloc_len;
+    return 0;
 }
 
 void trace_record_finish(TraceBufferRecord *rec)
 {
-    TraceRecord record;
-    read_from_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
-    smp_wmb(); /* write barrier before marking as valid */
-    record.event |= TRACE_RECORD_VALID;
-    write_to_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
-
-    if (((unsigned int)g_atomic_int_get(&trace_idx) - writeout_idx)
-        > TRACE_BUF_FLUSH_THRESHOLD) {
+    TraceThreadBuffer *tbuf = rec->tbuf;
+
+    /* Publish the record to the writeout thread */
+    qatomic_store_release(&tbuf->head, rec->new_head);
+    signal_barrier();
+    qatomic_set(&tbuf->busy, false);
+
+    if (rec->new_head - qatomic_read(&tbuf->tail) > TRACE_BUF_FLUSH_THRESHOLD) {
         flush_trace_file(false);
     }
 }
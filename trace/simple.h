@@ -15,12 +15,16 @@ void st_print_trace_file_status(void);
 bool st_set_trace_file_enabled(bool enable);
 void st_set_trace_file(const char *file);
 bool st_init(void);
+void st_init_thread(void);
 void st_init_group(size_t group);
 void st_flush_trace_buffer(void);
 
+typedef struct TraceThreadBuffer TraceThreadBuffer;
+
 typedef struct {
-    unsigned int tbuf_idx;
+    TraceThreadBuffer *tbuf;
     unsigned int rec_off;
+    unsigned int new_head;
 } TraceBufferRecord;
 
 /* Note for hackers: Make sure MAX_TRACE_LEN < sizeof(uint32_t) */
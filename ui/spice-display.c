@@ -17,6 +17,8 @@
 
 #include "qemu/osdep.h"
 #include "ui/qemu-spice.h"
+#include "qemu/bitmap.h"
+#include "qemu/cutils.h"
 #include "qemu/error-report.h"
 #include "qemu/timer.h"
 #include "qemu/lockable.h"
@@ -190,7 +192,8 @@ static void qemu_spice_create_update(SimpleSpiceDisplay *ssd)
     static const int blksize = 32;
     int blocks = DIV_ROUND_UP(surface_width(ssd->ds), blksize);
     g_autofree int *dirty_top = NULL;
-    int y, yoff1, yoff2, x, xoff, blk, bw;
+    g_autofree unsigned long *changed = NULL;
+    int y, yoff1, yoff2, x, xoff, blk, bw, i;
     int bpp = surface_bytes_per_pixel(ssd->ds);
     uint8_t *guest, *mirror;
 
@@ -202,19 +205,22 @@ static void qemu_spice_create_update(SimpleSpiceDisplay *ssd)
     for (blk = 0; blk < blocks; blk++) {
         dirty_top[blk] = -1;
     }
+    changed = bitmap_new(blocks);
 
     guest = surface_data(ssd->ds);
     mirror = (void *)pixman_image_get_data(ssd->mirror);
+    xoff = ssd->dirty.left * bpp;
     for (y = ssd->dirty.top; y < ssd->dirty.bottom; y++) {
         yoff1 = y * surface_stride(ssd->ds);
         yoff2 = y * pixman_image_get_stride(ssd->mirror);
-        for (x = ssd->dirty.left; x < ssd->dirty.right; x += blksize) {
-            xoff = x * bpp;
+        buffer_diff_tiles(guest + yoff1 + xoff, mirror + yoff2 + xoff,
+                          (ssd->dirty.right - ssd->dirty.left) * bpp,
+                          blksize * bpp, NULL, changed);
+        for (x = ssd->dirty.left, i = 0; x < ssd->dirty.right;
+             x += blksize, i++) {
             blk = x / blksize;
             bw = MIN(blksize, ssd->dirty.right - x);
-            if (memcmp(guest + yoff1 + xoff,
-                       mirror + yoff2 + xoff,
-                       bw * bpp) == 0) {
+            if (!test_bit(i, changed)) {
                 if (dirty_top[blk] != -1) {
                     QXLRect update = {
                         .top    = dirty_top[blk],
@@ -0,0 +1,37 @@
+/*
+ * Video encoder that produces no data, for testing
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/module.h"
+#include "ui/video-encoder.h"
+
+static bool video_encoder_null_init(VideoEncoder *enc, Error **errp)
+{
+    return true;
+}
+
+static bool video_encoder_null_encode(VideoEncoder *enc, pixman_image_t *image,
+                                      bool keyframe, GByteArray *out,
+                                      Error **errp)
+{
+    return true;
+}
+
+static const VideoEncoderDriver video_encoder_null = {
+    .name = "null",
+    .instance_size = sizeof(VideoEncoder),
+    .init = video_encoder_null_init,
+    .encode = video_encoder_null_encode,
+};
+
+static void register_video_encoder_null(void)
+{
+    video_encoder_register(&video_encoder_null);
+}
+
+type_init(register_video_encoder_null);
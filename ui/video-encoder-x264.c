@@ -0,0 +1,187 @@
+/*
+ * H.264 video encoder using libx264
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/module.h"
+#include "ui/video-encoder.h"
+
+#include <x264.h>
+
+typedef struct VideoEncoderX264 {
+    VideoEncoder parent;
+    x264_param_t param;
+    x264_t *x264;
+    x264_picture_t pic;
+} VideoEncoderX264;
+
+static void x264_set_rate_control(VideoEncoderX264 *s)
+{
+    s->param.rc.i_rc_method = X264_RC_ABR;
+    s->param.rc.i_bitrate = s->parent.bitrate;
+    s->param.rc.i_vbv_max_bitrate = s->parent.bitrate;
+    /* One second of buffering keeps the latency bounded */
+    s->param.rc.i_vbv_buffer_size = s->parent.bitrate;
+}
+
+static bool video_encoder_x264_init(VideoEncoder *enc, Error **errp)
+{
+    VideoEncoderX264 *s = container_of(enc, VideoEncoderX264, parent);
+
+    if (x264_param_default_preset(&s->param, "ultrafast", "zerolatency") < 0) {
+        error_setg(errp, "x264: cannot set preset");
+        return false;
+    }
+    s->param.i_csp = X264_CSP_I420;
+    /* 4:2:0 chroma subsampling needs even dimensions */
+    s->param.i_width = ROUND_UP(enc->width, 2);
+    s->param.i_height = ROUND_UP(enc->height, 2);
+    s->param.i_fps_num = enc->fps;
+    s->param.i_fps_den = 1;
+    s->param.i_keyint_max = X264_KEYINT_MAX_INFINITE;
+    s->param.b_repeat_headers = 1;
+    s->param.b_annexb = 1;
+    s->param.i_log_level = X264_LOG_ERROR;
+    x264_set_rate_control(s);
+    if (x264_param_apply_profile(&s->param, "baseline") < 0) {
+        error_setg(errp, "x264: cannot apply baseline profile");
+        return false;
+    }
+
+    s->x264 = x264_encoder_open(&s->param);
+    if (!s->x264) {
+        error_setg(errp, "x264: cannot open encoder for %dx%d",
+                   enc->width, enc->height);
+        return false;
+    }
+    if (x264_picture_alloc(&s->pic, X264_CSP_I420,
+                           s->param.i_width, s->param.i_height) < 0) {
+        x264_encoder_close(s->x264);
+        error_setg(errp, "x264: cannot allocate picture");
+        return false;
+    }
+    return true;
+}
+
+static void video_encoder_x264_finalize(VideoEncoder *enc)
+{
+    VideoEncoderX264 *s = container_of(enc, VideoEncoderX264, parent);
+
+    x264_picture_clean(&s->pic);
+    x264_encoder_close(s->x264);
+}
+
+static inline uint8_t rgb_to_y(int r, int g, int b)
+{
+    return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+static inline uint8_t rgb_to_u(int r, int g, int b)
+{
+    return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+static inline uint8_t rgb_to_v(int r, int g, int b)
+{
+    return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+/*
+ * Convert x8r8g8b8 to BT.601 limited range I420.  Odd widths and heights
+ * are padded by repeating the last column and row.
+ */
+static void x264_convert_frame(VideoEncoderX264 *s, pixman_image_t *image)
+{
+    const uint8_t *data = (const uint8_t *)pixman_image_get_data(image);
+    int stride = pixman_image_get_stride(image);
+    int width = s->parent.width, height = s->parent.height;
+    x264_image_t *img = &s->pic.img;
+    int x, y;
+
+    for (y = 0; y < s->param.i_height; y += 2) {
+        const uint32_t *row0 = (const uint32_t *)
+            (data + MIN(y, height - 1) * stride);
+        const uint32_t *row1 = (const uint32_t *)
+            (data + MIN(y + 1, height - 1) * stride);
+        uint8_t *y0 = img->plane[0] + y * img->i_stride[0];
+        uint8_t *y1 = y0 + img->i_stride[0];
+        uint8_t *u = img->plane[1] + y / 2 * img->i_stride[1];
+        uint8_t *v = img->plane[2] + y / 2 * img->i_stride[2];
+
+        for (x = 0; x < s->param.i_width; x += 2) {
+            int x1 = MIN(x + 1, width - 1);
+            uint32_t p[4] = { row0[x], row0[x1], row1[x], row1[x1] };
+            int r = 0, g = 0, b = 0, i;
+
+            for (i = 0; i < 4; i++) {
+                int pr = (p[i] >> 16) & 0xff;
+                int pg = (p[i] >> 8) & 0xff;
+                int pb = p[i] & 0xff;
+
+                (i < 2 ? y0 : y1)[x + (i & 1)] = rgb_to_y(pr, pg, pb);
+                r += pr;
+                g += pg;
+                b += pb;
+            }
+            u[x / 2] = rgb_to_u(r / 4, g / 4, b / 4);
+            v[x / 2] = rgb_to_v(r / 4, g / 4, b / 4);
+        }
+    }
+}
+
+static bool video_encoder_x264_encode(VideoEncoder *enc, pixman_image_t *image,
+                                      bool keyframe, GByteArray *out,
+                                      Error **errp)
+{
+    VideoEncoderX264 *s = container_of(enc, VideoEncoderX264, parent);
+    x264_picture_t pic_out;
+    x264_nal_t *nal;
+    int i_nal, size;
+
+    assert(pixman_image_get_format(image) == PIXMAN_x8r8g8b8);
+    x264_convert_frame(s, image);
+    s->pic.i_pts = enc->frames;
+    s->pic.i_type = keyframe ? X264_TYPE_IDR : X264_TYPE_AUTO;
+
+    size = x264_encoder_encode(s->x264, &nal, &i_nal, &s->pic, &pic_out);
+    if (size < 0) {
+        error_setg(errp, "x264: encoding failed");
+        return false;
+    }
+
+    /* The payloads of all NAL units are contiguous */
+    if (size > 0) {
+        g_byte_array_append(out, nal[0].p_payload, size);
+    }
+    return true;
+}
+
+static void video_encoder_x264_set_bitrate(VideoEncoder *enc)
+{
+    VideoEncoderX264 *s = container_of(enc, VideoEncoderX264, parent);
+
+    x264_set_rate_control(s);
+    x264_encoder_reconfig(s->x264, &s->param);
+}
+
+static const VideoEncoderDriver video_encoder_x264 = {
+    .name = "x264",
+    .priority = 10,
+    .instance_size = sizeof(VideoEncoderX264),
+    .init = video_encoder_x264_init,
+    .finalize = video_encoder_x264_finalize,
+    .encode = video_encoder_x264_encode,
+    .set_bitrate = video_encoder_x264_set_bitrate,
+};
+
+static void register_video_encoder_x264(void)
+{
+    video_encoder_register(&video_encoder_x264);
+}
+
+type_init(register_video_encoder_x264);
@@ -0,0 +1,159 @@
+/*
+ * Pluggable video encoders for remote displays
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/atomic.h"
+#include "qemu/timer.h"
+#include "ui/video-encoder.h"
+
+#define VIDEO_ENCODER_MAX_DRIVERS 8
+
+static const VideoEncoderDriver *drivers[VIDEO_ENCODER_MAX_DRIVERS];
+static int n_drivers;
+
+void video_encoder_register(const VideoEncoderDriver *drv)
+{
+    assert(n_drivers < VIDEO_ENCODER_MAX_DRIVERS);
+    assert(drv->instance_size >= sizeof(VideoEncoder));
+    drivers[n_drivers++] = drv;
+}
+
+static const VideoEncoderDriver *video_encoder_find(const char *name)
+{
+    const VideoEncoderDriver *best = NULL;
+    int i;
+
+    for (i = 0; i < n_drivers; i++) {
+        if (name) {
+            if (!strcmp(drivers[i]->name, name)) {
+                return drivers[i];
+            }
+        } else if (strcmp(drivers[i]->name, "null") &&
+                   (!best || drivers[i]->priority > best->priority)) {
+            best = drivers[i];
+        }
+    }
+    return best;
+}
+
+bool video_encoder_available(const char *name)
+{
+    return video_encoder_find(name) != NULL;
+}
+
+VideoEncoder *video_encoder_new(const char *name, int width, int height,
+                                Error **errp)
+{
+    const VideoEncoderDriver *drv = video_encoder_find(name);
+    VideoEncoder *enc;
+
+    if (!drv) {
+        if (name) {
+            error_setg(errp, "video encoder '%s' is not available", name);
+        } else {
+            error_setg(errp, "no video encoder available");
+        }
+        return NULL;
+    }
+
+    enc = g_malloc0(drv->instance_size);
+    enc->drv = drv;
+    enc->width = width;
+    enc->height = height;
+    enc->fps = VIDEO_ENCODER_DEFAULT_FPS;
+    enc->bitrate = VIDEO_ENCODER_DEFAULT_BITRATE;
+    enc->min_bitrate = VIDEO_ENCODER_MIN_BITRATE;
+    enc->max_bitrate = VIDEO_ENCODER_MAX_BITRATE;
+    enc->keyframe = true;
+
+    if (!drv->init(enc, errp)) {
+        g_free(enc);
+        return NULL;
+    }
+    return enc;
+}
+
+void video_encoder_free(VideoEncoder *enc)
+{
+    if (!enc) {
+        return;
+    }
+    if (enc->drv->finalize) {
+        enc->drv->finalize(enc);
+    }
+    g_free(enc);
+}
+
+int64_t video_encoder_frame_delay(VideoEncoder *enc, int64_t now)
+{
+    return MAX(qatomic_read_i64(&enc->next_frame_ns) - now, 0);
+}
+
+bool video_encoder_frame_due(VideoEncoder *enc, int64_t now)
+{
+    return !video_encoder_frame_delay(enc, now);
+}
+
+bool video_encoder_encode(VideoEncoder *enc, pixman_image_t *image,
+                          int64_t now, GByteArray *out, Error **errp)
+{
+    bool keyframe = enc->keyframe;
+
+    assert(pixman_image_get_width(image) == enc->width &&
+           pixman_image_get_height(image) == enc->height);
+
+    if (!enc->drv->encode(enc, image, keyframe, out, errp)) {
+        return false;
+    }
+    enc->keyframe = false;
+    enc->frames++;
+    qatomic_set_i64(&enc->next_frame_ns,
+                    now + NANOSECONDS_PER_SECOND / enc->fps);
+    return true;
+}
+
+void video_encoder_request_keyframe(VideoEncoder *enc)
+{
+    enc->keyframe = true;
+}
+
+static void video_encoder_set_bitrate(VideoEncoder *enc, uint32_t bitrate)
+{
+    bitrate = MIN(MAX(bitrate, enc->min_bitrate), enc->max_bitrate);
+    if (bitrate == enc->bitrate) {
+        return;
+    }
+
+    enc->bitrate = bitrate;
+    if (enc->drv->set_bitrate) {
+        enc->drv->set_bitrate(enc);
+    }
+}
+
+/*
+ * Back off quickly when data queues up, so that interactive latency
+ * recovers within a few frames, and probe for more bandwidth slowly, after
+ * a second in which every frame was sent in time.
+ */
+void video_encoder_feedback(VideoEncoder *enc, size_t backlog)
+{
+    size_t frame_bytes = (size_t)enc->bitrate * 1000 / 8 / enc->fps;
+
+    if (backlog > 2 * frame_bytes) {
+        enc->idle_frames = 0;
+        video_encoder_set_bitrate(enc, enc->bitrate / 4 * 3);
+    } else if (backlog < frame_bytes / 2) {
+        if (++enc->idle_frames >= enc->fps) {
+            enc->idle_frames = 0;
+            video_encoder_set_bitrate(enc, enc->bitrate / 8 * 9);
+        }
+    } else {
+        enc->idle_frames = 0;
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ * QEMU VNC display driver: Open H.264 encoding
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/atomic.h"
+#include "qemu/timer.h"
+#include "vnc.h"
+#include "trace.h"
+
+/*
+ * Each rectangle carries the length of the data and a flags word before
+ * the Annex B byte stream.  The client keeps one decoder per rectangle
+ * position; ResetContext makes it discard the decoder state, which is
+ * needed whenever the server starts a new encoder.
+ */
+#define VNC_H264_RESET_CONTEXT       (1 << 0)
+#define VNC_H264_RESET_ALL_CONTEXTS  (1 << 1)
+
+void vnc_h264_init(VncState *vs)
+{
+    vs->h264 = g_new0(VncH264, 1);
+    qemu_mutex_init(&vs->h264->lock);
+}
+
+static void vnc_h264_set_encoder(VncH264 *h264, VideoEncoder *enc)
+{
+    VideoEncoder *old;
+
+    WITH_QEMU_LOCK_GUARD(&h264->lock) {
+        old = h264->enc;
+        h264->enc = enc;
+    }
+    video_encoder_free(old);
+}
+
+/*
+ * Called by vnc_update_client() before queueing a frame.  Returns 0 if
+ * the frame is due, otherwise how many nanoseconds are left; keeping the
+ * dirty bits until then merges the damage into the next frame, rather
+ * than spending bandwidth on partial updates that the encoder would have
+ * to turn into full frames anyway.
+ */
+int64_t vnc_h264_frame_delay(VncState *vs)
+{
+    VncH264 *h264 = vs->h264;
+    int64_t delay = 0;
+
+    if (vs->update == VNC_STATE_UPDATE_FORCE) {
+        qatomic_set(&h264->keyframe, true);
+    } else {
+        WITH_QEMU_LOCK_GUARD(&h264->lock) {
+            if (h264->enc) {
+                delay = video_encoder_frame_delay(
+                    h264->enc, qemu_clock_get_ns(QEMU_CLOCK_REALTIME));
+            }
+        }
+    }
+    if (!delay) {
+        qatomic_set(&h264->backlog, vs->output.offset);
+    }
+    return delay;
+}
+
+static int vnc_h264_send_raw(VncState *vs, int x, int y, int w, int h)
+{
+    vnc_framebuffer_update(vs, x, y, w, h, VNC_ENCODING_RAW);
+    return vnc_raw_send_framebuffer_update(vs, x, y, w, h);
+}
+
+int vnc_h264_send_framebuffer_update(VncState *vs, int x, int y, int w, int h)
+{
+    VncH264 *h264 = vs->h264;
+    bool keyframe = qatomic_xchg(&h264->keyframe, false);
+    uint32_t flags = 0;
+    pixman_image_t *image;
+    Error *local_err = NULL;
+    bool ok;
+
+    if (h264->enc && (h264->enc->width != w || h264->enc->height != h)) {
+        vnc_h264_set_encoder(h264, NULL);
+    }
+    if (!h264->enc) {
+        VideoEncoder *enc = video_encoder_new(NULL, w, h, &local_err);
+
+        if (!enc) {
+            trace_vnc_h264_error(vs, error_get_pretty(local_err));
+            error_free(local_err);
+            return vnc_h264_send_raw(vs, x, y, w, h);
+        }
+        vnc_h264_set_encoder(h264, enc);
+        trace_vnc_h264_encoder_new(vs, enc->drv->name, w, h);
+        flags |= VNC_H264_RESET_CONTEXT;
+    } else if (keyframe) {
+        video_encoder_request_keyframe(h264->enc);
+    }
+    if (!h264->buf) {
+        h264->buf = g_byte_array_new();
+    }
+
+    video_encoder_feedback(h264->enc, qatomic_read(&h264->backlog));
+
+    image = pixman_image_create_bits(VNC_SERVER_FB_FORMAT, w, h,
+                                     vnc_server_fb_ptr(vs->vd, x, y),
+                                     vnc_server_fb_stride(vs->vd));
+    g_byte_array_set_size(h264->buf, 0);
+    ok = video_encoder_encode(h264->enc, image,
+                              qemu_clock_get_ns(QEMU_CLOCK_REALTIME),
+                              h264->buf, &local_err);
+    qemu_pixman_image_unref(image);
+    if (!ok) {
+        trace_vnc_h264_error(vs, error_get_pretty(local_err));
+        error_free(local_err);
+        /* Start over with a fresh encoder on the next frame */
+        vnc_h264_set_encoder(h264, NULL);
+        return vnc_h264_send_raw(vs, x, y, w, h);
+    }
+
+    trace_vnc_h264_frame(vs, h264->buf->len, h264->enc->bitrate);
+    if (!h264->buf->len) {
+        return 0;
+    }
+
+    vnc_framebuffer_update(vs, x, y, w, h, VNC_ENCODING_H264);
+    vnc_write_u32(vs, h264->buf->len);
+    vnc_write_u32(vs, flags);
+    vnc_write(vs, h264->buf->data, h264->buf->len);
+    return 1;
+}
+
+void vnc_h264_clear(VncState *vs)
+{
+    vnc_h264_set_encoder(vs->h264, NULL);
+    if (vs->h264->buf) {
+        g_byte_array_unref(vs->h264->buf);
+        vs->h264->buf = NULL;
+    }
+}
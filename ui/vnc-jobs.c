@@ -31,7 +31,11 @@
 #include "vnc-jobs.h"
 #include "qemu/sockets.h"
 #include "qemu/main-loop.h"
+#include "qemu/host-utils.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
 #include "block/aio.h"
+#include "sysemu/stats.h"
 #include "trace.h"
 
 /*
@@ -41,22 +45,30 @@
  * - jobs queue lock: for each operation on the queue (push, pop, isEmpty?)
  * - VncDisplay global lock: mainly used for framebuffer updates to avoid
  *                      screen corruption if the framebuffer is updated
- *                      while the worker is doing something.
+ *                      while a worker is doing something.  Workers only
+ *                      read the server surface, so they take it shared.
  * - VncState::output lock: used to make sure the output buffer is not corrupted
  *                          if two threads try to write on it at the same time
  *
- * While the VNC worker thread is working, the VncDisplay global lock is held
+ * While a VNC worker thread is working, the VncDisplay global lock is held
  * to avoid screen corruption (this does not block vnc_refresh() because it
  * uses trylock()) but the output lock is not held because the thread works on
  * its own output buffer.
  * When the encoding job is done, the worker thread will hold the output lock
  * and copy its output buffer in vs->output.
+ *
+ * The encoders keep per-client state (zlib streams, palettes, lossy
+ * rectangles) that is copied in and out of the worker, so jobs for the same
+ * client run one at a time and in order; jobs for different clients run in
+ * parallel on the pool of worker threads.
  */
 
+#define VNC_WORKER_THREADS_MAX 8
+
 struct VncJobQueue {
     QemuCond cond;
     QemuMutex mutex;
-    QemuThread thread;
+    int nthreads;
     bool exit;
     QTAILQ_HEAD(, VncJob) jobs;
 };
@@ -64,11 +76,23 @@ struct VncJobQueue {
 typedef struct VncJobQueue VncJobQueue;
 
 /*
- * We use a single global queue, but most of the functions are
- * already reentrant, so we can easily add more than one encoding thread
+ * We use a single global queue, served by up to VNC_WORKER_THREADS_MAX
+ * encoding threads.
  */
 static VncJobQueue *queue;
 
+/*
+ * Time from vnc_job_push() until the encoded update is ready to be sent.
+ * Bucket i of the histogram counts frames of [2^(i-1), 2^i) microseconds.
+ */
+#define VNC_FRAME_TIME_BUCKETS 24
+
+static Stat64 vnc_frames;
+static Stat64 vnc_frame_rects;
+static Stat64 vnc_frame_time_ns;
+static Stat64 vnc_frame_time_max_ns;
+static Stat64 vnc_frame_time_hist[VNC_FRAME_TIME_BUCKETS];
+
 static void vnc_lock_queue(VncJobQueue *queue)
 {
     qemu_mutex_lock(&queue->mutex);
@@ -110,6 +134,7 @@ int vnc_job_add_rect(VncJob *job, int x, int y, int w, int h)
 
 void vnc_job_push(VncJob *job)
 {
+    job->queued = get_clock();
     vnc_lock_queue(queue);
     if (queue->exit || QLIST_EMPTY(&job->rectangles)) {
         g_free(job);
@@ -120,6 +145,49 @@ void vnc_job_push(VncJob *job)
     vnc_unlock_queue(queue);
 }
 
+/* Return whether a worker is encoding a job for @vs */
+static bool vnc_job_running_locked(VncState *vs)
+{
+    VncJob *job;
+
+    QTAILQ_FOREACH(job, &queue->jobs, next) {
+        if (job->running && job->vs == vs) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Return the oldest job whose client is not being served by another worker.
+ * Because jobs are removed from the queue only once they are done, this is
+ * also the oldest job for that client.
+ */
+static VncJob *vnc_next_job_locked(VncJobQueue *queue)
+{
+    VncJob *job;
+
+    QTAILQ_FOREACH(job, &queue->jobs, next) {
+        if (!job->running && !vnc_job_running_locked(job->vs)) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
+static void vnc_frame_done(VncJob *job, int n_rectangles)
+{
+    uint64_t ns = get_clock() - job->queued;
+    int bucket = MIN(64 - clz64(ns / SCALE_US), VNC_FRAME_TIME_BUCKETS - 1);
+
+    stat64_add(&vnc_frames, 1);
+    stat64_add(&vnc_frame_rects, n_rectangles);
+    stat64_add(&vnc_frame_time_ns, ns);
+    stat64_max(&vnc_frame_time_max_ns, ns);
+    stat64_add(&vnc_frame_time_hist[bucket], 1);
+    trace_vnc_job_frame_time(job->vs, job, n_rectangles, ns);
+}
+
 static bool vnc_has_job_locked(VncState *vs)
 {
     VncJob *job;
@@ -193,6 +261,7 @@ static void vnc_async_encoding_start(VncState *orig, VncState *local)
     local->zlib = orig->zlib;
     local->hextile = orig->hextile;
     local->zrle = orig->zrle;
+    local->h264 = orig->h264;
     local->client_width = orig->client_width;
     local->client_height = orig->client_height;
 }
@@ -204,6 +273,7 @@ static void vnc_async_encoding_end(VncState *orig, VncState *local)
     orig->zlib = local->zlib;
     orig->hextile = local->hextile;
     orig->zrle = local->zrle;
+    orig->h264 = local->h264;
     orig->lossy_rect = local->lossy_rect;
 }
 
@@ -237,23 +307,22 @@ static bool vnc_worker_clamp_rect(VncState *vs, VncJob *job, VncRect *rect)
 
 static int vnc_worker_thread_loop(VncJobQueue *queue)
 {
-    VncJob *job;
+    VncJob *job = NULL;
     VncRectEntry *entry, *tmp;
     VncState vs = {};
     int n_rectangles;
     int saved_offset;
 
     vnc_lock_queue(queue);
-    while (QTAILQ_EMPTY(&queue->jobs) && !queue->exit) {
+    while (!queue->exit && !(job = vnc_next_job_locked(queue))) {
         qemu_cond_wait(&queue->cond, &queue->mutex);
     }
-    /* Here job can only be NULL if queue->exit is true */
-    job = QTAILQ_FIRST(&queue->jobs);
-    vnc_unlock_queue(queue);
-
     if (queue->exit) {
+        vnc_unlock_queue(queue);
         return -1;
     }
+    job->running = true;
+    vnc_unlock_queue(queue);
 
     assert(job->vs->magic == VNC_MAGIC);
 
@@ -283,12 +352,12 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     saved_offset = vs.output.offset;
     vnc_write_u16(&vs, 0);
 
-    vnc_lock_display(job->vs->vd);
+    vnc_lock_display_shared(job->vs->vd);
     QLIST_FOREACH_SAFE(entry, &job->rectangles, next, tmp) {
         int n;
 
         if (job->vs->ioc == NULL) {
-            vnc_unlock_display(job->vs->vd);
+            vnc_unlock_display_shared(job->vs->vd);
             /* Copy persistent encoding data */
             vnc_async_encoding_end(job->vs, &vs);
             goto disconnected;
@@ -305,12 +374,14 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
         g_free(entry);
     }
     trace_vnc_job_nrects(&vs, job, n_rectangles);
-    vnc_unlock_display(job->vs->vd);
+    vnc_unlock_display_shared(job->vs->vd);
 
     /* Put n_rectangles at the beginning of the message */
     vs.output.buffer[saved_offset] = (n_rectangles >> 8) & 0xFF;
     vs.output.buffer[saved_offset + 1] = n_rectangles & 0xFF;
 
+    vnc_frame_done(job, n_rectangles);
+
     vnc_lock_output(job->vs);
     if (job->vs->ioc != NULL) {
         buffer_move(&job->vs->jobs_buffer, &vs.output);
@@ -356,11 +427,16 @@ static void vnc_queue_clear(VncJobQueue *q)
 static void *vnc_worker_thread(void *arg)
 {
     VncJobQueue *queue = arg;
-
-    qemu_thread_get_self(&queue->thread);
+    bool last;
 
     while (!vnc_worker_thread_loop(queue)) ;
-    vnc_queue_clear(queue);
+
+    vnc_lock_queue(queue);
+    last = --queue->nthreads == 0;
+    vnc_unlock_queue(queue);
+    if (last) {
+        vnc_queue_clear(queue);
+    }
     return NULL;
 }
 
@@ -369,15 +445,76 @@ static bool vnc_worker_thread_running(void)
     return queue; /* Check global queue */
 }
 
+typedef struct VncStats {
+    uint64_t frames;
+    uint64_t rects;
+    uint64_t frame_time_ns;
+    uint64_t frame_time_max_ns;
+    uint64_t frame_time_hist[VNC_FRAME_TIME_BUCKETS];
+} VncStats;
+
+static const StatsDesc vnc_stats_desc[] = {
+    { "frames", STATS_TYPE_CUMULATIVE, 0, offsetof(VncStats, frames) },
+    { "rectangles", STATS_TYPE_CUMULATIVE, 0, offsetof(VncStats, rects) },
+    { "frame-time", STATS_TYPE_CUMULATIVE, -9,
+      offsetof(VncStats, frame_time_ns) },
+    { "max-frame-time", STATS_TYPE_PEAK, -9,
+      offsetof(VncStats, frame_time_max_ns) },
+    { "frame-time-histogram", STATS_TYPE_LOG2_HISTOGRAM, -6,
+      offsetof(VncStats, frame_time_hist), VNC_FRAME_TIME_BUCKETS },
+};
+
+static void vnc_stats_cb(StatsResultList **result, StatsTarget target,
+                         strList *names, strList *targets, Error **errp)
+{
+    StatsList *list = NULL;
+    VncStats stats;
+    int i;
+
+    if (target != STATS_TARGET_VM) {
+        return;
+    }
+
+    stats.frames = stat64_get(&vnc_frames);
+    stats.rects = stat64_get(&vnc_frame_rects);
+    stats.frame_time_ns = stat64_get(&vnc_frame_time_ns);
+    stats.frame_time_max_ns = stat64_get(&vnc_frame_time_max_ns);
+    for (i = 0; i < VNC_FRAME_TIME_BUCKETS; i++) {
+        stats.frame_time_hist[i] = stat64_get(&vnc_frame_time_hist[i]);
+    }
+
+    add_stats_from_desc(&list, names, vnc_stats_desc,
+                        ARRAY_SIZE(vnc_stats_desc), &stats);
+    if (list) {
+        add_stats_entry(result, STATS_PROVIDER_VNC, NULL, list);
+    }
+}
+
+static void vnc_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    add_stats_schema(result, STATS_PROVIDER_VNC, STATS_TARGET_VM,
+                     stats_schema_from_desc(vnc_stats_desc,
+                                            ARRAY_SIZE(vnc_stats_desc)));
+}
+
 void vnc_start_worker_thread(void)
 {
     VncJobQueue *q;
+    QemuThread thread;
+    long nprocs;
+    int i;
 
     if (vnc_worker_thread_running())
         return;
 
+    nprocs = sysconf(_SC_NPROCESSORS_ONLN);
     q = vnc_queue_init();
-    qemu_thread_create(&q->thread, "vnc_worker", vnc_worker_thread, q,
-                       QEMU_THREAD_DETACHED);
+    q->nthreads = MAX(MIN(nprocs, VNC_WORKER_THREADS_MAX), 1);
+    for (i = 0; i < q->nthreads; i++) {
+        qemu_thread_create(&thread, "vnc_worker", vnc_worker_thread, q,
+                           QEMU_THREAD_DETACHED);
+    }
     queue = q; /* Set global queue */
+
+    add_stats_callbacks(STATS_PROVIDER_VNC, vnc_stats_cb, vnc_schemas_cb);
 }
@@ -40,19 +40,27 @@ void vnc_jobs_consume_buffer(VncState *vs);
 void vnc_start_worker_thread(void);
 
 /* Locks */
+
+/* Exclusive, for updates to the server surface.  Returns 0 on success.  */
 static inline int vnc_trylock_display(VncDisplay *vd)
 {
-    return qemu_mutex_trylock(&vd->mutex);
+    return g_rw_lock_writer_trylock(&vd->lock) ? 0 : -EBUSY;
 }
 
-static inline void vnc_lock_display(VncDisplay *vd)
+static inline void vnc_unlock_display(VncDisplay *vd)
 {
-    qemu_mutex_lock(&vd->mutex);
+    g_rw_lock_writer_unlock(&vd->lock);
 }
 
-static inline void vnc_unlock_display(VncDisplay *vd)
+/* Shared, for the encoding threads.  */
+static inline void vnc_lock_display_shared(VncDisplay *vd)
+{
+    g_rw_lock_reader_lock(&vd->lock);
+}
+
+static inline void vnc_unlock_display_shared(VncDisplay *vd)
 {
-    qemu_mutex_unlock(&vd->mutex);
+    g_rw_lock_reader_unlock(&vd->lock);
 }
 
 static inline void vnc_lock_output(VncState *vs)
@@ -612,7 +612,7 @@ bool vnc_display_reload_certs(const char *id, Error **errp)
    3) resolutions > 1024
 */
 
-static int vnc_update_client(VncState *vs, int has_dirty);
+static int vnc_update_client(VncState *vs, int has_dirty, int64_t *delay);
 static void vnc_disconnect_start(VncState *vs);
 
 static void vnc_colordepth(VncState *vs);
@@ -972,6 +972,9 @@ int vnc_send_framebuffer_update(VncState *vs, int x, int y, int w, int h)
         case VNC_ENCODING_ZYWRLE:
             n = vnc_zywrle_send_framebuffer_update(vs, x, y, w, h);
             break;
+        case VNC_ENCODING_H264:
+            n = vnc_h264_send_framebuffer_update(vs, x, y, w, h);
+            break;
         default:
             vnc_framebuffer_update(vs, x, y, w, h, VNC_ENCODING_RAW);
             n = vnc_raw_send_framebuffer_update(vs, x, y, w, h);
@@ -1141,7 +1144,45 @@ static bool vnc_should_update(VncState *vs)
     return false;
 }
 
-static int vnc_update_client(VncState *vs, int has_dirty)
+/*
+ * Dirty runs of a row that are separated by at most this many clean bits
+ * are sent as a single rectangle; encoding a few clean pixels is cheaper
+ * than the header and encoder setup of another rectangle.
+ */
+#define VNC_DIRTY_MERGE_GAP 1
+
+static void vnc_merge_dirty_gaps(VncState *vs, int height)
+{
+    unsigned long size = height * VNC_DIRTY_BPL(vs);
+    unsigned long offset = find_next_bit((unsigned long *) &vs->dirty,
+                                         size, 0);
+
+    while (offset < size) {
+        int y = offset / VNC_DIRTY_BPL(vs);
+        unsigned long x = offset % VNC_DIRTY_BPL(vs);
+        unsigned long x2, next;
+
+        for (;;) {
+            x2 = find_next_zero_bit(vs->dirty[y], VNC_DIRTY_BPL(vs), x);
+            next = find_next_bit(vs->dirty[y], VNC_DIRTY_BPL(vs), x2);
+            if (next >= VNC_DIRTY_BPL(vs)) {
+                break;
+            }
+            if (next - x2 <= VNC_DIRTY_MERGE_GAP) {
+                bitmap_set(vs->dirty[y], x2, next - x2);
+            }
+            x = next;
+        }
+        offset = find_next_bit((unsigned long *) &vs->dirty,
+                               size, (y + 1) * VNC_DIRTY_BPL(vs));
+    }
+}
+
+/*
+ * If a frame was not sent only because the encoder's frame rate does not
+ * allow it yet, lower *@delay to the nanoseconds left until it does.
+ */
+static int vnc_update_client(VncState *vs, int has_dirty, int64_t *delay)
 {
     VncDisplay *vd = vs->vd;
     VncJob *job;
@@ -1163,6 +1204,15 @@ static int vnc_update_client(VncState *vs, int has_dirty)
         return 0;
     }
 
+    if (vs->vnc_encoding == VNC_ENCODING_H264) {
+        int64_t frame_delay = vnc_h264_frame_delay(vs);
+
+        if (frame_delay) {
+            *delay = MIN(*delay, frame_delay);
+            return 0;
+        }
+    }
+
     /*
      * Send screen updates to the vnc client using the server
      * surface and server dirty map.  guest surface updates
@@ -1174,6 +1224,16 @@ static int vnc_update_client(VncState *vs, int has_dirty)
     height = pixman_image_get_height(vd->server);
     width = pixman_image_get_width(vd->server);
 
+    if (vs->vnc_encoding == VNC_ENCODING_H264) {
+        /* Video encoders always work on the whole frame */
+        for (y = 0; y < height; y++) {
+            bitmap_zero(vs->dirty[y], VNC_DIRTY_BPL(vs));
+        }
+        n = vnc_job_add_rect(job, 0, 0, width, height);
+    } else {
+        vnc_merge_dirty_gaps(vs, height);
+    }
+
     y = 0;
     for (;;) {
         int x, h;
@@ -1325,6 +1385,7 @@ void vnc_disconnect_finish(VncState *vs)
     vnc_zlib_clear(vs);
     vnc_tight_clear(vs);
     vnc_zrle_clear(vs);
+    vnc_h264_clear(vs);
 
 #ifdef CONFIG_VNC_SASL
     vnc_sasl_client_cleanup(vs);
@@ -1364,6 +1425,8 @@ void vnc_disconnect_finish(VncState *vs)
     vs->magic = 0;
     g_free(vs->zrle);
     g_free(vs->tight);
+    qemu_mutex_destroy(&vs->h264->lock);
+    g_free(vs->h264);
     g_free(vs);
 }
 
@@ -2181,6 +2244,13 @@ static void set_encodings(VncState *vs, int32_t *encodings, size_t n_encodings)
             vnc_set_feature(vs, VNC_FEATURE_ZYWRLE);
             vs->vnc_encoding = enc;
             break;
+        case VNC_ENCODING_H264:
+            /* H.264 is lossy, so only offer it when lossy=on */
+            if (vs->vd->lossy && video_encoder_available(NULL)) {
+                vnc_set_feature(vs, VNC_FEATURE_H264);
+                vs->vnc_encoding = enc;
+            }
+            break;
         case VNC_ENCODING_DESKTOPRESIZE:
             vnc_set_feature(vs, VNC_FEATURE_RESIZE);
             break;
@@ -3109,8 +3179,9 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
     int has_dirty = 0;
     pixman_image_t *tmpbuf = NULL;
     unsigned long offset;
-    int x;
+    int x, tiles, changed;
     uint8_t *guest_ptr, *server_ptr;
+    DECLARE_BITMAP(row_dirty, VNC_MAX_WIDTH / VNC_DIRTY_PIXELS_PER_BIT);
 
     struct timeval tv = { 0, 0 };
 
@@ -3149,11 +3220,14 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
     }
     line_bytes = MIN(server_stride, guest_ll);
 
+    tiles = DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
+    line_bytes = MIN(line_bytes, tiles * cmp_bytes);
+    bitmap_zero(row_dirty, tiles);
+
     for (;;) {
         y = offset / VNC_DIRTY_BPL(&vd->guest);
-        x = offset % VNC_DIRTY_BPL(&vd->guest);
 
-        server_ptr = server_row0 + y * server_stride + x * cmp_bytes;
+        server_ptr = server_row0 + y * server_stride;
 
         if (vd->guest.format != VNC_SERVER_FB_FORMAT) {
             qemu_pixman_linebuf_fill(tmpbuf, vd->guest.fb, width, 0, y);
@@ -3161,30 +3235,27 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
         } else {
             guest_ptr = guest_row0 + y * guest_stride;
         }
-        guest_ptr += x * cmp_bytes;
 
-        for (; x < DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
-             x++, guest_ptr += cmp_bytes, server_ptr += cmp_bytes) {
-            int _cmp_bytes = cmp_bytes;
-            if (!test_and_clear_bit(x, vd->guest.dirty[y])) {
-                continue;
-            }
-            if ((x + 1) * cmp_bytes > line_bytes) {
-                _cmp_bytes = line_bytes - x * cmp_bytes;
-            }
-            assert(_cmp_bytes >= 0);
-            if (memcmp(server_ptr, guest_ptr, _cmp_bytes) == 0) {
-                continue;
-            }
-            memcpy(server_ptr, guest_ptr, _cmp_bytes);
-            if (!vd->non_adaptive) {
-                vnc_rect_updated(vd, x * VNC_DIRTY_PIXELS_PER_BIT,
-                                 y, &tv);
+        /* Compare the tiles that the guest marked dirty in one pass */
+        changed = buffer_diff_tiles(server_ptr, guest_ptr, line_bytes,
+                                    cmp_bytes, vd->guest.dirty[y], row_dirty);
+        bitmap_clear(vd->guest.dirty[y], 0, tiles);
+        if (changed) {
+            for (x = find_first_bit(row_dirty, tiles); x < tiles;
+                 x = find_next_bit(row_dirty, tiles, x + 1)) {
+                int _cmp_bytes = MIN(cmp_bytes, line_bytes - x * cmp_bytes);
+
+                memcpy(server_ptr + x * cmp_bytes, guest_ptr + x * cmp_bytes,
+                       _cmp_bytes);
+                if (!vd->non_adaptive) {
+                    vnc_rect_updated(vd, x * VNC_DIRTY_PIXELS_PER_BIT,
+                                     y, &tv);
+                }
             }
             QTAILQ_FOREACH(vs, &vd->clients, next) {
-                set_bit(x, vs->dirty[y]);
+                bitmap_or(vs->dirty[y], vs->dirty[y], row_dirty, tiles);
             }
-            has_dirty++;
+            has_dirty += changed;
         }
 
         y++;
@@ -3205,6 +3276,7 @@ static void vnc_refresh(DisplayChangeListener *dcl)
     VncDisplay *vd = container_of(dcl, VncDisplay, dcl);
     VncState *vs, *vn;
     int has_dirty, rects = 0;
+    int64_t delay = INT64_MAX;
 
     if (QTAILQ_EMPTY(&vd->clients)) {
         update_displaychangelistener(&vd->dcl, VNC_REFRESH_INTERVAL_MAX);
@@ -3222,11 +3294,22 @@ static void vnc_refresh(DisplayChangeListener *dcl)
     vnc_unlock_display(vd);
 
     QTAILQ_FOREACH_SAFE(vs, &vd->clients, next, vn) {
-        rects += vnc_update_client(vs, has_dirty);
+        rects += vnc_update_client(vs, has_dirty, &delay);
         /* vs might be free()ed here */
     }
 
-    if (has_dirty && rects) {
+    if (delay != INT64_MAX) {
+        /*
+         * A frame is only waiting for the encoder's frame rate.  This is
+         * not idleness; come back just in time for it.
+         */
+        vd->dcl.update_interval = MIN(vd->dcl.update_interval,
+                                      DIV_ROUND_UP(delay, SCALE_MS));
+        return;
+    }
+
+    /* Damage held back for the frame rate counts, even if has_dirty is 0 */
+    if (rects) {
         vd->dcl.update_interval /= 2;
         if (vd->dcl.update_interval < VNC_REFRESH_INTERVAL_BASE) {
             vd->dcl.update_interval = VNC_REFRESH_INTERVAL_BASE;
@@ -3249,6 +3332,7 @@ static void vnc_connect(VncDisplay *vd, QIOChannelSocket *sioc,
     trace_vnc_client_connect(vs, sioc);
     vs->zrle = g_new0(VncZrle, 1);
     vs->tight = g_new0(VncTight, 1);
+    vnc_h264_init(vs);
     vs->magic = VNC_MAGIC;
     vs->sioc = sioc;
     object_ref(OBJECT(vs->sioc));
@@ -3416,7 +3500,7 @@ void vnc_display_init(const char *id, Error **errp)
     vd->share_policy = VNC_SHARE_POLICY_ALLOW_EXCLUSIVE;
     vd->connections_limit = 32;
 
-    qemu_mutex_init(&vd->mutex);
+    g_rw_lock_init(&vd->lock);
     vnc_start_worker_thread();
 
     vd->dcl.ops = &dcl_ops;
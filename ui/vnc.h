@@ -45,6 +45,7 @@
 #include "vnc-palette.h"
 #include "vnc-enc-zrle.h"
 #include "ui/kbd-state.h"
+#include "ui/video-encoder.h"
 
 // #define _VNC_DEBUG 1
 
@@ -157,7 +158,7 @@ struct VncDisplay
     QEMUPutLEDEntry *led;
     int ledstate;
     QKbdState *kbd;
-    QemuMutex mutex;
+    GRWLock lock;
 
     int cursor_msize;
     uint8_t *cursor_mask;
@@ -232,6 +233,20 @@ typedef struct VncZywrle {
     int buf[VNC_ZRLE_TILE_WIDTH * VNC_ZRLE_TILE_HEIGHT];
 } VncZywrle;
 
+typedef struct VncH264 {
+    /*
+     * Owned by the worker thread.  @lock is taken to replace @enc, so
+     * that the main thread can check whether a frame is due.
+     */
+    QemuMutex lock;
+    VideoEncoder *enc;
+    GByteArray *buf;
+
+    /* Set by the main thread, consumed by the worker thread */
+    size_t backlog;
+    bool keyframe;
+} VncH264;
+
 struct VncRect
 {
     int x;
@@ -249,6 +264,8 @@ struct VncRectEntry
 struct VncJob
 {
     VncState *vs;
+    int64_t queued;
+    bool running;
 
     QLIST_HEAD(, VncRectEntry) rectangles;
     QTAILQ_ENTRY(VncJob) next;
@@ -345,6 +362,7 @@ struct VncState
     VncHextile hextile;
     VncZrle *zrle;
     VncZywrle zywrle;
+    VncH264 *h264;
 
     Notifier mouse_mode_notifier;
 
@@ -405,6 +423,7 @@ enum {
 #define VNC_ENCODING_TRLE                 0x0000000f
 #define VNC_ENCODING_ZRLE                 0x00000010
 #define VNC_ENCODING_ZYWRLE               0x00000011
+#define VNC_ENCODING_H264                 0x00000032
 #define VNC_ENCODING_COMPRESSLEVEL0       0xFFFFFF00 /* -256 */
 #define VNC_ENCODING_QUALITYLEVEL0        0xFFFFFFE0 /* -32  */
 #define VNC_ENCODING_XCURSOR              0xFFFFFF10 /* -240 */
@@ -465,6 +484,7 @@ enum VncFeatures {
     VNC_FEATURE_XVP,
     VNC_FEATURE_CLIPBOARD_EXT,
     VNC_FEATURE_AUDIO,
+    VNC_FEATURE_H264,
 };
 
 
@@ -626,6 +646,11 @@ int vnc_zrle_send_framebuffer_update(VncState *vs, int x, int y, int w, int h);
 int vnc_zywrle_send_framebuffer_update(VncState *vs, int x, int y, int w, int h);
 void vnc_zrle_clear(VncState *vs);
 
+int64_t vnc_h264_frame_delay(VncState *vs);
+void vnc_h264_init(VncState *vs);
+int vnc_h264_send_framebuffer_update(VncState *vs, int x, int y, int w, int h);
+void vnc_h264_clear(VncState *vs);
+
 /* vnc-clipboard.c */
 void vnc_server_cut_text_caps(VncState *vs);
 void vnc_client_cut_text(VncState *vs, size_t len, uint8_t *text);
@@ -0,0 +1,83 @@
+/*
+ * Compare two buffers tile by tile
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/cutils.h"
+#include "qemu/bitops.h"
+#include "host/cpuinfo.h"
+
+typedef size_t (*bdiff_accel_fn)(const void *, const void *, size_t, size_t,
+                                  const unsigned long *, unsigned long *);
+
+/*
+ * Walk the tiles selected by @check, or all of them, and record in @diff
+ * those for which @differs returns true.  Always inlined, so that each
+ * implementation gets its own copy with @differs inlined too.
+ */
+static inline __attribute__((always_inline)) size_t
+buffer_diff_tiles_common(const void *a, const void *b, size_t len, size_t tile,
+                         const unsigned long *check, unsigned long *diff,
+                         bool (*differs)(const void *, const void *, size_t))
+{
+    size_t n = DIV_ROUND_UP(len, tile);
+    size_t i, count = 0;
+
+    bitmap_zero(diff, n);
+    for (i = check ? find_first_bit(check, n) : 0; i < n;
+         i = check ? find_next_bit(check, n, i + 1) : i + 1) {
+        size_t offset = i * tile;
+
+        if (differs(a + offset, b + offset, MIN(tile, len - offset))) {
+            set_bit(i, diff);
+            count++;
+        }
+    }
+    return count;
+}
+
+static inline bool buffer_differs_int(const void *a, const void *b, size_t len)
+{
+    return memcmp(a, b, len) != 0;
+}
+
+static size_t buffer_diff_tiles_int(const void *a, const void *b, size_t len,
+                                    size_t tile, const unsigned long *check,
+                                    unsigned long *diff)
+{
+    return buffer_diff_tiles_common(a, b, len, tile, check, diff,
+                                    buffer_differs_int);
+}
+
+#include "host/bufferdiff.c.inc"
+
+static bdiff_accel_fn buffer_diff_tiles_accel;
+static unsigned accel_index;
+
+size_t buffer_diff_tiles(const void *a, const void *b, size_t len, size_t tile,
+                         const unsigned long *check, unsigned long *diff)
+{
+    assert(tile > 0);
+    if (unlikely(len == 0)) {
+        return 0;
+    }
+    return buffer_diff_tiles_accel(a, b, len, tile, check, diff);
+}
+
+bool test_buffer_diff_next_accel(void)
+{
+    if (accel_index != 0) {
+        buffer_diff_tiles_accel = accel_table[--accel_index];
+        return true;
+    }
+    return false;
+}
+
+static void __attribute__((constructor)) init_accel(void)
+{
+    accel_index = best_accel();
+    buffer_diff_tiles_accel = accel_table[accel_index];
+}
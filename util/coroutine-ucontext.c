@@ -42,6 +42,20 @@
 #include <sanitizer/tsan_interface.h>
 #endif
 
+/*
+ * On the most common hosts, switch stacks with a few instructions that
+ * only save the callee-saved registers, instead of sigsetjmp/siglongjmp
+ * which also save and mangle the signal mask, stack and frame pointers.
+ * The sanitizers and SafeStack need to be told about each switch, and
+ * shadow stacks would need to be switched too, so they keep using the
+ * generic code.
+ */
+#if (defined(__x86_64__) || defined(__aarch64__)) && defined(__ELF__) && \
+    !defined(CONFIG_ASAN) && !defined(CONFIG_TSAN) && \
+    !defined(CONFIG_SAFESTACK) && !(defined(__CET__) && (__CET__ & 2))
+#define COROUTINE_ASM_SWITCH 1
+#endif
+
 typedef struct {
     Coroutine base;
     void *stack;
@@ -51,7 +65,11 @@ typedef struct {
     void *unsafe_stack;
     size_t unsafe_stack_size;
 #endif
+#ifdef COROUTINE_ASM_SWITCH
+    void *sp;
+#else
     sigjmp_buf env;
+#endif
 
 #ifdef CONFIG_TSAN
     void *tsan_co_fiber;
@@ -145,6 +163,138 @@ void start_switch_fiber_tsan(void **fake_stack_save,
 #endif
 }
 
+#ifdef COROUTINE_ASM_SWITCH
+/*
+ * coroutine_asm_switch() pushes the callee-saved registers on the stack
+ * of @from, stores the stack pointer in *@from_sp, and pops the registers
+ * of @to from @to_sp.  It then returns @action to whoever switched away
+ * from @to last; for a new coroutine, that is coroutine_asm_start, which
+ * finds its arguments in the registers prepared by coroutine_asm_init().
+ */
+CoroutineAction coroutine_asm_switch(void **from_sp, void *to_sp,
+                                     CoroutineAction action);
+void coroutine_asm_start(void);
+
+#if defined(__x86_64__)
+asm(".pushsection .text\n"
+    ".p2align 4\n"
+    ".globl coroutine_asm_switch\n"
+    ".hidden coroutine_asm_switch\n"
+    ".type coroutine_asm_switch, @function\n"
+    "coroutine_asm_switch:\n"
+    "    .byte 0xf3, 0x0f, 0x1e, 0xfa\n"  /* endbr64 */
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    movl %edx, %eax\n"
+    "    ret\n"
+    ".size coroutine_asm_switch, .-coroutine_asm_switch\n"
+    ".globl coroutine_asm_start\n"
+    ".hidden coroutine_asm_start\n"
+    ".type coroutine_asm_start, @function\n"
+    "coroutine_asm_start:\n"
+    "    movq %rbx, %rdi\n"
+    "    callq *%r12\n"
+    "    ud2\n"
+    ".size coroutine_asm_start, .-coroutine_asm_start\n"
+    ".popsection\n");
+
+/* r15, r14, r13, r12, rbx, rbp, return address, padding */
+#define COROUTINE_ASM_FRAME_WORDS   9
+#define COROUTINE_ASM_FRAME_SELF    4
+#define COROUTINE_ASM_FRAME_FUNC    3
+#define COROUTINE_ASM_FRAME_RA      6
+#elif defined(__aarch64__)
+asm(".pushsection .text\n"
+    ".p2align 4\n"
+    ".globl coroutine_asm_switch\n"
+    ".hidden coroutine_asm_switch\n"
+    ".type coroutine_asm_switch, %function\n"
+    "coroutine_asm_switch:\n"
+    "    hint #34\n"                       /* bti c */
+    "    sub sp, sp, #160\n"
+    "    stp x19, x20, [sp, #0]\n"
+    "    stp x21, x22, [sp, #16]\n"
+    "    stp x23, x24, [sp, #32]\n"
+    "    stp x25, x26, [sp, #48]\n"
+    "    stp x27, x28, [sp, #64]\n"
+    "    stp x29, x30, [sp, #80]\n"
+    "    stp d8, d9, [sp, #96]\n"
+    "    stp d10, d11, [sp, #112]\n"
+    "    stp d12, d13, [sp, #128]\n"
+    "    stp d14, d15, [sp, #144]\n"
+    "    mov x3, sp\n"
+    "    str x3, [x0]\n"
+    "    mov sp, x1\n"
+    "    ldp x19, x20, [sp, #0]\n"
+    "    ldp x21, x22, [sp, #16]\n"
+    "    ldp x23, x24, [sp, #32]\n"
+    "    ldp x25, x26, [sp, #48]\n"
+    "    ldp x27, x28, [sp, #64]\n"
+    "    ldp x29, x30, [sp, #80]\n"
+    "    ldp d8, d9, [sp, #96]\n"
+    "    ldp d10, d11, [sp, #112]\n"
+    "    ldp d12, d13, [sp, #128]\n"
+    "    ldp d14, d15, [sp, #144]\n"
+    "    add sp, sp, #160\n"
+    "    mov w0, w2\n"
+    "    ret\n"
+    ".size coroutine_asm_switch, .-coroutine_asm_switch\n"
+    ".globl coroutine_asm_start\n"
+    ".hidden coroutine_asm_start\n"
+    ".type coroutine_asm_start, %function\n"
+    "coroutine_asm_start:\n"
+    "    mov x0, x19\n"
+    "    blr x20\n"
+    "    brk #0\n"
+    ".size coroutine_asm_start, .-coroutine_asm_start\n"
+    ".popsection\n");
+
+/* x19-x28, x29, x30, d8-d15 */
+#define COROUTINE_ASM_FRAME_WORDS   20
+#define COROUTINE_ASM_FRAME_SELF    0
+#define COROUTINE_ASM_FRAME_FUNC    1
+#define COROUTINE_ASM_FRAME_RA      11
+#endif
+
+static G_NORETURN void coroutine_asm_trampoline(CoroutineUContext *self)
+{
+    Coroutine *co = &self->base;
+
+    while (true) {
+        co->entry(co->entry_arg);
+        qemu_coroutine_switch(co, co->caller, COROUTINE_TERMINATE);
+    }
+}
+
+/*
+ * Build a frame at the top of the stack, as if coroutine_asm_start had
+ * called coroutine_asm_switch().  The frame pointer is zero, so that
+ * backtraces stop there.
+ */
+static void coroutine_asm_init(CoroutineUContext *co)
+{
+    uintptr_t *sp = QEMU_ALIGN_PTR_DOWN(co->stack + co->stack_size, 16);
+
+    sp -= COROUTINE_ASM_FRAME_WORDS;
+    memset(sp, 0, COROUTINE_ASM_FRAME_WORDS * sizeof(*sp));
+    sp[COROUTINE_ASM_FRAME_SELF] = (uintptr_t)co;
+    sp[COROUTINE_ASM_FRAME_FUNC] = (uintptr_t)coroutine_asm_trampoline;
+    sp[COROUTINE_ASM_FRAME_RA] = (uintptr_t)coroutine_asm_start;
+    co->sp = sp;
+}
+#else
 static void coroutine_trampoline(int i0, int i1)
 {
     union cc_arg arg;
@@ -176,10 +326,22 @@ static void coroutine_trampoline(int i0, int i1)
         qemu_coroutine_switch(co, co->caller, COROUTINE_TERMINATE);
     }
 }
+#endif
 
 Coroutine *qemu_coroutine_new(void)
 {
     CoroutineUContext *co;
+#ifdef COROUTINE_ASM_SWITCH
+    co = g_malloc0(sizeof(*co));
+    co->stack_size = COROUTINE_STACK_SIZE;
+    co->stack = qemu_alloc_stack(&co->stack_size);
+#ifdef CONFIG_VALGRIND_H
+    co->valgrind_stack_id =
+        VALGRIND_STACK_REGISTER(co->stack, co->stack + co->stack_size);
+#endif
+    coroutine_asm_init(co);
+    return &co->base;
+#else
     ucontext_t old_uc, uc;
     sigjmp_buf old_env;
     union cc_arg arg = {0};
@@ -249,6 +411,7 @@ Coroutine *qemu_coroutine_new(void)
     finish_switch_fiber(fake_stack_save);
 
     return &co->base;
+#endif
 }
 
 #ifdef CONFIG_VALGRIND_H
@@ -313,6 +476,11 @@ qemu_coroutine_switch(Coroutine *from_, Coroutine *to_,
 {
     CoroutineUContext *from = DO_UPCAST(CoroutineUContext, base, from_);
     CoroutineUContext *to = DO_UPCAST(CoroutineUContext, base, to_);
+#ifdef COROUTINE_ASM_SWITCH
+    set_current(to_);
+
+    return coroutine_asm_switch(&from->sp, to->sp, action);
+#else
     int ret;
     void *fake_stack_save = NULL;
 
@@ -332,6 +500,7 @@ qemu_coroutine_switch(Coroutine *from_, Coroutine *to_,
     finish_switch_fiber(fake_stack_save);
 
     return ret;
+#endif
 }
 
 Coroutine *qemu_coroutine_self(void)
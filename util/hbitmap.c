@@ -12,8 +12,11 @@
 #include "qemu/osdep.h"
 #include "qemu/hbitmap.h"
 #include "qemu/host-utils.h"
+#include "qemu/bitmap.h"
 #include "trace.h"
+#include "qemu/cutils.h"
 #include "crypto/hash.h"
+#include "host/cpuinfo.h"
 
 /* HBitmaps provides an array of bits.  The bits are stored as usual in an
  * array of unsigned longs, but HBitmap is also optimized to provide fast
@@ -50,8 +53,16 @@
  * extremely sparse, this is also O(m + m/W + m/W^2 + ...), so the amortized
  * cost of advancing from one bit to the next is usually constant (worst case
  * O(logB n) as in the non-amortized complexity).
+ *
+ * The last level is by far the largest.  In a sparse HBitmap it is split
+ * in chunks of HB_CHUNK_WORDS words, which are only allocated when one of
+ * their bits is set and freed when they become clear again.  The upper
+ * levels are always allocated as a whole.
  */
 
+#define HB_CHUNK_SHIFT          9
+#define HB_CHUNK_WORDS          (1 << HB_CHUNK_SHIFT)
+
 struct HBitmap {
     /*
      * Size of the bitmap, as requested in hbitmap_alloc or in hbitmap_truncate.
@@ -99,8 +110,160 @@ struct HBitmap {
 
     /* The length of each levels[] array. */
     uint64_t sizes[HBITMAP_LEVELS];
+
+    /* For sparse bitmaps, the last level in chunks of HB_CHUNK_WORDS words,
+     * NULL if they are entirely clear; levels[HBITMAP_LEVELS - 1] is NULL.
+     */
+    unsigned long **chunks;
 };
 
+static inline uint64_t hb_num_chunks(const HBitmap *hb)
+{
+    return DIV_ROUND_UP(hb->sizes[HBITMAP_LEVELS - 1], HB_CHUNK_WORDS);
+}
+
+/* Return the words of the last level from @pos to the end of its chunk, or
+ * NULL if they are all zero.
+ */
+static inline unsigned long *hb_chunk(const HBitmap *hb, uint64_t pos)
+{
+    if (unlikely(hb->chunks)) {
+        unsigned long *chunk = hb->chunks[pos >> HB_CHUNK_SHIFT];
+        return chunk ? chunk + (pos & (HB_CHUNK_WORDS - 1)) : NULL;
+    }
+    return hb->levels[HBITMAP_LEVELS - 1] + pos;
+}
+
+/* Number of words from @pos to the end of its chunk, at most @n */
+static inline uint64_t hb_chunk_len(uint64_t pos, uint64_t n)
+{
+    return MIN(n, HB_CHUNK_WORDS - (pos & (HB_CHUNK_WORDS - 1)));
+}
+
+static inline unsigned long hb_word(const HBitmap *hb, int level, uint64_t pos)
+{
+    if (level == HBITMAP_LEVELS - 1 && unlikely(hb->chunks)) {
+        unsigned long *chunk = hb->chunks[pos >> HB_CHUNK_SHIFT];
+        return chunk ? chunk[pos & (HB_CHUNK_WORDS - 1)] : 0;
+    }
+    return hb->levels[level][pos];
+}
+
+/* Return a pointer to a word for modification.  For a clear chunk, either
+ * allocate it or, if @alloc is false, return NULL.
+ */
+static unsigned long *hb_word_ptr(HBitmap *hb, int level, uint64_t pos,
+                                  bool alloc)
+{
+    if (level == HBITMAP_LEVELS - 1 && unlikely(hb->chunks)) {
+        unsigned long **chunk = &hb->chunks[pos >> HB_CHUNK_SHIFT];
+
+        if (!*chunk) {
+            if (!alloc) {
+                return NULL;
+            }
+            *chunk = g_new0(unsigned long, HB_CHUNK_WORDS);
+        }
+        return *chunk + (pos & (HB_CHUNK_WORDS - 1));
+    }
+    return &hb->levels[level][pos];
+}
+
+/* Free the chunks between the ones that hold @first and @last if they are
+ * clear, as told by the 2nd-last level.
+ */
+static void hb_free_clear_chunks(HBitmap *hb, uint64_t first, uint64_t last)
+{
+    const uint64_t parent_words = HB_CHUNK_WORDS >> BITS_PER_LEVEL;
+    unsigned long *parent = hb->levels[HBITMAP_LEVELS - 2];
+    uint64_t c, i;
+
+    for (c = first >> HB_CHUNK_SHIFT; c <= last >> HB_CHUNK_SHIFT; c++) {
+        if (!hb->chunks[c]) {
+            continue;
+        }
+        for (i = c * parent_words;
+             i < MIN((c + 1) * parent_words, hb->sizes[HBITMAP_LEVELS - 2]);
+             i++) {
+            if (parent[i]) {
+                break;
+            }
+        }
+        if (i == MIN((c + 1) * parent_words, hb->sizes[HBITMAP_LEVELS - 2])) {
+            g_free(hb->chunks[c]);
+            hb->chunks[c] = NULL;
+        }
+    }
+}
+
+/*
+ * Kernels that process a whole array of words, selected at startup
+ * according to the host CPU.
+ */
+typedef struct HBitmapAccel {
+    /* Return the number of bits set in @p[0..@n-1] */
+    uint64_t (*popcount)(const unsigned long *p, size_t n);
+    /* Return the index of the first word of @p that is not all ones, or @n */
+    size_t (*find_not_ones)(const unsigned long *p, size_t n);
+    /* Compute @dst = @a | @b and return the number of bits set in @dst */
+    uint64_t (*or_count)(unsigned long *dst, const unsigned long *a,
+                         const unsigned long *b, size_t n);
+} HBitmapAccel;
+
+static uint64_t hb_popcount_int(const unsigned long *p, size_t n)
+{
+    uint64_t count = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        count += ctpopl(p[i]);
+    }
+    return count;
+}
+
+static size_t hb_find_not_ones_int(const unsigned long *p, size_t n)
+{
+    size_t i = 0;
+
+    while (i < n && p[i] == ~0UL) {
+        i++;
+    }
+    return i;
+}
+
+static uint64_t hb_or_count_int(unsigned long *dst, const unsigned long *a,
+                                const unsigned long *b, size_t n)
+{
+    uint64_t count = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        dst[i] = a[i] | b[i];
+        count += ctpopl(dst[i]);
+    }
+    return count;
+}
+
+#include "host/hbitmap.c.inc"
+
+static const HBitmapAccel *hb_accel;
+static unsigned accel_index;
+
+bool test_hbitmap_next_accel(void)
+{
+    if (accel_index != 0) {
+        hb_accel = &accel_table[--accel_index];
+        return true;
+    }
+    return false;
+}
+
+static void __attribute__((constructor)) hbitmap_init_accel(void)
+{
+    accel_index = best_accel();
+    hb_accel = &accel_table[accel_index];
+}
+
 /* Advance hbi to the next nonzero word and return it.  hbi->pos
  * is updated.  Returns zero if we reach the end of the bitmap.
  */
@@ -136,7 +299,7 @@ static unsigned long hbitmap_iter_skip_words(HBitmapIter *hbi)
         hbi->cur[i] = cur & (cur - 1);
 
         /* Set up next level for iteration.  */
-        cur = hb->levels[i + 1][pos];
+        cur = hb_word(hb, i + 1, pos);
     }
 
     hbi->pos = pos;
@@ -149,7 +312,7 @@ static unsigned long hbitmap_iter_skip_words(HBitmapIter *hbi)
 int64_t hbitmap_iter_next(HBitmapIter *hbi)
 {
     unsigned long cur = hbi->cur[HBITMAP_LEVELS - 1] &
-            hbi->hb->levels[HBITMAP_LEVELS - 1][hbi->pos];
+            hb_word(hbi->hb, HBITMAP_LEVELS - 1, hbi->pos);
     int64_t item;
 
     if (cur == 0) {
@@ -182,7 +345,7 @@ void hbitmap_iter_init(HBitmapIter *hbi, const HBitmap *hb, uint64_t first)
         pos >>= BITS_PER_LEVEL;
 
         /* Drop bits representing items before first.  */
-        hbi->cur[i] = hb->levels[i][pos] & ~((1UL << bit) - 1);
+        hbi->cur[i] = hb_word(hb, i, pos) & ~((1UL << bit) - 1);
 
         /* We have already added level i+1, so the lowest set bit has
          * been processed.  Clear it.
@@ -220,8 +383,7 @@ int64_t hbitmap_next_dirty(const HBitmap *hb, int64_t start, int64_t count)
 int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
 {
     size_t pos = (start >> hb->granularity) >> BITS_PER_LEVEL;
-    unsigned long *last_lev = hb->levels[HBITMAP_LEVELS - 1];
-    unsigned long cur = last_lev[pos];
+    unsigned long cur, *chunk;
     unsigned start_bit_offset;
     uint64_t end_bit, sz;
     int64_t res;
@@ -241,19 +403,30 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
      * in them, let's set them.
      */
     start_bit_offset = (start >> hb->granularity) & (BITS_PER_LONG - 1);
-    cur |= (1UL << start_bit_offset) - 1;
     assert((start >> hb->granularity) < hb->size);
+    cur = hb_word(hb, HBITMAP_LEVELS - 1, pos);
+    cur |= (1UL << start_bit_offset) - 1;
 
     if (cur == (unsigned long)-1) {
-        do {
-            pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
+        /* A clear chunk stops the search at its first word.  */
+        pos++;
+        while (pos < sz) {
+            uint64_t len = hb_chunk_len(pos, sz - pos);
+            uint64_t n;
+
+            chunk = hb_chunk(hb, pos);
+            n = chunk ? hb_accel->find_not_ones(chunk, len) : 0;
+            pos += n;
+            if (n < len) {
+                break;
+            }
+        }
 
         if (pos >= sz) {
             return -1;
         }
 
-        cur = last_lev[pos];
+        cur = hb_word(hb, HBITMAP_LEVELS - 1, pos);
     }
 
     res = (pos << BITS_PER_LEVEL) + ctol(cur);
@@ -378,6 +551,36 @@ static size_t hbitmap_iter_next_word(HBitmapIter *hbi, unsigned long *p_cur)
     return hbi->pos;
 }
 
+/* Count the number of set bits between start and last by looking at every
+ * word of the last level.
+ */
+static uint64_t hb_count_words(HBitmap *hb, uint64_t start, uint64_t last)
+{
+    uint64_t first_word = start >> BITS_PER_LEVEL;
+    uint64_t last_word = last >> BITS_PER_LEVEL;
+    unsigned long first_el = hb_word(hb, HBITMAP_LEVELS - 1, first_word);
+    unsigned long last_el = hb_word(hb, HBITMAP_LEVELS - 1, last_word);
+    uint64_t pos, count;
+
+    if (first_word == last_word) {
+        return ctpopl(first_el & BITMAP_FIRST_WORD_MASK(start) &
+                      BITMAP_LAST_WORD_MASK(last + 1));
+    }
+
+    count = ctpopl(first_el & BITMAP_FIRST_WORD_MASK(start)) +
+            ctpopl(last_el & BITMAP_LAST_WORD_MASK(last + 1));
+    for (pos = first_word + 1; pos < last_word; ) {
+        uint64_t len = hb_chunk_len(pos, last_word - pos);
+        unsigned long *chunk = hb_chunk(hb, pos);
+
+        if (chunk) {
+            count += hb_accel->popcount(chunk, len);
+        }
+        pos += len;
+    }
+    return count;
+}
+
 /* Count the number of set bits between start and end, not accounting for
  * the granularity.  Also an example of how to use hbitmap_iter_next_word.
  */
@@ -389,6 +592,14 @@ static uint64_t hb_count_between(HBitmap *hb, uint64_t start, uint64_t last)
     unsigned long cur;
     size_t pos;
 
+    /* The iterator skips clean areas quickly through the upper levels, but
+     * when there is about one dirty bit per word or more, it is faster to
+     * count every word.
+     */
+    if (hb->count >= (hb->size >> BITS_PER_LEVEL)) {
+        return hb_count_words(hb, start, last);
+    }
+
     hbitmap_iter_init(&hbi, hb, start << hb->granularity);
     for (;;) {
         pos = hbitmap_iter_next_word(&hbi, &cur);
@@ -439,18 +650,22 @@ static bool hb_set_between(HBitmap *hb, int level, uint64_t start,
     i = pos;
     if (i < lastpos) {
         uint64_t next = (start | (BITS_PER_LONG - 1)) + 1;
-        changed |= hb_set_elem(&hb->levels[level][i], start, next - 1);
+        changed |= hb_set_elem(hb_word_ptr(hb, level, i, true),
+                               start, next - 1);
         for (;;) {
+            unsigned long *elem;
+
             start = next;
             next += BITS_PER_LONG;
             if (++i == lastpos) {
                 break;
             }
-            changed |= (hb->levels[level][i] == 0);
-            hb->levels[level][i] = ~0UL;
+            elem = hb_word_ptr(hb, level, i, true);
+            changed |= (*elem == 0);
+            *elem = ~0UL;
         }
     }
-    changed |= hb_set_elem(&hb->levels[level][i], start, last);
+    changed |= hb_set_elem(hb_word_ptr(hb, level, i, true), start, last);
 
     /* If there was any change in this layer, we may have to update
      * the one above.
@@ -512,6 +727,7 @@ static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
     size_t pos = start >> BITS_PER_LEVEL;
     size_t lastpos = last >> BITS_PER_LEVEL;
     bool changed = false;
+    unsigned long *elem;
     size_t i;
 
     i = pos;
@@ -523,7 +739,8 @@ static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
          * unless the lower-level word became entirely zero.  So, remove pos
          * from the upper-level range if bits remain set.
          */
-        if (hb_reset_elem(&hb->levels[level][i], start, next - 1)) {
+        elem = hb_word_ptr(hb, level, i, false);
+        if (elem && hb_reset_elem(elem, start, next - 1)) {
             changed = true;
         } else {
             pos++;
@@ -535,13 +752,17 @@ static bool hb_reset_between(HBitmap *hb, int level, uint64_t start,
             if (++i == lastpos) {
                 break;
             }
-            changed |= (hb->levels[level][i] != 0);
-            hb->levels[level][i] = 0UL;
+            elem = hb_word_ptr(hb, level, i, false);
+            if (elem) {
+                changed |= (*elem != 0);
+                *elem = 0UL;
+            }
         }
     }
 
     /* Same as above, this time for lastpos.  */
-    if (hb_reset_elem(&hb->levels[level][i], start, last)) {
+    elem = hb_word_ptr(hb, level, i, false);
+    if (elem && hb_reset_elem(elem, start, last)) {
         changed = true;
     } else {
         lastpos--;
@@ -577,9 +798,14 @@ void hbitmap_reset(HBitmap *hb, uint64_t start, uint64_t count)
     assert(last < hb->size);
 
     hb->count -= hb_count_between(hb, first, last);
-    if (hb_reset_between(hb, HBITMAP_LEVELS - 1, first, last) &&
-        hb->meta) {
-        hbitmap_set(hb->meta, start, count);
+    if (hb_reset_between(hb, HBITMAP_LEVELS - 1, first, last)) {
+        if (hb->chunks) {
+            hb_free_clear_chunks(hb, first >> BITS_PER_LEVEL,
+                                 last >> BITS_PER_LEVEL);
+        }
+        if (hb->meta) {
+            hbitmap_set(hb->meta, start, count);
+        }
     }
 }
 
@@ -589,7 +815,17 @@ void hbitmap_reset_all(HBitmap *hb)
 
     /* Same as hbitmap_alloc() except for memset() instead of malloc() */
     for (i = HBITMAP_LEVELS; --i >= 1; ) {
-        memset(hb->levels[i], 0, hb->sizes[i] * sizeof(unsigned long));
+        if (hb->levels[i]) {
+            memset(hb->levels[i], 0, hb->sizes[i] * sizeof(unsigned long));
+        }
+    }
+    if (hb->chunks) {
+        uint64_t c;
+
+        for (c = 0; c < hb_num_chunks(hb); c++) {
+            g_free(hb->chunks[c]);
+            hb->chunks[c] = NULL;
+        }
     }
 
     hb->levels[0][0] = 1UL << (BITS_PER_LONG - 1);
@@ -621,7 +857,7 @@ bool hbitmap_get(const HBitmap *hb, uint64_t item)
     unsigned long bit = 1UL << (pos & (BITS_PER_LONG - 1));
     assert(pos < hb->size);
 
-    return (hb->levels[HBITMAP_LEVELS - 1][pos >> BITS_PER_LEVEL] & bit) != 0;
+    return (hb_word(hb, HBITMAP_LEVELS - 1, pos >> BITS_PER_LEVEL) & bit) != 0;
 }
 
 uint64_t hbitmap_serialization_align(const HBitmap *hb)
@@ -638,7 +874,7 @@ uint64_t hbitmap_serialization_align(const HBitmap *hb)
  */
 static void serialization_chunk(const HBitmap *hb,
                                 uint64_t start, uint64_t count,
-                                unsigned long **first_el, uint64_t *el_count)
+                                uint64_t *first_el, uint64_t *el_count)
 {
     uint64_t last = start + count - 1;
     uint64_t gran = hbitmap_serialization_align(hb);
@@ -652,7 +888,7 @@ static void serialization_chunk(const HBitmap *hb,
     start = (start >> hb->granularity) >> BITS_PER_LEVEL;
     last = (last >> hb->granularity) >> BITS_PER_LEVEL;
 
-    *first_el = &hb->levels[HBITMAP_LEVELS - 1][start];
+    *first_el = start;
     *el_count = last - start + 1;
 }
 
@@ -660,12 +896,12 @@ uint64_t hbitmap_serialization_size(const HBitmap *hb,
                                     uint64_t start, uint64_t count)
 {
     uint64_t el_count;
-    unsigned long *cur;
+    uint64_t pos;
 
     if (!count) {
         return 0;
     }
-    serialization_chunk(hb, start, count, &cur, &el_count);
+    serialization_chunk(hb, start, count, &pos, &el_count);
 
     return el_count * sizeof(unsigned long);
 }
@@ -673,22 +909,39 @@ uint64_t hbitmap_serialization_size(const HBitmap *hb,
 void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
                             uint64_t start, uint64_t count)
 {
-    uint64_t el_count;
+    uint64_t el_count, pos, len;
     unsigned long *cur, *end;
 
     if (!count) {
         return;
     }
-    serialization_chunk(hb, start, count, &cur, &el_count);
-    end = cur + el_count;
+    serialization_chunk(hb, start, count, &pos, &el_count);
+
+    for (; el_count; el_count -= len, pos += len) {
+        len = hb_chunk_len(pos, el_count);
+        cur = hb_chunk(hb, pos);
+        end = cur + len;
 
-    while (cur != end) {
-        unsigned long el =
-            (BITS_PER_LONG == 32 ? cpu_to_le32(*cur) : cpu_to_le64(*cur));
+        if (!cur) {
+            memset(buf, 0, len * sizeof(unsigned long));
+            buf += len * sizeof(unsigned long);
+            continue;
+        }
 
-        memcpy(buf, &el, sizeof(el));
-        buf += sizeof(el);
-        cur++;
+        if (!HOST_BIG_ENDIAN) {
+            memcpy(buf, cur, len * sizeof(unsigned long));
+            buf += len * sizeof(unsigned long);
+            continue;
+        }
+
+        while (cur != end) {
+            unsigned long el =
+                (BITS_PER_LONG == 32 ? cpu_to_le32(*cur) : cpu_to_le64(*cur));
+
+            memcpy(buf, &el, sizeof(el));
+            buf += sizeof(el);
+            cur++;
+        }
     }
 }
 
@@ -696,26 +949,44 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
                               uint64_t start, uint64_t count,
                               bool finish)
 {
-    uint64_t el_count;
+    uint64_t el_count, pos, len;
     unsigned long *cur, *end;
 
     if (!count) {
         return;
     }
-    serialization_chunk(hb, start, count, &cur, &el_count);
-    end = cur + el_count;
+    serialization_chunk(hb, start, count, &pos, &el_count);
 
-    while (cur != end) {
-        memcpy(cur, buf, sizeof(*cur));
+    for (; el_count; el_count -= len, pos += len) {
+        len = hb_chunk_len(pos, el_count);
 
-        if (BITS_PER_LONG == 32) {
-            le32_to_cpus((uint32_t *)cur);
-        } else {
-            le64_to_cpus((uint64_t *)cur);
+        /* Do not allocate chunks for clear parts of sparse bitmaps.  */
+        cur = hb_word_ptr(hb, HBITMAP_LEVELS - 1, pos,
+                          !buffer_is_zero(buf, len * sizeof(unsigned long)));
+        if (!cur) {
+            buf += len * sizeof(unsigned long);
+            continue;
+        }
+        end = cur + len;
+
+        if (!HOST_BIG_ENDIAN) {
+            memcpy(cur, buf, len * sizeof(unsigned long));
+            buf += len * sizeof(unsigned long);
+            continue;
         }
 
-        buf += sizeof(unsigned long);
-        cur++;
+        while (cur != end) {
+            memcpy(cur, buf, sizeof(*cur));
+
+            if (BITS_PER_LONG == 32) {
+                le32_to_cpus((uint32_t *)cur);
+            } else {
+                le64_to_cpus((uint64_t *)cur);
+            }
+
+            buf += sizeof(unsigned long);
+            cur++;
+        }
     }
     if (finish) {
         hbitmap_deserialize_finish(hb);
@@ -725,15 +996,21 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
 void hbitmap_deserialize_zeroes(HBitmap *hb, uint64_t start, uint64_t count,
                                 bool finish)
 {
-    uint64_t el_count;
+    uint64_t el_count, pos, len;
     unsigned long *first;
 
     if (!count) {
         return;
     }
-    serialization_chunk(hb, start, count, &first, &el_count);
+    serialization_chunk(hb, start, count, &pos, &el_count);
 
-    memset(first, 0, el_count * sizeof(unsigned long));
+    for (; el_count; el_count -= len, pos += len) {
+        len = hb_chunk_len(pos, el_count);
+        first = hb_word_ptr(hb, HBITMAP_LEVELS - 1, pos, false);
+        if (first) {
+            memset(first, 0, len * sizeof(unsigned long));
+        }
+    }
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
@@ -742,15 +1019,19 @@ void hbitmap_deserialize_zeroes(HBitmap *hb, uint64_t start, uint64_t count,
 void hbitmap_deserialize_ones(HBitmap *hb, uint64_t start, uint64_t count,
                               bool finish)
 {
-    uint64_t el_count;
+    uint64_t el_count, pos, len;
     unsigned long *first;
 
     if (!count) {
         return;
     }
-    serialization_chunk(hb, start, count, &first, &el_count);
+    serialization_chunk(hb, start, count, &pos, &el_count);
 
-    memset(first, 0xff, el_count * sizeof(unsigned long));
+    for (; el_count; el_count -= len, pos += len) {
+        len = hb_chunk_len(pos, el_count);
+        first = hb_word_ptr(hb, HBITMAP_LEVELS - 1, pos, true);
+        memset(first, 0xff, len * sizeof(unsigned long));
+    }
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
@@ -770,7 +1051,13 @@ void hbitmap_deserialize_finish(HBitmap *bitmap)
         memset(bitmap->levels[lev], 0, size * sizeof(unsigned long));
 
         for (i = 0; i < prev_size; ++i) {
-            if (bitmap->levels[lev + 1][i]) {
+            if (lev == HBITMAP_LEVELS - 2 && bitmap->chunks &&
+                !bitmap->chunks[i >> HB_CHUNK_SHIFT]) {
+                /* Skip the rest of a clear chunk */
+                i |= HB_CHUNK_WORDS - 1;
+                continue;
+            }
+            if (hb_word(bitmap, lev + 1, i)) {
                 bitmap->levels[lev][i >> BITS_PER_LEVEL] |=
                     1UL << (i & (BITS_PER_LONG - 1));
             }
@@ -778,20 +1065,36 @@ void hbitmap_deserialize_finish(HBitmap *bitmap)
     }
 
     bitmap->levels[0][0] |= 1UL << (BITS_PER_LONG - 1);
-    bitmap->count = hb_count_between(bitmap, 0, bitmap->size - 1);
+    if (bitmap->chunks) {
+        hb_free_clear_chunks(bitmap, 0, bitmap->sizes[HBITMAP_LEVELS - 1] - 1);
+    }
+    bitmap->count = hb_count_words(bitmap, 0, bitmap->size - 1);
 }
 
 void hbitmap_free(HBitmap *hb)
 {
     unsigned i;
+    uint64_t c;
+
     assert(!hb->meta);
     for (i = HBITMAP_LEVELS; i-- > 0; ) {
         g_free(hb->levels[i]);
     }
+    if (hb->chunks) {
+        for (c = 0; c < hb_num_chunks(hb); c++) {
+            g_free(hb->chunks[c]);
+        }
+        g_free(hb->chunks);
+    }
     g_free(hb);
 }
 
 HBitmap *hbitmap_alloc(uint64_t size, int granularity)
+{
+    return hbitmap_alloc_sparse(size, granularity, false);
+}
+
+HBitmap *hbitmap_alloc_sparse(uint64_t size, int granularity, bool sparse)
 {
     HBitmap *hb = g_new0(struct HBitmap, 1);
     unsigned i;
@@ -808,7 +1111,11 @@ HBitmap *hbitmap_alloc(uint64_t size, int granularity)
     for (i = HBITMAP_LEVELS; i-- > 0; ) {
         size = MAX((size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
         hb->sizes[i] = size;
-        hb->levels[i] = g_new0(unsigned long, size);
+        if (sparse && i == HBITMAP_LEVELS - 1) {
+            hb->chunks = g_new0(unsigned long *, hb_num_chunks(hb));
+        } else {
+            hb->levels[i] = g_new0(unsigned long, size);
+        }
     }
 
     /* We necessarily have free bits in level 0 due to the definition
@@ -820,6 +1127,29 @@ HBitmap *hbitmap_alloc(uint64_t size, int granularity)
     return hb;
 }
 
+/* Resize the last level of a sparse bitmap to @size words.  */
+static void hb_truncate_chunks(HBitmap *hb, uint64_t size)
+{
+    uint64_t old = hb_num_chunks(hb);
+    uint64_t num, c;
+
+    hb->sizes[HBITMAP_LEVELS - 1] = size;
+    num = hb_num_chunks(hb);
+    for (c = num; c < old; c++) {
+        g_free(hb->chunks[c]);
+    }
+    hb->chunks = g_renew(unsigned long *, hb->chunks, num);
+    if (num > old) {
+        memset(&hb->chunks[old], 0, (num - old) * sizeof(*hb->chunks));
+    }
+
+    /*
+     * When growing, the words past the old end of the last chunk are
+     * already zero: hbitmap_reset cleared them on shrink, and new chunks
+     * are allocated with g_new0.
+     */
+}
+
 void hbitmap_truncate(HBitmap *hb, uint64_t size)
 {
     bool shrink;
@@ -860,6 +1190,10 @@ void hbitmap_truncate(HBitmap *hb, uint64_t size)
         if (hb->sizes[i] == size) {
             break;
         }
+        if (i == HBITMAP_LEVELS - 1 && hb->chunks) {
+            hb_truncate_chunks(hb, size);
+            continue;
+        }
         old = hb->sizes[i];
         hb->sizes[i] = size;
         hb->levels[i] = g_renew(unsigned long, hb->levels[i], size);
@@ -892,6 +1226,43 @@ static void hbitmap_sparse_merge(HBitmap *dst, const HBitmap *src)
     }
 }
 
+/* Merge the last level of bitmaps with the same granularity, one chunk at
+ * a time, when any of them is sparse.  Chunks that are clear in both @a and
+ * @b stay unallocated in @result.
+ */
+static void hbitmap_merge_chunks(const HBitmap *a, const HBitmap *b,
+                                 HBitmap *result)
+{
+    uint64_t words = a->sizes[HBITMAP_LEVELS - 1];
+    uint64_t pos, len;
+    uint64_t count = 0;
+
+    for (pos = 0; pos < words; pos += len) {
+        const unsigned long *pa, *pb;
+        unsigned long *dst;
+
+        len = hb_chunk_len(pos, words - pos);
+        pa = hb_chunk(a, pos);
+        pb = hb_chunk(b, pos);
+        if (!pa && !pb) {
+            if (result->chunks) {
+                g_free(result->chunks[pos >> HB_CHUNK_SHIFT]);
+                result->chunks[pos >> HB_CHUNK_SHIFT] = NULL;
+            } else {
+                memset(hb_chunk(result, pos), 0, len * sizeof(unsigned long));
+            }
+            continue;
+        }
+
+        /* hb_word_ptr may allocate a chunk that is also @a or @b */
+        dst = hb_word_ptr(result, HBITMAP_LEVELS - 1, pos, true);
+        pa = hb_chunk(a, pos);
+        pb = hb_chunk(b, pos);
+        count += hb_accel->or_count(dst, pa ?: pb, pb ?: pa, len);
+    }
+    result->count = count;
+}
+
 /**
  * Given HBitmaps A and B, let R := A (BITOR) B.
  * Bitmaps A and B will not be modified,
@@ -901,7 +1272,6 @@ static void hbitmap_sparse_merge(HBitmap *dst, const HBitmap *src)
 void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
 {
     int i;
-    uint64_t j;
 
     assert(a->orig_size == result->orig_size);
     assert(b->orig_size == result->orig_size);
@@ -932,16 +1302,24 @@ void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
     /* This merge is O(size), as BITS_PER_LONG and HBITMAP_LEVELS are constant.
      * It may be possible to improve running times for sparsely populated maps
      * by using hbitmap_iter_next, but this is suboptimal for dense maps.
+     * The dirty count is recomputed together with the last level.
      */
     assert(a->size == b->size);
-    for (i = HBITMAP_LEVELS - 1; i >= 0; i--) {
-        for (j = 0; j < a->sizes[i]; j++) {
-            result->levels[i][j] = a->levels[i][j] | b->levels[i][j];
+    i = HBITMAP_LEVELS - 1;
+    if (a->chunks || b->chunks || result->chunks) {
+        hbitmap_merge_chunks(a, b, result);
+        while (i-- > 0) {
+            hb_accel->or_count(result->levels[i], a->levels[i], b->levels[i],
+                               a->sizes[i]);
         }
+        return;
+    }
+    result->count = hb_accel->or_count(result->levels[i], a->levels[i],
+                                       b->levels[i], a->sizes[i]);
+    while (i-- > 0) {
+        hb_accel->or_count(result->levels[i], a->levels[i], b->levels[i],
+                           a->sizes[i]);
     }
-
-    /* Recompute the dirty count */
-    result->count = hb_count_between(result, 0, result->size - 1);
 }
 
 char *hbitmap_sha256(const HBitmap *bitmap, Error **errp)
@@ -949,7 +1327,73 @@ char *hbitmap_sha256(const HBitmap *bitmap, Error **errp)
     size_t size = bitmap->sizes[HBITMAP_LEVELS - 1] * sizeof(unsigned long);
     char *data = (char *)bitmap->levels[HBITMAP_LEVELS - 1];
     char *hash = NULL;
+
+    if (bitmap->chunks) {
+        /* Hash the same bytes as the dense representation would have */
+        static const unsigned long zero_chunk[HB_CHUNK_WORDS];
+        uint64_t n = hb_num_chunks(bitmap);
+        g_autofree struct iovec *iov = g_new(struct iovec, n);
+        uint64_t c;
+
+        for (c = 0; c < n; c++) {
+            iov[c].iov_base = bitmap->chunks[c] ?: (void *)zero_chunk;
+            iov[c].iov_len = MIN(size, HB_CHUNK_WORDS * sizeof(unsigned long));
+            size -= iov[c].iov_len;
+        }
+        qcrypto_hash_digestv(QCRYPTO_HASH_ALG_SHA256, iov, n, &hash, errp);
+        return hash;
+    }
+
     qcrypto_hash_digest(QCRYPTO_HASH_ALG_SHA256, data, size, &hash, errp);
 
     return hash;
 }
+
+bool hbitmap_is_sparse(const HBitmap *hb)
+{
+    return hb->chunks != NULL;
+}
+
+void hbitmap_set_sparse(HBitmap *hb, bool sparse)
+{
+    uint64_t words = hb->sizes[HBITMAP_LEVELS - 1];
+    uint64_t n = hb_num_chunks(hb);
+    uint64_t c, len;
+
+    if (sparse == hbitmap_is_sparse(hb)) {
+        return;
+    }
+
+    if (sparse) {
+        unsigned long *last = hb->levels[HBITMAP_LEVELS - 1];
+
+        hb->chunks = g_new0(unsigned long *, n);
+        for (c = 0; c < n; c++) {
+            len = hb_chunk_len(c << HB_CHUNK_SHIFT,
+                               words - (c << HB_CHUNK_SHIFT));
+            if (!buffer_is_zero(last + (c << HB_CHUNK_SHIFT),
+                                len * sizeof(unsigned long))) {
+                hb->chunks[c] = g_new0(unsigned long, HB_CHUNK_WORDS);
+                memcpy(hb->chunks[c], last + (c << HB_CHUNK_SHIFT),
+                       len * sizeof(unsigned long));
+            }
+        }
+        hb->levels[HBITMAP_LEVELS - 1] = NULL;
+        g_free(last);
+    } else {
+        unsigned long *last = g_new0(unsigned long, words);
+
+        for (c = 0; c < n; c++) {
+            if (hb->chunks[c]) {
+                len = hb_chunk_len(c << HB_CHUNK_SHIFT,
+                                   words - (c << HB_CHUNK_SHIFT));
+                memcpy(last + (c << HB_CHUNK_SHIFT), hb->chunks[c],
+                       len * sizeof(unsigned long));
+                g_free(hb->chunks[c]);
+            }
+        }
+        g_free(hb->chunks);
+        hb->chunks = NULL;
+        hb->levels[HBITMAP_LEVELS - 1] = last;
+    }
+}
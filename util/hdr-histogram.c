@@ -0,0 +1,172 @@
+/*
+ * Lock-free log-linear histograms
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/coroutine-tls.h"
+#include "qemu/host-utils.h"
+#include "qemu/hdr-histogram.h"
+
+/*
+ * The address of this variable identifies the current thread.  A thread
+ * may inherit the shards of one that has exited, which is fine because
+ * there is still only one writer.
+ */
+QEMU_DEFINE_STATIC_CO_TLS(char, hdr_histogram_owner)
+
+/* The tag of shards whose tag was forgotten; it matches no other tag */
+static const char hdr_histogram_no_tag;
+
+struct HdrHistogramShard {
+    HdrHistogramShard *next;
+    const void *owner;
+    const void *tag;
+    uint64_t max;
+    uint64_t buckets[HDR_HISTOGRAM_BUCKETS];
+};
+
+static unsigned hdr_histogram_index(uint64_t value)
+{
+    unsigned shift;
+
+    if (value < HDR_HISTOGRAM_SUB_BUCKETS) {
+        return value;
+    }
+
+    value = MIN(value, (1ULL << HDR_HISTOGRAM_MAX_BITS) - 1);
+    shift = 63 - clz64(value) - HDR_HISTOGRAM_SUB_BITS;
+    return (shift + 1) * HDR_HISTOGRAM_SUB_BUCKETS +
+           ((value >> shift) & (HDR_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/* The largest value that falls in bucket @index */
+static uint64_t hdr_histogram_bucket_max(unsigned index)
+{
+    unsigned shift;
+    uint64_t sub;
+
+    if (index < HDR_HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    if (index == HDR_HISTOGRAM_BUCKETS - 1) {
+        /* The last bucket also gets all values that are out of range */
+        return UINT64_MAX;
+    }
+
+    shift = index / HDR_HISTOGRAM_SUB_BUCKETS - 1;
+    sub = HDR_HISTOGRAM_SUB_BUCKETS + index % HDR_HISTOGRAM_SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1;
+}
+
+static HdrHistogramShard *hdr_histogram_get_shard(HdrHistogram *hist,
+                                                  const void *tag)
+{
+    const void *owner = get_ptr_hdr_histogram_owner();
+    HdrHistogramShard *head = qatomic_rcu_read(&hist->shards);
+    HdrHistogramShard *shard, *old;
+
+    for (shard = head; shard; shard = shard->next) {
+        if (shard->owner == owner && qatomic_read(&shard->tag) == tag) {
+            return shard;
+        }
+    }
+
+    /* Only this thread can add a shard for itself, so just push it */
+    shard = g_new0(HdrHistogramShard, 1);
+    shard->owner = owner;
+    shard->tag = tag;
+    do {
+        shard->next = head;
+        old = head;
+        head = qatomic_cmpxchg(&hist->shards, old, shard);
+    } while (head != old);
+
+    return shard;
+}
+
+void hdr_histogram_record(HdrHistogram *hist, uint64_t value, const void *tag)
+{
+    HdrHistogramShard *shard = hdr_histogram_get_shard(hist, tag);
+    uint64_t *bucket = &shard->buckets[hdr_histogram_index(value)];
+
+    /* Single writer: a plain load and store are enough */
+    qatomic_set_u64(bucket, qatomic_read_u64(bucket) + 1);
+    if (value > qatomic_read_u64(&shard->max)) {
+        qatomic_set_u64(&shard->max, value);
+    }
+}
+
+void hdr_histogram_add_to_snapshot(HdrHistogram *hist, const void *tag,
+                                   HdrHistogramSnapshot *snap)
+{
+    HdrHistogramShard *shard;
+    unsigned i;
+
+    for (shard = qatomic_rcu_read(&hist->shards); shard;
+         shard = shard->next) {
+        if (tag && qatomic_read(&shard->tag) != tag) {
+            continue;
+        }
+        for (i = 0; i < HDR_HISTOGRAM_BUCKETS; i++) {
+            uint64_t n = qatomic_read_u64(&shard->buckets[i]);
+
+            snap->buckets[i] += n;
+            snap->count += n;
+        }
+        snap->max = MAX(snap->max, qatomic_read_u64(&shard->max));
+    }
+}
+
+uint64_t hdr_histogram_percentile(const HdrHistogramSnapshot *snap,
+                                  double percentile)
+{
+    double exact_rank = snap->count * percentile / 100;
+    uint64_t rank, seen = 0;
+    unsigned i;
+
+    if (!snap->count) {
+        return 0;
+    }
+
+    /* The rank of the value at @percentile, rounded up and starting at 1 */
+    rank = exact_rank;
+    if (rank < exact_rank) {
+        rank++;
+    }
+    rank = MAX(rank, 1);
+
+    for (i = 0; i < HDR_HISTOGRAM_BUCKETS; i++) {
+        seen += snap->buckets[i];
+        if (seen >= rank) {
+            return MIN(hdr_histogram_bucket_max(i), snap->max);
+        }
+    }
+
+    return snap->max;
+}
+
+void hdr_histogram_forget_tag(HdrHistogram *hist, const void *tag)
+{
+    HdrHistogramShard *shard;
+
+    for (shard = qatomic_rcu_read(&hist->shards); shard;
+         shard = shard->next) {
+        if (qatomic_read(&shard->tag) == tag) {
+            qatomic_set(&shard->tag, &hdr_histogram_no_tag);
+        }
+    }
+}
+
+void hdr_histogram_destroy(HdrHistogram *hist)
+{
+    HdrHistogramShard *shard, *next;
+
+    for (shard = hist->shards; shard; shard = next) {
+        next = shard->next;
+        g_free(shard);
+    }
+    hist->shards = NULL;
+}
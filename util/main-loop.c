@@ -29,6 +29,7 @@
 #include "sysemu/cpu-timers.h"
 #include "sysemu/replay.h"
 #include "qemu/main-loop.h"
+#include "qemu/coroutine.h"
 #include "block/aio.h"
 #include "block/thread-pool.h"
 #include "qemu/error-report.h"
@@ -170,6 +171,7 @@ int qemu_init_main_loop(Error **errp)
         return -EMFILE;
     }
     qemu_set_current_aio_context(qemu_aio_context);
+    qemu_coroutine_pool_trim_init();
     qemu_notify_bh = qemu_bh_new(notify_event_cb, NULL);
     gpollfds = g_array_new(FALSE, FALSE, sizeof(GPollFD));
     src = aio_get_g_source(qemu_aio_context);
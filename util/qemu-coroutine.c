@@ -19,12 +19,22 @@
 #include "qemu/coroutine_int.h"
 #include "qemu/coroutine-tls.h"
 #include "qemu/cutils.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
 #include "block/aio.h"
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
 enum {
     COROUTINE_POOL_BATCH_MAX_SIZE = 128,
+    COROUTINE_POOL_MAX_NODES = 16,
 };
 
+/* How often the global pool is trimmed to the recently observed needs */
+#define COROUTINE_POOL_TRIM_INTERVAL_NS (2 * NANOSECONDS_PER_SECOND)
+
 /*
  * Coroutine creation and deletion is expensive so a pool of unused coroutines
  * is kept as a cache. When the pool has coroutines available, they are
@@ -37,13 +47,29 @@ enum {
  * batches whereas the maximum size of the global pool is controlled by the
  * qemu_coroutine_inc_pool_size() API.
  *
+ * The global pool is split by host NUMA node, so that the stack of a
+ * recycled coroutine is usually local to the thread that runs it.  Threads
+ * return batches to the pool of the node they are running on, and take
+ * them from there, falling back to the other nodes before allocating new
+ * coroutines.
+ *
+ * .-----------------------------------.
+ * | Batch 1 | Batch 2 | Batch 3 | ... | global_pool, node 0
+ * `-----------------------------------'
  * .-----------------------------------.
- * | Batch 1 | Batch 2 | Batch 3 | ... | global_pool
+ * | Batch 1 | Batch 2 | Batch 3 | ... | global_pool, node 1
  * `-----------------------------------'
  *
  * .-------------------.
  * | Batch 1 | Batch 2 | per-thread local_pool (maximum 2 batches)
  * `-------------------'
+ *
+ * Each node's pool remembers how many coroutines sat unused during the
+ * last COROUTINE_POOL_TRIM_INTERVAL_NS, and half of those are freed at
+ * the end of the interval.  This way the pool follows the concurrency
+ * that was actually observed and shrinks again after a burst of requests.
+ * Trimming happens when batches are taken from or returned to a node; a
+ * main loop timer covers the nodes that went idle while not empty.
  */
 typedef struct CoroutinePoolBatch {
     /* Batches are kept in a list */
@@ -56,17 +82,39 @@ typedef struct CoroutinePoolBatch {
 
 typedef QSLIST_HEAD(, CoroutinePoolBatch) CoroutinePool;
 
+typedef struct CoroutineNodePool {
+    QemuMutex lock; /* protects the following fields */
+    CoroutinePool pool;
+    unsigned int size;
+
+    /* Smallest @size since @trim_time */
+    unsigned int min_size;
+    int64_t trim_time;
+} QEMU_ALIGNED(64) CoroutineNodePool;
+
 /* Host operating system limit on number of pooled coroutines */
 static unsigned int global_pool_hard_max_size;
 
-static QemuMutex global_pool_lock; /* protects the following variables */
-static CoroutinePool global_pool = QSLIST_HEAD_INITIALIZER(global_pool);
-static unsigned int global_pool_size;
+static CoroutineNodePool global_pool[COROUTINE_POOL_MAX_NODES];
+static unsigned int global_pool_nodes = 1;
+static unsigned int global_pool_size; /* sum over all nodes */
 static unsigned int global_pool_max_size = COROUTINE_POOL_BATCH_MAX_SIZE;
 
+/* Runs while the global pool is not empty; see coroutine_pool_trim_idle() */
+static QEMUTimer *pool_trim_timer;
+static bool pool_trim_timer_armed;
+
+static Stat64 pool_hits;
+static Stat64 pool_misses;
+static Stat64 pool_remote_batches;
+static Stat64 pool_trimmed;
+
 QEMU_DEFINE_STATIC_CO_TLS(CoroutinePool, local_pool);
 QEMU_DEFINE_STATIC_CO_TLS(Notifier, local_pool_cleanup_notifier);
 
+/* Hits are counted per thread and added to pool_hits one batch at a time */
+QEMU_DEFINE_STATIC_CO_TLS(unsigned int, local_pool_hits);
+
 static CoroutinePoolBatch *coroutine_pool_batch_new(void)
 {
     CoroutinePoolBatch *batch = g_new(CoroutinePoolBatch, 1);
@@ -88,6 +136,16 @@ static void coroutine_pool_batch_delete(CoroutinePoolBatch *batch)
     g_free(batch);
 }
 
+static void coroutine_pool_flush_hits(void)
+{
+    unsigned int hits = get_local_pool_hits();
+
+    if (hits) {
+        stat64_add(&pool_hits, hits);
+        set_local_pool_hits(0);
+    }
+}
+
 static void local_pool_cleanup(Notifier *n, void *value)
 {
     CoroutinePool *local_pool = get_ptr_local_pool();
@@ -98,6 +156,7 @@ static void local_pool_cleanup(Notifier *n, void *value)
         QSLIST_REMOVE_HEAD(local_pool, next);
         coroutine_pool_batch_delete(batch);
     }
+    coroutine_pool_flush_hits();
 }
 
 /* Ensure the atexit notifier is registered */
@@ -129,21 +188,158 @@ static Coroutine *coroutine_pool_get_local(void)
         QSLIST_REMOVE_HEAD(local_pool, next);
         coroutine_pool_batch_delete(batch);
     }
+    set_local_pool_hits(get_local_pool_hits() + 1);
     return co;
 }
 
+/* Index of the global pool for the NUMA node the thread is running on */
+static unsigned int coroutine_pool_node(void)
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned int cpu, node;
+
+    if (global_pool_nodes > 1 &&
+        syscall(SYS_getcpu, &cpu, &node, NULL) == 0) {
+        return node % global_pool_nodes;
+    }
+#endif
+    return 0;
+}
+
+/*
+ * Free the coroutines in excess of what was needed in the last interval,
+ * moving their batches to @trimmed.  The least recently used batches are
+ * at the end of the list, so they go first.
+ */
+static void coroutine_node_pool_trim_locked(CoroutineNodePool *np,
+                                            CoroutinePool *trimmed)
+{
+    int64_t now = get_clock();
+    CoroutinePoolBatch *batch, *prev = NULL, *tmp;
+    unsigned int keep, kept = 0;
+
+    if (now - np->trim_time < COROUTINE_POOL_TRIM_INTERVAL_NS) {
+        return;
+    }
+
+    keep = np->size - np->min_size / 2;
+    batch = QSLIST_FIRST(&np->pool);
+    while (batch && kept + batch->size <= keep) {
+        kept += batch->size;
+        prev = batch;
+        batch = QSLIST_NEXT(batch, next);
+    }
+    while (batch) {
+        tmp = QSLIST_NEXT(batch, next);
+        if (prev) {
+            QSLIST_REMOVE_AFTER(prev, next);
+        } else {
+            QSLIST_REMOVE_HEAD(&np->pool, next);
+        }
+        np->size -= batch->size;
+        qatomic_sub(&global_pool_size, batch->size);
+        stat64_add(&pool_trimmed, batch->size);
+        QSLIST_INSERT_HEAD(trimmed, batch, next);
+        batch = tmp;
+    }
+
+    np->min_size = np->size;
+    np->trim_time = now;
+}
+
+static void coroutine_pool_delete_trimmed(CoroutinePool *trimmed)
+{
+    CoroutinePoolBatch *batch, *tmp;
+
+    QSLIST_FOREACH_SAFE(batch, trimmed, next, tmp) {
+        coroutine_pool_batch_delete(batch);
+    }
+}
+
+static void coroutine_pool_arm_trim_timer(void)
+{
+    if (pool_trim_timer && !qatomic_xchg(&pool_trim_timer_armed, true)) {
+        timer_mod(pool_trim_timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                                   COROUTINE_POOL_TRIM_INTERVAL_NS);
+    }
+}
+
+static void coroutine_pool_trim_idle(void *opaque)
+{
+    CoroutinePool trimmed = QSLIST_HEAD_INITIALIZER(trimmed);
+    bool empty = true;
+    unsigned int i;
+
+    /*
+     * Clear it first, so that a put that this function does not see rearms
+     * the timer.  The node locks order the two.
+     */
+    qatomic_set(&pool_trim_timer_armed, false);
+
+    for (i = 0; i < global_pool_nodes; i++) {
+        CoroutineNodePool *np = &global_pool[i];
+
+        WITH_QEMU_LOCK_GUARD(&np->lock) {
+            coroutine_node_pool_trim_locked(np, &trimmed);
+            empty &= !np->size;
+        }
+    }
+
+    coroutine_pool_delete_trimmed(&trimmed);
+    if (!empty) {
+        coroutine_pool_arm_trim_timer();
+    }
+}
+
+void qemu_coroutine_pool_trim_init(void)
+{
+    if (IS_ENABLED(CONFIG_COROUTINE_POOL) && !pool_trim_timer) {
+        pool_trim_timer = timer_new_ns(QEMU_CLOCK_REALTIME,
+                                       coroutine_pool_trim_idle, NULL);
+    }
+}
+
+/* Take a batch from one node's global pool */
+static CoroutinePoolBatch *coroutine_pool_get_node(CoroutineNodePool *np)
+{
+    CoroutinePool trimmed = QSLIST_HEAD_INITIALIZER(trimmed);
+    CoroutinePoolBatch *batch;
+
+    WITH_QEMU_LOCK_GUARD(&np->lock) {
+        coroutine_node_pool_trim_locked(np, &trimmed);
+        batch = QSLIST_FIRST(&np->pool);
+
+        if (batch) {
+            QSLIST_REMOVE_HEAD(&np->pool, next);
+            np->size -= batch->size;
+            np->min_size = MIN(np->min_size, np->size);
+            qatomic_sub(&global_pool_size, batch->size);
+        }
+    }
+
+    coroutine_pool_delete_trimmed(&trimmed);
+    return batch;
+}
+
 /* Get the next batch from the global pool */
 static void coroutine_pool_refill_local(void)
 {
     CoroutinePool *local_pool = get_ptr_local_pool();
-    CoroutinePoolBatch *batch;
+    CoroutinePoolBatch *batch = NULL;
+    unsigned int node = coroutine_pool_node();
+    unsigned int i;
 
-    WITH_QEMU_LOCK_GUARD(&global_pool_lock) {
-        batch = QSLIST_FIRST(&global_pool);
+    coroutine_pool_flush_hits();
+    if (!qatomic_read(&global_pool_size)) {
+        return;
+    }
 
-        if (batch) {
-            QSLIST_REMOVE_HEAD(&global_pool, next);
-            global_pool_size -= batch->size;
+    /* Prefer the current node, then steal from the others */
+    for (i = 0; i < global_pool_nodes && !batch; i++) {
+        batch = coroutine_pool_get_node(
+            &global_pool[(node + i) % global_pool_nodes]);
+        if (batch && i) {
+            stat64_add(&pool_remote_batches, 1);
         }
     }
 
@@ -156,21 +352,31 @@ static void coroutine_pool_refill_local(void)
 /* Add a batch of coroutines to the global pool */
 static void coroutine_pool_put_global(CoroutinePoolBatch *batch)
 {
-    WITH_QEMU_LOCK_GUARD(&global_pool_lock) {
-        unsigned int max = MIN(global_pool_max_size,
-                               global_pool_hard_max_size);
-
-        if (global_pool_size < max) {
-            QSLIST_INSERT_HEAD(&global_pool, batch, next);
-
-            /* Overshooting the max pool size is allowed */
-            global_pool_size += batch->size;
-            return;
+    CoroutineNodePool *np = &global_pool[coroutine_pool_node()];
+    CoroutinePool trimmed = QSLIST_HEAD_INITIALIZER(trimmed);
+    unsigned int max = MIN(qatomic_read(&global_pool_max_size),
+                           global_pool_hard_max_size);
+
+    coroutine_pool_flush_hits();
+    WITH_QEMU_LOCK_GUARD(&np->lock) {
+        coroutine_node_pool_trim_locked(np, &trimmed);
+
+        /* Overshooting the max pool size is allowed */
+        if (qatomic_read(&global_pool_size) < max) {
+            QSLIST_INSERT_HEAD(&np->pool, batch, next);
+            np->size += batch->size;
+            qatomic_add(&global_pool_size, batch->size);
+            batch = NULL;
         }
     }
 
+    coroutine_pool_delete_trimmed(&trimmed);
+    coroutine_pool_arm_trim_timer();
+
     /* The global pool was full, so throw away this batch */
-    coroutine_pool_batch_delete(batch);
+    if (batch) {
+        coroutine_pool_batch_delete(batch);
+    }
 }
 
 /* Get the next unused coroutine from the pool or return NULL */
@@ -224,6 +430,9 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
 
     if (!co) {
         co = qemu_coroutine_new();
+        if (IS_ENABLED(CONFIG_COROUTINE_POOL)) {
+            stat64_add(&pool_misses, 1);
+        }
     }
 
     co->entry = entry;
@@ -351,14 +560,24 @@ AioContext *qemu_coroutine_get_aio_context(Coroutine *co)
 
 void qemu_coroutine_inc_pool_size(unsigned int additional_pool_size)
 {
-    QEMU_LOCK_GUARD(&global_pool_lock);
-    global_pool_max_size += additional_pool_size;
+    qatomic_add(&global_pool_max_size, additional_pool_size);
 }
 
 void qemu_coroutine_dec_pool_size(unsigned int removing_pool_size)
 {
-    QEMU_LOCK_GUARD(&global_pool_lock);
-    global_pool_max_size -= removing_pool_size;
+    qatomic_sub(&global_pool_max_size, removing_pool_size);
+}
+
+void qemu_coroutine_get_pool_stats(CoroutinePoolStats *stats)
+{
+    coroutine_pool_flush_hits();
+    stats->hits = stat64_get(&pool_hits);
+    stats->misses = stat64_get(&pool_misses);
+    stats->remote_batches = stat64_get(&pool_remote_batches);
+    stats->trimmed = stat64_get(&pool_trimmed);
+    stats->size = qatomic_read(&global_pool_size);
+    stats->max_size = MIN(qatomic_read(&global_pool_max_size),
+                          global_pool_hard_max_size);
 }
 
 static unsigned int get_global_pool_hard_max_size(void)
@@ -394,8 +613,39 @@ static unsigned int get_global_pool_hard_max_size(void)
     return UINT_MAX;
 }
 
+static unsigned int get_global_pool_nodes(void)
+{
+#ifdef __linux__
+    g_autofree char *contents = NULL;
+    const char *p;
+    unsigned int last;
+
+    /* A list of ranges such as "0-3"; the last number is the highest node */
+    if (g_file_get_contents("/sys/devices/system/node/possible", &contents,
+                            NULL, NULL)) {
+        g_strchomp(contents);
+        p = contents + strlen(contents);
+        while (p > contents && g_ascii_isdigit(p[-1])) {
+            p--;
+        }
+        if (qemu_strtoui(p, NULL, 10, &last) == 0) {
+            return MIN(last + 1, COROUTINE_POOL_MAX_NODES);
+        }
+    }
+#endif
+
+    return 1;
+}
+
 static void __attribute__((constructor)) qemu_coroutine_init(void)
 {
-    qemu_mutex_init(&global_pool_lock);
+    int64_t now = get_clock();
+    unsigned int i;
+
     global_pool_hard_max_size = get_global_pool_hard_max_size();
+    global_pool_nodes = get_global_pool_nodes();
+    for (i = 0; i < global_pool_nodes; i++) {
+        qemu_mutex_init(&global_pool[i].lock);
+        global_pool[i].trim_time = now;
+    }
 }
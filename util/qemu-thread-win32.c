@@ -15,6 +15,7 @@
 #include "qemu/thread.h"
 #include "qemu/notify.h"
 #include "qemu-thread-common.h"
+#include "trace/control.h"
 #include <process.h>
 
 static bool name_threads;
@@ -408,6 +409,7 @@ static unsigned __stdcall win32_start_routine(void *arg)
     void *thread_arg = data->arg;
 
     qemu_thread_data = data;
+    trace_init_thread();
     qemu_thread_exit(start_routine(thread_arg));
     abort();
 }
@@ -32,6 +32,9 @@
 #include "qemu/thread.h"
 #include "qemu/main-loop.h"
 #include "qemu/lockable.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
+#include "trace/control.h"
 #if defined(CONFIG_MALLOC_TRIM)
 #include <malloc.h>
 #endif
@@ -46,10 +49,18 @@
 unsigned long rcu_gp_ctr = RCU_GP_LOCKED;
 
 QemuEvent rcu_gp_event;
-static int in_drain_call_rcu;
+static int rcu_expedite;
+static int rcu_drain_waiters;
 static QemuMutex rcu_registry_lock;
 static QemuMutex rcu_sync_lock;
 
+static Stat64 rcu_stat_grace_periods;
+static Stat64 rcu_stat_expedited;
+static Stat64 rcu_stat_gp_ns;
+static Stat64 rcu_stat_max_gp_ns;
+static Stat64 rcu_stat_gp_hist[RCU_STATS_HIST_BUCKETS];
+static Stat64 rcu_stat_callbacks;
+
 /*
  * Check whether a quiescent state was crossed between the beginning of
  * update_counter_and_wait and now.
@@ -106,7 +117,7 @@ static void wait_for_readers(void)
                  * get some extra futex wakeups.
                  */
                 qatomic_set(&index->waiting, false);
-            } else if (qatomic_read(&in_drain_call_rcu)) {
+            } else if (qatomic_read(&rcu_expedite)) {
                 notifier_list_notify(&index->force_rcu, NULL);
             }
         }
@@ -141,8 +152,25 @@ static void wait_for_readers(void)
     QLIST_SWAP(&registry, &qsreaders, node);
 }
 
+static void rcu_account_grace_period(int64_t start, bool expedited)
+{
+    uint64_t ns = get_clock() - start;
+    int bucket = MIN(64 - clz64(ns / 1000), RCU_STATS_HIST_BUCKETS - 1);
+
+    stat64_add(&rcu_stat_grace_periods, 1);
+    if (expedited) {
+        stat64_add(&rcu_stat_expedited, 1);
+    }
+    stat64_add(&rcu_stat_gp_ns, ns);
+    stat64_max(&rcu_stat_max_gp_ns, ns);
+    stat64_add(&rcu_stat_gp_hist[bucket], 1);
+}
+
 void synchronize_rcu(void)
 {
+    int64_t start = get_clock();
+    bool expedited = qatomic_read(&rcu_expedite);
+
     QEMU_LOCK_GUARD(&rcu_sync_lock);
 
     /* Write RCU-protected pointers before reading p_rcu_reader->ctr.
@@ -171,6 +199,27 @@ void synchronize_rcu(void)
 
         wait_for_readers();
     }
+
+    rcu_account_grace_period(start, expedited);
+}
+
+void synchronize_rcu_expedited(void)
+{
+    qatomic_inc(&rcu_expedite);
+    synchronize_rcu();
+    qatomic_dec(&rcu_expedite);
+}
+
+void rcu_get_stats(RCUStats *stats)
+{
+    stats->grace_periods = stat64_get(&rcu_stat_grace_periods);
+    stats->expedited_grace_periods = stat64_get(&rcu_stat_expedited);
+    stats->grace_period_ns = stat64_get(&rcu_stat_gp_ns);
+    stats->max_grace_period_ns = stat64_get(&rcu_stat_max_gp_ns);
+    for (int i = 0; i < RCU_STATS_HIST_BUCKETS; i++) {
+        stats->grace_period_hist[i] = stat64_get(&rcu_stat_gp_hist[i]);
+    }
+    stats->callbacks = stat64_get(&rcu_stat_callbacks);
 }
 
 
@@ -252,25 +301,110 @@ retry:
     return node;
 }
 
+/*
+ * Registered threads queue their callbacks on a list of their own
+ * (see call_rcu1), and only threads that are not registered use the
+ * shared queue above.  The lists are walked with both rcu_sync_lock
+ * and rcu_registry_lock taken, so that wait_for_readers() cannot have
+ * moved any of them out of the registry.
+ */
+static int rcu_call_pending(void)
+{
+    struct rcu_reader_data *index;
+    int n = qatomic_read(&rcu_call_count);
+
+    QEMU_LOCK_GUARD(&rcu_sync_lock);
+    QEMU_LOCK_GUARD(&rcu_registry_lock);
+    QLIST_FOREACH(index, &registry, node) {
+        n += qatomic_read(&index->cbs_queued) - index->cbs_taken;
+    }
+    return n;
+}
+
+/*
+ * Take the callbacks queued so far, in the order they were queued:
+ * return the per-thread ones, and in @n the number of nodes to dequeue
+ * from the shared queue.  These must be run first: a thread that
+ * registers only does so after it is done with the shared queue, and
+ * one that unregisters moves its own callbacks to the shared queue
+ * under rcu_registry_lock.
+ */
+static struct rcu_head *rcu_call_take(int *n)
+{
+    struct rcu_reader_data *index;
+    struct rcu_head *list = NULL, **tailp = &list;
+
+    QEMU_LOCK_GUARD(&rcu_sync_lock);
+    QEMU_LOCK_GUARD(&rcu_registry_lock);
+    *n = qatomic_read(&rcu_call_count);
+    qatomic_sub(&rcu_call_count, *n);
+
+    QLIST_FOREACH(index, &registry, node) {
+        struct rcu_head *node = qatomic_xchg(&index->cbs, NULL);
+        struct rcu_head *fifo = NULL, **next = tailp;
+
+        /* Reverse the list and append it to the result.  */
+        while (node) {
+            struct rcu_head *tmp = node->next;
+            node->next = fifo;
+            fifo = node;
+            node = tmp;
+            index->cbs_taken++;
+        }
+        *tailp = fifo;
+        while (*next) {
+            next = &(*next)->next;
+        }
+        tailp = next;
+    }
+    return list;
+}
+
+/*
+ * Move callbacks that the call_rcu thread has not taken yet from
+ * @reader's list to the shared queue, in order.  Called with
+ * rcu_registry_lock taken.
+ */
+static void rcu_move_thread_callbacks(struct rcu_reader_data *reader)
+{
+    struct rcu_head *node = qatomic_xchg(&reader->cbs, NULL);
+    struct rcu_head *fifo = NULL;
+
+    while (node) {
+        struct rcu_head *tmp = node->next;
+        node->next = fifo;
+        fifo = node;
+        node = tmp;
+    }
+    while (fifo) {
+        node = fifo;
+        fifo = node->next;
+        enqueue(node);
+        qatomic_inc(&rcu_call_count);
+        reader->cbs_taken++;
+    }
+}
+
 static void *call_rcu_thread(void *opaque)
 {
-    struct rcu_head *node;
+    struct rcu_head *node, *list;
 
     rcu_register_thread();
 
     for (;;) {
         int tries = 0;
-        int n = qatomic_read(&rcu_call_count);
+        int n = rcu_call_pending();
 
-        /* Heuristically wait for a decent number of callbacks to pile up.
-         * Fetch rcu_call_count now, we only must process elements that were
-         * added before synchronize_rcu() starts.
+        /* Heuristically wait for a decent number of callbacks to pile up,
+         * unless somebody is waiting for them.  Only the elements that
+         * were added before synchronize_rcu() starts may be processed.
          */
-        while (n == 0 || (n < RCU_CALL_MIN_SIZE && ++tries <= 5)) {
+        while (n == 0 || (n < RCU_CALL_MIN_SIZE && ++tries <= 5 &&
+                          !qatomic_read(&rcu_drain_waiters))) {
             g_usleep(10000);
             if (n == 0) {
                 qemu_event_reset(&rcu_call_ready_event);
-                n = qatomic_read(&rcu_call_count);
+                n = rcu_call_pending();
                 if (n == 0) {
 #if defined(CONFIG_MALLOC_TRIM)
                     malloc_trim(4 * 1024 * 1024);
@@ -278,11 +412,15 @@ static void *call_rcu_thread(void *opaque)
                     qemu_event_wait(&rcu_call_ready_event);
                 }
             }
-            n = qatomic_read(&rcu_call_count);
+            n = rcu_call_pending();
         }
 
-        qatomic_sub(&rcu_call_count, n);
-        synchronize_rcu();
+        list = rcu_call_take(&n);
+        if (qatomic_read(&rcu_drain_waiters)) {
+            synchronize_rcu_expedited();
+        } else {
+            synchronize_rcu();
+        }
         bql_lock();
         while (n > 0) {
             node = try_dequeue();
@@ -299,6 +437,13 @@ static void *call_rcu_thread(void *opaque)
 
             n--;
             node->func(node);
+            stat64_add(&rcu_stat_callbacks, 1);
+        }
+        while (list) {
+            node = list;
+            list = node->next;
+            node->func(node);
+            stat64_add(&rcu_stat_callbacks, 1);
         }
         bql_unlock();
     }
@@ -307,9 +452,26 @@ static void *call_rcu_thread(void *opaque)
 
 void call_rcu1(struct rcu_head *node, void (*func)(struct rcu_head *node))
 {
+    struct rcu_reader_data *reader = get_ptr_rcu_reader();
+
     node->func = func;
-    enqueue(node);
-    qatomic_inc(&rcu_call_count);
+    if (reader->registered) {
+        struct rcu_head *old = qatomic_read(&reader->cbs), *prev;
+
+        /* Count first, so that cbs_taken never gets ahead of it.  */
+        qatomic_set(&reader->cbs_queued, reader->cbs_queued + 1);
+        for (;;) {
+            node->next = old;
+            prev = qatomic_cmpxchg(&reader->cbs, old, node);
+            if (prev == old) {
+                break;
+            }
+            old = prev;
+        }
+    } else {
+        enqueue(node);
+        qatomic_inc(&rcu_call_count);
+    }
     qemu_event_set(&rcu_call_ready_event);
 }
 
@@ -353,16 +515,19 @@ void drain_call_rcu(void)
      * is called, all RCU callbacks that were registered on this thread
      * prior to calling this function are completed.
      *
-     * Note that since we have only one global queue of the RCU callbacks,
+     * Note that since the call_rcu thread runs callbacks in batches,
      * we also end up waiting for most of RCU callbacks that were registered
      * on the other threads, but this is a side effect that shouldn't be
      * assumed.
+     *
+     * The call_rcu thread does not wait for more callbacks to pile up
+     * while anybody is draining, and expedites the grace period.
      */
 
-    qatomic_inc(&in_drain_call_rcu);
+    qatomic_inc(&rcu_drain_waiters);
     call_rcu1(&rcu_drain.rcu, drain_rcu_callback);
     qemu_event_wait(&rcu_drain.drain_complete_event);
-    qatomic_dec(&in_drain_call_rcu);
+    qatomic_dec(&rcu_drain_waiters);
 
     if (locked) {
         bql_lock();
@@ -372,16 +537,26 @@ void drain_call_rcu(void)
 
 void rcu_register_thread(void)
 {
-    assert(get_ptr_rcu_reader()->ctr == 0);
+    struct rcu_reader_data *reader = get_ptr_rcu_reader();
+
+    /* Threads that are not QemuThreads, e.g. linux-user CPUs, start here */
+    trace_init_thread();
+
+    assert(reader->ctr == 0);
     qemu_mutex_lock(&rcu_registry_lock);
-    QLIST_INSERT_HEAD(&registry, get_ptr_rcu_reader(), node);
+    QLIST_INSERT_HEAD(&registry, reader, node);
+    reader->registered = true;
     qemu_mutex_unlock(&rcu_registry_lock);
 }
 
 void rcu_unregister_thread(void)
 {
+    struct rcu_reader_data *reader = get_ptr_rcu_reader();
+
     qemu_mutex_lock(&rcu_registry_lock);
-    QLIST_REMOVE(get_ptr_rcu_reader(), node);
+    QLIST_REMOVE(reader, node);
+    reader->registered = false;
+    rcu_move_thread_callbacks(reader);
     qemu_mutex_unlock(&rcu_registry_lock);
 }
 
@@ -433,12 +608,19 @@ void rcu_disable_atfork(void)
 #ifdef CONFIG_POSIX
 static void rcu_init_lock(void)
 {
+    struct rcu_reader_data *index;
+
     if (atfork_depth < 1) {
         return;
     }
 
     qemu_mutex_lock(&rcu_sync_lock);
     qemu_mutex_lock(&rcu_registry_lock);
+
+    /* Only the shared queue survives in the child.  */
+    QLIST_FOREACH(index, &registry, node) {
+        rcu_move_thread_callbacks(index);
+    }
 }
 
 static void rcu_init_unlock(void)
@@ -458,6 +640,7 @@ static void rcu_init_child(void)
     }
 
     memset(&registry, 0, sizeof(registry));
+    smp_mb_global_init();
     rcu_init_complete();
 }
 #endif
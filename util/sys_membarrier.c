@@ -19,6 +19,13 @@ membarrier(int cmd, int flags)
 {
     return syscall(__NR_membarrier, cmd, flags);
 }
+
+/*
+ * MEMBARRIER_CMD_SHARED waits for a scheduler grace period, which can
+ * take milliseconds; the private expedited command only IPIs the CPUs
+ * that are running threads of this process.
+ */
+static bool membarrier_private_expedited;
 #endif
 
 void smp_mb_global(void)
@@ -26,6 +33,12 @@ void smp_mb_global(void)
 #if defined CONFIG_WIN32
     FlushProcessWriteBuffers();
 #elif defined CONFIG_LINUX
+#ifdef MEMBARRIER_CMD_PRIVATE_EXPEDITED
+    if (membarrier_private_expedited) {
+        membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+        return;
+    }
+#endif
     membarrier(MEMBARRIER_CMD_SHARED, 0);
 #else
 #error --enable-membarrier is not supported on this operating system.
@@ -46,5 +59,11 @@ void smp_mb_global_init(void)
         error_report("Please upgrade your system to a newer version of Linux");
         exit(1);
     }
+#ifdef MEMBARRIER_CMD_PRIVATE_EXPEDITED
+    /* Registration does not survive fork, so this runs in the child too.  */
+    membarrier_private_expedited =
+        (ret & MEMBARRIER_CMD_PRIVATE_EXPEDITED) &&
+        membarrier(MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+#endif
 #endif
 }
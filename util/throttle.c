@@ -165,6 +165,22 @@ static int64_t throttle_compute_wait_for(ThrottleState *ts,
     return max_wait;
 }
 
+/* Leak the buckets and compute the time that an I/O request in this
+ * direction would have to wait
+ *
+ * @direction:  throttle direction
+ * @now:        the current clock timestamp
+ * @ret:        time to wait in ns, or 0 if the request can go through
+ */
+int64_t throttle_compute_delay(ThrottleState *ts, ThrottleDirection direction,
+                               int64_t now)
+{
+    /* leak proportionally to the time elapsed */
+    throttle_do_leak(ts, now);
+
+    return throttle_compute_wait_for(ts, direction);
+}
+
 /* compute the timer for this type of operation
  *
  * @direction:  throttle direction
@@ -177,13 +193,8 @@ static bool throttle_compute_timer(ThrottleState *ts,
                                    int64_t now,
                                    int64_t *next_timestamp)
 {
-    int64_t wait;
-
-    /* leak proportionally to the time elapsed */
-    throttle_do_leak(ts, now);
-
     /* compute the wait time if any */
-    wait = throttle_compute_wait_for(ts, direction);
+    int64_t wait = throttle_compute_delay(ts, direction, now);
 
     /* if the code must wait compute when the next timer should fire */
     if (wait) {
@@ -462,48 +473,118 @@ bool throttle_schedule_timer(ThrottleState *ts,
     return true;
 }
 
-/* do the accounting for this operation
+static const BucketType bucket_types_size[THROTTLE_MAX][2] = {
+    { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
+    { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
+};
+static const BucketType bucket_types_units[THROTTLE_MAX][2] = {
+    { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
+    { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
+};
+
+/* Compute how much can still be added to a leaky bucket before
+ * throttle_compute_wait() returns a non-zero wait time
  *
- * @direction: throttle direction
- * @size:     the size of the operation
+ * @bkt:  the leaky bucket we operate on
+ * @room: the upper bound of the result, also used for unlimited buckets
+ * @ret:  the headroom in the bucket, in bytes or operations
  */
-void throttle_account(ThrottleState *ts, ThrottleDirection direction,
-                      uint64_t size)
+static double throttle_bucket_headroom(LeakyBucket *bkt, double room)
+{
+    double bucket_size;
+
+    if (!bkt->avg) {
+        return room;
+    }
+
+    /* Same bucket sizes as in throttle_compute_wait() */
+    if (!bkt->max) {
+        bucket_size = (double) bkt->avg / 10;
+    } else {
+        bucket_size = bkt->max * bkt->burst_length;
+    }
+    room = MIN(room, bucket_size - bkt->level);
+
+    if (bkt->burst_length > 1) {
+        room = MIN(room, (double) bkt->max / 10 - bkt->burst_level);
+    }
+
+    return MAX(room, 0);
+}
+
+/* Leak the buckets and compute how much I/O in this direction can be
+ * accounted before a request has to wait
+ *
+ * @direction:  throttle direction
+ * @now:        the current clock timestamp
+ * @bytes:      lowered to the number of bytes that fit in the buckets
+ * @units:      lowered to the number of operations that fit in the buckets
+ */
+void throttle_compute_headroom(ThrottleState *ts, ThrottleDirection direction,
+                               int64_t now, double *bytes, double *units)
 {
-    static const BucketType bucket_types_size[THROTTLE_MAX][2] = {
-        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
-        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
-    };
-    static const BucketType bucket_types_units[THROTTLE_MAX][2] = {
-        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
-        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
-    };
-    double units = 1.0;
     unsigned i;
 
     assert(direction < THROTTLE_MAX);
-    /* if cfg.op_size is defined and smaller than size we compute unit count */
-    if (ts->cfg.op_size && size > ts->cfg.op_size) {
-        units = (double) size / ts->cfg.op_size;
+    throttle_do_leak(ts, now);
+
+    for (i = 0; i < ARRAY_SIZE(bucket_types_size[THROTTLE_READ]); i++) {
+        *bytes = throttle_bucket_headroom(
+            &ts->cfg.buckets[bucket_types_size[direction][i]], *bytes);
+        *units = throttle_bucket_headroom(
+            &ts->cfg.buckets[bucket_types_units[direction][i]], *units);
     }
+}
 
+/* Add I/O to the buckets of a direction, or remove it if the amounts
+ * are negative. The levels never go below zero.
+ *
+ * @direction: throttle direction
+ * @bytes:     the number of bytes
+ * @units:     the number of operations
+ */
+void throttle_charge(ThrottleState *ts, ThrottleDirection direction,
+                     double bytes, double units)
+{
+    unsigned i;
+
+    assert(direction < THROTTLE_MAX);
     for (i = 0; i < ARRAY_SIZE(bucket_types_size[THROTTLE_READ]); i++) {
         LeakyBucket *bkt;
 
         bkt = &ts->cfg.buckets[bucket_types_size[direction][i]];
-        bkt->level += size;
+        bkt->level = MAX(bkt->level + bytes, 0);
         if (bkt->burst_length > 1) {
-            bkt->burst_level += size;
+            bkt->burst_level = MAX(bkt->burst_level + bytes, 0);
         }
 
         bkt = &ts->cfg.buckets[bucket_types_units[direction][i]];
-        bkt->level += units;
+        bkt->level = MAX(bkt->level + units, 0);
         if (bkt->burst_length > 1) {
-            bkt->burst_level += units;
+            bkt->burst_level = MAX(bkt->burst_level + units, 0);
         }
     }
 }
 
+/* do the accounting for this operation
+ *
+ * @direction: throttle direction
+ * @size:     the size of the operation
+ */
+void throttle_account(ThrottleState *ts, ThrottleDirection direction,
+                      uint64_t size)
+{
+    double units = 1.0;
+
+    assert(direction < THROTTLE_MAX);
+    /* if cfg.op_size is defined and smaller than size we compute unit count */
+    if (ts->cfg.op_size && size > ts->cfg.op_size) {
+        units = (double) size / ts->cfg.op_size;
+    }
+
+    throttle_charge(ts, direction, size, units);
+}
+
 /* return a ThrottleConfig based on the options in a ThrottleLimits
  *
  * @arg:    the ThrottleLimits object to read from